@@ -0,0 +1,43 @@
+#include "bench_framework.h"
+#include "bench_memory.hpp"
+#include "bench_http.hpp"
+#include "bench_parallel.hpp"
+
+#include <fstream>
+
+// NexusBench [--json FILE] [--filter SUBSTRING], the JSON report goes to stdout unless a file is given
+int main(int argc, char** argv) {
+    std::string filter, json;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string arg = argv[i];
+        if (arg == "--filter") {
+            filter = argv[i + 1];
+        } else if (arg == "--json") {
+            json = argv[i + 1];
+        }
+    }
+    using namespace Nexus::Bench;
+    RegisterBench("memory/shared_pool_write_read_64", Base::SharedPoolWriteRead64);
+    RegisterBench("memory/shared_pool_write_4k", Base::SharedPoolWrite4K);
+    RegisterBench("memory/shared_pool_copy", Base::SharedPoolCopy);
+    RegisterBench("memory/unique_pool_write_read_64", Base::UniquePoolWriteRead64);
+    RegisterBench("memory/unique_pool_write_4k", Base::UniquePoolWrite4K);
+    RegisterBench("memory/stream_next_u64", Base::StreamNext);
+    RegisterBench("memory/stream_write_read_4k", Base::StreamWriteRead);
+    RegisterBench("http/parse_browser", Net::ParseBrowser);
+    RegisterBench("http/resolve_browser", Net::ResolveBrowser);
+    RegisterBench("http/resolve_api", Net::ResolveApi);
+    RegisterBench("http/serialize_response", Net::SerializeResponse);
+    RegisterBench("http/serialize_chunk_4k", Net::SerializeChunk);
+    RegisterBench("http/locate_cached", Net::LocateCached);
+    RegisterBench("parallel/post_throughput", Parallel::PostThroughput);
+    RegisterBench("parallel/post_latency", Parallel::PostLatency);
+    if (json.empty()) {
+        ExecuteBenches(filter, std::cout);
+    } else {
+        std::ofstream out(json);
+        ExecuteBenches(filter, out);
+    }
+    Net::LocateCleanup();
+    Parallel::GroupCleanup();
+}
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <format>
+#include <thirdparty/picohttpparser/picohttpparser.h>
+
+/* What a benchmark is asked to do and what it reports besides its run time. */
+struct BenchState {
+    // Run the measured operation this many times
+    uint64_t iterations;
+    // Bytes one operation processes, turned into a throughput when set
+    uint64_t bytes {0};
+    // Extra results such as latency percentiles, reported as they are
+    std::map<std::string, double> counters;
+};
+using bench_task = void(*)(BenchState&);
+
+struct bench_entry {
+    std::string name;
+    bench_task task;
+};
+
+static std::vector<bench_entry> benches;
+
+// Each sample runs for at least this long, the reported figure is the median of the samples
+static constexpr std::chrono::milliseconds bench_min_time {200};
+static constexpr int bench_samples = 5;
+
+/* Keep the compiler from optimizing away a value the benchmark computes. */
+template<typename T>
+inline static void DoNotOptimize(const T& value) {
+#if defined(__GNUC__)
+    asm volatile("" : : "r,m"(value) : "memory");
+#else
+    static volatile const void* sink;
+    sink = &value;
+#endif
+}
+
+inline static void RegisterBench(const std::string& name, bench_task task) {
+    benches.push_back({name, task});
+}
+
+inline static std::string JsonEscape(const std::string& s) {
+    std::string out;
+    for (char c : s) {
+        if (c == '"' || c == '\\') out.push_back('\\');
+        out.push_back(c);
+    }
+    return out;
+}
+
+/* Run every benchmark whose name contains filter and write the results as JSON to out. */
+inline static void ExecuteBenches(const std::string& filter, std::ostream& out) {
+    using clock = std::chrono::steady_clock;
+    out << "{\n  \"context\": {";
+    out << std::format("\"compiler\": \"{}\", ", JsonEscape(
+#if defined(__VERSION__)
+            __VERSION__
+#else
+            "unknown"
+#endif
+    ));
+    out << std::format("\"threads\": {}, \"parser_kernel\": {}", std::thread::hardware_concurrency(), phr_kernel());
+    out << "},\n  \"benchmarks\": [";
+    bool first = true;
+    for (auto& bench : benches) {
+        if (bench.name.find(filter) == std::string::npos) continue;
+        std::cerr << std::format("Running {}", bench.name) << std::endl;
+        // Grow the iteration count until one run takes long enough to time reliably
+        BenchState state {1};
+        double elapsed;
+        while (true) {
+            state.counters.clear();
+            auto begin = clock::now();
+            bench.task(state);
+            elapsed = std::chrono::duration<double, std::nano>(clock::now() - begin).count();
+            if (elapsed >= std::chrono::duration<double, std::nano>(bench_min_time).count() || state.iterations >= (1ULL << 40)) break;
+            auto scale = elapsed > 0 ? std::chrono::duration<double, std::nano>(bench_min_time).count() * 1.2 / elapsed : 10.0;
+            state.iterations = static_cast<uint64_t>(static_cast<double>(state.iterations) * std::clamp(scale, 1.5, 10.0));
+        }
+        std::vector<double> per_op {elapsed / static_cast<double>(state.iterations)};
+        for (int i = 1; i < bench_samples; ++i) {
+            state.counters.clear();
+            auto begin = clock::now();
+            bench.task(state);
+            per_op.push_back(std::chrono::duration<double, std::nano>(clock::now() - begin).count() / static_cast<double>(state.iterations));
+        }
+        std::sort(per_op.begin(), per_op.end());
+        double median = per_op[per_op.size() / 2];
+        out << (first ? "\n" : ",\n");
+        first = false;
+        out << std::format("    {{\"name\": \"{}\", \"iterations\": {}, \"ns_per_op\": {:.2f}, \"ns_per_op_min\": {:.2f}, \"ns_per_op_max\": {:.2f}, \"ops_per_sec\": {:.0f}",
+                           JsonEscape(bench.name), state.iterations, median, per_op.front(), per_op.back(), 1e9 / median);
+        if (state.bytes > 0) {
+            out << std::format(", \"bytes_per_sec\": {:.0f}", static_cast<double>(state.bytes) * 1e9 / median);
+        }
+        if (!state.counters.empty()) {
+            out << ", \"counters\": {";
+            bool first_counter = true;
+            for (auto& [k, v] : state.counters) {
+                out << std::format("{}\"{}\": {:.2f}", first_counter ? "" : ", ", JsonEscape(k), v);
+                first_counter = false;
+            }
+            out << "}";
+        }
+        out << "}";
+    }
+    out << "\n  ]\n}" << std::endl;
+}
@@ -0,0 +1,124 @@
+#include "bench_framework.h"
+#include <include/net/http_connection.h>
+#include <include/net/http_resolver.h>
+#include <include/io/resource_locator.h>
+
+namespace Nexus::Bench::Net {
+    using namespace Nexus::Net;
+
+    // What a current desktop browser sends for a page load
+    static const std::string browser_request =
+            "GET /articles/2024/performance-notes?ref=home&lang=en HTTP/1.1\r\n"
+            "Host: www.example.com\r\n"
+            "Connection: keep-alive\r\n"
+            "sec-ch-ua: \"Chromium\";v=\"124\", \"Google Chrome\";v=\"124\", \"Not-A.Brand\";v=\"99\"\r\n"
+            "sec-ch-ua-mobile: ?0\r\n"
+            "sec-ch-ua-platform: \"Windows\"\r\n"
+            "Upgrade-Insecure-Requests: 1\r\n"
+            "User-Agent: Mozilla/5.0 (Windows NT 10.0; Win64; x64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/124.0.0.0 Safari/537.36\r\n"
+            "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,image/avif,image/webp,image/apng,*/*;q=0.8\r\n"
+            "Sec-Fetch-Site: same-origin\r\n"
+            "Sec-Fetch-Mode: navigate\r\n"
+            "Sec-Fetch-User: ?1\r\n"
+            "Sec-Fetch-Dest: document\r\n"
+            "Referer: https://www.example.com/\r\n"
+            "Accept-Encoding: gzip, deflate, br, zstd\r\n"
+            "Accept-Language: en-US,en;q=0.9,de;q=0.8\r\n"
+            "Cookie: session=3f9a1c0e7b2d4e6f8a1b3c5d7e9f0a2b; theme=dark; _ga=GA1.1.123456789.1700000000\r\n"
+            "\r\n";
+
+    // A bare API call
+    static const std::string api_request =
+            "POST /api/v1/events HTTP/1.1\r\n"
+            "Host: api.example.com\r\n"
+            "Content-Type: application/json\r\n"
+            "Content-Length: 2\r\n"
+            "\r\n";
+
+    inline static void Resolve(BenchState& st, const std::string& request) {
+        http_request_buffer_t pool;
+        pool.append(request.data(), request.size());
+        st.bytes = request.size();
+        for (uint64_t i = 0; i < st.iterations; ++i) {
+            // One resolver per request, as every connection has its own
+            HttpResolver resolver(pool);
+            bool ended = resolver.header_ended();
+            DoNotOptimize(ended);
+            DoNotOptimize(resolver.resolve_headers());
+        }
+    }
+
+    inline static void ResolveBrowser(BenchState& st) {
+        Resolve(st, browser_request);
+    }
+
+    inline static void ResolveApi(BenchState& st) {
+        Resolve(st, api_request);
+    }
+
+    // Parser alone, without building the header map
+    inline static void ParseBrowser(BenchState& st) {
+        st.bytes = browser_request.size();
+        for (uint64_t i = 0; i < st.iterations; ++i) {
+            const char *method, *path;
+            size_t method_len, path_len, num_headers = 64;
+            int minor;
+            phr_header headers[64];
+            int r = phr_parse_request(browser_request.data(), browser_request.size(), &method, &method_len, &path, &path_len, &minor, headers, &num_headers, 0);
+            DoNotOptimize(r);
+        }
+    }
+
+    inline static void SerializeResponse(BenchState& st) {
+        http_response_buffer_t out;
+        static const char body[] = "{\"status\":\"ok\",\"items\":[1,2,3,4,5,6,7,8]}";
+        for (uint64_t i = 0; i < st.iterations; ++i) {
+            out.clear();
+            http_header_t headers {
+                    {"Content-Type", "application/json"},
+                    {"Cache-Control", "no-store"},
+                    {"Content-Length", std::to_string(sizeof(body) - 1)}
+            };
+            HttpConnection::WriteHead(out, "200 OK", headers);
+            out.append(body, sizeof(body) - 1);
+            DoNotOptimize(out.front());
+        }
+    }
+
+    inline static void SerializeChunk(BenchState& st) {
+        http_response_buffer_t out;
+        static char piece[4096] {};
+        st.bytes = sizeof(piece);
+        for (uint64_t i = 0; i < st.iterations; ++i) {
+            out.clear();
+            auto size = std::format("{:x}\r\n", sizeof(piece));
+            out.append(size.data(), size.size());
+            out.append(piece, sizeof(piece));
+            out.append("\r\n", 2);
+            DoNotOptimize(out.front());
+        }
+    }
+
+    // Cached static resource lookups, the file is created under static/ for the run
+    inline static void LocateCached(BenchState& st) {
+        static const std::string path = "/nexus-bench.html";
+        std::filesystem::create_directories("static");
+        if (!std::filesystem::exists("static" + path)) {
+            std::ofstream("static" + path, std::ios::binary) << std::string(16384, 'b');
+        }
+        auto warm = Nexus::IO::ResourceLocator::LocateResource(path);
+        if (!warm.is_valid()) {
+            st.counters["failed"] = 1;
+            return;
+        }
+        for (uint64_t i = 0; i < st.iterations; ++i) {
+            auto r = Nexus::IO::ResourceLocator::LocateResource(path);
+            DoNotOptimize(r);
+        }
+    }
+
+    inline static void LocateCleanup() {
+        std::error_code ec;
+        std::filesystem::remove("static/nexus-bench.html", ec);
+    }
+}
\ No newline at end of file
@@ -0,0 +1,90 @@
+#include "bench_framework.h"
+#include <include/mem/memory.h>
+
+namespace Nexus::Bench::Base {
+    using namespace Nexus::Base;
+
+    // A small header-sized write and a page-sized one
+    static char bench_block[4096] {};
+
+    inline static void SharedPoolWriteRead64(BenchState& st) {
+        SharedPool<> pool(1024);
+        st.bytes = 64;
+        for (uint64_t i = 0; i < st.iterations; ++i) {
+            pool.clear();
+            pool.write(bench_block, 64);
+            auto r = pool.read(0, 64);
+            DoNotOptimize(r);
+        }
+    }
+
+    inline static void SharedPoolWrite4K(BenchState& st) {
+        SharedPool<> pool(sizeof(bench_block));
+        st.bytes = sizeof(bench_block);
+        for (uint64_t i = 0; i < st.iterations; ++i) {
+            pool.clear();
+            pool.write(bench_block, sizeof(bench_block));
+            DoNotOptimize(pool[0]);
+        }
+    }
+
+    inline static void SharedPoolCopy(BenchState& st) {
+        SharedPool<> pool(1024);
+        for (uint64_t i = 0; i < st.iterations; ++i) {
+            SharedPool<> copy(pool);
+            DoNotOptimize(copy);
+        }
+    }
+
+    inline static void UniquePoolWriteRead64(BenchState& st) {
+        UniquePool<> pool(1024);
+        st.bytes = 64;
+        for (uint64_t i = 0; i < st.iterations; ++i) {
+            pool.clear();
+            pool.write(bench_block, 64);
+            auto r = pool.read(0, 64);
+            DoNotOptimize(r);
+        }
+    }
+
+    inline static void UniquePoolWrite4K(BenchState& st) {
+        UniquePool<> pool(sizeof(bench_block));
+        st.bytes = sizeof(bench_block);
+        for (uint64_t i = 0; i < st.iterations; ++i) {
+            pool.clear();
+            pool.write(bench_block, sizeof(bench_block));
+            DoNotOptimize(pool[0]);
+        }
+    }
+
+    // Typed writes and reads the way the protocol code walks a buffer
+    inline static void StreamNext(BenchState& st) {
+        Stream<UniquePool<>> stream(UniquePool<>(1024));
+        st.bytes = 64 * sizeof(uint64_t);
+        for (uint64_t i = 0; i < st.iterations; ++i) {
+            stream.container().clear();
+            for (uint64_t j = 0; j < 64; ++j) {
+                stream.next<uint64_t>(j);
+            }
+            stream.rewind();
+            uint64_t sum = 0;
+            for (uint64_t j = 0; j < 64; ++j) {
+                auto v = stream.next<uint64_t>();
+                if (v.is_valid()) sum += v.reference();
+            }
+            DoNotOptimize(sum);
+        }
+    }
+
+    inline static void StreamWriteRead(BenchState& st) {
+        Stream<SharedPool<>> stream(SharedPool<>(sizeof(bench_block)));
+        st.bytes = sizeof(bench_block);
+        for (uint64_t i = 0; i < st.iterations; ++i) {
+            stream.container().clear();
+            stream.write(bench_block, sizeof(bench_block));
+            stream.rewind();
+            auto r = stream.read(sizeof(bench_block));
+            DoNotOptimize(r);
+        }
+    }
+}
@@ -0,0 +1,57 @@
+#include "bench_framework.h"
+#include <include/parallel/worker.h>
+#include <include/base/def.h>
+#include <atomic>
+
+namespace Nexus::Bench::Parallel {
+    using namespace Nexus::Parallel;
+
+    // The server's own configuration, one worker per core but the loop thread
+    inline static WorkGroup<CPU_CORES - 1>& Group() {
+        static WorkGroup<CPU_CORES - 1> group;
+        return group;
+    }
+
+    // Post as fast as the loop thread can and wait for all of it to run
+    inline static void PostThroughput(BenchState& st) {
+        std::atomic<uint64_t> done {0};
+        for (uint64_t i = 0; i < st.iterations; ++i) {
+            Group().post([&done]() {
+                done.fetch_add(1, std::memory_order_relaxed);
+            });
+        }
+        while (done.load(std::memory_order_acquire) != st.iterations) {
+            std::this_thread::yield();
+        }
+    }
+
+    // One task at a time, from post until it starts running on a worker
+    inline static void PostLatency(BenchState& st) {
+        using clock = std::chrono::steady_clock;
+        std::vector<double> latencies;
+        latencies.reserve(st.iterations);
+        for (uint64_t i = 0; i < st.iterations; ++i) {
+            std::atomic<bool> ran {false};
+            clock::time_point started;
+            auto posted = clock::now();
+            Group().post([&ran, &started]() {
+                started = clock::now();
+                ran.store(true, std::memory_order_release);
+            });
+            while (!ran.load(std::memory_order_acquire)) {}
+            latencies.push_back(std::chrono::duration<double, std::nano>(started - posted).count());
+        }
+        std::sort(latencies.begin(), latencies.end());
+        auto at = [&latencies](double q) {
+            return latencies[std::min<uint64_t>(static_cast<uint64_t>(q * static_cast<double>(latencies.size())), latencies.size() - 1)];
+        };
+        st.counters["p50_ns"] = at(0.50);
+        st.counters["p99_ns"] = at(0.99);
+        st.counters["p999_ns"] = at(0.999);
+        st.counters["max_ns"] = latencies.back();
+    }
+
+    inline static void GroupCleanup() {
+        Group().cleanup();
+    }
+}
@@ -8,6 +8,10 @@ enum class SockType {
 };
 
 constexpr int CPU_CORES = 12;
+// Requests whose header does not end within this many bytes are rejected
+constexpr uint64_t max_header_size = 64 * 1024;
+// Request bodies past this many bytes are answered with 413, a handler can declare its own max_body
+constexpr uint64_t max_body_size = 64 * 1024 * 1024;
 
 static inline constexpr std::string_view get_not_found_resp = "<html><body><h1>404 Not Found</h1><p>Server: Nexus@BetaV1.1</p></body></html>";
 static inline constexpr std::string_view post_not_found_resp = "Handler Not Found | Nexus@BetaV1.1";
\ No newline at end of file
@@ -1,8 +1,19 @@
 #pragma once
 #include "../mem/memory.h"
+#include "../mem/arena.h"
+#include "../mem/tracking.h"
+#include <algorithm>
+#include <cctype>
 #include <filesystem>
 #include <fstream>
 #include <utility>
+#include <memory>
+#include <mutex>
+#include <format>
+
+#ifdef PLATFORM_WIN32
+#include "../platform/win32/win32_io.h"
+#endif
 
 static inline std::unordered_map<std::string, std::string> mime_mapping {
         {".html", "text/html"},
@@ -70,19 +81,40 @@ static inline std::unordered_map<std::string, std::string> mime_mapping {
 };
 
 namespace Nexus::IO {
+#ifdef PLATFORM_WIN32
+    using DirectoryWatcher = Win32DirectoryWatcher;
+#endif
+
     class ResourceLocator {
     public:
+        // Cached files live in the arena and are accounted as cached_files
+        using wire_allocator_t = Nexus::Base::TrackingAllocator<Nexus::Base::CACHED_FILES, Nexus::Base::ArenaAllocator>;
         struct Resource {
+            // Ready-to-send response: status line, headers and body in one buffer
+            Nexus::Base::FixedPool<true, wire_allocator_t> wire;
+            // The body part of wire
             Nexus::Base::FixedPool<> data;
             std::string mime;
-            bool valid;
-            std::atomic<int> hit {0};
-            Resource(Nexus::Base::FixedPool<> data_, std::string  mime_, bool valid_) : data(std::move(data_)), mime(std::move(mime_)), valid(valid_) {}
-            Resource(const Resource& r) : data(r.data), mime(r.mime), valid(r.valid), hit(r.hit.load()) {}
+            mutable std::atomic<int> hit {0};
+            Resource(Nexus::Base::FixedPool<true, wire_allocator_t> wire_, uint64_t header_size, std::string mime_) : wire(std::move(wire_)),
+                data(wire.ptr() + header_size, wire.limit() - header_size), mime(std::move(mime_)) {}
         };
+        // Cached entries are immutable and shared, a reload swaps in a new entry while in-flight responses keep the old one
+        using resource_ptr = std::shared_ptr<const Resource>;
     private:
+        static inline const std::string root_ {"static"};
         static std::mutex mtx_;
-        static std::unordered_map<std::string, Resource> hotspot_map_;
+        static std::unordered_map<std::string, resource_ptr> hotspot_map_;
+        // Bumped under mtx_ for every change the watcher reports, a miss only caches what it loaded if none came in meanwhile
+        static uint64_t changes_;
+        static DirectoryWatcher watcher_;
+
+        /* The cache key of a path, file names under static/ do not tell case apart so neither do the keys. */
+        static std::string Key(const std::string& path) {
+            std::string key(path);
+            std::transform(key.begin(), key.end(), key.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+            return key;
+        }
     public:
         static uint64_t file_size(std::ifstream& fin)
         {
@@ -94,44 +126,114 @@ namespace Nexus::IO {
             return filesize;
         }
 
-        static Resource LocateResource(const std::string& request_path) {
-            mtx_.lock();
+        /* Read the resource from disk without touching the cache. */
+        static Nexus::Utils::MayFail<resource_ptr> LoadResource(const std::string& request_path) {
             using namespace Nexus::Base;
-            using namespace Nexus::Utils;
-            if (hotspot_map_.contains(request_path)) {
-                hotspot_map_.at(request_path).hit++;
-                mtx_.unlock();
-                return { hotspot_map_.at(request_path) };
-            } else {
-                std::string pathstr("static");
-                pathstr.append(request_path);
-                std::filesystem::path path(pathstr);
-                if (!exists(path)) {
-                    mtx_.unlock();
-                    return { Nexus::Base::FixedPool(nullptr, 0), {}, false };
+            std::filesystem::path path(root_ + request_path);
+            std::error_code ec;
+            if (!std::filesystem::is_regular_file(path, ec)) {
+                return Nexus::Utils::failed;
+            }
+            std::ifstream fs(path, std::ios::in | std::ios::binary);
+            if (!fs.is_open()) {
+                return Nexus::Utils::failed;
+            }
+            std::string mime;
+            if (mime_mapping.contains(path.extension().string())) mime = mime_mapping[path.extension().string()];
+            else mime = "application/octet-stream";
+            auto sz = file_size(fs);
+            auto header = std::format("HTTP/1.1 200 OK\r\nContent-Type: {}\r\nContent-Length: {}\r\n\r\n", mime, sz);
+            char* mem = wire_allocator_t().allocate(header.size() + sz);
+            memcpy(mem, header.data(), header.size());
+            char* body = mem + header.size();
+            uint64_t readn = 0;
+            while (fs && readn < sz) {
+                fs.read(body + readn, static_cast<std::streamsize>(std::min<uint64_t>(1024, sz - readn)));
+                if (fs.gcount() > 0) {
+                    readn += fs.gcount();
+                }
+            }
+            fs.close();
+            if (readn != sz) {
+                // The file changed while being read, the watcher will pick up the new version
+                wire_allocator_t().recycle(mem, header.size() + sz);
+                return Nexus::Utils::failed;
+            }
+            return resource_ptr(std::make_shared<Resource>(FixedPool<true, wire_allocator_t>(mem, header.size() + sz), header.size(), mime));
+        }
+
+        static Nexus::Utils::MayFail<resource_ptr> LocateResource(const std::string& request_path) {
+            auto key = Key(request_path);
+            uint64_t changes;
+            {
+                std::lock_guard lock(mtx_);
+                auto it = hotspot_map_.find(key);
+                if (it != hotspot_map_.end()) {
+                    it->second->hit++;
+                    return it->second;
+                }
+                changes = changes_;
+            }
+            auto r = LoadResource(request_path);
+            if (r.is_valid()) {
+                std::lock_guard lock(mtx_);
+                // A change reported while loading may have been read half old, it is served once and loaded again next time
+                if (changes_ == changes) {
+                    hotspot_map_.try_emplace(key, r.reference());
                 }
-                std::ifstream fs(path, std::ios::in | std::ios::binary);
-                std::string mime;
-                if (mime_mapping.contains(path.extension().string())) mime = mime_mapping[path.extension().string()];
-                else mime = "application/octet-stream";
-                auto sz = file_size(fs);
-                char* mem = reinterpret_cast<char*>(malloc(sz));
-                Resource res(FixedPool(mem, sz), mime, true);
-                uint64_t readn = 0;
-                while (fs) {
-                    fs.read(mem + readn, 1024);
-                    if (fs.gcount() > 0) {
-                        readn += fs.gcount();
+            }
+            return r;
+        }
+
+        /* Reload the cached entries of a changed path, the file itself or everything under it when it is a directory, and
+         * drop those whose file is gone. */
+        static void RefreshResource(const std::string& request_path) {
+            auto key = Key(request_path);
+            auto prefix = key + "/";
+            std::vector<std::string> paths;
+            {
+                std::lock_guard lock(mtx_);
+                changes_++;
+                for (auto& [path, res] : hotspot_map_) {
+                    if (path == key || path.starts_with(prefix)) {
+                        paths.push_back(path);
                     }
                 }
-                fs.close();
-                hotspot_map_.emplace(request_path, res);
-                mtx_.unlock();
-                return res;
             }
+            for (auto& path : paths) {
+                auto r = LoadResource(path);
+                std::lock_guard lock(mtx_);
+                if (r.is_valid()) {
+                    hotspot_map_.insert_or_assign(path, r.reference());
+                } else {
+                    hotspot_map_.erase(path);
+                }
+            }
+        }
+
+        /* Reload every cached entry, used when the watcher lost track of individual changes. */
+        static void RefreshAll() {
+            RefreshResource("");
+        }
+
+        /* Start watching the static root in background, changed files are refreshed in place. */
+        static bool StartWatching() {
+            return watcher_.start(root_, [](const std::string& relative_path) {
+                if (relative_path.empty()) {
+                    RefreshAll();
+                } else {
+                    RefreshResource("/" + relative_path);
+                }
+            });
+        }
+
+        static void StopWatching() {
+            watcher_.stop();
         }
     };
     inline std::mutex ResourceLocator::mtx_{};
-    inline std::unordered_map<std::string, ResourceLocator::Resource> ResourceLocator::hotspot_map_{};
+    inline std::unordered_map<std::string, ResourceLocator::resource_ptr> ResourceLocator::hotspot_map_{};
+    inline uint64_t ResourceLocator::changes_{0};
+    inline DirectoryWatcher ResourceLocator::watcher_{};
 
 }
\ No newline at end of file
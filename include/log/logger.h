@@ -16,6 +16,8 @@ namespace Nexus::Log {
     };
 
     inline std::ofstream lf;
+    // Messages below this level are dropped, tools that drive an in-process server raise it to keep the console quiet
+    inline log_level log_threshold = log_level::TRACE;
 
     inline std::string format_time(const std::string& fmt) {
         auto now = std::chrono::system_clock::now(); // 获取当前时间
@@ -41,6 +43,9 @@ namespace Nexus::Log {
 
     template<log_level lv, typename... Args>
     inline static void logout(std::format_string<Args...> fmt, const char* file, int line, Args&&... args) {
+        if (lv < log_threshold) {
+            return;
+        }
         std::string lgmsg = std::format(fmt, std::forward<Args>(args)...);
         std::string level;
         std::string ansi_suffix = "\x1b[37m";
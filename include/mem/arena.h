@@ -0,0 +1,249 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <new>
+#include "./memory.h"
+
+#ifdef PLATFORM_WIN32
+#include "../platform/win32/win32_mem.h"
+#endif
+
+namespace Nexus::Base {
+    /*
+     * Arena hands out memory from 2 MB chunks mapped on the NUMA node of the allocating thread, in large pages when the
+     * process may use them, so buffers a thread fills sit in memory local to it and cost fewer TLB entries. Blocks come in
+     * size classes, four to every power of two from 64 bytes to 1 MB, and freed blocks go to a free list of their class
+     * on the node they came from. Larger blocks are mapped on their own. Every block carries a 16 byte header in front of
+     * its class size naming where it came from, so a power of two fills its class exactly, the block can be freed from any
+     * thread, and whatever size the caller passes back is not trusted.
+     *
+     * The arena starts in HEAP mode, where blocks come from calloc with the same header, and Configure() switches it on at
+     * start. Blocks allocated before a switch are still freed the right way.
+     * */
+    class Arena {
+    public:
+        using mode_t = enum {
+            HEAP,
+            // Node-local chunks in normal pages
+            NUMA,
+            // Node-local chunks in large pages, chunks that cannot get them fall back to normal pages
+            HUGEPAGES
+        };
+        static constexpr uint64_t chunk_size = 2 * 1024 * 1024;
+        static constexpr uint64_t max_class_size = 1024 * 1024;
+        static constexpr uint32_t max_nodes = 64;
+    private:
+        struct header_t {
+            uint32_t node;
+            uint32_t cls;
+            // What the caller may use of the block
+            uint64_t size;
+        };
+        static_assert(sizeof(header_t) == 16);
+        static constexpr uint32_t heap_node = UINT32_MAX;
+        static constexpr uint32_t mapped_class = UINT32_MAX;
+        static constexpr uint32_t classes = 57;
+
+        struct free_block_t {
+            free_block_t* next;
+        };
+
+        struct node_t {
+            std::mutex mtx;
+            free_block_t* free[classes] {};
+            char* cursor {nullptr};
+            char* end {nullptr};
+        };
+
+        inline static std::atomic<mode_t> mode_ {HEAP};
+        inline static std::atomic<uint64_t> chunks_ {0};
+        inline static std::atomic<uint64_t> large_chunks_ {0};
+
+        static node_t* Nodes() {
+            // Never freed, blocks may be returned while statics are torn down
+            static node_t* nodes = new node_t[max_nodes];
+            return nodes;
+        }
+
+        static uint32_t Node() {
+            thread_local uint32_t node = std::min<uint32_t>(CurrentNumaNode(), max_nodes - 1);
+            return node;
+        }
+
+        /* The smallest class that holds size bytes. */
+        static uint32_t Class(uint64_t size) {
+            if (size <= 64) {
+                return 0;
+            }
+            uint32_t group = std::bit_width(size - 1) - 7;
+            uint32_t shift = group + 4;
+            return group * 4 + static_cast<uint32_t>(((size + (uint64_t {1} << shift) - 1) >> shift) - 4);
+        }
+
+        static uint64_t ClassSize(uint32_t cls) {
+            return uint64_t {4 + cls % 4} << (cls / 4 + 4);
+        }
+
+        static uint64_t PageSize(bool large) {
+            return large ? std::max<uint64_t>(LargePageSize(), 64 * 1024) : 64 * 1024;
+        }
+
+        static char* Map(uint64_t& size, uint32_t node) {
+            if (mode_.load(std::memory_order_relaxed) == HUGEPAGES) {
+                auto page = PageSize(true);
+                auto large = (size + page - 1) / page * page;
+                if (auto ptr = MapPages(large, node, true); ptr != nullptr) {
+                    size = large;
+                    large_chunks_.fetch_add(1, std::memory_order_relaxed);
+                    return ptr;
+                }
+            }
+            auto page = PageSize(false);
+            size = (size + page - 1) / page * page;
+            auto ptr = MapPages(size, node, false);
+            if (ptr == nullptr) {
+                throw std::bad_alloc();
+            }
+            return ptr;
+        }
+
+        static header_t* Header(const void* ptr) {
+            return reinterpret_cast<header_t*>(const_cast<char*>(reinterpret_cast<const char*>(ptr))) - 1;
+        }
+    public:
+        /* Switch how blocks are allocated from now on, false when HUGEPAGES was asked for and large pages cannot be had,
+         * the arena then uses NUMA. */
+        static bool Configure(mode_t mode) {
+            bool ok = true;
+            if (mode == HUGEPAGES && !EnableLargePages()) {
+                mode = NUMA;
+                ok = false;
+            }
+            mode_.store(mode, std::memory_order_relaxed);
+            return ok;
+        }
+
+        static mode_t Mode() {
+            return mode_.load(std::memory_order_relaxed);
+        }
+
+        /* Chunks mapped so far, and how many of them are in large pages. */
+        static uint64_t Chunks() {
+            return chunks_.load(std::memory_order_relaxed);
+        }
+
+        static uint64_t LargeChunks() {
+            return large_chunks_.load(std::memory_order_relaxed);
+        }
+
+        /* size zeroed bytes. */
+        static char* Allocate(uint64_t size) {
+            if (mode_.load(std::memory_order_relaxed) == HEAP) {
+                auto h = reinterpret_cast<header_t*>(calloc(1, sizeof(header_t) + size));
+                if (h == nullptr) {
+                    throw std::bad_alloc();
+                }
+                *h = {heap_node, 0, size};
+                return reinterpret_cast<char*>(h + 1);
+            }
+            auto node = Node();
+            if (size > max_class_size) {
+                auto total = sizeof(header_t) + size;
+                auto h = reinterpret_cast<header_t*>(Map(total, node));
+                *h = {node, mapped_class, total - sizeof(header_t)};
+                return reinterpret_cast<char*>(h + 1);
+            }
+            auto cls = Class(size);
+            auto& n = Nodes()[node];
+            header_t* h;
+            {
+                std::lock_guard lock(n.mtx);
+                if (auto block = n.free[cls]; block != nullptr) {
+                    n.free[cls] = block->next;
+                    h = reinterpret_cast<header_t*>(block);
+                    memset(h + 1, 0, size);
+                } else {
+                    auto span = sizeof(header_t) + ClassSize(cls);
+                    if (n.cursor == nullptr || static_cast<uint64_t>(n.end - n.cursor) < span) {
+                        // The rest of the old chunk is left unused, it is smaller than the block
+                        uint64_t mapped = chunk_size;
+                        n.cursor = Map(mapped, node);
+                        n.end = n.cursor + mapped;
+                        chunks_.fetch_add(1, std::memory_order_relaxed);
+                    }
+                    h = reinterpret_cast<header_t*>(n.cursor);
+                    n.cursor += span;
+                }
+            }
+            *h = {node, cls, ClassSize(cls)};
+            return reinterpret_cast<char*>(h + 1);
+        }
+
+        /* Grow ptr to size, in place when its block has room. Grown bytes are not zeroed. */
+        static char* Reallocate(char* ptr, uint64_t size) {
+            if (ptr == nullptr) {
+                return Allocate(size);
+            }
+            auto h = Header(ptr);
+            if (h->node == heap_node) {
+                h = reinterpret_cast<header_t*>(realloc(h, sizeof(header_t) + size));
+                if (h == nullptr) {
+                    throw std::bad_alloc();
+                }
+                h->size = size;
+                return reinterpret_cast<char*>(h + 1);
+            }
+            if (size <= h->size) {
+                return ptr;
+            }
+            auto moved = Allocate(size);
+            memcpy(moved, ptr, h->size);
+            Recycle(ptr);
+            return moved;
+        }
+
+        static void Recycle(const void* ptr) {
+            if (ptr == nullptr) {
+                return;
+            }
+            auto h = Header(ptr);
+            if (h->node == heap_node) {
+                free(h);
+            } else if (h->cls == mapped_class) {
+                UnmapPages(h, sizeof(header_t) + h->size);
+            } else {
+                // The link overwrites the header
+                auto cls = h->cls;
+                auto& n = Nodes()[h->node];
+                std::lock_guard lock(n.mtx);
+                auto block = reinterpret_cast<free_block_t*>(h);
+                block->next = n.free[cls];
+                n.free[cls] = block;
+            }
+        }
+    };
+
+    /* IsAllocator over Arena, for the pool family, IOBuf and the resource cache. */
+    class ArenaAllocator {
+    public:
+        char* allocate(uint64_t size) {
+            return Arena::Allocate(size);
+        }
+
+        // The arena knows the size of every block, the sizes the pool family passes along are not needed
+        char* reallocate(char* old_ptr, [[maybe_unused]] uint64_t old_size, uint64_t new_size) {
+            return Arena::Reallocate(old_ptr, new_size);
+        }
+
+        bool recycle(const void* ptr, [[maybe_unused]] uint64_t size) {
+            Arena::Recycle(ptr);
+            return true;
+        }
+    };
+}
\ No newline at end of file
@@ -0,0 +1,400 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include "./memory.h"
+
+namespace Nexus::Base {
+    /*
+     * IOBuf is a chain of slices over fixed-size segments, for buffers that grow a piece at a time. Appending never moves
+     * what is already buffered: the last segment is filled up and another one is linked when it is full, so collecting N
+     * bytes copies each of them once where SharedPool reallocates and copies again on every expansion. Segments go back to
+     * a free list of the thread that drops them and are reused from there.
+     *
+     * Segments are reference counted, split() hands out the front of a buffer sharing the segment on the boundary, and a
+     * segment is only written to while a single slice refers to it. append_external() links memory the buffer does not own,
+     * a large body goes out behind its head without being copied, its owner keeps it alive until the buffer let go of it.
+     * gather() exports the slices for WSASend the way iovecs go to writev, prepare() and commit() expose the free tail to
+     * read into. Parsers that need contiguous memory call coalesce().
+     * */
+    template<typename A = HeapAllocator> requires IsAllocator<A>
+    class IOBuf {
+    public:
+        // What a segment allocates including its header, a power of two so allocators with size classes fit it exactly
+        static constexpr uint64_t segment_size = 4096;
+        // Free segments a thread keeps, more are returned to the allocator
+        static constexpr uint64_t cached_segments = 256;
+    private:
+        struct segment_t {
+            std::atomic<uint32_t> refs {1};
+            uint64_t capacity;
+            segment_t* next {nullptr};
+
+            explicit segment_t(uint64_t cap) : capacity(cap) {}
+
+            char* data() {
+                return reinterpret_cast<char*>(this + 1);
+            }
+        };
+
+        struct slice_t {
+            // nullptr for memory appended with append_external()
+            segment_t* seg;
+            char* begin;
+            char* end;
+
+            uint64_t size() const {
+                return end - begin;
+            }
+        };
+    public:
+        // Bytes a segment holds
+        static constexpr uint64_t segment_room = segment_size - sizeof(segment_t);
+    private:
+
+        struct free_list_t {
+            segment_t* head {nullptr};
+            uint64_t count {0};
+            bool closed {false};
+
+            ~free_list_t() {
+                closed = true;
+                while (head != nullptr) {
+                    auto seg = head;
+                    head = seg->next;
+                    Recycle(seg);
+                }
+            }
+        };
+
+        inline static thread_local free_list_t free_ {};
+
+        // Slices before head_ are released already, trimming the front only moves head_
+        std::vector<slice_t> slices_;
+        uint64_t head_ {0};
+        uint64_t size_ {0};
+
+        static segment_t* Allocate(uint64_t capacity) {
+            if (capacity == segment_room && free_.head != nullptr) {
+                auto seg = free_.head;
+                free_.head = seg->next;
+                --free_.count;
+                seg->refs.store(1, std::memory_order_relaxed);
+                return seg;
+            }
+            return new (A().allocate(sizeof(segment_t) + capacity)) segment_t(capacity);
+        }
+
+        static void Recycle(segment_t* seg) {
+            uint64_t capacity = seg->capacity;
+            seg->~segment_t();
+            A().recycle(seg, sizeof(segment_t) + capacity);
+        }
+
+        static void Release(segment_t* seg) {
+            if (seg == nullptr || seg->refs.fetch_sub(1, std::memory_order_acq_rel) != 1) {
+                return;
+            }
+            if (seg->capacity == segment_room && free_.count < cached_segments && !free_.closed) {
+                seg->next = free_.head;
+                free_.head = seg;
+                ++free_.count;
+                return;
+            }
+            Recycle(seg);
+        }
+
+        /* The last slice when its segment has room behind it that nobody else can see, nullptr otherwise. */
+        slice_t* writable_back() {
+            if (slices_.size() == head_) {
+                return nullptr;
+            }
+            auto& s = slices_.back();
+            if (s.seg == nullptr || s.end == s.seg->data() + s.seg->capacity || s.seg->refs.load(std::memory_order_acquire) != 1) {
+                return nullptr;
+            }
+            return &s;
+        }
+
+        /* Drop an empty slice prepare() left at the back, before something else is linked behind it. */
+        void drop_empty_back() {
+            if (slices_.size() > head_ && slices_.back().size() == 0) {
+                Release(slices_.back().seg);
+                slices_.pop_back();
+            }
+        }
+
+        void push_front(const slice_t& s) {
+            if (head_ > 0) {
+                slices_[--head_] = s;
+            } else {
+                slices_.insert(slices_.begin(), s);
+            }
+        }
+
+        void compact() {
+            if (head_ == slices_.size()) {
+                slices_.clear();
+                head_ = 0;
+            } else if (head_ > 16 && head_ * 2 > slices_.size()) {
+                slices_.erase(slices_.begin(), slices_.begin() + static_cast<int64_t>(head_));
+                head_ = 0;
+            }
+        }
+    public:
+        IOBuf() = default;
+        IOBuf(const IOBuf&) = delete;
+        IOBuf& operator=(const IOBuf&) = delete;
+
+        IOBuf(IOBuf&& other) noexcept : slices_(std::move(other.slices_)), head_(other.head_), size_(other.size_) {
+            other.slices_.clear();
+            other.head_ = 0;
+            other.size_ = 0;
+        }
+
+        IOBuf& operator=(IOBuf&& other) noexcept {
+            if (this != &other) {
+                clear();
+                slices_ = std::move(other.slices_);
+                head_ = other.head_;
+                size_ = other.size_;
+                other.slices_.clear();
+                other.head_ = 0;
+                other.size_ = 0;
+            }
+            return *this;
+        }
+
+        ~IOBuf() {
+            clear();
+        }
+
+        uint64_t size() const {
+            return size_;
+        }
+
+        bool empty() const {
+            return size_ == 0;
+        }
+
+        /* Same as size(), for code written against the pool family like the frame writers. */
+        uint64_t limit() const {
+            return size_;
+        }
+
+        /* The free tail of the last segment, a new segment is linked when there is none. Fill it and commit() what was
+         * written, nothing else may change the buffer in between. */
+        std::pair<char*, uint64_t> prepare() {
+            auto s = writable_back();
+            if (s == nullptr) {
+                auto seg = Allocate(segment_room);
+                slices_.push_back({seg, seg->data(), seg->data()});
+                s = &slices_.back();
+            }
+            return {s->end, static_cast<uint64_t>(s->seg->data() + s->seg->capacity - s->end)};
+        }
+
+        void commit(uint64_t len) {
+            slices_.back().end += len;
+            size_ += len;
+        }
+
+        void append(const char* data, uint64_t len) {
+            while (len > 0) {
+                auto [ptr, room] = prepare();
+                auto n = std::min<uint64_t>(room, len);
+                memcpy(ptr, data, n);
+                commit(n);
+                data += n;
+                len -= n;
+            }
+        }
+
+        /* Same as append(), for code written against the pool family. */
+        bool write(const char* data, uint64_t len) {
+            append(data, len);
+            return true;
+        }
+
+        /* Move the slices of other behind the ones of this buffer, nothing is copied. */
+        void append(IOBuf&& other) {
+            drop_empty_back();
+            for (auto i = other.head_; i < other.slices_.size(); ++i) {
+                slices_.push_back(other.slices_[i]);
+            }
+            size_ += other.size_;
+            other.slices_.clear();
+            other.head_ = 0;
+            other.size_ = 0;
+        }
+
+        /* Link len bytes at data without copying them, they have to stay valid and unchanged until they are trimmed, split
+         * off or cleared. */
+        void append_external(const char* data, uint64_t len) {
+            if (len == 0) {
+                return;
+            }
+            drop_empty_back();
+            slices_.push_back({nullptr, const_cast<char*>(data), const_cast<char*>(data) + len});
+            size_ += len;
+        }
+
+        /* Put len bytes in front of what is buffered, into the room before the first slice when its segment has some. A new
+         * segment is filled from its end, so prepending more lands in the same one. */
+        void prepend(const char* data, uint64_t len) {
+            while (len > 0) {
+                uint64_t room = 0;
+                if (head_ < slices_.size()) {
+                    auto& s = slices_[head_];
+                    if (s.seg != nullptr && s.seg->refs.load(std::memory_order_acquire) == 1) {
+                        room = s.begin - s.seg->data();
+                    }
+                }
+                if (room == 0) {
+                    auto seg = Allocate(segment_room);
+                    auto end = seg->data() + seg->capacity;
+                    push_front({seg, end, end});
+                    continue;
+                }
+                auto& s = slices_[head_];
+                auto n = std::min<uint64_t>(room, len);
+                s.begin -= n;
+                memcpy(s.begin, data + len - n, n);
+                len -= n;
+                size_ += n;
+            }
+        }
+
+        /* Drop len bytes from the front, what was sent. */
+        void trim_front(uint64_t len) {
+            len = std::min<uint64_t>(len, size_);
+            size_ -= len;
+            while (len > 0) {
+                auto& s = slices_[head_];
+                if (len < s.size()) {
+                    s.begin += len;
+                    break;
+                }
+                len -= s.size();
+                Release(s.seg);
+                ++head_;
+            }
+            compact();
+        }
+
+        /* Drop len bytes from the back. */
+        void trim_back(uint64_t len) {
+            len = std::min<uint64_t>(len, size_);
+            size_ -= len;
+            while (len > 0) {
+                auto& s = slices_.back();
+                if (len < s.size()) {
+                    s.end -= len;
+                    break;
+                }
+                len -= s.size();
+                Release(s.seg);
+                slices_.pop_back();
+            }
+            compact();
+        }
+
+        /* Take the first len bytes out into a buffer of their own. The segment on the boundary is shared, neither buffer
+         * writes into it any more. */
+        IOBuf split(uint64_t len) {
+            IOBuf front;
+            len = std::min<uint64_t>(len, size_);
+            size_ -= len;
+            front.size_ = len;
+            while (len > 0) {
+                auto& s = slices_[head_];
+                if (len < s.size()) {
+                    if (s.seg != nullptr) {
+                        s.seg->refs.fetch_add(1, std::memory_order_relaxed);
+                    }
+                    front.slices_.push_back({s.seg, s.begin, s.begin + len});
+                    s.begin += len;
+                    break;
+                }
+                len -= s.size();
+                front.slices_.push_back(s);
+                ++head_;
+            }
+            compact();
+            return front;
+        }
+
+        void clear() {
+            for (auto i = head_; i < slices_.size(); ++i) {
+                Release(slices_[i].seg);
+            }
+            slices_.clear();
+            head_ = 0;
+            size_ = 0;
+        }
+
+        /* clear() for a buffer that is kept for reuse, the slice list a large buffer grew is given back as well. */
+        void reset(uint64_t keep_slices = 16) {
+            clear();
+            if (slices_.capacity() > keep_slices) {
+                std::vector<slice_t>().swap(slices_);
+            }
+        }
+
+        /* The first contiguous piece of the buffer, empty when there is nothing buffered. */
+        std::string_view front() const {
+            for (auto i = head_; i < slices_.size(); ++i) {
+                if (slices_[i].size() > 0) {
+                    return {slices_[i].begin, slices_[i].size()};
+                }
+            }
+            return {};
+        }
+
+        /* Fill views with up to max pieces of the buffer in order, return how many. */
+        uint64_t gather(std::string_view* views, uint64_t max) const {
+            uint64_t n = 0;
+            for (auto i = head_; i < slices_.size() && n < max; ++i) {
+                if (slices_[i].size() > 0) {
+                    views[n++] = {slices_[i].begin, slices_[i].size()};
+                }
+            }
+            return n;
+        }
+
+        /* Make the buffer one contiguous piece and return it. The segment copied into has as much room again behind it, so
+         * a parser coalescing after every read copies the bytes a bounded number of times. */
+        std::string_view coalesce() {
+            drop_empty_back();
+            if (slices_.size() - head_ > 1) {
+                auto seg = Allocate(std::max<uint64_t>(size_ * 2, segment_room));
+                auto end = seg->data();
+                for (auto i = head_; i < slices_.size(); ++i) {
+                    memcpy(end, slices_[i].begin, slices_[i].size());
+                    end += slices_[i].size();
+                    Release(slices_[i].seg);
+                }
+                slices_.clear();
+                slices_.push_back({seg, seg->data(), end});
+                head_ = 0;
+            }
+            return front();
+        }
+
+        std::string to_string() const {
+            std::string str;
+            str.reserve(size_);
+            for (auto i = head_; i < slices_.size(); ++i) {
+                str.append(slices_[i].begin, slices_[i].size());
+            }
+            return str;
+        }
+    };
+}
\ No newline at end of file
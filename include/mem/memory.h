@@ -1,11 +1,13 @@
 #pragma once
 
+#include <algorithm>
 #include <cstdint>
 #include <concepts>
 #include <shared_mutex>
 #include <cstdlib>
 #include <cstring>
 #include <new>
+#include <string_view>
 #include <thread>
 #include "../utils/check.h"
 
@@ -84,6 +86,8 @@ namespace Nexus::Base {
         { c.template next<plain_type_for_constraint>() } -> std::same_as<Nexus::Utils::MayFail<plain_type_for_constraint>>;
         { c.template next<decltype(fixed_array_type_for_constraint)>() } -> std::same_as<Nexus::Utils::MayFail<decltype(fixed_array_type_for_constraint)>>;
         { c.read(UINT64_MAX) } -> std::same_as<Nexus::Utils::MayFail<UniqueFlexHolder<char>>>;
+        { c.peek(UINT64_MAX) };
+        { c.consume(UINT64_MAX) };
         { c.rewind() };
         { c.position() } -> std::same_as<uint64_t&>;
         { c.limit() } -> std::same_as<uint64_t>;
@@ -210,6 +214,18 @@ namespace Nexus::Base {
         Nexus::Utils::MayFail<UniqueFlexHolder<char>> read(uint64_t len) {
             return container_.read(len);
         }
+        /* Borrow up to len bytes at the position without copying or moving past them. */
+        auto peek(uint64_t len) {
+            return container_.peek(len);
+        }
+        /* Move past len bytes that were borrowed. */
+        void consume(uint64_t len) {
+            container_.consume(len);
+        }
+        /* Borrow up to len bytes at the position and move past them. */
+        auto read_view(uint64_t len) {
+            return container_.read_view(len);
+        }
         /* Write data in specified size. */
         bool write(char* ptr, uint64_t len) {
             return container_.write(ptr, len);
@@ -275,6 +291,21 @@ namespace Nexus::Base {
             return container_.read(len);
         }
 
+        /* Borrow up to len bytes at the position without copying or moving past them. */
+        auto peek(uint64_t len) {
+            return container_.peek(len);
+        }
+
+        /* Move past len bytes that were borrowed. */
+        void consume(uint64_t len) {
+            container_.consume(len);
+        }
+
+        /* Borrow up to len bytes at the position and move past them. */
+        auto read_view(uint64_t len) {
+            return container_.read_view(len);
+        }
+
         /* Rewind the container. */
         void rewind() {
             container_.rewind();
@@ -423,6 +454,22 @@ namespace Nexus::Base {
             up.memptr_ = nullptr;
             up.capacity_ = 0;
         }
+        /* Release the memory held and take over the one of up. */
+        UniquePool& operator=(UniquePool&& up) noexcept {
+            if (this != &up) {
+                release();
+                memptr_ = up.memptr_;
+                capacity_ = up.capacity_;
+                position_ = up.position_;
+                limit_ = up.limit_;
+                allocator_ = up.allocator_;
+                settings_ = up.settings_;
+                flag_ = up.flag_;
+                up.memptr_ = nullptr;
+                up.capacity_ = 0;
+            }
+            return *this;
+        }
         /* Direct access to the buffer. */
         char& operator[](uint64_t index) {
             return memptr_[index];
@@ -456,6 +503,28 @@ namespace Nexus::Base {
             return data;
         }
 
+        /* Borrow up to len bytes at the position without moving past them. The view is valid until the pool is written to
+         * or goes away. */
+        std::string_view peek(uint64_t len) const {
+            if (position_ >= limit_) {
+                return {};
+            }
+            return {memptr_ + position_, std::min<uint64_t>(len, limit_ - position_)};
+        }
+
+        /* Move past len bytes, at most up to the limit. */
+        void consume(uint64_t len) {
+            position_ += std::min<uint64_t>(len, position_ < limit_ ? limit_ - position_ : 0);
+        }
+
+        /* Borrow up to len bytes at the position and move past them, empty and eof at the limit. */
+        std::string_view read_view(uint64_t len) {
+            auto view = peek(len);
+            flag_ = view.empty() && len > 0 ? flag_t::eof : flag_t::normal;
+            position_ += view.size();
+            return view;
+        }
+
         /* Write data in specified size with specified position. */
         bool write(const char* ptr, uint64_t off, uint64_t len) {
             if (off + len > capacity_) {
@@ -513,6 +582,13 @@ namespace Nexus::Base {
             return capacity_;
         }
 
+        /* Drop the content but keep the memory for reuse. */
+        void clear() {
+            position_ = 0;
+            limit_ = 0;
+            flag_ = flag_t::normal;
+        }
+
         ~UniquePool() {
             release();
         }
@@ -596,7 +672,7 @@ namespace Nexus::Base {
             position_ = npos;
         }
 
-        uint64_t limit() {
+        uint64_t limit() const {
             return limit_;
         }
 
@@ -635,6 +711,46 @@ namespace Nexus::Base {
         std::shared_mutex* mtx;
         flag_t flag_ {flag_t::normal};
     public:
+        /*
+         * View borrows a piece of the pool without copying it. It holds a reference like a copy of the pool does, so the
+         * memory outlives every other copy. A write that grows the pool may move the memory, views are for what is
+         * already written and have to be dropped before writing more.
+         * */
+        class View {
+        private:
+            SharedPool owner_;
+            const char* data_ {nullptr};
+            uint64_t size_ {0};
+        public:
+            View(const SharedPool& pool, uint64_t off, uint64_t len) : owner_(pool) {
+                owner_.mtx->lock_shared();
+                auto limit = *owner_.limit_;
+                if (off < limit) {
+                    data_ = *owner_.memholder_ + off;
+                    size_ = std::min<uint64_t>(len, limit - off);
+                }
+                owner_.mtx->unlock_shared();
+            }
+            View(const View&) = delete;
+            View(View&& v) noexcept = default;
+
+            const char* data() const {
+                return data_;
+            }
+
+            uint64_t size() const {
+                return size_;
+            }
+
+            bool empty() const {
+                return size_ == 0;
+            }
+
+            std::string_view str() const {
+                return {data_, size_};
+            }
+        };
+
         /* Allocate a new SharedPool with given capacity. */
         explicit SharedPool(uint64_t capacity) : allocator_(A()), mtx(new std::shared_mutex), settings_(1) {
             reference_counting = reinterpret_cast<int64_t*>(allocator_.allocate(sizeof(int64_t)));
@@ -707,6 +823,31 @@ namespace Nexus::Base {
             return data;
         }
 
+        /* Borrow up to len bytes at off, the position and flag stay as they are. */
+        View read_view(uint64_t off, uint64_t len) const {
+            return View(*this, off, len);
+        }
+
+        /* Borrow up to len bytes at the position without moving past them. */
+        View peek(uint64_t len) const {
+            return View(*this, position_, len);
+        }
+
+        /* Move past len bytes, at most up to the limit. */
+        void consume(uint64_t len) {
+            mtx->lock_shared();
+            position_ += std::min<uint64_t>(len, position_ < *limit_ ? *limit_ - position_ : 0);
+            mtx->unlock_shared();
+        }
+
+        /* Borrow up to len bytes at the position and move past them, empty and eof at the limit. */
+        View read_view(uint64_t len) {
+            View view(*this, position_, len);
+            flag_ = view.empty() && len > 0 ? flag_t::eof : flag_t::normal;
+            position_ += view.size();
+            return view;
+        }
+
         /* Write data in specified size with specified position. */
         bool write(const char* ptr, uint64_t off, uint64_t len) {
             mtx->lock();
@@ -794,6 +935,15 @@ namespace Nexus::Base {
                 memholder_ = nullptr;
             }
         }
+        /* Drop the content but keep the memory for reuse. Positions held by other copies are not reset. */
+        void clear() {
+            mtx->lock();
+            position_ = 0;
+            *limit_ = 0;
+            flag_ = flag_t::normal;
+            mtx->unlock();
+        }
+
         ~SharedPool() {
             release();
         }
@@ -916,24 +1066,27 @@ namespace Nexus::Base {
         };
     private:
         const char* memptr_;
+        // What was allocated, freed as a whole when auto_free is set
         uint64_t capacity_;
         uint64_t position_ {0};
-        uint64_t& limit_ {capacity_};
+        // What may be read, less than the capacity for pools from unique_to_readonly()
+        uint64_t limit_ {capacity_};
         flag_t flag_ {flag_t::normal};
         A allocator_ {};
     public:
         /* Use FixedPool to manage a pointer and carefully confirm the life cycle of the pointer. */
         FixedPool(const char* memptr, uint64_t size) : memptr_(memptr), capacity_(size) {}
         /* FixedPool can be copied. */
-        FixedPool(const FixedPool& up) : memptr_(up.memptr_), capacity_(up.capacity_), allocator_(up.allocator_) {
+        FixedPool(const FixedPool& up) : memptr_(up.memptr_), capacity_(up.capacity_), limit_(up.limit_), allocator_(up.allocator_) {
             if constexpr (auto_free) {
                 static_assert("When auto_free is specified, the copy constructor is not allowed.");
             }
         }
         /* FixedPool can be moved. */
-        FixedPool(FixedPool&& up) noexcept : memptr_(up.memptr_), capacity_(up.capacity_), allocator_(up.allocator_) {
+        FixedPool(FixedPool&& up) noexcept : memptr_(up.memptr_), capacity_(up.capacity_), limit_(up.limit_), allocator_(up.allocator_) {
             up.memptr_ = nullptr;
             up.capacity_ = 0;
+            up.limit_ = 0;
         }
 
         /* Direct access to the buffer. */
@@ -943,12 +1096,12 @@ namespace Nexus::Base {
         /* Read data in specified size with specified position. */
         Nexus::Utils::MayFail<UniqueFlexHolder<char>> read(uint64_t off, uint64_t len) {
             flag_ = flag_t::normal;
-            if (position_ >= capacity_) {
+            if (position_ >= limit_) {
                 flag_ = flag_t::eof;
                 return Nexus::Utils::failed;
             }
-            if (position_ + len >= capacity_) {
-                len = capacity_ - position_;
+            if (position_ + len >= limit_) {
+                len = limit_ - position_;
             }
             auto data = UniqueFlexHolder<char>(len);
             memcpy(&data.get(), memptr_ + position_, len);
@@ -959,7 +1112,7 @@ namespace Nexus::Base {
         /* Read data in specified size with position. */
         Nexus::Utils::MayFail<UniqueFlexHolder<char>> read(uint64_t len) {
             flag_ = flag_t::normal;
-            if ((position_ + len) > capacity_) {
+            if ((position_ + len) > limit_) {
                 flag_ = flag_t::eof;
                 return Nexus::Utils::failed;
             }
@@ -969,6 +1122,27 @@ namespace Nexus::Base {
             return data;
         }
 
+        /* Borrow up to len bytes at the position without moving past them, valid as long as the memory is. */
+        std::string_view peek(uint64_t len) const {
+            if (position_ >= limit_) {
+                return {};
+            }
+            return {memptr_ + position_, std::min<uint64_t>(len, limit_ - position_)};
+        }
+
+        /* Move past len bytes, at most up to the limit. */
+        void consume(uint64_t len) {
+            position_ += std::min<uint64_t>(len, position_ < limit_ ? limit_ - position_ : 0);
+        }
+
+        /* Borrow up to len bytes at the position and move past them, empty and eof at the limit. */
+        std::string_view read_view(uint64_t len) {
+            auto view = peek(len);
+            flag_ = view.empty() && len > 0 ? flag_t::eof : flag_t::normal;
+            position_ += view.size();
+            return view;
+        }
+
         ~FixedPool() {
             if (memptr_ != nullptr) {
                 if constexpr (auto_free) {
@@ -983,9 +1157,9 @@ namespace Nexus::Base {
         Nexus::Utils::MayFail<T> next()  {
             constexpr auto step = sizeof(T);
             flag_ = flag_t::normal;
-            if (position_ + step >= capacity_) {
+            if (position_ + step >= limit_) {
                 flag_ = flag_t::eof;
-                if (position_ + step > capacity_) return Nexus::Utils::failed;
+                if (position_ + step > limit_) return Nexus::Utils::failed;
             }
             T d{};
             memcpy(&d, memptr_ + position_, step);
@@ -997,9 +1171,9 @@ namespace Nexus::Base {
         Nexus::Utils::MayFail<T(&)[S]> next() {
             constexpr auto size = sizeof(T) * S;
             flag_ = flag_t::normal;
-            if (position_ + size >= capacity_) {
+            if (position_ + size >= limit_) {
                 flag_ = flag_t::eof;
-                if (position_ + size > capacity_) return Nexus::Utils::failed;
+                if (position_ + size > limit_) return Nexus::Utils::failed;
             }
             T d{};
             memcpy(&d[0], memptr_ + position_, size);
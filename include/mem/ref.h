@@ -0,0 +1,91 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <utility>
+
+namespace Nexus::Base {
+    /* Base of objects owned through Ref, the count lives in the object so a reference is a single pointer and taking one
+     * touches nothing but the object itself. */
+    class RefCounted {
+    private:
+        template<typename T> friend class Ref;
+        mutable std::atomic<uint32_t> refs_ {0};
+    protected:
+        RefCounted() = default;
+        ~RefCounted() = default;
+    public:
+        RefCounted(const RefCounted&) = delete;
+        RefCounted& operator=(const RefCounted&) = delete;
+
+        /* References held right now. 1 means the caller holds the only one, and as long as nobody can copy it that stays so. */
+        uint32_t refs() const {
+            return refs_.load(std::memory_order_acquire);
+        }
+    };
+
+    /*
+     * Ref is an intrusive shared pointer to a RefCounted T, deleted with the last reference. It is the size of a pointer and
+     * has no control block, copies are an atomic increment on the object.
+     * */
+    template<typename T>
+    class Ref {
+    private:
+        T* ptr_ {nullptr};
+
+        explicit Ref(T* ptr) : ptr_(ptr) {
+            ptr_->refs_.fetch_add(1, std::memory_order_relaxed);
+        }
+    public:
+        template<typename... Args>
+        static Ref Make(Args&&... args) {
+            return Ref(new T(std::forward<Args>(args)...));
+        }
+
+        Ref() = default;
+
+        Ref(const Ref& other) : ptr_(other.ptr_) {
+            if (ptr_ != nullptr) {
+                ptr_->refs_.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+
+        Ref(Ref&& other) noexcept : ptr_(std::exchange(other.ptr_, nullptr)) {}
+
+        Ref& operator=(Ref other) noexcept {
+            std::swap(ptr_, other.ptr_);
+            return *this;
+        }
+
+        ~Ref() {
+            reset();
+        }
+
+        void reset() {
+            if (ptr_ != nullptr && ptr_->refs_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                delete ptr_;
+            }
+            ptr_ = nullptr;
+        }
+
+        T* get() const {
+            return ptr_;
+        }
+
+        T* operator->() const {
+            return ptr_;
+        }
+
+        T& operator*() const {
+            return *ptr_;
+        }
+
+        explicit operator bool() const {
+            return ptr_ != nullptr;
+        }
+
+        bool operator==(const Ref& other) const {
+            return ptr_ == other.ptr_;
+        }
+    };
+}
\ No newline at end of file
@@ -0,0 +1,142 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <format>
+#include <string>
+#include "./memory.h"
+#include "../metrics/metrics.h"
+
+namespace Nexus::Base {
+    // What memory is for, every tag is accounted on its own
+    using alloc_tag_t = enum {
+        REQUEST_BUFFERS,
+        RESPONSE_BUFFERS,
+        CACHED_FILES,
+        HANDLER_BODIES,
+        ALLOC_TAGS
+    };
+
+    /*
+     * MemoryAccounts keeps for every tag the bytes live, allocations and frees, the high-water mark of the live bytes and a
+     * histogram of allocation sizes. Counts, live bytes and sizes go to the per-thread metric shards like any other metric,
+     * an allocation costs a few relaxed stores to cells of the calling thread and shows up on the metrics endpoint. The
+     * high-water mark needs a shared total: each thread collects its changes and folds them in once they add up to
+     * flush_bytes either way, so the mark can lag by up to flush_bytes a thread. Peak() also counts the live bytes of the
+     * moment it is read. Segments IOBuf keeps on its free lists count as live, they are still held.
+     * */
+    class MemoryAccounts {
+    public:
+        static constexpr int64_t flush_bytes = 64 * 1024;
+        static constexpr const char* names[ALLOC_TAGS] = {"request_buffers", "response_buffers", "cached_files", "handler_bodies"};
+    private:
+        struct account_t {
+            Nexus::Metrics::Gauge live;
+            Nexus::Metrics::Counter allocations;
+            Nexus::Metrics::Counter frees;
+            Nexus::Metrics::Histogram sizes;
+            std::atomic<int64_t> total {0};
+            std::atomic<int64_t> peak {0};
+
+            explicit account_t(const char* name) :
+                live("nexus_memory_live_bytes", "Bytes allocated and not freed, by subsystem", {{"subsystem", name}}),
+                allocations("nexus_memory_allocations_total", "Allocations, by subsystem", {{"subsystem", name}}),
+                frees("nexus_memory_frees_total", "Frees, by subsystem", {{"subsystem", name}}),
+                sizes("nexus_memory_allocation_size_bytes", "Sizes of allocations and reallocations, by subsystem", {{"subsystem", name}}, 1) {}
+        };
+
+        static account_t& Account(alloc_tag_t tag) {
+            static account_t accounts[ALLOC_TAGS] {account_t(names[0]), account_t(names[1]), account_t(names[2]), account_t(names[3])};
+            return accounts[tag];
+        }
+
+        static void Change(account_t& a, alloc_tag_t tag, int64_t bytes) {
+            thread_local int64_t pending[ALLOC_TAGS] {};
+            a.live.add(bytes);
+            auto& p = pending[tag];
+            p += bytes;
+            if (p >= flush_bytes || p <= -flush_bytes) {
+                auto total = a.total.fetch_add(p, std::memory_order_relaxed) + p;
+                p = 0;
+                auto peak = a.peak.load(std::memory_order_relaxed);
+                while (total > peak && !a.peak.compare_exchange_weak(peak, total, std::memory_order_relaxed)) {}
+            }
+        }
+    public:
+        static void Allocated(alloc_tag_t tag, uint64_t size) {
+            auto& a = Account(tag);
+            a.allocations.inc();
+            a.sizes.observe(size);
+            Change(a, tag, static_cast<int64_t>(size));
+        }
+
+        static void Reallocated(alloc_tag_t tag, uint64_t old_size, uint64_t size) {
+            auto& a = Account(tag);
+            a.sizes.observe(size);
+            Change(a, tag, static_cast<int64_t>(size) - static_cast<int64_t>(old_size));
+        }
+
+        static void Freed(alloc_tag_t tag, uint64_t size) {
+            auto& a = Account(tag);
+            a.frees.inc();
+            Change(a, tag, -static_cast<int64_t>(size));
+        }
+
+        static int64_t Live(alloc_tag_t tag) {
+            return Account(tag).live.value();
+        }
+
+        static int64_t Peak(alloc_tag_t tag) {
+            auto& a = Account(tag);
+            return std::max<int64_t>(a.peak.load(std::memory_order_relaxed), a.live.value());
+        }
+
+        static uint64_t Allocations(alloc_tag_t tag) {
+            return Account(tag).allocations.value();
+        }
+
+        static uint64_t Frees(alloc_tag_t tag) {
+            return Account(tag).frees.value();
+        }
+
+        /* Every account as a JSON object keyed by tag name. */
+        static std::string Export() {
+            std::string out = "{";
+            for (uint32_t i = 0; i < ALLOC_TAGS; ++i) {
+                auto tag = static_cast<alloc_tag_t>(i);
+                out.append(std::format("{}\"{}\":{{\"live_bytes\":{},\"peak_bytes\":{},\"allocations\":{},\"frees\":{}}}", i == 0 ? "" : ",",
+                                       names[i], Live(tag), Peak(tag), Allocations(tag), Frees(tag)));
+            }
+            out.push_back('}');
+            return out;
+        }
+    };
+
+    /* Allocate from A and account it under tag. The sizes recycle() and reallocate() are given have to be the ones
+     * allocated, which holds for the pool family and IOBuf. */
+    template<alloc_tag_t tag, typename A = HeapAllocator> requires IsAllocator<A>
+    class TrackingAllocator {
+    private:
+        A allocator_;
+    public:
+        char* allocate(uint64_t size) {
+            auto ptr = allocator_.allocate(size);
+            MemoryAccounts::Allocated(tag, size);
+            return ptr;
+        }
+
+        char* reallocate(char* old_ptr, uint64_t old_size, uint64_t new_size) {
+            auto ptr = allocator_.reallocate(old_ptr, old_size, new_size);
+            MemoryAccounts::Reallocated(tag, old_size, new_size);
+            return ptr;
+        }
+
+        bool recycle(const void* ptr, uint64_t size) {
+            if (ptr != nullptr) {
+                MemoryAccounts::Freed(tag, size);
+            }
+            return allocator_.recycle(ptr, size);
+        }
+    };
+}
\ No newline at end of file
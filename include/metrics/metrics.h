@@ -0,0 +1,274 @@
+#pragma once
+
+#include <atomic>
+#include <bit>
+#include <cstdint>
+#include <format>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace Nexus::Metrics {
+    enum class metric_t {
+        COUNTER,
+        GAUGE,
+        HISTOGRAM
+    };
+
+    using labels_t = std::vector<std::pair<std::string, std::string>>;
+
+    /*
+     * Shard holds the cells one thread records into. Only the owning thread writes a cell, so an increment is a relaxed
+     * load and store, plain moves on x86 with no lock prefix, and scrapes read the cells of every shard without stopping
+     * the writers. Shards are never freed, what a finished thread counted stays in the totals.
+     * */
+    class Shard {
+    public:
+        static constexpr uint32_t max_cells = 1 << 14;
+    private:
+        std::atomic<uint64_t> cells_[max_cells] {};
+    public:
+        void add(uint32_t cell, uint64_t n) {
+            cells_[cell].store(cells_[cell].load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+        }
+
+        uint64_t load(uint32_t cell) const {
+            return cells_[cell].load(std::memory_order_relaxed);
+        }
+    };
+
+    /*
+     * Registry keeps the metric series and the per-thread shards. A series is a metric name plus its labels and owns a
+     * range of cells in every shard, registering the same series twice hands out the same cells. Values are summed
+     * across the shards only when they are read.
+     * */
+    class Registry {
+    private:
+        struct series_t {
+            std::string name;
+            std::string help;
+            metric_t kind;
+            // Rendered as in the exposition format, without braces
+            std::string labels;
+            uint32_t cell;
+            // Histogram values are divided by it when exposed
+            double unit;
+        };
+
+        static std::mutex& Lock() {
+            static std::mutex mtx;
+            return mtx;
+        }
+
+        static std::vector<series_t>& Series() {
+            static std::vector<series_t> series;
+            return series;
+        }
+
+        static std::vector<std::unique_ptr<Shard>>& Shards() {
+            static std::vector<std::unique_ptr<Shard>> shards;
+            return shards;
+        }
+
+        // Cell 0 takes the writes of series registered after the shards ran out of cells
+        inline static uint32_t next_cell_ {1};
+
+        static Shard* Attach() {
+            std::lock_guard lock(Lock());
+            Shards().push_back(std::make_unique<Shard>());
+            return Shards().back().get();
+        }
+
+        static void Escape(std::string& out, std::string_view value) {
+            for (char c : value) {
+                if (c == '\\' || c == '"') {
+                    out.push_back('\\');
+                    out.push_back(c);
+                } else if (c == '\n') {
+                    out.append("\\n");
+                } else {
+                    out.push_back(c);
+                }
+            }
+        }
+    public:
+        /* Cells of the series, allocated on first registration. */
+        static uint32_t Register(const std::string& name, const std::string& help, metric_t kind, const labels_t& labels, uint32_t cells, double unit = 1) {
+            std::string rendered;
+            for (auto& [key, value] : labels) {
+                if (!rendered.empty()) {
+                    rendered.push_back(',');
+                }
+                rendered.append(key).append("=\"");
+                Escape(rendered, value);
+                rendered.push_back('"');
+            }
+            std::lock_guard lock(Lock());
+            for (auto& s : Series()) {
+                if (s.name == name && s.labels == rendered) {
+                    return s.cell;
+                }
+            }
+            if (next_cell_ + cells > Shard::max_cells) {
+                return 0;
+            }
+            Series().push_back({name, help, kind, std::move(rendered), next_cell_, unit});
+            next_cell_ += cells;
+            return Series().back().cell;
+        }
+
+        /* The shard of the calling thread. */
+        static Shard& Local() {
+            thread_local Shard* shard = Attach();
+            return *shard;
+        }
+
+        /* The sum of a cell over all shards. */
+        static uint64_t Sum(uint32_t cell) {
+            std::lock_guard lock(Lock());
+            uint64_t sum = 0;
+            for (auto& shard : Shards()) {
+                sum += shard->load(cell);
+            }
+            return sum;
+        }
+
+        /* Every series in the Prometheus text exposition format. */
+        static std::string Expose();
+    };
+
+    class Counter {
+    private:
+        uint32_t cell_;
+    public:
+        Counter(const std::string& name, const std::string& help, const labels_t& labels = {}) :
+            cell_(Registry::Register(name, help, metric_t::COUNTER, labels, 1)) {}
+
+        void inc(uint64_t n = 1) {
+            Registry::Local().add(cell_, n);
+        }
+
+        [[nodiscard]] uint64_t value() const {
+            return Registry::Sum(cell_);
+        }
+    };
+
+    /* A gauge sums the signed changes every thread made to it, so one thread may raise it and another lower it. */
+    class Gauge {
+    private:
+        uint32_t cell_;
+    public:
+        Gauge(const std::string& name, const std::string& help, const labels_t& labels = {}) :
+            cell_(Registry::Register(name, help, metric_t::GAUGE, labels, 1)) {}
+
+        void add(int64_t n) {
+            Registry::Local().add(cell_, static_cast<uint64_t>(n));
+        }
+
+        void inc() {
+            add(1);
+        }
+
+        void dec() {
+            add(-1);
+        }
+
+        [[nodiscard]] int64_t value() const {
+            return static_cast<int64_t>(Registry::Sum(cell_));
+        }
+    };
+
+    /*
+     * Histogram counts durations in microseconds into log-linear buckets, two per power of two from 1us up to about 67s:
+     * 1, 2, 3, 4, 6, 8, 12, 16 and so on. Finding the bucket is a bit scan and a compare. The last cell holds the sum.
+     * Other integer values, like sizes in bytes, are counted the same with a unit of 1 so they are exposed as they are.
+     * */
+    class Histogram {
+    public:
+        static constexpr uint32_t buckets = 52;
+    private:
+        uint32_t cell_;
+    public:
+        /* Upper bound of bucket i in microseconds. */
+        static constexpr uint64_t Bound(uint32_t i) {
+            if (i < 2) {
+                return i + 1;
+            }
+            // 3 * 2^k and 2^(k+2) for k = 0, 1, 2, ...
+            return i % 2 == 0 ? uint64_t {3} << ((i - 2) / 2) : uint64_t {1} << ((i + 1) / 2);
+        }
+
+        /* The bucket of a value, buckets for the ones past the last bound. */
+        static constexpr uint32_t Bucket(uint64_t micros) {
+            if (micros <= 2) {
+                return micros <= 1 ? 0 : 1;
+            }
+            // 2^(o-1) < micros <= 2^o
+            auto o = static_cast<uint32_t>(std::bit_width(micros - 1));
+            uint32_t i = micros <= (uint64_t {3} << (o - 2)) ? 2 * o - 2 : 2 * o - 1;
+            return i < buckets ? i : buckets;
+        }
+
+        /* Values are exposed divided by unit, microseconds as seconds by default. */
+        Histogram(const std::string& name, const std::string& help, const labels_t& labels = {}, double unit = 1e6) :
+            cell_(Registry::Register(name, help, metric_t::HISTOGRAM, labels, buckets + 2, unit)) {}
+
+        void observe(uint64_t micros) {
+            auto& shard = Registry::Local();
+            shard.add(cell_ == 0 ? 0 : cell_ + Bucket(micros), 1);
+            shard.add(cell_ == 0 ? 0 : cell_ + buckets + 1, micros);
+        }
+
+        [[nodiscard]] uint64_t count() const {
+            uint64_t n = 0;
+            for (uint32_t i = 0; i <= buckets; ++i) {
+                n += Registry::Sum(cell_ + i);
+            }
+            return n;
+        }
+    };
+
+    inline std::string Registry::Expose() {
+        std::vector<series_t> series;
+        {
+            std::lock_guard lock(Lock());
+            series = Series();
+        }
+        // Group the series of a metric under one HELP and TYPE
+        std::map<std::string, std::vector<const series_t*>> families;
+        for (auto& s : series) {
+            families[s.name].push_back(&s);
+        }
+        std::string out;
+        for (auto& [name, members] : families) {
+            auto kind = members.front()->kind;
+            out.append(std::format("# HELP {} {}\n# TYPE {} {}\n", name, members.front()->help, name,
+                                   kind == metric_t::COUNTER ? "counter" : kind == metric_t::GAUGE ? "gauge" : "histogram"));
+            for (auto s : members) {
+                auto braced = s->labels.empty() ? std::string() : std::format("{{{}}}", s->labels);
+                if (kind == metric_t::COUNTER) {
+                    out.append(std::format("{}{} {}\n", name, braced, Sum(s->cell)));
+                    continue;
+                }
+                if (kind == metric_t::GAUGE) {
+                    out.append(std::format("{}{} {}\n", name, braced, static_cast<int64_t>(Sum(s->cell))));
+                    continue;
+                }
+                auto prefix = s->labels.empty() ? std::string() : s->labels + ",";
+                uint64_t cumulative = 0;
+                for (uint32_t i = 0; i < Histogram::buckets; ++i) {
+                    cumulative += Sum(s->cell + i);
+                    out.append(std::format("{}_bucket{{{}le=\"{}\"}} {}\n", name, prefix, static_cast<double>(Histogram::Bound(i)) / s->unit, cumulative));
+                }
+                cumulative += Sum(s->cell + Histogram::buckets);
+                out.append(std::format("{}_bucket{{{}le=\"+Inf\"}} {}\n", name, prefix, cumulative));
+                out.append(std::format("{}_sum{} {}\n", name, braced, static_cast<double>(Sum(s->cell + Histogram::buckets + 1)) / s->unit));
+                out.append(std::format("{}_count{} {}\n", name, braced, cumulative));
+            }
+        }
+        return out;
+    }
+}
\ No newline at end of file
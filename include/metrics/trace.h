@@ -0,0 +1,174 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <format>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define NEXUS_TRACE_TSC
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+#endif
+
+namespace Nexus::Metrics {
+    // One timed phase of a traced connection
+    struct trace_span_t {
+        // Static strings, spans only keep the pointers
+        const char* name;
+        const char* category;
+        uint64_t trace;
+        uint64_t begin;
+        uint64_t end;
+    };
+
+    /*
+     * TraceRing keeps the last spans one thread recorded. Only the owning thread writes, the exporter reads whatever is
+     * there, a span overwritten while it is being read comes out garbled, which a diagnostic dump can live with.
+     * */
+    class TraceRing {
+    public:
+        static constexpr uint64_t capacity = 1 << 14;
+    private:
+        trace_span_t spans_[capacity] {};
+        std::atomic<uint64_t> head_ {0};
+        uint64_t thread_;
+    public:
+        explicit TraceRing(uint64_t thread) : thread_(thread) {}
+
+        void push(const trace_span_t& span) {
+            auto head = head_.load(std::memory_order_relaxed);
+            spans_[head & (capacity - 1)] = span;
+            head_.store(head + 1, std::memory_order_release);
+        }
+
+        template<typename F>
+        void for_each(F&& f) const {
+            auto head = head_.load(std::memory_order_acquire);
+            for (auto i = head > capacity ? head - capacity : 0; i < head; ++i) {
+                f(spans_[i & (capacity - 1)]);
+            }
+        }
+
+        [[nodiscard]] uint64_t thread() const {
+            return thread_;
+        }
+    };
+
+    /*
+     * Tracer records the phases of sampled connections with time stamp counter reads, a few cycles each, into per-thread
+     * rings. One connection in sample_every gets a trace id, the others get 0 and record nothing. Time stamps are turned
+     * into microseconds only when exporting, against a steady clock reading taken at start.
+     * */
+    class Tracer {
+    private:
+        inline static std::atomic<uint64_t> sample_every_ {64};
+        inline static std::atomic<uint64_t> next_trace_ {0};
+
+        static std::mutex& Lock() {
+            static std::mutex mtx;
+            return mtx;
+        }
+
+        static std::vector<std::unique_ptr<TraceRing>>& Rings() {
+            static std::vector<std::unique_ptr<TraceRing>> rings;
+            return rings;
+        }
+
+        static TraceRing& Local() {
+            thread_local TraceRing* ring = [] {
+                std::lock_guard lock(Lock());
+                Rings().push_back(std::make_unique<TraceRing>(Rings().size() + 1));
+                return Rings().back().get();
+            }();
+            return *ring;
+        }
+
+        static int64_t SteadyNs() {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+        }
+
+        struct origin_t {
+            uint64_t ticks;
+            int64_t ns;
+        };
+
+        static const origin_t& Origin() {
+            static const origin_t origin {Now(), SteadyNs()};
+            return origin;
+        }
+    public:
+        /* The time stamp counter, or steady clock nanoseconds where there is none. */
+        static uint64_t Now() {
+#ifdef NEXUS_TRACE_TSC
+            return __rdtsc();
+#else
+            return static_cast<uint64_t>(SteadyNs());
+#endif
+        }
+
+        /* Trace one connection in every n, 0 turns tracing off. */
+        static void SetSampling(uint64_t n) {
+            sample_every_.store(n, std::memory_order_relaxed);
+            Origin();
+        }
+
+        static uint64_t Sampling() {
+            return sample_every_.load(std::memory_order_relaxed);
+        }
+
+        /* A trace id for a new connection, 0 when it is not sampled. */
+        static uint64_t Sample() {
+            Origin();
+            auto every = sample_every_.load(std::memory_order_relaxed);
+            if (every == 0) {
+                return 0;
+            }
+            auto n = next_trace_.fetch_add(1, std::memory_order_relaxed);
+            return n % every == 0 ? n / every + 1 : 0;
+        }
+
+        /* Record a span of a traced connection, nothing for trace 0. */
+        static void Span(uint64_t trace, const char* name, const char* category, uint64_t begin, uint64_t end) {
+            if (trace != 0) {
+                Local().push({name, category, trace, begin, end});
+            }
+        }
+
+        /* The recorded spans as Chrome trace event JSON, which chrome://tracing and Perfetto open. Every connection is a
+         * track of its own, the thread that recorded a span is in its arguments. */
+        static std::string Export() {
+            auto& origin = Origin();
+            auto ticks = Now() - origin.ticks;
+            auto ns = SteadyNs() - origin.ns;
+            double ns_per_tick = ticks == 0 || ns <= 0 ? 1.0 : static_cast<double>(ns) / static_cast<double>(ticks);
+            auto micros = [&](uint64_t tick) {
+                return static_cast<double>(static_cast<int64_t>(tick - origin.ticks)) * ns_per_tick / 1000;
+            };
+            std::string out = "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+            bool first = true;
+            std::lock_guard lock(Lock());
+            for (auto& ring : Rings()) {
+                ring->for_each([&](const trace_span_t& span) {
+                    if (span.name == nullptr || span.end < span.begin) {
+                        return;
+                    }
+                    out.append(first ? "\n" : ",\n");
+                    first = false;
+                    out.append(std::format(R"({{"name":"{}","cat":"{}","ph":"X","pid":1,"tid":{},"ts":{:.3f},"dur":{:.3f},"args":{{"thread":{}}}}})",
+                                           span.name, span.category, span.trace, micros(span.begin),
+                                           static_cast<double>(span.end - span.begin) * ns_per_tick / 1000, ring->thread()));
+                });
+            }
+            out.append("\n]}");
+            return out;
+        }
+    };
+}
\ No newline at end of file
@@ -0,0 +1,155 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include "./socket.h"
+#include "../metrics/metrics.h"
+#include "../log/logger.h"
+
+namespace Nexus::Net {
+    /*
+     * Admission decides whether a listener accepts another connection. Each listener has a limit of its own and all of
+     * them share a process-wide one. At the limit the listener stops polling for reads and new connections wait in the
+     * kernel backlog until some close. When accept fails because the process ran out of socket handles, a reserved spare
+     * handle is given up for a moment to accept the pending connection and close it at once. The client then gets a
+     * reset, and the listener does not stay readable with an accept that fails forever.
+     * */
+    class Admission {
+    public:
+        // How long a listener stays paused after the process ran out of handles, in milliseconds
+        static constexpr uint64_t exhaustion_backoff = 100;
+    private:
+        inline static std::atomic<uint64_t> global_limit_ {16384};
+        inline static std::atomic<uint64_t> global_open_ {0};
+        inline static Nexus::Metrics::Counter shed_ {"nexus_connections_shed_total", "Connections closed right after accept because handles ran out"};
+        inline static Nexus::Metrics::Counter paused_total_ {"nexus_listener_pauses_total", "Times a listener stopped accepting at its connection limit"};
+        // Zero is no limit of the listener's own
+        uint64_t limit_ {0};
+        std::atomic<uint64_t> open_ {0};
+        bool paused_ {false};
+        uint64_t backoff_until_ {0};
+
+        static std::mutex& SpareLock() {
+            static std::mutex mtx;
+            return mtx;
+        }
+
+        static io_handle_t& Spare() {
+            static io_handle_t spare = INVALID_SOCKET;
+            return spare;
+        }
+
+        static void ReserveSpare() {
+            if (Spare() == INVALID_SOCKET) {
+                Spare() = ::socket(AF_INET, SOCK_STREAM, 0);
+            }
+        }
+
+        /* Accept the pending connection with the spare handle and drop it. */
+        static void Shed(Socket& listener) {
+            std::lock_guard lock(SpareLock());
+            if (Spare() != INVALID_SOCKET) {
+                CloseSocket(Spare());
+                Spare() = INVALID_SOCKET;
+            }
+            Socket client = listener.accept();
+            if (!client.invalid()) {
+                client.close();
+                shed_.inc();
+            }
+            ReserveSpare();
+        }
+    public:
+        Admission() {
+            std::lock_guard lock(SpareLock());
+            ReserveSpare();
+        }
+
+        /* Connections all listeners together may hold, 0 lifts the limit. */
+        static void SetGlobalLimit(uint64_t limit) {
+            global_limit_.store(limit == 0 ? UINT64_MAX : limit, std::memory_order_relaxed);
+        }
+
+        static uint64_t GlobalOpen() {
+            return global_open_.load(std::memory_order_relaxed);
+        }
+
+        /* Connections this listener may hold, 0 leaves only the global limit. */
+        void set_limit(uint64_t limit) {
+            limit_ = limit;
+        }
+
+        /* Take a slot for a new connection, false at either limit. */
+        bool admit() {
+            if (limit_ != 0 && open_.load(std::memory_order_relaxed) >= limit_) {
+                return false;
+            }
+            if (global_open_.fetch_add(1, std::memory_order_relaxed) >= global_limit_.load(std::memory_order_relaxed)) {
+                global_open_.fetch_sub(1, std::memory_order_relaxed);
+                return false;
+            }
+            open_.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+
+        /* Give back the slot of a connection that closed. */
+        void release() {
+            open_.fetch_sub(1, std::memory_order_relaxed);
+            global_open_.fetch_sub(1, std::memory_order_relaxed);
+        }
+
+        /* Whether admit() would fail. */
+        bool saturated() {
+            return (limit_ != 0 && open_.load(std::memory_order_relaxed) >= limit_)
+                   || global_open_.load(std::memory_order_relaxed) >= global_limit_.load(std::memory_order_relaxed);
+        }
+
+        /* Accept a pending connection within the limits, now is in milliseconds. The socket is invalid when there was none,
+         * a limit was reached or the process ran out of handles, which sheds the pending connection. */
+        Socket accept(Socket& listener, uint64_t now) {
+            if (!admit()) {
+                return Socket {SockType::INVALID};
+            }
+            Socket client = listener.accept();
+            if (!client.invalid()) {
+                return client;
+            }
+            release();
+            auto err = GetLastNetworkError();
+            if (err == WSAEMFILE || err == WSAENOBUFS) {
+                LWARN("Out of socket handles with {} connections open, shedding a pending connection. Errno: {}", GlobalOpen(), err);
+                Shed(listener);
+                backoff_until_ = now + exhaustion_backoff;
+            }
+            return client;
+        }
+
+        /* Whether the listener should stop polling for reads now. */
+        bool pause(uint64_t now) {
+            if (!paused_ && (saturated() || now < backoff_until_)) {
+                paused_ = true;
+                paused_total_.inc();
+                return true;
+            }
+            return false;
+        }
+
+        /* Whether a paused listener can poll for reads again. */
+        bool resume(uint64_t now) {
+            if (paused_ && !saturated() && now >= backoff_until_) {
+                paused_ = false;
+                return true;
+            }
+            return false;
+        }
+
+        bool paused() {
+            return paused_;
+        }
+
+        uint64_t open() {
+            return open_.load(std::memory_order_relaxed);
+        }
+    };
+}
\ No newline at end of file
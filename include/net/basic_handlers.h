@@ -8,4 +8,31 @@ public:
     ~statistics_handler() = default;
     static http_response doGet(const get_request& gr);
     static http_response doPost(const post_request& pr);
+};
+
+// Every metric in the Prometheus text format, see include/metrics/metrics.h
+class metrics_handler {
+public:
+    metrics_handler() = default;
+    ~metrics_handler() = default;
+    static http_response doGet(const get_request& gr);
+    static http_response doPost(const post_request& pr);
+};
+
+// Spans of the sampled connections as Chrome trace JSON, see include/metrics/trace.h
+class trace_handler {
+public:
+    trace_handler() = default;
+    ~trace_handler() = default;
+    static http_response doGet(const get_request& gr);
+    static http_response doPost(const post_request& pr);
+};
+
+// Live and peak bytes, allocations and frees of every memory account and how the arena is set up, see include/mem/tracking.h
+class memory_handler {
+public:
+    memory_handler() = default;
+    ~memory_handler() = default;
+    static http_response doGet(const get_request& gr);
+    static http_response doPost(const post_request& pr);
 };
\ No newline at end of file
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <concepts>
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include "../mem/ref.h"
+
+namespace Nexus::Net {
+    /*
+     * ConnectionPool keeps finished connections of a listener for the next clients it accepts, so connection churn does not
+     * build and tear down the buffers, parser and lock of a connection every time. A released connection is retired until
+     * the work group let go of it, then recycle() drops what its last client left and trims what that client grew, and
+     * acquire() hands it out again through reuse() with the arguments a new one is constructed from. Only the thread
+     * running the listener loop may use the pool.
+     * */
+    template<typename C> requires std::derived_from<C, Nexus::Base::RefCounted>
+    class ConnectionPool {
+    public:
+        // Idle connections kept, more are freed
+        static constexpr uint64_t max_idle = 256;
+    private:
+        std::vector<Nexus::Base::Ref<C>> idle_;
+        // Released but possibly still held by a drive posted to the work group
+        std::vector<Nexus::Base::Ref<C>> retired_;
+    public:
+        template<typename... Args>
+        Nexus::Base::Ref<C> acquire(Args&&... args) {
+            collect();
+            if (idle_.empty()) {
+                return Nexus::Base::Ref<C>::Make(std::forward<Args>(args)...);
+            }
+            auto conn = std::move(idle_.back());
+            idle_.pop_back();
+            conn->reuse(std::forward<Args>(args)...);
+            return conn;
+        }
+
+        /* Hand back a finished connection, cleanup() has to be done with it. */
+        void release(Nexus::Base::Ref<C> conn) {
+            retired_.push_back(std::move(conn));
+        }
+
+        /* Recycle the retired connections nobody else holds any more. */
+        void collect() {
+            for (uint64_t i = 0; i < retired_.size(); ) {
+                // Nothing new takes a reference to a retired connection, once this is the last one it stays the last one
+                if (retired_[i]->refs() != 1) {
+                    ++i;
+                    continue;
+                }
+                if (idle_.size() < max_idle) {
+                    retired_[i]->recycle();
+                    idle_.push_back(std::move(retired_[i]));
+                }
+                if (i + 1 != retired_.size()) {
+                    retired_[i] = std::move(retired_.back());
+                }
+                retired_.pop_back();
+            }
+        }
+
+        uint64_t idle() const {
+            return idle_.size();
+        }
+
+        void clear() {
+            idle_.clear();
+            retired_.clear();
+        }
+    };
+}
\ No newline at end of file
@@ -0,0 +1,214 @@
+#pragma once
+
+#include <algorithm>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace Nexus::Net {
+    // One encoded event, shared read-only by every subscriber it was queued to
+    using event_ptr = std::shared_ptr<const std::string>;
+
+    /*
+     * EventSubscriber is the send queue of one text/event-stream connection. Publishers push references to encoded events,
+     * the connection gathers the front of the queue into one vectored send and pops what went out. Nothing is copied per
+     * subscriber, and a parked subscriber holds only the references queued to it.
+     * */
+    class EventSubscriber {
+    public:
+        // A subscriber further behind than this is dropped instead of buffering without bound
+        static constexpr uint64_t max_queued = 1 << 20;
+    private:
+        std::mutex mtx_;
+        std::deque<event_ptr> queue_;
+        // Bytes of the front event already sent
+        uint64_t offset_ {0};
+        uint64_t queued_ {0};
+        bool overflowed_ {false};
+    public:
+        /* Queue an event, false once the subscriber fell too far behind. */
+        bool push(const event_ptr& event) {
+            std::lock_guard lock(mtx_);
+            if (overflowed_ || queued_ + event->size() > max_queued) {
+                overflowed_ = true;
+                return false;
+            }
+            queued_ += event->size();
+            queue_.push_back(event);
+            return true;
+        }
+
+        /* Views of up to max unsent events in order, the first one past what was already sent. They stay valid until
+         * sent() pops their events, which only the owning connection does. */
+        uint64_t gather(std::string_view* views, uint64_t max) {
+            std::lock_guard lock(mtx_);
+            uint64_t n = 0;
+            for (auto it = queue_.begin(); it != queue_.end() && n < max; ++it, ++n) {
+                views[n] = std::string_view(**it).substr(n == 0 ? offset_ : 0);
+            }
+            return n;
+        }
+
+        /* Pop n bytes worth of events from the front, the last one may be partly sent. */
+        void sent(uint64_t n) {
+            std::lock_guard lock(mtx_);
+            queued_ -= n;
+            while (n > 0) {
+                uint64_t left = queue_.front()->size() - offset_;
+                if (n < left) {
+                    offset_ += n;
+                    return;
+                }
+                n -= left;
+                offset_ = 0;
+                queue_.pop_front();
+            }
+        }
+
+        bool overflowed() {
+            std::lock_guard lock(mtx_);
+            return overflowed_;
+        }
+    };
+
+    /*
+     * EventBroker keeps the topics handlers publish to. Publishing encodes the event once and queues the same buffer to
+     * every live subscriber of the topic, so a broadcast costs one reference per subscriber plus the bytes on the wire.
+     * Subscribers are held weakly and pruned when their connection is gone.
+     * */
+    class EventBroker {
+    public:
+        // Idle streams get a comment line this often, in milliseconds, so proxies and dead peers are noticed
+        static constexpr uint64_t heartbeat_interval = 15000;
+        // A stream that got nothing out for this long, heartbeats included, has a dead peer that stopped reading
+        static constexpr uint64_t stream_timeout = heartbeat_interval * 3;
+    private:
+        struct topic_t {
+            std::mutex mtx;
+            std::vector<std::weak_ptr<EventSubscriber>> subscribers;
+            uint64_t next_id {1};
+            // Subscribing prunes the subscribers that are gone once there are this many, so topics that seldom publish
+            // do not collect every connection that ever came by
+            uint64_t prune_at {16};
+        };
+
+        static std::shared_mutex& Lock() {
+            static std::shared_mutex mtx;
+            return mtx;
+        }
+
+        static std::unordered_map<std::string, std::unique_ptr<topic_t>>& Topics() {
+            static std::unordered_map<std::string, std::unique_ptr<topic_t>> topics;
+            return topics;
+        }
+
+        /* Find a topic, creating it when create is set. Topics live as long as the process. */
+        static topic_t* Find(const std::string& name, bool create) {
+            {
+                std::shared_lock lock(Lock());
+                if (auto it = Topics().find(name); it != Topics().end()) {
+                    return it->second.get();
+                }
+            }
+            if (!create) {
+                return nullptr;
+            }
+            std::unique_lock lock(Lock());
+            auto& topic = Topics()[name];
+            if (!topic) {
+                topic = std::make_unique<topic_t>();
+            }
+            return topic.get();
+        }
+    public:
+        /* Encode an event in the text/event-stream format, every line of data becomes a data field. */
+        static event_ptr Encode(std::string_view event, std::string_view data, uint64_t id) {
+            std::string out;
+            out.reserve(data.size() + event.size() + 32);
+            if (!event.empty()) {
+                out.append("event: ");
+                // A line break would end the field early
+                out.append(event.substr(0, event.find_first_of("\r\n")));
+                out.push_back('\n');
+            }
+            if (id != 0) {
+                out.append("id: ");
+                out.append(std::to_string(id));
+                out.push_back('\n');
+            }
+            while (true) {
+                auto eol = data.find('\n');
+                auto line = data.substr(0, eol);
+                if (!line.empty() && line.back() == '\r') {
+                    line.remove_suffix(1);
+                }
+                out.append("data: ");
+                out.append(line);
+                out.push_back('\n');
+                if (eol == std::string_view::npos) {
+                    break;
+                }
+                data.remove_prefix(eol + 1);
+            }
+            out.push_back('\n');
+            return std::make_shared<const std::string>(std::move(out));
+        }
+
+        /* The comment sent on idle streams. */
+        static const event_ptr& Heartbeat() {
+            static const event_ptr heartbeat = std::make_shared<const std::string>(":\n\n");
+            return heartbeat;
+        }
+
+        static void Subscribe(const std::string& topic, const std::shared_ptr<EventSubscriber>& subscriber) {
+            auto t = Find(topic, true);
+            std::lock_guard lock(t->mtx);
+            auto& subscribers = t->subscribers;
+            if (subscribers.size() >= t->prune_at) {
+                std::erase_if(subscribers, [](const std::weak_ptr<EventSubscriber>& s) { return s.expired(); });
+                // Twice what is left keeps pruning amortized constant per subscribe
+                t->prune_at = std::max<uint64_t>(16, subscribers.size() * 2);
+            }
+            subscribers.emplace_back(subscriber);
+        }
+
+        /* Publish data to every subscriber of topic, returns how many it was queued to. Subscribers that are gone or
+         * fell behind are removed on the way. */
+        static uint64_t Publish(const std::string& topic, std::string_view data, std::string_view event = {}) {
+            auto t = Find(topic, false);
+            if (t == nullptr) {
+                return 0;
+            }
+            std::lock_guard lock(t->mtx);
+            auto encoded = Encode(event, data, t->next_id++);
+            uint64_t reached = 0;
+            auto& subscribers = t->subscribers;
+            for (uint64_t i = 0; i < subscribers.size(); ) {
+                auto subscriber = subscribers[i].lock();
+                if (subscriber && subscriber->push(encoded)) {
+                    ++reached;
+                    ++i;
+                    continue;
+                }
+                subscribers[i] = std::move(subscribers.back());
+                subscribers.pop_back();
+            }
+            return reached;
+        }
+
+        /* Subscribers of topic, as of the last publish or prune. */
+        static uint64_t Subscribers(const std::string& topic) {
+            auto t = Find(topic, false);
+            if (t == nullptr) {
+                return 0;
+            }
+            std::lock_guard lock(t->mtx);
+            return t->subscribers.size();
+        }
+    };
+}
\ No newline at end of file
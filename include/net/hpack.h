@@ -0,0 +1,416 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace Nexus::Net {
+    using hpack_field_t = std::pair<std::string, std::string>;
+
+    /*
+     * Huffman implements the static Huffman code of HPACK (RFC 7541 appendix B). Decoding walks a binary tree that is built
+     * once from the code table.
+     * */
+    class Huffman {
+    private:
+        static constexpr uint32_t eos_code = 0x3fffffff;
+        static constexpr uint8_t eos_len = 30;
+        static constexpr uint32_t codes_[256] = {
+            0x1ff8, 0x7fffd8, 0xfffffe2, 0xfffffe3, 0xfffffe4, 0xfffffe5, 0xfffffe6, 0xfffffe7,
+            0xfffffe8, 0xffffea, 0x3ffffffc, 0xfffffe9, 0xfffffea, 0x3ffffffd, 0xfffffeb, 0xfffffec,
+            0xfffffed, 0xfffffee, 0xfffffef, 0xffffff0, 0xffffff1, 0xffffff2, 0x3ffffffe, 0xffffff3,
+            0xffffff4, 0xffffff5, 0xffffff6, 0xffffff7, 0xffffff8, 0xffffff9, 0xffffffa, 0xffffffb,
+            0x14, 0x3f8, 0x3f9, 0xffa, 0x1ff9, 0x15, 0xf8, 0x7fa,
+            0x3fa, 0x3fb, 0xf9, 0x7fb, 0xfa, 0x16, 0x17, 0x18,
+            0x0, 0x1, 0x2, 0x19, 0x1a, 0x1b, 0x1c, 0x1d,
+            0x1e, 0x1f, 0x5c, 0xfb, 0x7ffc, 0x20, 0xffb, 0x3fc,
+            0x1ffa, 0x21, 0x5d, 0x5e, 0x5f, 0x60, 0x61, 0x62,
+            0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69, 0x6a,
+            0x6b, 0x6c, 0x6d, 0x6e, 0x6f, 0x70, 0x71, 0x72,
+            0xfc, 0x73, 0xfd, 0x1ffb, 0x7fff0, 0x1ffc, 0x3ffc, 0x22,
+            0x7ffd, 0x3, 0x23, 0x4, 0x24, 0x5, 0x25, 0x26,
+            0x27, 0x6, 0x74, 0x75, 0x28, 0x29, 0x2a, 0x7,
+            0x2b, 0x76, 0x2c, 0x8, 0x9, 0x2d, 0x77, 0x78,
+            0x79, 0x7a, 0x7b, 0x7ffe, 0x7fc, 0x3ffd, 0x1ffd, 0xffffffc,
+            0xfffe6, 0x3fffd2, 0xfffe7, 0xfffe8, 0x3fffd3, 0x3fffd4, 0x3fffd5, 0x7fffd9,
+            0x3fffd6, 0x7fffda, 0x7fffdb, 0x7fffdc, 0x7fffdd, 0x7fffde, 0xffffeb, 0x7fffdf,
+            0xffffec, 0xffffed, 0x3fffd7, 0x7fffe0, 0xffffee, 0x7fffe1, 0x7fffe2, 0x7fffe3,
+            0x7fffe4, 0x1fffdc, 0x3fffd8, 0x7fffe5, 0x3fffd9, 0x7fffe6, 0x7fffe7, 0xffffef,
+            0x3fffda, 0x1fffdd, 0xfffe9, 0x3fffdb, 0x3fffdc, 0x7fffe8, 0x7fffe9, 0x1fffde,
+            0x7fffea, 0x3fffdd, 0x3fffde, 0xfffff0, 0x1fffdf, 0x3fffdf, 0x7fffeb, 0x7fffec,
+            0x1fffe0, 0x1fffe1, 0x3fffe0, 0x1fffe2, 0x7fffed, 0x3fffe1, 0x7fffee, 0x7fffef,
+            0xfffea, 0x3fffe2, 0x3fffe3, 0x3fffe4, 0x7ffff0, 0x3fffe5, 0x3fffe6, 0x7ffff1,
+            0x3ffffe0, 0x3ffffe1, 0xfffeb, 0x7fff1, 0x3fffe7, 0x7ffff2, 0x3fffe8, 0x1ffffec,
+            0x3ffffe2, 0x3ffffe3, 0x3ffffe4, 0x7ffffde, 0x7ffffdf, 0x3ffffe5, 0xfffff1, 0x1ffffed,
+            0x7fff2, 0x1fffe3, 0x3ffffe6, 0x7ffffe0, 0x7ffffe1, 0x3ffffe7, 0x7ffffe2, 0xfffff2,
+            0x1fffe4, 0x1fffe5, 0x3ffffe8, 0x3ffffe9, 0xffffffd, 0x7ffffe3, 0x7ffffe4, 0x7ffffe5,
+            0xfffec, 0xfffff3, 0xfffed, 0x1fffe6, 0x3fffe9, 0x1fffe7, 0x1fffe8, 0x7ffff3,
+            0x3fffea, 0x3fffeb, 0x1ffffee, 0x1ffffef, 0xfffff4, 0xfffff5, 0x3ffffea, 0x7ffff4,
+            0x3ffffeb, 0x7ffffe6, 0x3ffffec, 0x3ffffed, 0x7ffffe7, 0x7ffffe8, 0x7ffffe9, 0x7ffffea,
+            0x7ffffeb, 0xffffffe, 0x7ffffec, 0x7ffffed, 0x7ffffee, 0x7ffffef, 0x7fffff0, 0x3ffffee,
+        };
+        static constexpr uint8_t lens_[256] = {
+            13, 23, 28, 28, 28, 28, 28, 28, 28, 24, 30, 28, 28, 30, 28, 28,
+            28, 28, 28, 28, 28, 28, 30, 28, 28, 28, 28, 28, 28, 28, 28, 28,
+            6, 10, 10, 12, 13, 6, 8, 11, 10, 10, 8, 11, 8, 6, 6, 6,
+            5, 5, 5, 6, 6, 6, 6, 6, 6, 6, 7, 8, 15, 6, 12, 10,
+            13, 6, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+            7, 7, 7, 7, 7, 7, 7, 7, 8, 7, 8, 13, 19, 13, 14, 6,
+            15, 5, 6, 5, 6, 5, 6, 6, 6, 5, 7, 7, 6, 6, 6, 5,
+            6, 7, 6, 5, 5, 6, 7, 7, 7, 7, 7, 15, 11, 14, 13, 28,
+            20, 22, 20, 20, 22, 22, 22, 23, 22, 23, 23, 23, 23, 23, 24, 23,
+            24, 24, 22, 23, 24, 23, 23, 23, 23, 21, 22, 23, 22, 23, 23, 24,
+            22, 21, 20, 22, 22, 23, 23, 21, 23, 22, 22, 24, 21, 22, 23, 23,
+            21, 21, 22, 21, 23, 22, 23, 23, 20, 22, 22, 22, 23, 22, 22, 23,
+            26, 26, 20, 19, 22, 23, 22, 25, 26, 26, 26, 27, 27, 26, 24, 25,
+            19, 21, 26, 27, 27, 26, 27, 24, 21, 21, 26, 26, 28, 27, 27, 27,
+            20, 24, 20, 21, 22, 21, 21, 23, 22, 22, 25, 25, 24, 24, 26, 23,
+            26, 27, 26, 26, 27, 27, 27, 27, 27, 28, 27, 27, 27, 27, 27, 26,
+        };
+        struct node_t {
+            int32_t child[2] {-1, -1};
+            int32_t sym {-1};
+        };
+
+        static const std::vector<node_t>& Tree() {
+            static const std::vector<node_t> tree = []() {
+                std::vector<node_t> t(1);
+                auto insert = [&t](uint32_t code, uint8_t len, int32_t sym) {
+                    int32_t n = 0;
+                    for (int i = len - 1; i >= 0; --i) {
+                        int bit = (code >> i) & 1;
+                        if (t[n].child[bit] < 0) {
+                            t[n].child[bit] = static_cast<int32_t>(t.size());
+                            t.emplace_back();
+                        }
+                        n = t[n].child[bit];
+                    }
+                    t[n].sym = sym;
+                };
+                for (int32_t s = 0; s < 256; ++s) {
+                    insert(codes_[s], lens_[s], s);
+                }
+                insert(eos_code, eos_len, 256);
+                return t;
+            }();
+            return tree;
+        }
+    public:
+        static uint64_t EncodedLength(std::string_view str) {
+            uint64_t bits = 0;
+            for (unsigned char c : str) {
+                bits += lens_[c];
+            }
+            return (bits + 7) / 8;
+        }
+
+        static void Encode(std::string_view str, std::string& out) {
+            uint64_t acc = 0;
+            uint32_t bits = 0;
+            for (unsigned char c : str) {
+                acc = (acc << lens_[c]) | codes_[c];
+                bits += lens_[c];
+                while (bits >= 8) {
+                    bits -= 8;
+                    out.push_back(static_cast<char>(acc >> bits));
+                }
+            }
+            if (bits > 0) {
+                // Pad with the most significant bits of EOS, which are all ones
+                out.push_back(static_cast<char>((acc << (8 - bits)) | (0xff >> bits)));
+            }
+        }
+
+        /* Decode a Huffman string, false when it contains EOS or is padded with anything but a short run of ones. */
+        static bool Decode(const uint8_t* data, uint64_t len, std::string& out) {
+            auto& tree = Tree();
+            int32_t n = 0;
+            uint32_t depth = 0;
+            bool ones = true;
+            for (uint64_t i = 0; i < len; ++i) {
+                for (int b = 7; b >= 0; --b) {
+                    int bit = (data[i] >> b) & 1;
+                    n = tree[n].child[bit];
+                    if (n < 0) return false;
+                    ++depth;
+                    ones = ones && bit;
+                    if (tree[n].sym >= 0) {
+                        if (tree[n].sym == 256) return false;
+                        out.push_back(static_cast<char>(tree[n].sym));
+                        n = 0;
+                        depth = 0;
+                        ones = true;
+                    }
+                }
+            }
+            return depth <= 7 && ones;
+        }
+    };
+
+    /*
+     * HpackTable is the HPACK header table (RFC 7541 section 2.3): the static table followed by a dynamic table with FIFO
+     * eviction. Indices start at 1, dynamic entries follow the static ones with the newest first.
+     * */
+    class HpackTable {
+    public:
+        static constexpr uint64_t static_length = 61;
+        static constexpr uint64_t entry_overhead = 32;
+    private:
+        std::deque<hpack_field_t> dynamic_;
+        uint64_t size_ {0};
+        uint64_t capacity_;
+
+        static const std::array<hpack_field_t, static_length>& Static() {
+            static const std::array<hpack_field_t, static_length> table {{
+                {":authority", ""}, {":method", "GET"}, {":method", "POST"}, {":path", "/"}, {":path", "/index.html"},
+                {":scheme", "http"}, {":scheme", "https"}, {":status", "200"}, {":status", "204"}, {":status", "206"},
+                {":status", "304"}, {":status", "400"}, {":status", "404"}, {":status", "500"}, {"accept-charset", ""},
+                {"accept-encoding", "gzip, deflate"}, {"accept-language", ""}, {"accept-ranges", ""}, {"accept", ""},
+                {"access-control-allow-origin", ""}, {"age", ""}, {"allow", ""}, {"authorization", ""}, {"cache-control", ""},
+                {"content-disposition", ""}, {"content-encoding", ""}, {"content-language", ""}, {"content-length", ""},
+                {"content-location", ""}, {"content-range", ""}, {"content-type", ""}, {"cookie", ""}, {"date", ""},
+                {"etag", ""}, {"expect", ""}, {"expires", ""}, {"from", ""}, {"host", ""}, {"if-match", ""},
+                {"if-modified-since", ""}, {"if-none-match", ""}, {"if-range", ""}, {"if-unmodified-since", ""},
+                {"last-modified", ""}, {"link", ""}, {"location", ""}, {"max-forwards", ""}, {"proxy-authenticate", ""},
+                {"proxy-authorization", ""}, {"range", ""}, {"referer", ""}, {"refresh", ""}, {"retry-after", ""},
+                {"server", ""}, {"set-cookie", ""}, {"strict-transport-security", ""}, {"transfer-encoding", ""},
+                {"user-agent", ""}, {"vary", ""}, {"via", ""}, {"www-authenticate", ""}
+            }};
+            return table;
+        }
+
+        void evict(uint64_t room) {
+            while (!dynamic_.empty() && size_ + room > capacity_) {
+                size_ -= EntrySize(dynamic_.back().first, dynamic_.back().second);
+                dynamic_.pop_back();
+            }
+        }
+    public:
+        explicit HpackTable(uint64_t capacity = 4096) : capacity_(capacity) {}
+
+        static uint64_t EntrySize(std::string_view name, std::string_view value) {
+            return name.size() + value.size() + entry_overhead;
+        }
+
+        /* The field at index, nullptr when the index is out of range. */
+        const hpack_field_t* get(uint64_t index) const {
+            if (index == 0) return nullptr;
+            if (index <= static_length) return &Static()[index - 1];
+            index -= static_length + 1;
+            return index < dynamic_.size() ? &dynamic_[index] : nullptr;
+        }
+
+        /* Index of a matching field or of a field with the same name (second is false then), 0 when there is neither. */
+        std::pair<uint64_t, bool> find(std::string_view name, std::string_view value) const {
+            uint64_t name_match = 0;
+            for (uint64_t i = 0; i < static_length; ++i) {
+                if (Static()[i].first == name) {
+                    if (Static()[i].second == value) return {i + 1, true};
+                    if (name_match == 0) name_match = i + 1;
+                }
+            }
+            for (uint64_t i = 0; i < dynamic_.size(); ++i) {
+                if (dynamic_[i].first == name) {
+                    if (dynamic_[i].second == value) return {static_length + i + 1, true};
+                    if (name_match == 0) name_match = static_length + i + 1;
+                }
+            }
+            return {name_match, false};
+        }
+
+        /* Insert a field, an entry larger than the whole table just empties it. */
+        void insert(std::string name, std::string value) {
+            auto sz = EntrySize(name, value);
+            evict(sz);
+            if (sz > capacity_) return;
+            size_ += sz;
+            dynamic_.emplace_front(std::move(name), std::move(value));
+        }
+
+        void resize(uint64_t capacity) {
+            capacity_ = capacity;
+            evict(0);
+        }
+
+        uint64_t capacity() const {
+            return capacity_;
+        }
+
+        uint64_t size() const {
+            return size_;
+        }
+
+        uint64_t length() const {
+            return dynamic_.size();
+        }
+    };
+
+    /*
+     * HpackDecoder turns header blocks into fields. The dynamic table persists across blocks of one connection, so blocks have
+     * to be decoded in the order they arrived.
+     * */
+    class HpackDecoder {
+    private:
+        HpackTable table_;
+        // The table size we announced, updates from the encoder may not exceed it
+        uint64_t max_capacity_;
+
+    public:
+        static bool DecodeInteger(const uint8_t*& p, const uint8_t* end, uint8_t prefix, uint64_t& value) {
+            if (p == end) return false;
+            uint8_t mask = static_cast<uint8_t>((1u << prefix) - 1);
+            value = *p++ & mask;
+            if (value < mask) return true;
+            for (uint32_t shift = 0; p != end; shift += 7) {
+                if (shift > 56) return false;
+                uint8_t b = *p++;
+                value += static_cast<uint64_t>(b & 0x7f) << shift;
+                if ((b & 0x80) == 0) return true;
+            }
+            return false;
+        }
+
+        /* Decode a string literal whose length has a prefix bits wide integer, the Huffman flag is the bit above it. */
+        static bool DecodeString(const uint8_t*& p, const uint8_t* end, std::string& out, uint8_t prefix = 7) {
+            if (p == end) return false;
+            bool huffman = (*p & (1u << prefix)) != 0;
+            uint64_t len;
+            if (!DecodeInteger(p, end, prefix, len) || len > static_cast<uint64_t>(end - p)) return false;
+            out.clear();
+            if (huffman) {
+                if (!Huffman::Decode(p, len, out)) return false;
+            } else {
+                out.assign(reinterpret_cast<const char*>(p), len);
+            }
+            p += len;
+            return true;
+        }
+
+        explicit HpackDecoder(uint64_t max_capacity = 4096) : table_(max_capacity), max_capacity_(max_capacity) {}
+
+        /* Decode a complete header block into fields, false on a compression error, which is fatal for the connection. */
+        bool decode(const uint8_t* data, uint64_t len, std::vector<hpack_field_t>& fields) {
+            const uint8_t* p = data;
+            const uint8_t* end = data + len;
+            bool leading = true;
+            while (p != end) {
+                uint8_t b = *p;
+                uint64_t index;
+                if (b & 0x80) {
+                    // Indexed field
+                    if (!DecodeInteger(p, end, 7, index)) return false;
+                    auto f = table_.get(index);
+                    if (f == nullptr) return false;
+                    fields.push_back(*f);
+                } else if ((b & 0xe0) == 0x20) {
+                    // Dynamic table size update, only allowed before the first field
+                    if (!leading || !DecodeInteger(p, end, 5, index) || index > max_capacity_) return false;
+                    table_.resize(index);
+                    continue;
+                } else {
+                    // Literal field, with incremental indexing (01), without indexing (0000) or never indexed (0001)
+                    bool indexing = (b & 0xc0) == 0x40;
+                    if (!DecodeInteger(p, end, indexing ? 6 : 4, index)) return false;
+                    hpack_field_t f;
+                    if (index == 0) {
+                        if (!DecodeString(p, end, f.first)) return false;
+                    } else {
+                        auto named = table_.get(index);
+                        if (named == nullptr) return false;
+                        f.first = named->first;
+                    }
+                    if (!DecodeString(p, end, f.second)) return false;
+                    if (indexing) table_.insert(f.first, f.second);
+                    fields.push_back(std::move(f));
+                }
+                leading = false;
+            }
+            return true;
+        }
+
+        const HpackTable& table() const {
+            return table_;
+        }
+    };
+
+    /*
+     * HpackEncoder writes header blocks. Fields are looked up in the static and dynamic table, literals are added to the dynamic
+     * table unless their value is unlikely to repeat or is sensitive, and strings use Huffman coding when it is shorter.
+     * */
+    class HpackEncoder {
+    private:
+        HpackTable table_;
+        bool resized_ {false};
+
+    public:
+        static void EncodeInteger(std::string& out, uint8_t first, uint8_t prefix, uint64_t value) {
+            uint8_t mask = static_cast<uint8_t>((1u << prefix) - 1);
+            if (value < mask) {
+                out.push_back(static_cast<char>(first | value));
+                return;
+            }
+            out.push_back(static_cast<char>(first | mask));
+            value -= mask;
+            while (value >= 0x80) {
+                out.push_back(static_cast<char>((value & 0x7f) | 0x80));
+                value >>= 7;
+            }
+            out.push_back(static_cast<char>(value));
+        }
+
+        /* Write a string literal, first carries the representation bits above the Huffman flag. */
+        static void EncodeString(std::string& out, std::string_view str, uint8_t first = 0, uint8_t prefix = 7) {
+            auto hlen = Huffman::EncodedLength(str);
+            if (hlen < str.size()) {
+                EncodeInteger(out, first | static_cast<uint8_t>(1u << prefix), prefix, hlen);
+                Huffman::Encode(str, out);
+            } else {
+                EncodeInteger(out, first, prefix, str.size());
+                out.append(str);
+            }
+        }
+
+        explicit HpackEncoder(uint64_t capacity = 4096) : table_(capacity) {}
+
+        /* Follow the SETTINGS_HEADER_TABLE_SIZE of the peer, the change is announced at the start of the next block. */
+        void resize(uint64_t capacity) {
+            capacity = std::min<uint64_t>(capacity, 4096);
+            if (capacity != table_.capacity()) {
+                table_.resize(capacity);
+                resized_ = true;
+            }
+        }
+
+        /* Append one field to a header block. Names must already be lower case. */
+        void encode(std::string_view name, std::string_view value, std::string& out) {
+            if (resized_) {
+                EncodeInteger(out, 0x20, 5, table_.capacity());
+                resized_ = false;
+            }
+            auto [index, exact] = table_.find(name, value);
+            if (exact) {
+                EncodeInteger(out, 0x80, 7, index);
+                return;
+            }
+            bool sensitive = name == "authorization" || name == "set-cookie" || name == "cookie";
+            bool volatile_value = name == "content-length" || name == "date" || name == ":path";
+            if (sensitive || volatile_value) {
+                EncodeInteger(out, sensitive ? 0x10 : 0x00, 4, index);
+            } else {
+                EncodeInteger(out, 0x40, 6, index);
+                table_.insert(std::string(name), std::string(value));
+            }
+            if (index == 0) EncodeString(out, name);
+            EncodeString(out, value);
+        }
+
+        const HpackTable& table() const {
+            return table_;
+        }
+    };
+}
\ No newline at end of file
@@ -0,0 +1,578 @@
+#pragma once
+
+#include <algorithm>
+#include <map>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "./hpack.h"
+#include "./http_handler.h"
+#include "./http_exchange.h"
+#include "./rate_limit.h"
+#include "../base/def.h"
+#include "../mem/memory.h"
+#include "include/log/logger.h"
+
+namespace Nexus::Net {
+    enum class h2_frame_t : uint8_t {
+        DATA = 0x0,
+        HEADERS = 0x1,
+        PRIORITY = 0x2,
+        RST_STREAM = 0x3,
+        SETTINGS = 0x4,
+        PUSH_PROMISE = 0x5,
+        PING = 0x6,
+        GOAWAY = 0x7,
+        WINDOW_UPDATE = 0x8,
+        CONTINUATION = 0x9
+    };
+
+    enum class h2_error_t : uint32_t {
+        NONE = 0x0,
+        PROTOCOL = 0x1,
+        INTERNAL = 0x2,
+        FLOW_CONTROL = 0x3,
+        SETTINGS_TIMEOUT = 0x4,
+        STREAM_CLOSED = 0x5,
+        FRAME_SIZE = 0x6,
+        REFUSED_STREAM = 0x7,
+        CANCEL = 0x8,
+        COMPRESSION = 0x9,
+        CONNECT = 0xa,
+        ENHANCE_YOUR_CALM = 0xb,
+        INADEQUATE_SECURITY = 0xc,
+        HTTP_1_1_REQUIRED = 0xd
+    };
+
+    /*
+     * Http2Frame is the frame codec: a 9 byte header holding a 24 bit payload length, the type, the flags and a 31 bit stream
+     * identifier, followed by the payload (RFC 9113 section 4.1).
+     * */
+    struct Http2Frame {
+        static constexpr uint64_t header_size = 9;
+        static constexpr uint8_t END_STREAM = 0x1;
+        static constexpr uint8_t ACK = 0x1;
+        static constexpr uint8_t END_HEADERS = 0x4;
+        static constexpr uint8_t PADDED = 0x8;
+        static constexpr uint8_t PRIORITY = 0x20;
+        uint32_t length;
+        h2_frame_t type;
+        uint8_t flags;
+        uint32_t stream;
+
+        static uint32_t Read32(const uint8_t* p) {
+            return (static_cast<uint32_t>(p[0]) << 24) | (static_cast<uint32_t>(p[1]) << 16) | (static_cast<uint32_t>(p[2]) << 8) | p[3];
+        }
+
+        static void Write32(char* p, uint32_t v) {
+            p[0] = static_cast<char>(v >> 24);
+            p[1] = static_cast<char>(v >> 16);
+            p[2] = static_cast<char>(v >> 8);
+            p[3] = static_cast<char>(v);
+        }
+
+        static Http2Frame Parse(const uint8_t* p) {
+            return {
+                (static_cast<uint32_t>(p[0]) << 16) | (static_cast<uint32_t>(p[1]) << 8) | p[2],
+                static_cast<h2_frame_t>(p[3]),
+                p[4],
+                Read32(p + 5) & 0x7fffffff
+            };
+        }
+
+        /* Append a whole frame to a pool. */
+        template<typename P>
+        static void Write(P& out, h2_frame_t type, uint8_t flags, uint32_t stream, const char* payload, uint64_t len) {
+            char header[header_size] = {
+                static_cast<char>(len >> 16), static_cast<char>(len >> 8), static_cast<char>(len),
+                static_cast<char>(type), static_cast<char>(flags),
+                static_cast<char>((stream >> 24) & 0x7f), static_cast<char>(stream >> 16), static_cast<char>(stream >> 8), static_cast<char>(stream)
+            };
+            out.write(header, header_size);
+            if (len > 0) {
+                out.write(payload, len);
+            }
+        }
+    };
+
+    /*
+     * Http2Session is the HTTP/2 state of one connection, independent of the transport. Received bytes go in through feed(),
+     * frames to send come out of pull(). Requests of all streams are dispatched to the same handler table and ResourceLocator
+     * as HTTP/1.1, responses are interleaved frame by frame in round robin order within the flow control windows of the peer.
+     * */
+    class Http2Session {
+    public:
+        static constexpr std::string_view preface = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+        static constexpr int64_t default_window = 65535;
+        static constexpr int64_t max_window = 0x7fffffff;
+        static constexpr uint32_t max_frame_size = 16384;
+        static constexpr uint32_t max_concurrent_streams = 100;
+        // Bytes of frames produced by one pull, bounds the output buffer of the connection
+        static constexpr uint64_t pull_budget = 64 * 1024;
+    private:
+        struct stream_t {
+            uint32_t id;
+            bool local_done {false};
+            int64_t send_window {default_window};
+            int64_t recv_window {default_window};
+            // Received body bytes not yet returned to the peer with WINDOW_UPDATE
+            uint64_t unacked {0};
+            bool head_pending {true};
+            HttpExchange ex;
+            stream_t(uint32_t id_, std::unordered_map<std::string, HttpHandlerFunctionSet>& handlers) : id(id_), ex(handlers) {}
+        };
+
+        std::unordered_map<std::string, HttpHandlerFunctionSet>& handlers_;
+        std::string peer_;
+        // Rate limiter bucket of the peer, 0 is never limited
+        uint64_t client_;
+        std::string in_;
+        bool preface_done_ {false};
+        bool settings_done_ {false};
+        Nexus::Base::UniquePool<> control_;
+        HpackDecoder decoder_;
+        HpackEncoder encoder_;
+        std::map<uint32_t, stream_t> streams_;
+        uint32_t last_stream_ {0};
+        uint32_t last_served_ {0};
+        // Stream whose header block is still followed by CONTINUATION frames
+        uint32_t continuation_ {0};
+        bool continuation_end_stream_ {false};
+        std::string header_block_;
+        int64_t send_window_ {default_window};
+        int64_t recv_window_ {default_window};
+        uint64_t recv_unacked_ {0};
+        int64_t initial_window_ {default_window};
+        uint32_t peer_max_frame_ {16384};
+        bool goaway_ {false};
+        bool failed_ {false};
+
+        void window_update(uint32_t stream, uint32_t increment) {
+            char payload[4];
+            Http2Frame::Write32(payload, increment);
+            Http2Frame::Write(control_, h2_frame_t::WINDOW_UPDATE, 0, stream, payload, 4);
+        }
+
+        /* Reset a stream and forget it, the stream must not be used afterwards. */
+        void reset(uint32_t stream, h2_error_t err) {
+            char payload[4];
+            Http2Frame::Write32(payload, static_cast<uint32_t>(err));
+            Http2Frame::Write(control_, h2_frame_t::RST_STREAM, 0, stream, payload, 4);
+            streams_.erase(stream);
+        }
+
+        /* A connection error: announce it with GOAWAY and stop processing anything. */
+        bool fail(h2_error_t err, std::string_view reason) {
+            LWARN("HTTP/2 connection error with {}: {}", peer_, reason);
+            char payload[8];
+            Http2Frame::Write32(payload, last_stream_);
+            Http2Frame::Write32(payload + 4, static_cast<uint32_t>(err));
+            Http2Frame::Write(control_, h2_frame_t::GOAWAY, 0, 0, payload, 8);
+            streams_.clear();
+            failed_ = true;
+            goaway_ = true;
+            return false;
+        }
+
+        bool on_frame(const Http2Frame& f, const uint8_t* p) {
+            if (!settings_done_ && f.type != h2_frame_t::SETTINGS) {
+                return fail(h2_error_t::PROTOCOL, "connection preface not followed by SETTINGS");
+            }
+            if (continuation_ != 0 && (f.type != h2_frame_t::CONTINUATION || f.stream != continuation_)) {
+                return fail(h2_error_t::PROTOCOL, "header block interrupted");
+            }
+            switch (f.type) {
+                case h2_frame_t::DATA:
+                    return on_data(f, p);
+                case h2_frame_t::HEADERS:
+                    return on_headers(f, p);
+                case h2_frame_t::PRIORITY:
+                    if (f.stream == 0) return fail(h2_error_t::PROTOCOL, "PRIORITY on stream 0");
+                    if (f.length != 5) reset(f.stream, h2_error_t::FRAME_SIZE);
+                    return true;
+                case h2_frame_t::RST_STREAM:
+                    if (f.stream == 0 || f.stream > last_stream_) return fail(h2_error_t::PROTOCOL, "RST_STREAM on idle stream");
+                    if (f.length != 4) return fail(h2_error_t::FRAME_SIZE, "bad RST_STREAM length");
+                    streams_.erase(f.stream);
+                    return true;
+                case h2_frame_t::SETTINGS:
+                    return on_settings(f, p);
+                case h2_frame_t::PUSH_PROMISE:
+                    return fail(h2_error_t::PROTOCOL, "PUSH_PROMISE from client");
+                case h2_frame_t::PING:
+                    if (f.stream != 0) return fail(h2_error_t::PROTOCOL, "PING on a stream");
+                    if (f.length != 8) return fail(h2_error_t::FRAME_SIZE, "bad PING length");
+                    if ((f.flags & Http2Frame::ACK) == 0) {
+                        Http2Frame::Write(control_, h2_frame_t::PING, Http2Frame::ACK, 0, reinterpret_cast<const char*>(p), 8);
+                    }
+                    return true;
+                case h2_frame_t::GOAWAY:
+                    if (f.stream != 0) return fail(h2_error_t::PROTOCOL, "GOAWAY on a stream");
+                    // Finish the streams in flight, then close
+                    goaway_ = true;
+                    return true;
+                case h2_frame_t::WINDOW_UPDATE:
+                    return on_window_update(f, p);
+                case h2_frame_t::CONTINUATION:
+                    if (continuation_ == 0) return fail(h2_error_t::PROTOCOL, "unexpected CONTINUATION");
+                    header_block_.append(reinterpret_cast<const char*>(p), f.length);
+                    if (header_block_.size() > max_header_size) return fail(h2_error_t::ENHANCE_YOUR_CALM, "header block too large");
+                    return (f.flags & Http2Frame::END_HEADERS) ? end_headers() : true;
+                default:
+                    // Unknown frame types are ignored
+                    return true;
+            }
+        }
+
+        bool on_settings(const Http2Frame& f, const uint8_t* p) {
+            if (f.stream != 0) return fail(h2_error_t::PROTOCOL, "SETTINGS on a stream");
+            if (f.flags & Http2Frame::ACK) {
+                return f.length == 0 ? true : fail(h2_error_t::FRAME_SIZE, "SETTINGS ACK with payload");
+            }
+            if (f.length % 6 != 0) return fail(h2_error_t::FRAME_SIZE, "bad SETTINGS length");
+            for (uint32_t i = 0; i < f.length; i += 6) {
+                uint16_t id = static_cast<uint16_t>((p[i] << 8) | p[i + 1]);
+                uint32_t value = Http2Frame::Read32(p + i + 2);
+                switch (id) {
+                    case 0x1:
+                        encoder_.resize(value);
+                        break;
+                    case 0x2:
+                        if (value > 1) return fail(h2_error_t::PROTOCOL, "bad SETTINGS_ENABLE_PUSH");
+                        break;
+                    case 0x4: {
+                        if (value > max_window) return fail(h2_error_t::FLOW_CONTROL, "bad SETTINGS_INITIAL_WINDOW_SIZE");
+                        // The change applies to the windows of all open streams
+                        int64_t delta = static_cast<int64_t>(value) - initial_window_;
+                        for (auto& [id_, s] : streams_) {
+                            s.send_window += delta;
+                        }
+                        initial_window_ = value;
+                        break;
+                    }
+                    case 0x5:
+                        if (value < 16384 || value > 16777215) return fail(h2_error_t::PROTOCOL, "bad SETTINGS_MAX_FRAME_SIZE");
+                        peer_max_frame_ = value;
+                        break;
+                    default:
+                        break;
+                }
+            }
+            settings_done_ = true;
+            Http2Frame::Write(control_, h2_frame_t::SETTINGS, Http2Frame::ACK, 0, nullptr, 0);
+            return true;
+        }
+
+        bool on_window_update(const Http2Frame& f, const uint8_t* p) {
+            if (f.length != 4) return fail(h2_error_t::FRAME_SIZE, "bad WINDOW_UPDATE length");
+            uint32_t increment = Http2Frame::Read32(p) & 0x7fffffff;
+            if (f.stream == 0) {
+                if (increment == 0) return fail(h2_error_t::PROTOCOL, "zero WINDOW_UPDATE");
+                send_window_ += increment;
+                return send_window_ > max_window ? fail(h2_error_t::FLOW_CONTROL, "connection window overflow") : true;
+            }
+            auto it = streams_.find(f.stream);
+            if (it == streams_.end()) return true;
+            if (increment == 0) {
+                reset(f.stream, h2_error_t::PROTOCOL);
+                return true;
+            }
+            it->second.send_window += increment;
+            if (it->second.send_window > max_window) reset(f.stream, h2_error_t::FLOW_CONTROL);
+            return true;
+        }
+
+        bool on_headers(const Http2Frame& f, const uint8_t* p) {
+            if (f.stream == 0 || f.stream % 2 == 0) return fail(h2_error_t::PROTOCOL, "HEADERS on a server stream");
+            uint64_t off = 0;
+            uint64_t len = f.length;
+            uint8_t pad = 0;
+            if (f.flags & Http2Frame::PADDED) {
+                if (len < 1) return fail(h2_error_t::FRAME_SIZE, "bad HEADERS padding");
+                pad = p[0];
+                off = 1;
+                len -= 1;
+            }
+            if (f.flags & Http2Frame::PRIORITY) {
+                if (len < 5) return fail(h2_error_t::FRAME_SIZE, "bad HEADERS priority");
+                off += 5;
+                len -= 5;
+            }
+            if (pad > len) return fail(h2_error_t::PROTOCOL, "HEADERS padding exceeds payload");
+            header_block_.assign(reinterpret_cast<const char*>(p + off), len - pad);
+            continuation_ = f.stream;
+            continuation_end_stream_ = (f.flags & Http2Frame::END_STREAM) != 0;
+            return (f.flags & Http2Frame::END_HEADERS) ? end_headers() : true;
+        }
+
+        bool end_headers() {
+            uint32_t id = continuation_;
+            continuation_ = 0;
+            // Blocks have to be decoded even for refused streams, the dynamic table depends on them
+            std::vector<hpack_field_t> fields;
+            if (!decoder_.decode(reinterpret_cast<const uint8_t*>(header_block_.data()), header_block_.size(), fields)) {
+                return fail(h2_error_t::COMPRESSION, "malformed header block");
+            }
+            header_block_.clear();
+            if (auto it = streams_.find(id); it != streams_.end()) {
+                // Trailers, they carry nothing the handlers look at
+                if (it->second.ex.remote_done() || !continuation_end_stream_) {
+                    reset(id, h2_error_t::PROTOCOL);
+                } else {
+                    end_stream(it->second);
+                }
+                return true;
+            }
+            if (id <= last_stream_) return fail(h2_error_t::STREAM_CLOSED, "HEADERS on a closed stream");
+            last_stream_ = id;
+            if (goaway_) return true;
+            if (streams_.size() >= max_concurrent_streams) {
+                reset(id, h2_error_t::REFUSED_STREAM);
+                return true;
+            }
+            auto& s = streams_.try_emplace(id, id, handlers_).first->second;
+            s.send_window = initial_window_;
+            auto& ex = s.ex;
+            for (auto& [name, value] : fields) {
+                if (name == ":method") {
+                    ex.method = value;
+                } else if (name == ":path") {
+                    ex.path = value;
+                } else if (!name.starts_with(':')) {
+                    if (auto h = ex.headers.find(name); h != ex.headers.end()) {
+                        h->second.append(name == "cookie" ? "; " : ", ").append(value);
+                    } else {
+                        ex.headers.emplace(name, value);
+                    }
+                }
+            }
+            if (ex.method.empty() || ex.path.empty()) {
+                reset(id, h2_error_t::PROTOCOL);
+                return true;
+            }
+            HttpMetrics::h2_requests.inc();
+            LINFO("New Https Request: {} {} (h2 stream {}) from {}", ex.method, ex.path, id, peer_);
+            if (!RateLimiter::Global().take(client_)) {
+                ex.refuse("429 Too Many Requests", {{"retry-after", "1"}}, continuation_end_stream_);
+                return true;
+            }
+            ex.start(continuation_end_stream_);
+            if (ex.aborted()) reset(id, h2_error_t::INTERNAL);
+            return true;
+        }
+
+        bool on_data(const Http2Frame& f, const uint8_t* p) {
+            if (f.stream == 0) return fail(h2_error_t::PROTOCOL, "DATA on stream 0");
+            // Flow control counts the whole payload, padding included
+            recv_window_ -= f.length;
+            recv_unacked_ += f.length;
+            if (recv_window_ < 0) return fail(h2_error_t::FLOW_CONTROL, "connection window exceeded");
+            auto it = streams_.find(f.stream);
+            if (it == streams_.end()) {
+                return f.stream > last_stream_ ? fail(h2_error_t::PROTOCOL, "DATA on idle stream") : true;
+            }
+            auto& s = it->second;
+            if (s.ex.remote_done()) {
+                reset(f.stream, h2_error_t::STREAM_CLOSED);
+                return true;
+            }
+            s.recv_window -= f.length;
+            s.unacked += f.length;
+            if (s.recv_window < 0) {
+                reset(f.stream, h2_error_t::FLOW_CONTROL);
+                return true;
+            }
+            uint64_t off = 0;
+            uint64_t len = f.length;
+            if (f.flags & Http2Frame::PADDED) {
+                if (len < 1 || p[0] >= len) return fail(h2_error_t::PROTOCOL, "bad DATA padding");
+                off = 1;
+                len -= 1 + p[0];
+            }
+            if (len > 0 && !s.ex.body(reinterpret_cast<const char*>(p + off), len)) {
+                reset(f.stream, h2_error_t::CANCEL);
+                return true;
+            }
+            if (f.flags & Http2Frame::END_STREAM) {
+                end_stream(s);
+            }
+            return true;
+        }
+
+        void end_stream(stream_t& s) {
+            s.ex.end();
+            if (s.ex.aborted()) reset(s.id, h2_error_t::INTERNAL);
+        }
+
+        template<typename P>
+        void write_head(stream_t& s, P& out, bool end_stream) {
+            std::string block;
+            encoder_.encode(":status", s.ex.status, block);
+            for (auto& [name, value] : s.ex.response_header) {
+                // Connection specific fields are not allowed in HTTP/2
+                if (name == "connection" || name == "transfer-encoding" || name == "keep-alive" || name == "upgrade" || name == "proxy-connection") {
+                    continue;
+                }
+                encoder_.encode(name, value, block);
+            }
+            uint64_t off = 0;
+            do {
+                uint64_t n = std::min<uint64_t>(block.size() - off, peer_max_frame_);
+                uint8_t flags = off + n == block.size() ? Http2Frame::END_HEADERS : 0;
+                if (off == 0 && end_stream) flags |= Http2Frame::END_STREAM;
+                Http2Frame::Write(out, off == 0 ? h2_frame_t::HEADERS : h2_frame_t::CONTINUATION, flags, s.id, block.data() + off, n);
+                off += n;
+            } while (off < block.size());
+        }
+
+        /* Emit at most one frame of a stream, return whether something was written. */
+        template<typename P>
+        bool serve(stream_t& s, P& out) {
+            auto& ex = s.ex;
+            if (!ex.responded()) return false;
+            if (s.head_pending) {
+                s.head_pending = false;
+                write_head(s, out, ex.bodiless());
+                s.local_done = ex.bodiless();
+                return true;
+            }
+            uint64_t avail = ex.available();
+            if (avail == 0) {
+                if (ex.finishing()) {
+                    Http2Frame::Write(out, h2_frame_t::DATA, Http2Frame::END_STREAM, s.id, nullptr, 0);
+                    s.local_done = true;
+                    return true;
+                }
+                return false;
+            }
+            int64_t window = std::min(send_window_, s.send_window);
+            if (window <= 0) return false;
+            uint64_t n = std::min<uint64_t>({avail, peer_max_frame_, static_cast<uint64_t>(window)});
+            bool last = n == avail && ex.finishing();
+            Http2Frame::Write(out, h2_frame_t::DATA, last ? Http2Frame::END_STREAM : 0, s.id, ex.peek(), n);
+            ex.consume(n);
+            send_window_ -= static_cast<int64_t>(n);
+            s.send_window -= static_cast<int64_t>(n);
+            s.local_done = last;
+            return true;
+        }
+    public:
+        Http2Session(std::unordered_map<std::string, HttpHandlerFunctionSet>& handlers, std::string peer, uint64_t client = 0) : handlers_(handlers),
+                                                                                                                                 peer_(std::move(peer)), client_(client), control_(1024) {
+            // SETTINGS_MAX_CONCURRENT_STREAMS and SETTINGS_MAX_HEADER_LIST_SIZE, everything else keeps the defaults
+            char payload[12] = {0, 0x3};
+            Http2Frame::Write32(payload + 2, max_concurrent_streams);
+            payload[6] = 0;
+            payload[7] = 0x6;
+            Http2Frame::Write32(payload + 8, static_cast<uint32_t>(max_header_size));
+            Http2Frame::Write(control_, h2_frame_t::SETTINGS, 0, 0, payload, 12);
+        }
+        Http2Session(const Http2Session&) = delete;
+
+        /* Process received bytes, false once the connection failed and only the GOAWAY is left to send. */
+        bool feed(const char* data, uint64_t len) {
+            if (failed_) return false;
+            in_.append(data, len);
+            uint64_t pos = 0;
+            if (!preface_done_) {
+                auto n = std::min<uint64_t>(in_.size(), preface.size());
+                if (in_.compare(0, n, preface.substr(0, n)) != 0) {
+                    return fail(h2_error_t::PROTOCOL, "bad connection preface");
+                }
+                if (n < preface.size()) return true;
+                preface_done_ = true;
+                pos = preface.size();
+            }
+            while (!failed_ && in_.size() - pos >= Http2Frame::header_size) {
+                auto f = Http2Frame::Parse(reinterpret_cast<const uint8_t*>(in_.data() + pos));
+                if (f.length > max_frame_size) {
+                    return fail(h2_error_t::FRAME_SIZE, "frame larger than SETTINGS_MAX_FRAME_SIZE");
+                }
+                if (in_.size() - pos < Http2Frame::header_size + f.length) break;
+                auto payload = reinterpret_cast<const uint8_t*>(in_.data() + pos + Http2Frame::header_size);
+                pos += Http2Frame::header_size + f.length;
+                on_frame(f, payload);
+            }
+            in_.erase(0, pos);
+            return !failed_;
+        }
+
+        /* Whether a suspended coroutine handler of any stream can make progress. */
+        bool resumable() const {
+            for (auto& [id, s] : streams_) {
+                if (s.ex.ready()) return true;
+            }
+            return false;
+        }
+
+        void resume() {
+            for (auto it = streams_.begin(); it != streams_.end(); ) {
+                auto& s = (it++)->second;
+                if (s.ex.ready()) {
+                    s.ex.resume();
+                    if (s.ex.aborted()) reset(s.id, h2_error_t::INTERNAL);
+                }
+            }
+        }
+
+        /* Append frames that are ready to out, return false when there was nothing to send. */
+        template<typename P>
+        bool pull(P& out) {
+            if (!failed_) {
+                // Return the credit of consumed body bytes. Coroutine handlers only get more once they caught up.
+                if (recv_unacked_ > 0) {
+                    window_update(0, static_cast<uint32_t>(recv_unacked_));
+                    recv_window_ += static_cast<int64_t>(recv_unacked_);
+                    recv_unacked_ = 0;
+                }
+                for (auto& [id, s] : streams_) {
+                    if (s.unacked > 0 && !s.ex.remote_done() && !s.ex.backlogged()) {
+                        window_update(id, static_cast<uint32_t>(s.unacked));
+                        s.recv_window += static_cast<int64_t>(s.unacked);
+                        s.unacked = 0;
+                    }
+                }
+            }
+            if (control_.limit() > 0) {
+                out.write(&control_[0], control_.limit());
+                control_.clear();
+            }
+            bool progress = true;
+            while (!failed_ && progress && out.limit() < pull_budget && !streams_.empty()) {
+                progress = false;
+                // One frame per stream and round, starting after the stream served last
+                auto it = streams_.upper_bound(last_served_);
+                for (uint64_t n = streams_.size(); n > 0 && out.limit() < pull_budget; --n) {
+                    if (it == streams_.end()) it = streams_.begin();
+                    auto& s = it->second;
+                    if (serve(s, out)) {
+                        progress = true;
+                        last_served_ = s.id;
+                    }
+                    if (s.local_done) {
+                        if (!s.ex.remote_done()) {
+                            // The response is complete, the rest of the request is not needed
+                            char payload[4];
+                            Http2Frame::Write32(payload, static_cast<uint32_t>(h2_error_t::NONE));
+                            Http2Frame::Write(out, h2_frame_t::RST_STREAM, 0, s.id, payload, 4);
+                        }
+                        it = streams_.erase(it);
+                    } else {
+                        ++it;
+                    }
+                }
+            }
+            return out.limit() > 0;
+        }
+
+        bool failed() const {
+            return failed_;
+        }
+
+        /* Whether the session is over and the connection can be closed once the output is flushed. */
+        bool closed() const {
+            return goaway_ && streams_.empty() && control_.limit() == 0;
+        }
+    };
+}
\ No newline at end of file
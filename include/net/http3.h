@@ -0,0 +1,444 @@
+#pragma once
+
+#include <algorithm>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "./qpack.h"
+#include "./http_handler.h"
+#include "./http_exchange.h"
+#include "../base/def.h"
+#include "include/log/logger.h"
+
+namespace Nexus::Net {
+    enum class h3_frame_t : uint64_t {
+        DATA = 0x0,
+        HEADERS = 0x1,
+        CANCEL_PUSH = 0x3,
+        SETTINGS = 0x4,
+        PUSH_PROMISE = 0x5,
+        GOAWAY = 0x7,
+        MAX_PUSH_ID = 0xd
+    };
+
+    enum class h3_stream_t : uint64_t {
+        CONTROL = 0x0,
+        PUSH = 0x1,
+        QPACK_ENCODER = 0x2,
+        QPACK_DECODER = 0x3
+    };
+
+    enum class h3_error_t : uint64_t {
+        NONE = 0x100,
+        GENERAL_PROTOCOL = 0x101,
+        INTERNAL = 0x102,
+        STREAM_CREATION = 0x103,
+        CLOSED_CRITICAL_STREAM = 0x104,
+        FRAME_UNEXPECTED = 0x105,
+        FRAME = 0x106,
+        EXCESSIVE_LOAD = 0x107,
+        ID = 0x108,
+        SETTINGS = 0x109,
+        MISSING_SETTINGS = 0x10a,
+        REQUEST_REJECTED = 0x10b,
+        REQUEST_CANCELLED = 0x10c,
+        REQUEST_INCOMPLETE = 0x10d,
+        MESSAGE = 0x10e,
+        CONNECT = 0x10f,
+        VERSION_FALLBACK = 0x110,
+        QPACK_DECOMPRESSION_FAILED = 0x200,
+        QPACK_ENCODER_STREAM = 0x201,
+        QPACK_DECODER_STREAM = 0x202
+    };
+
+    /*
+     * Http3Frame is the frame codec of RFC 9114 section 7.1: type and length are QUIC variable-length integers (RFC 9000
+     * section 16) followed by the payload. QUIC already delimits streams, so unlike HTTP/2 there is no stream identifier.
+     * */
+    struct Http3Frame {
+        static bool ReadVarint(const uint8_t*& p, const uint8_t* end, uint64_t& value) {
+            if (p == end) return false;
+            uint64_t n = 1ull << (*p >> 6);
+            if (static_cast<uint64_t>(end - p) < n) return false;
+            value = *p++ & 0x3f;
+            for (uint64_t i = 1; i < n; ++i) {
+                value = (value << 8) | *p++;
+            }
+            return true;
+        }
+
+        static void WriteVarint(std::string& out, uint64_t value) {
+            if (value < 0x40) {
+                out.push_back(static_cast<char>(value));
+            } else if (value < 0x4000) {
+                out.push_back(static_cast<char>(0x40 | (value >> 8)));
+                out.push_back(static_cast<char>(value));
+            } else if (value < 0x40000000) {
+                out.push_back(static_cast<char>(0x80 | (value >> 24)));
+                for (int shift = 16; shift >= 0; shift -= 8) out.push_back(static_cast<char>(value >> shift));
+            } else {
+                out.push_back(static_cast<char>(0xc0 | (value >> 56)));
+                for (int shift = 48; shift >= 0; shift -= 8) out.push_back(static_cast<char>(value >> shift));
+            }
+        }
+
+        /* Append a whole frame. */
+        static void Write(std::string& out, h3_frame_t type, const char* payload, uint64_t len) {
+            WriteVarint(out, static_cast<uint64_t>(type));
+            WriteVarint(out, len);
+            if (len > 0) {
+                out.append(payload, len);
+            }
+        }
+
+        /* Frame types of HTTP/2 that have no HTTP/3 counterpart, receiving one is an error. */
+        static bool Reserved(uint64_t type) {
+            return type == 0x2 || type == 0x6 || type == 0x8 || type == 0x9;
+        }
+    };
+
+    /*
+     * Http3Stream is one request stream, independent of the transport. The bytes the client sends on the stream go in through
+     * feed(), the response comes out of pull() as a HEADERS frame followed by DATA frames, and the transport ends the stream
+     * once finished(). Requests are dispatched through HttpExchange exactly like HTTP/2 streams.
+     * */
+    class Http3Stream {
+    public:
+        // Bytes of frames produced by one pull, bounds what the connection buffers per stream
+        static constexpr uint64_t pull_budget = 64 * 1024;
+    private:
+        uint64_t id_;
+        std::string peer_;
+        HttpExchange ex_;
+        std::string in_;
+        // Payload bytes of the current DATA frame, or of an unknown frame that is skipped, still to come
+        uint64_t data_left_ {0};
+        uint64_t skip_left_ {0};
+        bool started_ {false};
+        bool trailers_ {false};
+        bool head_sent_ {false};
+        bool done_ {false};
+        h3_error_t error_ {h3_error_t::NONE};
+        bool fatal_ {false};
+
+        /* Fail the stream, fatal errors close the whole connection. */
+        bool fail(h3_error_t err, bool fatal, std::string_view reason) {
+            LWARN("HTTP/3 {} error on stream {} with {}: {}", fatal ? "connection" : "stream", id_, peer_, reason);
+            error_ = err;
+            fatal_ = fatal;
+            return false;
+        }
+
+        bool on_headers(const uint8_t* p, uint64_t len) {
+            std::vector<hpack_field_t> fields;
+            if (!QpackDecoder::Decode(p, len, fields)) {
+                return fail(h3_error_t::QPACK_DECOMPRESSION_FAILED, true, "malformed field section");
+            }
+            if (started_) {
+                // Trailers, they carry nothing the handlers look at
+                if (trailers_) return fail(h3_error_t::FRAME_UNEXPECTED, true, "HEADERS after trailers");
+                trailers_ = true;
+                return true;
+            }
+            for (auto& [name, value] : fields) {
+                if (name == ":method") {
+                    ex_.method = value;
+                } else if (name == ":path") {
+                    ex_.path = value;
+                } else if (!name.starts_with(':')) {
+                    if (auto h = ex_.headers.find(name); h != ex_.headers.end()) {
+                        h->second.append(name == "cookie" ? "; " : ", ").append(value);
+                    } else {
+                        ex_.headers.emplace(name, value);
+                    }
+                }
+            }
+            if (ex_.method.empty() || ex_.path.empty()) {
+                return fail(h3_error_t::MESSAGE, false, "request without :method or :path");
+            }
+            started_ = true;
+            HttpMetrics::h3_requests.inc();
+            LINFO("New Https Request: {} {} (h3 stream {}) from {}", ex_.method, ex_.path, id_, peer_);
+            ex_.start(false);
+            return ex_.aborted() ? fail(h3_error_t::INTERNAL, false, "handler failed") : true;
+        }
+    public:
+        Http3Stream(std::unordered_map<std::string, HttpHandlerFunctionSet>& handlers, uint64_t id, std::string peer) : id_(id), peer_(std::move(peer)),
+                                                                                                                      ex_(handlers) {}
+        Http3Stream(const Http3Stream&) = delete;
+
+        /* Process received bytes, fin marks the end of the request. False once the stream failed, see error(). */
+        bool feed(const char* data, uint64_t len, bool fin) {
+            if (error_ != h3_error_t::NONE) return false;
+            in_.append(data, len);
+            uint64_t pos = 0;
+            while (true) {
+                if (data_left_ > 0 || skip_left_ > 0) {
+                    uint64_t& left = data_left_ > 0 ? data_left_ : skip_left_;
+                    uint64_t n = std::min<uint64_t>(left, in_.size() - pos);
+                    if (n == 0) break;
+                    if (&left == &data_left_ && !ex_.body(in_.data() + pos, n)) {
+                        return fail(h3_error_t::REQUEST_CANCELLED, false, "request body rejected");
+                    }
+                    pos += n;
+                    left -= n;
+                    continue;
+                }
+                auto p = reinterpret_cast<const uint8_t*>(in_.data() + pos);
+                auto end = reinterpret_cast<const uint8_t*>(in_.data() + in_.size());
+                uint64_t type, length;
+                if (!Http3Frame::ReadVarint(p, end, type) || !Http3Frame::ReadVarint(p, end, length)) break;
+                uint64_t header = p - reinterpret_cast<const uint8_t*>(in_.data() + pos);
+                if (type == static_cast<uint64_t>(h3_frame_t::DATA)) {
+                    if (!started_ || trailers_) return fail(h3_error_t::FRAME_UNEXPECTED, true, "DATA outside of the message body");
+                    data_left_ = length;
+                    pos += header;
+                } else if (type == static_cast<uint64_t>(h3_frame_t::HEADERS)) {
+                    if (length > max_header_size) return fail(h3_error_t::EXCESSIVE_LOAD, false, "field section too large");
+                    if (end - p < static_cast<int64_t>(length)) break;
+                    pos += header + length;
+                    if (!on_headers(p, length)) return false;
+                } else if (type == static_cast<uint64_t>(h3_frame_t::CANCEL_PUSH) || type == static_cast<uint64_t>(h3_frame_t::SETTINGS) ||
+                           type == static_cast<uint64_t>(h3_frame_t::PUSH_PROMISE) || type == static_cast<uint64_t>(h3_frame_t::GOAWAY) ||
+                           type == static_cast<uint64_t>(h3_frame_t::MAX_PUSH_ID) || Http3Frame::Reserved(type)) {
+                    return fail(h3_error_t::FRAME_UNEXPECTED, true, "frame not allowed on a request stream");
+                } else {
+                    // Unknown frame types, grease included, are ignored
+                    skip_left_ = length;
+                    pos += header;
+                }
+            }
+            in_.erase(0, pos);
+            if (fin) {
+                if (data_left_ > 0 || skip_left_ > 0 || !in_.empty()) return fail(h3_error_t::FRAME, true, "truncated frame");
+                if (!started_) return fail(h3_error_t::REQUEST_INCOMPLETE, false, "stream ended before the request");
+                ex_.end();
+                if (ex_.aborted()) return fail(h3_error_t::INTERNAL, false, "handler failed");
+            }
+            return true;
+        }
+
+        /* Whether a suspended coroutine handler can make progress. */
+        bool ready() const {
+            return error_ == h3_error_t::NONE && ex_.ready();
+        }
+
+        void resume() {
+            ex_.resume();
+            if (ex_.aborted()) fail(h3_error_t::INTERNAL, false, "handler failed");
+        }
+
+        /* Append response frames that are ready to out, return false when there was nothing to send. */
+        bool pull(std::string& out) {
+            if (error_ != h3_error_t::NONE || done_ || !ex_.responded()) return false;
+            auto start = out.size();
+            if (!head_sent_) {
+                head_sent_ = true;
+                std::string block;
+                QpackEncoder::Begin(block);
+                QpackEncoder::Encode(":status", ex_.status, block);
+                for (auto& [name, value] : ex_.response_header) {
+                    // Connection specific fields are not allowed in HTTP/3 either
+                    if (name == "connection" || name == "transfer-encoding" || name == "keep-alive" || name == "upgrade" || name == "proxy-connection") {
+                        continue;
+                    }
+                    QpackEncoder::Encode(name, value, block);
+                }
+                Http3Frame::Write(out, h3_frame_t::HEADERS, block.data(), block.size());
+                done_ = ex_.bodiless();
+            }
+            while (!done_ && out.size() - start < pull_budget) {
+                uint64_t avail = ex_.available();
+                if (avail == 0) {
+                    done_ = ex_.finishing();
+                    break;
+                }
+                uint64_t n = std::min<uint64_t>(avail, pull_budget);
+                Http3Frame::Write(out, h3_frame_t::DATA, ex_.peek(), n);
+                ex_.consume(n);
+                done_ = n == avail && ex_.finishing();
+            }
+            return out.size() > start;
+        }
+
+        /* Whether the whole response was pulled, the transport ends the stream after writing it. */
+        bool finished() const {
+            return done_;
+        }
+
+        /* Whether the response started and more of it is to come. */
+        bool responding() const {
+            return error_ == h3_error_t::NONE && !done_ && ex_.responded();
+        }
+
+        /* Whether the client sent the whole request. */
+        bool remote_done() const {
+            return ex_.remote_done();
+        }
+
+        h3_error_t error() const {
+            return error_;
+        }
+
+        /* Whether error() is a connection error rather than one that only resets this stream. */
+        bool fatal() const {
+            return fatal_;
+        }
+    };
+
+    /*
+     * Http3UniStream is a unidirectional stream opened by the client. The first varint is the stream type: the control stream
+     * has to start with SETTINGS and may carry GOAWAY afterwards, the QPACK streams may not say anything that needs a dynamic
+     * table, and unknown types are discarded. Preamble() builds the content of our own control stream.
+     * */
+    class Http3UniStream {
+    private:
+        bool typed_ {false};
+        uint64_t type_ {0};
+        std::string in_;
+        uint64_t skip_left_ {0};
+        bool settings_ {false};
+        bool goaway_ {false};
+        h3_error_t error_ {h3_error_t::NONE};
+
+        bool fail(h3_error_t err, std::string_view reason) {
+            LWARN("HTTP/3 connection error on a unidirectional stream: {}", reason);
+            error_ = err;
+            return false;
+        }
+
+        bool on_settings(const uint8_t* p, const uint8_t* end) {
+            std::vector<uint64_t> seen;
+            while (p != end) {
+                uint64_t id, value;
+                if (!Http3Frame::ReadVarint(p, end, id) || !Http3Frame::ReadVarint(p, end, value)) {
+                    return fail(h3_error_t::FRAME, "malformed SETTINGS");
+                }
+                // Identifiers of HTTP/2 settings that HTTP/3 does not have are reserved
+                if ((id >= 0x2 && id <= 0x5) || std::ranges::find(seen, id) != seen.end()) {
+                    return fail(h3_error_t::SETTINGS, "bad SETTINGS identifier");
+                }
+                seen.push_back(id);
+            }
+            settings_ = true;
+            return true;
+        }
+
+        bool on_control(const char* data, uint64_t len) {
+            in_.append(data, len);
+            uint64_t pos = 0;
+            while (true) {
+                if (skip_left_ > 0) {
+                    uint64_t n = std::min<uint64_t>(skip_left_, in_.size() - pos);
+                    if (n == 0) break;
+                    pos += n;
+                    skip_left_ -= n;
+                    continue;
+                }
+                auto p = reinterpret_cast<const uint8_t*>(in_.data() + pos);
+                auto end = reinterpret_cast<const uint8_t*>(in_.data() + in_.size());
+                uint64_t type, length;
+                if (!Http3Frame::ReadVarint(p, end, type) || !Http3Frame::ReadVarint(p, end, length)) break;
+                uint64_t header = p - reinterpret_cast<const uint8_t*>(in_.data() + pos);
+                if (!settings_ && type != static_cast<uint64_t>(h3_frame_t::SETTINGS)) {
+                    return fail(h3_error_t::MISSING_SETTINGS, "control stream does not start with SETTINGS");
+                }
+                if (type == static_cast<uint64_t>(h3_frame_t::SETTINGS) || type == static_cast<uint64_t>(h3_frame_t::GOAWAY) ||
+                    type == static_cast<uint64_t>(h3_frame_t::CANCEL_PUSH) || type == static_cast<uint64_t>(h3_frame_t::MAX_PUSH_ID)) {
+                    if (length > 1024) return fail(h3_error_t::EXCESSIVE_LOAD, "control frame too large");
+                    if (end - p < static_cast<int64_t>(length)) break;
+                    pos += header + length;
+                    if (type == static_cast<uint64_t>(h3_frame_t::SETTINGS)) {
+                        if (settings_) return fail(h3_error_t::FRAME_UNEXPECTED, "second SETTINGS");
+                        if (!on_settings(p, p + length)) return false;
+                    } else if (type == static_cast<uint64_t>(h3_frame_t::GOAWAY)) {
+                        // Requests in flight are finished, the client opens no new ones
+                        goaway_ = true;
+                    }
+                } else if (type == static_cast<uint64_t>(h3_frame_t::DATA) || type == static_cast<uint64_t>(h3_frame_t::HEADERS) ||
+                           type == static_cast<uint64_t>(h3_frame_t::PUSH_PROMISE) || Http3Frame::Reserved(type)) {
+                    return fail(h3_error_t::FRAME_UNEXPECTED, "frame not allowed on the control stream");
+                } else {
+                    skip_left_ = length;
+                    pos += header;
+                }
+            }
+            in_.erase(0, pos);
+            return true;
+        }
+    public:
+        /* Our control stream: its type and SETTINGS that rule out a dynamic QPACK table. */
+        static std::string Preamble() {
+            std::string settings;
+            Http3Frame::WriteVarint(settings, 0x1);  // SETTINGS_QPACK_MAX_TABLE_CAPACITY
+            Http3Frame::WriteVarint(settings, 0);
+            Http3Frame::WriteVarint(settings, 0x6);  // SETTINGS_MAX_FIELD_SECTION_SIZE
+            Http3Frame::WriteVarint(settings, max_header_size);
+            Http3Frame::WriteVarint(settings, 0x7);  // SETTINGS_QPACK_BLOCKED_STREAMS
+            Http3Frame::WriteVarint(settings, 0);
+            std::string out;
+            Http3Frame::WriteVarint(out, static_cast<uint64_t>(h3_stream_t::CONTROL));
+            Http3Frame::Write(out, h3_frame_t::SETTINGS, settings.data(), settings.size());
+            return out;
+        }
+
+        /* Process received bytes, false on a connection error, see error(). */
+        bool feed(const char* data, uint64_t len, bool fin) {
+            if (error_ != h3_error_t::NONE) return false;
+            if (!typed_) {
+                in_.append(data, len);
+                auto p = reinterpret_cast<const uint8_t*>(in_.data());
+                auto end = p + in_.size();
+                if (!Http3Frame::ReadVarint(p, end, type_)) {
+                    return fin ? fail(h3_error_t::STREAM_CREATION, "stream ended before its type") : true;
+                }
+                typed_ = true;
+                if (type_ == static_cast<uint64_t>(h3_stream_t::PUSH)) {
+                    return fail(h3_error_t::STREAM_CREATION, "push stream from the client");
+                }
+                std::string rest(reinterpret_cast<const char*>(p), end - p);
+                in_.clear();
+                return feed(rest.data(), rest.size(), fin);
+            }
+            if (fin && critical()) {
+                return fail(h3_error_t::CLOSED_CRITICAL_STREAM, "critical stream closed");
+            }
+            switch (static_cast<h3_stream_t>(type_)) {
+                case h3_stream_t::CONTROL:
+                    return on_control(data, len);
+                case h3_stream_t::QPACK_ENCODER:
+                    // Set Dynamic Table Capacity to 0 is the only instruction that fits a table of capacity 0
+                    for (uint64_t i = 0; i < len; ++i) {
+                        if (static_cast<uint8_t>(data[i]) != 0x20) return fail(h3_error_t::QPACK_ENCODER_STREAM, "encoder stream needs a dynamic table");
+                    }
+                    return true;
+                default:
+                    // Decoder stream instructions only acknowledge or cancel, unknown stream types are discarded
+                    return true;
+            }
+        }
+
+        /* Whether the type is known yet. */
+        bool typed() const {
+            return typed_;
+        }
+
+        uint64_t type() const {
+            return type_;
+        }
+
+        /* Control and QPACK streams must stay open for the lifetime of the connection, and each may exist only once. */
+        bool critical() const {
+            return typed_ && type_ <= static_cast<uint64_t>(h3_stream_t::QPACK_DECODER) && type_ != static_cast<uint64_t>(h3_stream_t::PUSH);
+        }
+
+        bool goaway() const {
+            return goaway_;
+        }
+
+        h3_error_t error() const {
+            return error_;
+        }
+    };
+}
\ No newline at end of file
@@ -0,0 +1,303 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "./http3.h"
+#include "./http_handler.h"
+#include "include/log/logger.h"
+
+#include <openssl/ssl.h>
+#include <openssl/err.h>
+
+#if OPENSSL_VERSION_NUMBER >= 0x30500000L
+#include <openssl/quic.h>
+
+namespace Nexus::Net {
+    /*
+     * Http3Connection drives one QUIC connection accepted by Http3Server. Every request stream the client opens becomes an
+     * Http3Stream, the unidirectional streams of the client are checked by Http3UniStream, and our control stream carries the
+     * SETTINGS. All QUIC objects of a listener share one engine that OpenSSL locks internally, so connections can be driven on
+     * any worker while the server loop handles the socket.
+     * */
+    class Http3Connection {
+    public:
+        using status_t = enum {
+            ESTABLISHED,
+            CLOSING,
+            FINISHED
+        };
+    private:
+        struct request_t {
+            SSL* ssl;
+            Http3Stream stream;
+            std::string out;
+            uint64_t sent {0};
+            bool fin {false};
+            bool concluded {false};
+            request_t(SSL* ssl_, std::unordered_map<std::string, HttpHandlerFunctionSet>& handlers, const std::string& peer) : ssl(ssl_),
+                      stream(handlers, SSL_get_stream_id(ssl_), peer) {}
+        };
+        struct uni_t {
+            SSL* ssl;
+            Http3UniStream stream;
+            bool fin {false};
+        };
+
+        std::unordered_map<std::string, HttpHandlerFunctionSet>& handlers_;
+        SSL* conn_;
+        std::string peer_;
+        uint64_t established_time_;
+        uint64_t active_time_;
+        SSL* control_ {nullptr};
+        std::string control_out_;
+        uint64_t control_sent_ {0};
+        std::unordered_map<uint64_t, std::unique_ptr<request_t>> requests_;
+        std::vector<std::unique_ptr<uni_t>> unis_;
+        bool goaway_ {false};
+        bool draining_ {false};
+        // Lowest request stream the client did not open yet, what our GOAWAY announces
+        uint64_t next_request_ {0};
+        h3_error_t close_error_ {h3_error_t::NONE};
+        status_t status_ {ESTABLISHED};
+        std::mutex mtx_;
+
+        /* Read what arrived on a stream into feed, false when the peer reset it or the connection is gone. */
+        template<typename F>
+        bool read(SSL* ssl, bool& fin, F&& feed) {
+            char buf[4096];
+            size_t n = 0;
+            while (SSL_read_ex(ssl, buf, sizeof(buf), &n)) {
+                active_time_ = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+                if (!feed(buf, n, false)) return true;
+            }
+            switch (SSL_get_stream_read_state(ssl)) {
+                case SSL_STREAM_STATE_OK:
+                    return true;
+                case SSL_STREAM_STATE_FINISHED:
+                    fin = true;
+                    feed(nullptr, 0, true);
+                    return true;
+                default:
+                    return false;
+            }
+        }
+
+        /* Close the connection with an HTTP/3 error code, streams in flight are dropped. */
+        void close(h3_error_t err) {
+            if (status_ != ESTABLISHED) return;
+            close_error_ = err;
+            status_ = CLOSING;
+            for (auto& [id, r] : requests_) {
+                SSL_free(r->ssl);
+            }
+            requests_.clear();
+        }
+
+        void accept_streams() {
+            while (SSL* s = SSL_accept_stream(conn_, SSL_ACCEPT_STREAM_NO_BLOCK)) {
+                if (SSL_get_stream_type(s) != SSL_STREAM_TYPE_BIDI) {
+                    unis_.push_back(std::make_unique<uni_t>(s));
+                } else if (goaway_) {
+                    SSL_STREAM_RESET_ARGS args {static_cast<uint64_t>(h3_error_t::REQUEST_REJECTED)};
+                    SSL_stream_reset(s, &args, sizeof(args));
+                    SSL_free(s);
+                } else {
+                    auto r = std::make_unique<request_t>(s, handlers_, peer_);
+                    next_request_ = std::max<uint64_t>(next_request_, SSL_get_stream_id(s) + 4);
+                    requests_.emplace(SSL_get_stream_id(s), std::move(r));
+                }
+            }
+        }
+
+        void drive_unis() {
+            for (auto& u : unis_) {
+                if (u->fin) continue;
+                auto& stream = u->stream;
+                bool typed = stream.typed();
+                if (!read(u->ssl, u->fin, [&](const char* d, uint64_t n, bool fin) { return stream.feed(d, n, fin); })) {
+                    close(stream.critical() ? h3_error_t::CLOSED_CRITICAL_STREAM : h3_error_t::NONE);
+                    return;
+                }
+                if (stream.error() != h3_error_t::NONE) {
+                    close(stream.error());
+                    return;
+                }
+                if (!typed && stream.critical()) {
+                    for (auto& other : unis_) {
+                        if (other != u && other->stream.typed() && other->stream.type() == stream.type()) {
+                            close(h3_error_t::STREAM_CREATION);
+                            return;
+                        }
+                    }
+                }
+                goaway_ = goaway_ || stream.goaway();
+            }
+        }
+
+        /* Read, resume and write one request stream, false once it is done with and can be freed. */
+        bool drive_request(request_t& r) {
+            auto& stream = r.stream;
+            if (!r.fin && !read(r.ssl, r.fin, [&](const char* d, uint64_t n, bool fin) { return stream.feed(d, n, fin); })) {
+                return false;
+            }
+            if (stream.ready()) {
+                stream.resume();
+            }
+            if (stream.error() != h3_error_t::NONE) {
+                if (stream.fatal()) {
+                    close(stream.error());
+                    return true;
+                }
+                SSL_STREAM_RESET_ARGS args {static_cast<uint64_t>(stream.error())};
+                SSL_stream_reset(r.ssl, &args, sizeof(args));
+                return false;
+            }
+            while (true) {
+                if (r.sent == r.out.size()) {
+                    r.out.clear();
+                    r.sent = 0;
+                    if (!stream.pull(r.out)) break;
+                }
+                size_t written = 0;
+                uint64_t flags = stream.finished() ? SSL_WRITE_FLAG_CONCLUDE : 0;
+                if (!SSL_write_ex2(r.ssl, r.out.data() + r.sent, r.out.size() - r.sent, flags, &written)) {
+                    int err = SSL_get_error(r.ssl, 0);
+                    if (err == SSL_ERROR_WANT_WRITE || err == SSL_ERROR_WANT_READ) break;
+                    return false;
+                }
+                r.sent += written;
+                r.concluded = flags != 0 && r.sent == r.out.size();
+            }
+            if (stream.finished() && r.sent == r.out.size()) {
+                // A streamed body can end without a last DATA frame to carry the FIN
+                if (!r.concluded) SSL_stream_conclude(r.ssl, 0);
+                // Concluded streams are still delivered after they are freed, the rest of an unread request body is discarded
+                return false;
+            }
+            return true;
+        }
+
+        void drive_control() {
+            if (control_ == nullptr) {
+                control_ = SSL_new_stream(conn_, SSL_STREAM_FLAG_UNI | SSL_STREAM_FLAG_NO_BLOCK);
+                if (control_ == nullptr) return;
+                control_out_ = Http3UniStream::Preamble();
+            }
+            if (draining_ && !goaway_) {
+                std::string id;
+                Http3Frame::WriteVarint(id, next_request_);
+                Http3Frame::Write(control_out_, h3_frame_t::GOAWAY, id.data(), id.size());
+                goaway_ = true;
+            }
+            size_t written = 0;
+            while (control_sent_ < control_out_.size() && SSL_write_ex(control_, control_out_.data() + control_sent_, control_out_.size() - control_sent_, &written)) {
+                control_sent_ += written;
+            }
+        }
+    public:
+        Http3Connection(SSL* conn, std::unordered_map<std::string, HttpHandlerFunctionSet>& handlers, std::string peer) : handlers_(handlers), conn_(conn),
+                                                                                                                        peer_(std::move(peer)) {
+            auto now = std::chrono::system_clock::now().time_since_epoch();
+            established_time_ = std::chrono::duration_cast<std::chrono::milliseconds>(now).count();
+            active_time_ = established_time_;
+            SSL_set_blocking_mode(conn_, 0);
+            // Streams are opened explicitly, the client ones are accepted one by one
+            SSL_set_default_stream_mode(conn_, SSL_DEFAULT_STREAM_MODE_NONE);
+            SSL_set_incoming_stream_policy(conn_, SSL_INCOMING_STREAM_POLICY_ACCEPT, 0);
+        }
+        Http3Connection(const Http3Connection&) = delete;
+
+        void drive() {
+            std::lock_guard lock(mtx_);
+            if (status_ == FINISHED) return;
+            SSL_handle_events(conn_);
+            SSL_CONN_CLOSE_INFO info;
+            if (SSL_get_conn_close_info(conn_, &info, sizeof(info))) {
+                if ((info.flags & SSL_CONN_CLOSE_FLAG_LOCAL) == 0 && info.error_code != static_cast<uint64_t>(h3_error_t::NONE)) {
+                    LWARN("QUIC connection {} closed by peer, error code {:#x}", peer_, info.error_code);
+                }
+                cleanup();
+                return;
+            }
+            if (status_ == ESTABLISHED) {
+                drive_control();
+                accept_streams();
+                drive_unis();
+                for (auto it = requests_.begin(); status_ == ESTABLISHED && it != requests_.end(); ) {
+                    if (drive_request(*it->second)) {
+                        ++it;
+                        continue;
+                    }
+                    SSL_free(it->second->ssl);
+                    it = requests_.erase(it);
+                }
+                if (goaway_ && requests_.empty()) {
+                    close(h3_error_t::NONE);
+                }
+            }
+            if (status_ == CLOSING) {
+                SSL_SHUTDOWN_EX_ARGS args {static_cast<uint64_t>(close_error_), nullptr};
+                if (SSL_shutdown_ex(conn_, 0, &args, sizeof(args)) != 0) {
+                    cleanup();
+                }
+            }
+        }
+
+        /* Whether driving makes progress without new packets: a handler to resume or a response that is being sent. */
+        bool resumable() {
+            std::unique_lock lock(mtx_, std::try_to_lock);
+            if (!lock.owns_lock() || status_ != ESTABLISHED) return false;
+            for (auto& [id, r] : requests_) {
+                if (r->stream.ready() || r->stream.responding()) return true;
+            }
+            return false;
+        }
+
+        /* Start a graceful close with GOAWAY, requests in flight are answered first. */
+        void shutdown() {
+            std::lock_guard lock(mtx_);
+            draining_ = true;
+        }
+
+        status_t status() {
+            return status_;
+        }
+
+        void cleanup() {
+            if (status_ == FINISHED) return;
+            status_ = FINISHED;
+            for (auto& [id, r] : requests_) {
+                SSL_free(r->ssl);
+            }
+            requests_.clear();
+            for (auto& u : unis_) {
+                SSL_free(u->ssl);
+            }
+            unis_.clear();
+            if (control_ != nullptr) {
+                SSL_free(control_);
+                control_ = nullptr;
+            }
+            SSL_free(conn_);
+            conn_ = nullptr;
+        }
+
+        uint64_t time_established() {
+            return established_time_;
+        }
+
+        uint64_t time_active() {
+            return active_time_;
+        }
+
+        const std::string& peer() {
+            return peer_;
+        }
+    };
+}
+#endif
\ No newline at end of file
@@ -0,0 +1,58 @@
+#pragma once
+
+#include "./http3_connection.h"
+#include "./socket.h"
+#include "../utils/netaddr.h"
+#include "../io/mux.h"
+#include "http_handler.h"
+#include "../parallel/worker.h"
+#include "./proxy.h"
+
+#if OPENSSL_VERSION_NUMBER >= 0x30500000L
+#ifdef PLATFORM_WIN32
+#include <include/platform/win32/win32_udp.h>
+#endif
+
+namespace Nexus::Net {
+    /* The UDP socket behind the datagram BIO that the QUIC listener reads and writes, see http3_server.cpp. */
+    struct Http3Datagram {
+        Nexus::IO::Win32UdpBatch batch;
+        io_handle_t fd;
+        // Datagrams of one batched send, copied back to back
+        std::string staging;
+    };
+
+    template<typename MUX, int N>
+    class Http3Server {
+    private:
+        Nexus::IO::IOMultiplexer<MUX> iomux_;
+        // Keyed by accept order, all connections share the one socket
+        std::unordered_map<uint64_t, std::shared_ptr<Http3Connection>> connections_;
+        std::unordered_map<std::string, HttpHandlerFunctionSet> handlers_;
+        Socket sock_;
+        std::unique_ptr<Http3Datagram> dgram_;
+        SSL_CTX* ssl_ctx_;
+        SSL* listener_;
+        uint64_t accepted_ {0};
+        Nexus::Parallel::WorkGroup<N>& group_;
+    public:
+        // Listen for QUIC on the given UDP address, certificate and key are PEM files
+        explicit Http3Server(Nexus::Utils::NetAddr addr, Nexus::Parallel::WorkGroup<N>& group, const std::string& cert = "server.crt", const std::string& key = "server.key");
+        // Add http handler with given path
+        template<typename H> requires IsHttpHandler<H> || IsAsyncHttpHandler<H>
+        void add_handler(const std::string& path) {
+            handlers_[path] = make_handler_function_set<H>();
+            handlers_[path].metrics = std::make_shared<RouteMetrics>(path);
+        }
+        // Forward every request of path to the upstreams, see proxy.h
+        void add_proxy(const std::string& path, std::shared_ptr<UpstreamGroup> upstreams) {
+            handlers_[path] = make_proxy_function_set(std::move(upstreams));
+            handlers_[path].metrics = std::make_shared<RouteMetrics>(path);
+        }
+        // Process datagrams and timers, accept connections and dispatch them to the work group
+        void loop();
+        // Stop the server
+        void close();
+    };
+}
+#endif
\ No newline at end of file
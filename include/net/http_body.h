@@ -0,0 +1,182 @@
+#pragma once
+
+#include <atomic>
+#include <cstdio>
+#include <filesystem>
+#include <format>
+#include <functional>
+#include <string>
+#include "../mem/memory.h"
+#include "../../thirdparty/picohttpparser/picohttpparser.h"
+
+namespace Nexus::Net {
+    /*
+     * HttpBody holds a request body. Bodies stay in memory until they grow over spill_threshold, then they are moved into a
+     * temporary file, so an upload never needs memory equal to its size.
+     * */
+    class HttpBody {
+    public:
+        static constexpr uint64_t spill_threshold = 1024 * 1024;
+
+        /* Put file at off. long is 32 bits on Windows, the 64 bit calls keep spilled bodies past 2 GiB where they belong. */
+        static bool Seek(FILE* file, uint64_t off) {
+            return _fseeki64(file, static_cast<int64_t>(off), SEEK_SET) == 0 && _ftelli64(file) == static_cast<int64_t>(off);
+        }
+    private:
+        std::string memory_;
+        FILE* file_ {nullptr};
+        std::filesystem::path file_path_;
+        uint64_t size_ {0};
+
+        bool spill() {
+            static std::atomic<uint64_t> sequence {0};
+            std::error_code ec;
+            auto dir = std::filesystem::temp_directory_path(ec);
+            if (ec) return false;
+            file_path_ = dir / std::format("nexus-body-{}-{}.tmp", reinterpret_cast<uintptr_t>(this), sequence++);
+            file_ = fopen(file_path_.string().c_str(), "w+b");
+            if (file_ == nullptr) return false;
+            if (fwrite(memory_.data(), 1, memory_.size(), file_) != memory_.size()) return false;
+            std::string().swap(memory_);
+            return true;
+        }
+
+        void close() {
+            if (file_ != nullptr) {
+                fclose(file_);
+                file_ = nullptr;
+                std::error_code ec;
+                std::filesystem::remove(file_path_, ec);
+            }
+        }
+    public:
+        HttpBody() = default;
+        HttpBody(const HttpBody&) = delete;
+        HttpBody(HttpBody&& body) noexcept : memory_(std::move(body.memory_)), file_(body.file_), file_path_(std::move(body.file_path_)), size_(body.size_) {
+            body.file_ = nullptr;
+            body.size_ = 0;
+        }
+        HttpBody& operator=(HttpBody&& body) noexcept {
+            if (this != &body) {
+                close();
+                memory_ = std::move(body.memory_);
+                file_ = body.file_;
+                file_path_ = std::move(body.file_path_);
+                size_ = body.size_;
+                body.file_ = nullptr;
+                body.size_ = 0;
+            }
+            return *this;
+        }
+
+        /* Append data to the end of body, spilling to a temporary file once the threshold is exceeded. */
+        bool append(const char* data, uint64_t len) {
+            if (file_ == nullptr && size_ + len > spill_threshold) {
+                if (!spill()) return false;
+            }
+            if (file_ != nullptr) {
+                if (!Seek(file_, size_) || fwrite(data, 1, len, file_) != len) return false;
+            } else {
+                memory_.append(data, len);
+            }
+            size_ += len;
+            return true;
+        }
+
+        /* Copy up to len bytes starting at off into dst, return the number of bytes copied. */
+        uint64_t read(char* dst, uint64_t off, uint64_t len) const {
+            if (off >= size_) return 0;
+            len = std::min<uint64_t>(len, size_ - off);
+            if (file_ != nullptr) {
+                if (!Seek(file_, off)) return 0;
+                return fread(dst, 1, len, file_);
+            }
+            memcpy(dst, memory_.data() + off, len);
+            return len;
+        }
+
+        /* View of an in-memory body. A spilled body has to be read with read(). */
+        Nexus::Base::FixedPool<> view() const {
+            return {memory_.data(), file_ == nullptr ? size_ : 0};
+        }
+
+        uint64_t size() const {
+            return size_;
+        }
+
+        bool spilled() const {
+            return file_ != nullptr;
+        }
+
+        ~HttpBody() {
+            close();
+        }
+    };
+
+    /*
+     * HttpBodyReader decodes a request body framed by Content-Length or by chunked transfer coding and hands every decoded
+     * piece to the sink as soon as it arrives. Chunked data is decoded in place, so the input buffer must be writable.
+     * */
+    class HttpBodyReader {
+    public:
+        enum class status_t {
+            PARTIAL,
+            COMPLETE,
+            MALFORMED,
+            // The decoded body went past the limit, see set_limit()
+            TOO_LARGE
+        };
+        using sink_t = std::function<bool(const char*, uint64_t)>;
+    private:
+        sink_t sink_;
+        bool chunked_ {false};
+        uint64_t remaining_ {0};
+        uint64_t decoded_ {0};
+        uint64_t limit_ {UINT64_MAX};
+        phr_chunked_decoder decoder_ {};
+        status_t status_ {status_t::COMPLETE};
+    public:
+        HttpBodyReader() = default;
+        /* Read a body of content_length bytes. */
+        HttpBodyReader(sink_t sink, uint64_t content_length) : sink_(std::move(sink)), remaining_(content_length),
+                                                               status_(content_length == 0 ? status_t::COMPLETE : status_t::PARTIAL) {}
+        /* Read a body in chunked transfer coding, trailers are consumed and dropped. */
+        explicit HttpBodyReader(sink_t sink) : sink_(std::move(sink)), chunked_(true), status_(status_t::PARTIAL) {
+            decoder_.consume_trailer = 1;
+        }
+
+        status_t feed(char* data, uint64_t len) {
+            if (status_ != status_t::PARTIAL || len == 0) return status_;
+            if (chunked_) {
+                size_t decoded = len;
+                auto r = phr_decode_chunked(&decoder_, data, &decoded);
+                decoded_ += decoded;
+                if (r != -1 && decoded_ > limit_) {
+                    status_ = status_t::TOO_LARGE;
+                } else if (r == -1 || (decoded > 0 && !sink_(data, decoded))) {
+                    status_ = status_t::MALFORMED;
+                } else if (r >= 0) {
+                    status_ = status_t::COMPLETE;
+                }
+            } else {
+                auto n = std::min<uint64_t>(len, remaining_);
+                if (!sink_(data, n)) {
+                    status_ = status_t::MALFORMED;
+                } else {
+                    remaining_ -= n;
+                    if (remaining_ == 0) status_ = status_t::COMPLETE;
+                }
+            }
+            return status_;
+        }
+
+        status_t status() const {
+            return status_;
+        }
+
+        /* Refuse a chunked body once more than limit bytes were decoded, a Content-Length is checked before reading. */
+        void set_limit(uint64_t limit) {
+            limit_ = limit;
+        }
+    };
+}
\ No newline at end of file
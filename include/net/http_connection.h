@@ -1,212 +1,396 @@
 #pragma once
-#include <chrono>
-#include <ranges>
-#include "./socket.h"
-#include "./http_resolver.h"
+#include "./http_connection_base.h"
 #include "../utils/netaddr.h"
 #include "../io/resource_locator.h"
 #include "http_handler.h"
+#include "http_task.h"
+#include "websocket.h"
+#include "event_stream.h"
 #include "../log/logger.h"
+#include "http_metrics.h"
+#include "../metrics/trace.h"
+#include "rate_limit.h"
 
 #ifdef PLATFORM_WIN32
 #include <include/platform/win32/win32_io.h>
 #endif
 
 namespace Nexus::Net {
-    extern uint64_t executed_sock;
-    class HttpConnection {
+    class HttpConnection : public HttpConnectionBase<HttpConnection> {
+        friend class HttpConnectionBase<HttpConnection>;
     public:
         using status_t = enum {
             READ,
             EXECUTING,
+            AWAITING,
             RESPONSE,
+            // Switched to WebSocket, see websocket.h
+            UPGRADED,
+            // Parked on event stream topics, see event_stream.h
+            STREAMING,
             FINISHED
         };
     private:
-        std::unordered_map<std::string, HttpHandlerFunctionSet>& handlers_;
-        Socket sock_;
-        uint64_t established_time_;
-        Nexus::Base::SharedPool<Nexus::Base::AlignedHeapAllocator<4>> request_;
-        Nexus::Base::Stream<decltype(request_)> req_stream_;
-        Nexus::Base::SharedPool<> response_;
-        Nexus::Base::Stream<decltype(response_)> resp_stream_;
         status_t status_ {READ};
-        HttpResolver resolver_;
-        uint64_t content_length_ {0};
-        std::mutex mtx_;
+        std::unique_ptr<WebSocket> websocket_;
+        std::shared_ptr<EventSubscriber> subscriber_;
+        // The state last recorded in the state histograms and since when the connection is in it
+        status_t tracked_;
+        uint64_t tracked_since_;
+        // Trace id when the connection is sampled, 0 otherwise, see trace.h
+        uint64_t trace_ {Nexus::Metrics::Tracer::Sample()};
+        uint64_t traced_since_ {0};
+
+        /* Start the clocks and counters of a new client. */
+        void open() {
+            HttpConnectionBase::open();
+            tracked_ = status_;
+            tracked_since_ = HttpMetrics::Micros();
+            traced_since_ = trace_ != 0 ? Nexus::Metrics::Tracer::Now() : 0;
+            HttpMetrics::http1_connections.inc();
+        }
     public:
-        HttpConnection(const Socket& sock, std::unordered_map<std::string, HttpHandlerFunctionSet>& handlers) : sock_(sock), request_(1024), req_stream_(request_), resolver_(request_),
-                                                                                                         response_(1024), resp_stream_(response_), handlers_(handlers), mtx_(std::mutex{}) {
-            auto now = std::chrono::system_clock::now().time_since_epoch();
-            established_time_ = std::chrono::duration_cast<std::chrono::milliseconds>(now).count();
+        static constexpr const char* scheme = "Http";
+
+        HttpConnection(const Socket& sock, std::unordered_map<std::string, HttpHandlerFunctionSet>& handlers) : HttpConnectionBase(sock, handlers) {
+            open();
+        }
+
+        /* Drop what the finished connection still holds and trim its buffers, it waits in a ConnectionPool for reuse(). */
+        void recycle() {
+            // Event streams released their chunk buffer
+            if (subscriber_) {
+                chunk_ = Nexus::Base::UniquePool<>(chunk_size);
+            }
+            HttpConnectionBase::recycle();
+            websocket_.reset();
+            subscriber_.reset();
+        }
+
+        /* Serve a new client with a recycled connection, as if it was constructed for it. */
+        void reuse(const Socket& sock, std::unordered_map<std::string, HttpHandlerFunctionSet>& handlers) {
+            sock_ = sock;
+            handlers_ = &handlers;
+            status_ = READ;
+            trace_ = Nexus::Metrics::Tracer::Sample();
+            open();
         }
 
-        void drive() {
+        /* Make progress, queued is when the drive was posted to the work group when the connection is traced. */
+        void drive(uint64_t queued = 0) {
             mtx_.lock();
+            auto dequeued = trace_ != 0 ? Nexus::Metrics::Tracer::Now() : 0;
             switch (status_) {
                 case READ: {
                     int r;
                     char buf[1024];
-                    while ((r = recv(sock_.fd(), buf, 1024, 0)) > 0) {
-                        req_stream_.write(buf, r);
+                    while (status_ == READ && (r = recv(sock_.fd(), buf, 1024, 0)) > 0) {
+                        consume(buf, r);
+                    }
+                    if (status_ != READ) {
+                        break;
                     }
                     if (r == 0 || (GetLastNetworkError() != WSAEWOULDBLOCK)) {
                         LWARN("Socket read error, closing Socket connection: {}. Errno: {} | {}", sock_.addr().url(), GetLastNetworkError(), GetLastSystemError());
                         cleanup();
+                    }
+                    break;
+                }
+                case EXECUTING: {
+                    HttpMetrics::http1_requests.inc();
+                    execute();
+                    break;
+                }
+                case AWAITING: {
+                    // Keep reading the body while the handler has room for more
+                    int r = 1;
+                    while (status_ == AWAITING && !context_->body_done_ && context_->body_.size() < HttpContext::body_window) {
+                        char buf[1024];
+                        if ((r = recv(sock_.fd(), buf, 1024, 0)) <= 0) break;
+                        consume(buf, r);
+                    }
+                    if (r == 0 || (r < 0 && GetLastNetworkError() != WSAEWOULDBLOCK)) {
+                        LWARN("Socket read error, closing Socket connection: {}. Errno: {} | {}", sock_.addr().url(), GetLastNetworkError(), GetLastSystemError());
+                        cleanup();
+                    }
+                    if (status_ == AWAITING && task_.ready()) {
+                        task_.resume();
+                        settle();
+                    }
+                    if (status_ == AWAITING && producer_) {
+                        while (flush() == flush_t::DONE && pull()) {}
+                    }
+                    break;
+                }
+                case RESPONSE: {
+                    int r;
+                    if (cached_) {
+                        auto& wire = cached_->wire;
+                        r = 0;
+                        while (cached_pos_ < wire.limit()) {
+                            r = send(sock_.fd(), wire.ptr() + cached_pos_, static_cast<int>(std::min<uint64_t>(wire.limit() - cached_pos_, INT32_MAX)), 0);
+                            if (r <= 0) break;
+                            cached_pos_ += r;
+                            active_time_ = now();
+                        }
+                        if (cached_pos_ == wire.limit() || r == 0) {
+                            cleanup();
+                        } else if (r < 0 && GetLastNetworkError() != WSAEWOULDBLOCK) {
+                            LWARN("Socket write error, closing Socket connection: {}. Errno: {} | {}", sock_.addr().url(), GetLastNetworkError(), GetLastSystemError());
+                            cleanup();
+                        }
                         break;
                     }
-                    if (resolver_.header_ended()) {
-                        auto method = resolver_.resolve_method();
-                        resolver_.resolve_headers() ;
-                        if (method == http_method::GET) {
-                            status_ = EXECUTING;
+                    // Send what is pending, then keep pulling from the producer until the socket would block
+                    while (flush() == flush_t::DONE) {
+                        if (!producer_) {
+                            cleanup();
                             break;
-                        } else if (method == http_method::POST) {
-                            if (!resolver_.resolve_headers().contains("Content-Length")) {
-                                response("400 Bad Request", {});
-                                break;
-                            }
-                            try {
-                                content_length_ = std::stoul(resolver_.resolve_headers()["Content-Length"]);
-                                uint64_t curr = request_.limit() - resolver_.resolve_header_end();
-                                if (curr >= content_length_) {
-                                    status_ = EXECUTING;
-                                }
-                            } catch (std::exception& e) {
-                                response("400 Bad Request", {});
-                                break;
-                            }
-                        } else {
-                            response("405 Method Not Allowed", {});
+                        }
+                        if (!pull()) {
                             break;
                         }
                     }
                     break;
                 }
-                case EXECUTING: {
-                    executed_sock++;
-                    if (resolver_.resolve_method() == http_method::GET) {
-                        auto path = resolver_.resolve_path();
-                        LINFO("New Http Request: GET {} from {}", path, sock_.addr().url());
-                        if (handlers_.contains(path)) {
-                            HttpHandlerFunctionSet& fs = handlers_.at(path);
-                            get_request gr { resolver_.resolve_headers() };
-                            http_response resp = fs.get(gr);
-                            if (resp.response_body.limit() == 0) {
-                                response(resp.response_type, resp.response_header);
-                            } else {
-                                response(resp.response_type, resp.response_header, resp.response_body);
-                            }
-                        } else {
-                            if (path == "/") {
-                                path.append("index.html");
-                            }
-                            auto r = Nexus::IO::ResourceLocator::LocateResource(path);
-                            if (r.valid) {
-                                response("200 OK", {
-                                        {"Content-Type", r.mime}
-                                }, r.data);
-                            } else {
-                                response("404 Not Found", {
-                                        {"Content-Type", "text/html"}
-                                }, Nexus::Base::FixedPool(get_not_found_resp.data(), get_not_found_resp.size()));
-                            }
+                case UPGRADED: {
+                    // The handshake response goes out before any frame
+                    if (flush() != flush_t::DONE) {
+                        break;
+                    }
+                    int r;
+                    char buf[1024];
+                    while ((r = recv(sock_.fd(), buf, 1024, 0)) > 0) {
+                        active_time_ = now();
+                        if (!websocket_->feed(buf, r)) {
+                            break;
                         }
-                    } else if (resolver_.resolve_method() == http_method::POST) {
-                        char* body = reinterpret_cast<char*>(malloc(content_length_));
-                        memcpy(body, &request_[resolver_.resolve_header_end() + 1], content_length_);
-                        auto path = resolver_.resolve_path();
-                        LINFO("New Http Request: POST /{} from {}", path, sock_.addr().url());
-                        if (handlers_.contains(path)) {
-                            HttpHandlerFunctionSet &fs = handlers_.at(path);
-                            post_request pr{resolver_.resolve_headers(), Nexus::Base::FixedPool<true, Nexus::Base::HeapAllocator>(body, content_length_)};
-                            http_response resp = fs.post(pr);
-                            if (resp.response_body.limit() == 0) {
-                                response(resp.response_type, resp.response_header);
-                            } else {
-                                response<true>(resp.response_type, resp.response_header, resp.response_body);
-                            }
-                        } else {
-                            response("404 Not Found", {
-                                    {"Content-Type", "text/plain"}
-                            }, Nexus::Base::FixedPool(post_not_found_resp.data(), post_not_found_resp.size()));
+                    }
+                    if (r == 0 || (r < 0 && GetLastNetworkError() != WSAEWOULDBLOCK)) {
+                        LINFO("WebSocket connection closed by {}", sock_.addr().url());
+                        cleanup();
+                        break;
+                    }
+                    if (now() - active_time_ > WebSocket::idle_timeout / 2) {
+                        websocket_->keepalive();
+                    }
+                    std::string_view pending;
+                    while (!(pending = websocket_->pending()).empty()) {
+                        r = send(sock_.fd(), pending.data(), static_cast<int>(std::min<uint64_t>(pending.size(), INT32_MAX)), 0);
+                        if (r <= 0) {
+                            break;
                         }
+                        websocket_->sent(r);
+                    }
+                    if (r < 0 && GetLastNetworkError() != WSAEWOULDBLOCK) {
+                        LWARN("Socket write error, closing WebSocket connection: {}. Errno: {} | {}", sock_.addr().url(), GetLastNetworkError(), GetLastSystemError());
+                        cleanup();
+                    } else if (websocket_->status() == WebSocket::status_t::CLOSED && websocket_->pending().empty()) {
+                        cleanup();
                     }
                     break;
                 }
-                case RESPONSE: {
-                    int r;
-                    do {
-                        auto buf = resp_stream_.read(1024);
-                        r = send(sock_.fd(), buf.reference().ptr(), static_cast<int>(buf.reference().size()), 0);
-                    } while (resp_stream_.flag() != Nexus::Base::SharedPool<>::flag_t::eof && r > 0);
-                    if (r < 0) {
-                        if (WSAGetLastError() != WSAEWOULDBLOCK) {
-                            LWARN("Socket write error, closing Socket connection: {}. Errno: {} | {}", sock_.addr().url(), GetLastNetworkError(), GetLastSystemError());
-                            cleanup();
-                        }
-                    } else if (r == 0) {
+                case STREAMING: {
+                    if (flush() != flush_t::DONE) {
+                        break;
+                    }
+                    // Nothing is expected from the client, reading only notices it leaving
+                    char probe[64];
+                    int r = recv(sock_.fd(), probe, sizeof(probe), 0);
+                    if (r == 0 || (r < 0 && GetLastNetworkError() != WSAEWOULDBLOCK)) {
+                        LINFO("Event stream closed by {}", sock_.addr().url());
+                        cleanup();
+                        break;
+                    }
+                    if (subscriber_->overflowed()) {
+                        LWARN("Event stream subscriber {} fell behind, closing", sock_.addr().url());
                         cleanup();
+                        break;
+                    }
+                    if (now() - active_time_ > EventBroker::heartbeat_interval) {
+                        subscriber_->push(EventBroker::Heartbeat());
+                    }
+                    // Send the queued events as they are, several per call
+                    std::string_view views[16];
+                    WSABUF bufs[16];
+                    uint64_t n;
+                    while ((n = subscriber_->gather(views, 16)) > 0) {
+                        for (uint64_t i = 0; i < n; ++i) {
+                            bufs[i].len = static_cast<ULONG>(views[i].size());
+                            bufs[i].buf = const_cast<char*>(views[i].data());
+                        }
+                        DWORD sent = 0;
+                        if (WSASend(sock_.fd(), bufs, static_cast<DWORD>(n), &sent, 0, nullptr, nullptr) == SOCKET_ERROR) {
+                            if (GetLastNetworkError() != WSAEWOULDBLOCK) {
+                                LWARN("Socket write error, closing event stream: {}. Errno: {} | {}", sock_.addr().url(), GetLastNetworkError(), GetLastSystemError());
+                                cleanup();
+                            }
+                            break;
+                        }
+                        active_time_ = now();
+                        subscriber_->sent(sent);
                     }
                     break;
                 }
                 case FINISHED:
                     break;
             }
+            track(queued, dequeued);
             mtx_.unlock();
         }
 
-        status_t status() {
-            return status_;
+        /* Record how long the connection stayed in the state it just left. Traced connections also record the state as a
+         * span, and how long the drive that left it waited in the work group. */
+        void track(uint64_t queued = 0, uint64_t dequeued = 0) {
+            if (status_ != tracked_) {
+                auto now = HttpMetrics::Micros();
+                HttpMetrics::http1_states[tracked_].observe(now - tracked_since_);
+                if (trace_ != 0) {
+                    auto tsc = Nexus::Metrics::Tracer::Now();
+                    Nexus::Metrics::Tracer::Span(trace_, HttpMetrics::http1_state_names[tracked_], "http1", traced_since_, tsc);
+                    if (queued != 0) {
+                        Nexus::Metrics::Tracer::Span(trace_, "queued", "workgroup", queued, dequeued);
+                    }
+                    traced_since_ = tsc;
+                }
+                tracked_ = status_;
+                tracked_since_ = now;
+            }
         }
-        template<bool auto_free = false>
-        void response(const std::string& status, const http_header_t& headers, const Nexus::Base::FixedPool<auto_free>& content) {
-            status_ = RESPONSE;
-            std::stringstream ss;
-            ss << "HTTP/1.1 ";
-            ss << status << "\r\n";
-            const_cast<http_header_t&>(headers).emplace("Content-Length", std::to_string(content.limit()));
-            std::ranges::for_each(headers, [&ss](const auto& pair) {
-                ss << pair.first << ": " << pair.second << "\r\n";
-            });
-            auto prefix = ss.str();
-            response_.write(prefix.data(), prefix.size());
-            response_.write("\r\n", 2);
-            response_.write(content.ptr(), content.limit());
-            resp_stream_.position(0);
+
+        uint64_t trace_id() {
+            return trace_;
         }
 
-        void response(const std::string& status, const http_header_t& headers) {
-            status_ = RESPONSE;
-            std::stringstream ss;
-            ss << "HTTP/1.1 ";
-            ss << status << "\r\n";
-            std::ranges::for_each(headers, [&ss](const auto& pair) {
-                ss << pair.first << ": " << pair.second << "\r\n";
+        /* Keep the connection past the response of a WebSocket or event stream route. */
+        void take_over(HttpHandlerFunctionSet& fs) {
+            if (fs.message) {
+                upgrade(fs);
+            } else {
+                subscribe(fs);
+            }
+        }
+
+        /* Answer an event stream request and park the connection on the topics the handler picked. */
+        void subscribe(HttpHandlerFunctionSet& fs) {
+            get_request gr { resolver_.resolve_headers() };
+            auto topics = fs.subscribe(gr);
+            if (topics.empty()) {
+                response("204 No Content", {});
+                return;
+            }
+            LINFO("New event stream subscriber: {} {}", resolver_.resolve_path(), sock_.addr().url());
+            response("200 OK", {
+                    {"Content-Type", "text/event-stream"},
+                    {"Cache-Control", "no-cache"}
             });
-            auto prefix = ss.str();
-            response_.write(prefix.data(), prefix.size());
-            response_.write("\r\n", 2);
-            resp_stream_.position(0);
+            status_ = STREAMING;
+            active_time_ = now();
+            subscriber_ = std::make_shared<EventSubscriber>();
+            for (auto& topic : topics) {
+                EventBroker::Subscribe(topic, subscriber_);
+            }
+            // Events are sent from the subscriber queue, the chunk buffer is never used again
+            chunk_.release();
+            request_.clear();
         }
 
-        void cleanup() {
-            if (status_ != FINISHED) {
-                status_ = FINISHED;
-                sock_.close();
+        /* Answer the opening handshake of a WebSocket endpoint and keep the connection for its frames. */
+        void upgrade(HttpHandlerFunctionSet& fs) {
+            http_header_t headers;
+            std::unique_ptr<WebSocketDeflate> deflate;
+            auto refused = WebSocketHandshake::Handshake(resolver_.resolve_headers(), headers, deflate);
+            if (!refused.empty()) {
+                response(refused, headers);
+                return;
             }
+            LINFO("WebSocket connection upgraded: {} {}", resolver_.resolve_path(), sock_.addr().url());
+            response("101 Switching Protocols", headers);
+            status_ = UPGRADED;
+            websocket_ = std::make_unique<WebSocket>(fs, sock_.addr().url(), std::move(deflate));
+            websocket_->open();
+            // Frames the client sent right behind its handshake
+            request_.trim_front(resolver_.resolve_header_end());
+            if (auto rest = request_.coalesce(); !rest.empty()) {
+                websocket_->feed(rest.data(), rest.size());
+            }
+            request_.clear();
         }
 
-        uint64_t time_established() {
-            return established_time_;
+        /* Whether a suspended coroutine handler can make progress, polled by the server loop. */
+        bool resumable() {
+            std::unique_lock lock(mtx_, std::try_to_lock);
+            return lock.owns_lock() && status_ == AWAITING && task_.ready();
         }
 
-        Socket& get_socket() {
-            return sock_;
+        status_t status() {
+            return status_;
         }
-    };
 
+        enum class flush_t {
+            DONE,
+            BLOCKED,
+            FAILED
+        };
+
+        /* Send what response_ holds, the head and a borrowed body go out in the same call. The connection is cleaned up when
+         * it fails. */
+        flush_t flush() {
+            std::string_view views[16];
+            WSABUF bufs[16];
+            uint64_t n;
+            while ((n = response_.gather(views, 16)) > 0) {
+                for (uint64_t i = 0; i < n; ++i) {
+                    bufs[i].len = static_cast<ULONG>(std::min<uint64_t>(views[i].size(), INT32_MAX));
+                    bufs[i].buf = const_cast<char*>(views[i].data());
+                }
+                DWORD sent = 0;
+                int r = WSASend(sock_.fd(), bufs, static_cast<DWORD>(n), &sent, 0, nullptr, nullptr);
+                if (r == 0 && sent > 0) {
+                    response_.trim_front(sent);
+                    active_time_ = now();
+                    continue;
+                }
+                if (r == SOCKET_ERROR && GetLastNetworkError() == WSAEWOULDBLOCK) {
+                    return flush_t::BLOCKED;
+                }
+                LWARN("Socket write error, closing Socket connection: {}. Errno: {} | {}", sock_.addr().url(), GetLastNetworkError(), GetLastSystemError());
+                cleanup();
+                return flush_t::FAILED;
+            }
+            return flush_t::DONE;
+        }
 
-    
+        void cleanup() {
+            if (websocket_) {
+                websocket_->drop();
+            }
+            if (status_ != FINISHED) {
+                // Upgraded and streaming connections outlive their request, only the handshake answer is timed
+                if (route_ && status_ != UPGRADED && status_ != STREAMING) {
+                    route_->duration.observe(HttpMetrics::Micros() - route_since_);
+                }
+                status_ = FINISHED;
+                track();
+                HttpMetrics::http1_connections.dec();
+                sock_.close();
+            }
+        }
 
+        /* Whether the connection should be dropped, upgraded and streaming ones have their own idle limits. */
+        bool expired(uint64_t now) {
+            // The sweep takes now once, a drive on another thread or the accept that follows may have moved active_time_ past it
+            if (now <= active_time_) {
+                return false;
+            }
+            if (status_ == UPGRADED) {
+                return now - active_time_ > WebSocket::idle_timeout;
+            }
+            if (status_ == STREAMING) {
+                // Sends advance active_time_, a peer that stopped reading blocks even the heartbeats until it is reaped
+                return now - active_time_ > EventBroker::stream_timeout;
+            }
+            return HttpConnectionBase::expired(now);
+        }
+    };
 }
\ No newline at end of file
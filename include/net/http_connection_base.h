@@ -0,0 +1,388 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <optional>
+#include <ranges>
+#include <sstream>
+#include "./socket.h"
+#include "../mem/ref.h"
+#include "./http_resolver.h"
+#include "../base/def.h"
+#include "../io/resource_locator.h"
+#include "http_handler.h"
+#include "http_task.h"
+#include "../log/logger.h"
+#include "http_metrics.h"
+#include "rate_limit.h"
+
+namespace Nexus::Net {
+    /*
+     * HttpConnectionBase is what HTTP/1.1 over TCP and over TLS have in common: reading the head and body of a request,
+     * routing it, running coroutine handlers and building the response into response_. C only moves bytes, it reads
+     * into consume(), sends response_ in flush() and closes in cleanup(). C has the states READ, EXECUTING, AWAITING and
+     * RESPONSE in its status_t and lets the base set status_.
+     * */
+    template<typename C>
+    class HttpConnectionBase : public Nexus::Base::RefCounted {
+    protected:
+        // Rebound by reuse(), a pooled connection serves the table of the listener it is handed out by
+        std::unordered_map<std::string, HttpHandlerFunctionSet>* handlers_;
+        Socket sock_;
+        uint64_t established_time_;
+        // Last time request bytes came in or response bytes went out, a request idle for idle_timeout is dropped
+        uint64_t active_time_;
+        static constexpr uint64_t idle_timeout = 10000;
+        http_request_buffer_t request_;
+        // What is left to send, flush() trims the front as it goes out
+        http_response_buffer_t response_;
+        // Bodies past inline_body are linked into response_ from the handler's memory, owned_body_ keeps a returned one alive
+        static constexpr uint64_t inline_body = 16384;
+        std::optional<http_response_body_t> owned_body_;
+        HttpProducer producer_;
+        // Chunks of a streamed body, a pooled connection gets a fresh one when a producer grew it past chunk_limit
+        static constexpr uint64_t chunk_size = 4096;
+        static constexpr uint64_t chunk_limit = 65536;
+        Nexus::Base::UniquePool<> chunk_;
+        HttpResolver resolver_;
+        bool header_done_ {false};
+        post_request post_ {};
+        HttpBodyReader body_reader_;
+        // Coroutine handler state, the context has to outlive the task
+        std::unique_ptr<HttpContext> context_;
+        HttpTask task_;
+        Nexus::IO::ResourceLocator::resource_ptr cached_;
+        uint64_t cached_pos_ {0};
+        // The route of the request and when its head was complete
+        RouteMetrics* route_ {nullptr};
+        uint64_t route_since_ {0};
+        // Bucket of the peer in the rate limiter, see rate_limit.h
+        uint64_t client_ {0};
+        std::mutex mtx_;
+
+        HttpConnectionBase(const Socket& sock, std::unordered_map<std::string, HttpHandlerFunctionSet>& handlers) : handlers_(&handlers), sock_(sock),
+                                                                                                                     chunk_(chunk_size), resolver_(request_) {}
+
+        C& self() {
+            return static_cast<C&>(*this);
+        }
+
+        /* Start the clocks of a new client. */
+        void open() {
+            established_time_ = now();
+            active_time_ = established_time_;
+            client_ = RateLimiter::Key(sock_.addr());
+        }
+
+        /* Drop what the finished request still holds and trim the buffers it grew. */
+        void recycle() {
+            request_.reset();
+            response_.reset();
+            owned_body_.reset();
+            producer_ = nullptr;
+            if (chunk_.capacity() > chunk_limit) {
+                chunk_ = Nexus::Base::UniquePool<>(chunk_size);
+            }
+            chunk_.clear();
+            resolver_.reset();
+            header_done_ = false;
+            post_ = {};
+            body_reader_ = {};
+            task_ = {};
+            context_.reset();
+            cached_.reset();
+            cached_pos_ = 0;
+            route_ = nullptr;
+            route_since_ = 0;
+        }
+    public:
+        /* Serialize the status line and headers, up to the empty line that ends them. */
+        static void WriteHead(http_response_buffer_t& out, const std::string& status, const http_header_t& headers) {
+            std::stringstream ss;
+            ss << "HTTP/1.1 ";
+            ss << status << "\r\n";
+            std::ranges::for_each(headers, [&ss](const auto& pair) {
+                ss << pair.first << ": " << pair.second << "\r\n";
+            });
+            auto prefix = ss.str();
+            out.append(prefix.data(), prefix.size());
+            out.append("\r\n", 2);
+        }
+
+        /* Count the request against its route, how long it took is recorded at cleanup. */
+        void route(const std::string& path) {
+            auto h = handlers_->find(path);
+            route_ = h != handlers_->end() && h->second.metrics ? h->second.metrics.get() : &HttpMetrics::static_route;
+            route_->requests.inc();
+            route_since_ = HttpMetrics::Micros();
+        }
+
+        /* Feed received bytes to the header buffer until the header is complete, then to the body reader. The header buffer
+         * never holds more than max_header_size bytes and body bytes are not copied into it. */
+        void consume(char* data, uint64_t len) {
+            active_time_ = now();
+            if (!header_done_) {
+                request_.append(data, len);
+                if (!resolver_.header_ended()) {
+                    if (request_.size() > max_header_size) {
+                        response("431 Request Header Fields Too Large", {});
+                    }
+                    return;
+                }
+                header_done_ = true;
+                // Refused before any routing, handler or file work
+                if (!RateLimiter::Global().take(client_)) {
+                    response("429 Too Many Requests", {
+                            {"Retry-After", "1"}
+                    });
+                    return;
+                }
+                route(resolver_.resolve_path());
+                auto method = resolver_.resolve_method();
+                if (method == http_method::GET) {
+                    self().status_ = C::EXECUTING;
+                    return;
+                } else if (method != http_method::POST) {
+                    response("405 Method Not Allowed", {});
+                    return;
+                }
+                auto path = resolver_.resolve_path();
+                if (handlers_->contains(path) && (handlers_->at(path).message || handlers_->at(path).subscribe)) {
+                    response("405 Method Not Allowed", {});
+                    return;
+                }
+                if (!handlers_->contains(path)) {
+                    response("404 Not Found", {
+                            {"Content-Type", "text/plain"}
+                    }, Nexus::Base::FixedPool(post_not_found_resp.data(), post_not_found_resp.size()));
+                    return;
+                }
+                auto& headers = resolver_.resolve_headers();
+                post_.request_handler = headers;
+                HttpBodyReader::sink_t sink;
+                if (auto& fs = handlers_->at(path); fs.async) {
+                    context_ = std::make_unique<HttpContext>(method, path, headers);
+                    context_->body_done_ = false;
+                    sink = [this](const char* d, uint64_t n) {
+                        context_->body_.append(d, n);
+                        return true;
+                    };
+                } else if (fs.body) {
+                    sink = [this, &fs](const char* d, uint64_t n) { return fs.body(post_, d, n); };
+                } else {
+                    sink = [this](const char* d, uint64_t n) { return post_.request_body.append(d, n); };
+                }
+                auto max_body = handlers_->at(path).max_body;
+                if (headers.contains("Transfer-Encoding") && headers["Transfer-Encoding"].find("chunked") != std::string::npos) {
+                    body_reader_ = HttpBodyReader(std::move(sink));
+                    body_reader_.set_limit(max_body);
+                } else if (headers.contains("Content-Length")) {
+                    uint64_t length;
+                    try {
+                        length = std::stoull(headers["Content-Length"]);
+                    } catch (std::exception& e) {
+                        response("400 Bad Request", {});
+                        return;
+                    }
+                    if (length > max_body) {
+                        response("413 Content Too Large", {});
+                        return;
+                    }
+                    body_reader_ = HttpBodyReader(std::move(sink), length);
+                } else {
+                    response("411 Length Required", {});
+                    return;
+                }
+                // Whatever followed the header in the same read is the beginning of the body
+                request_.trim_front(resolver_.resolve_header_end());
+                auto rest = request_.coalesce();
+                len = rest.size();
+                data = len > 0 ? const_cast<char*>(rest.data()) : data;
+            }
+            switch (body_reader_.feed(data, len)) {
+                case HttpBodyReader::status_t::COMPLETE:
+                    if (context_) {
+                        context_->body_done_ = true;
+                    } else {
+                        self().status_ = C::EXECUTING;
+                    }
+                    break;
+                case HttpBodyReader::status_t::MALFORMED:
+                    response("400 Bad Request", {});
+                    break;
+                case HttpBodyReader::status_t::TOO_LARGE:
+                    response("413 Content Too Large", {});
+                    break;
+                default:
+                    break;
+            }
+            if (context_ && !task_.valid() && self().status_ == C::READ) {
+                start_task(handlers_->at(context_->path));
+            }
+        }
+
+        /* Answer a request that is complete, routes that keep the connection past the response are handed to C. */
+        void execute() {
+            auto path = resolver_.resolve_path();
+            if (resolver_.resolve_method() == http_method::GET) {
+                LINFO("New {} Request: GET {} from {}", C::scheme, path, sock_.addr().url());
+                if (handlers_->contains(path)) {
+                    HttpHandlerFunctionSet& fs = handlers_->at(path);
+                    if (fs.message || fs.subscribe) {
+                        self().take_over(fs);
+                        return;
+                    }
+                    if (fs.async) {
+                        context_ = std::make_unique<HttpContext>(http_method::GET, path, resolver_.resolve_headers());
+                        start_task(fs);
+                        return;
+                    }
+                    get_request gr { resolver_.resolve_headers() };
+                    http_response resp = fs.get(gr);
+                    response(resp);
+                } else {
+                    if (path == "/") {
+                        path.append("index.html");
+                    }
+                    auto r = Nexus::IO::ResourceLocator::LocateResource(path);
+                    if (r.is_valid()) {
+                        response(r.reference());
+                    } else {
+                        response("404 Not Found", {
+                                {"Content-Type", "text/html"}
+                        }, Nexus::Base::FixedPool(get_not_found_resp.data(), get_not_found_resp.size()));
+                    }
+                }
+            } else if (resolver_.resolve_method() == http_method::POST) {
+                LINFO("New {} Request: POST {} from {}", C::scheme, path, sock_.addr().url());
+                http_response resp = handlers_->at(path).post(post_);
+                response(resp);
+            }
+        }
+
+        /* Run a coroutine handler until its first suspension. */
+        void start_task(HttpHandlerFunctionSet& fs) {
+            LINFO("New {} Request: {} {} (async) from {}", C::scheme, context_->method == http_method::GET ? "GET" : "POST", context_->path, sock_.addr().url());
+            task_ = fs.async(*context_);
+            settle();
+        }
+
+        /* Act on where the coroutine handler stopped: respond once it returned, send the response head once it started writing. */
+        void settle() {
+            if (task_.done()) {
+                if (task_.failed()) {
+                    if (producer_) {
+                        // The head is already out, there is no way to report the failure
+                        self().cleanup();
+                    } else {
+                        response("500 Internal Server Error", {});
+                    }
+                    return;
+                }
+                auto& resp = task_.result();
+                if (!context_->streaming_) {
+                    response(resp);
+                    return;
+                }
+                if (resp.response_body.limit() > 0) {
+                    context_->out_.append(resp.response_body.ptr(), resp.response_body.limit());
+                }
+            }
+            if (context_->streaming_ && !producer_) {
+                auto headers = context_->response_header;
+                headers.emplace("Transfer-Encoding", "chunked");
+                response(context_->response_type, headers);
+                producer_ = [this](Nexus::Base::UniquePool<>& pool) {
+                    if (!context_->out_.empty()) {
+                        pool.write(context_->out_.data(), context_->out_.size());
+                        context_->out_.clear();
+                    }
+                    return !(task_.done() && context_->out_.empty());
+                };
+            }
+            self().status_ = task_.done() ? C::RESPONSE : C::AWAITING;
+        }
+
+        template<bool auto_free = false, typename A = Nexus::Base::HeapAllocator>
+        void response(const std::string& status, const http_header_t& headers, const Nexus::Base::FixedPool<auto_free, A>& content) {
+            self().status_ = C::RESPONSE;
+            const_cast<http_header_t&>(headers).emplace("Content-Length", std::to_string(content.limit()));
+            WriteHead(response_, status, headers);
+            if (content.limit() <= inline_body) {
+                response_.append(content.ptr(), content.limit());
+            } else {
+                response_.append_external(content.ptr(), content.limit());
+            }
+        }
+
+        void response(const std::string& status, const http_header_t& headers) {
+            self().status_ = C::RESPONSE;
+            WriteHead(response_, status, headers);
+        }
+
+        /* Respond with what a handler returned. */
+        void response(http_response& resp) {
+            if (resp.response_producer) {
+                resp.response_header.emplace("Transfer-Encoding", "chunked");
+                response(resp.response_type, resp.response_header);
+                producer_ = std::move(resp.response_producer);
+            } else if (resp.response_body.limit() == 0) {
+                response(resp.response_type, resp.response_header);
+            } else if (resp.response_body.limit() <= inline_body) {
+                response<true>(resp.response_type, resp.response_header, resp.response_body);
+            } else {
+                owned_body_.emplace(std::move(resp.response_body));
+                response<true>(resp.response_type, resp.response_header, *owned_body_);
+            }
+        }
+
+        /* Send a cached resource as it is, its wire image already carries the status line and headers. */
+        void response(const Nexus::IO::ResourceLocator::resource_ptr& resource) {
+            self().status_ = C::RESPONSE;
+            cached_ = resource;
+            cached_pos_ = 0;
+        }
+
+        /* Frame the next piece of the producer as a chunk into response_. Return false when the producer had nothing ready. */
+        bool pull() {
+            chunk_.clear();
+            bool more = producer_(chunk_);
+            response_.clear();
+            if (chunk_.limit() > 0) {
+                auto size = std::format("{:x}\r\n", chunk_.limit());
+                response_.append(size.data(), size.size());
+                response_.append(&chunk_[0], chunk_.limit());
+                response_.append("\r\n", 2);
+            }
+            if (!more) {
+                response_.append("0\r\n\r\n", 5);
+                producer_ = nullptr;
+            }
+            return !response_.empty();
+        }
+
+        uint64_t time_established() {
+            return established_time_;
+        }
+
+        /* Whether the request stalled, a slow client keeps the connection as long as bytes move either way. */
+        bool expired(uint64_t now) {
+            return now > active_time_ && now - active_time_ > idle_timeout;
+        }
+
+        static uint64_t now() {
+            return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+        }
+
+        Socket& get_socket() {
+            return sock_;
+        }
+
+        void lock() {
+            mtx_.lock();
+        }
+
+        void unlock() {
+            mtx_.unlock();
+        }
+    };
+}
\ No newline at end of file
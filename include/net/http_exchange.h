@@ -0,0 +1,312 @@
+#pragma once
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include "./http_body.h"
+#include "./http_handler.h"
+#include "./http_resolver.h"
+#include "./http_task.h"
+#include "./http_metrics.h"
+#include "../base/def.h"
+#include "../io/resource_locator.h"
+#include "../mem/memory.h"
+
+namespace Nexus::Net {
+    /*
+     * HttpExchange is one request and its response on a multiplexed connection. The request is routed to the handler table or
+     * the ResourceLocator the same way HttpConnection does it, the response comes out as a head followed by body pieces and
+     * the protocol only adds its framing. Field names of the response head are lower case.
+     * */
+    class HttpExchange {
+    public:
+        std::string method;
+        std::string path;
+        http_header_t headers;
+        // Response head, valid once responded()
+        std::string status;
+        http_header_t response_header;
+    private:
+        std::unordered_map<std::string, HttpHandlerFunctionSet>& handlers_;
+        bool remote_done_ {false};
+        bool responded_ {false};
+        bool aborted_ {false};
+        HttpHandlerFunctionSet* fs_ {nullptr};
+        post_request post_ {};
+        HttpBodyReader::sink_t sink_;
+        // Body bytes taken so far, the route's max_body caps them
+        uint64_t received_ {0};
+        std::unique_ptr<HttpContext> context_;
+        HttpTask task_;
+        std::optional<http_response_body_t> body_;
+        Nexus::IO::ResourceLocator::resource_ptr resource_;
+        const char* data_ {nullptr};
+        uint64_t data_size_ {0};
+        uint64_t data_pos_ {0};
+        // Streamed bodies come from the producer or the coroutine handler, through pending_
+        bool streaming_ {false};
+        HttpProducer producer_;
+        std::string pending_;
+        std::optional<Nexus::Base::UniquePool<>> chunk_;
+        // The route of the request and when it started, the duration is recorded when the exchange goes away
+        RouteMetrics* route_ {nullptr};
+        uint64_t route_since_ {0};
+
+        void execute() {
+            if (method == "POST") {
+                http_response resp = fs_->post(post_);
+                respond(resp);
+                return;
+            }
+            if (auto h = handlers_.find(path); h != handlers_.end()) {
+                get_request gr { headers };
+                http_response resp = h->second.get(gr);
+                respond(resp);
+                return;
+            }
+            auto r = Nexus::IO::ResourceLocator::LocateResource(path == "/" ? std::string("/index.html") : path);
+            if (r.is_valid()) {
+                respond(r.reference());
+            } else {
+                respond("404 Not Found", {{"content-type", "text/html"}}, get_not_found_resp);
+            }
+        }
+
+        void start_task(HttpHandlerFunctionSet& fs) {
+            task_ = fs.async(*context_);
+            settle();
+        }
+
+        /* Same as HttpConnection::settle, a failure after the head was sent aborts the exchange. */
+        void settle() {
+            if (task_.done()) {
+                if (task_.failed()) {
+                    if (responded_) {
+                        aborted_ = true;
+                    } else {
+                        respond("500 Internal Server Error", {}, {});
+                    }
+                    return;
+                }
+                auto& resp = task_.result();
+                if (!context_->streaming_) {
+                    respond(resp);
+                    return;
+                }
+                if (resp.response_body.limit() > 0) {
+                    context_->out_.append(resp.response_body.ptr(), resp.response_body.limit());
+                }
+            }
+            if (context_->streaming_ && !responded_) {
+                respond(context_->response_type, context_->response_header, {});
+                streaming_ = true;
+            }
+        }
+
+        /* Set the response head, content has to outlive the exchange. */
+        void respond(std::string_view status_line, http_header_t fields, std::string_view content) {
+            responded_ = true;
+            status = std::string(status_line.substr(0, status_line.find(' ')));
+            response_header.clear();
+            for (auto& [key, value] : fields) {
+                std::string name(key);
+                std::ranges::transform(name, name.begin(), [](unsigned char c) { return std::tolower(c); });
+                response_header[name] = std::move(value);
+            }
+            if (!context_ || !context_->streaming_) {
+                response_header["content-length"] = std::to_string(content.size());
+            }
+            data_ = content.data();
+            data_size_ = content.size();
+        }
+
+        void respond(http_response& resp) {
+            if (resp.response_producer) {
+                respond(resp.response_type, std::move(resp.response_header), {});
+                response_header.erase("content-length");
+                producer_ = std::move(resp.response_producer);
+                streaming_ = true;
+                return;
+            }
+            body_.emplace(std::move(resp.response_body));
+            respond(resp.response_type, std::move(resp.response_header), {body_->ptr(), body_->limit()});
+        }
+
+        void respond(const Nexus::IO::ResourceLocator::resource_ptr& resource) {
+            resource_ = resource;
+            respond("200 OK", {{"content-type", resource->mime}}, {resource->data.ptr(), resource->data.limit()});
+        }
+    public:
+        explicit HttpExchange(std::unordered_map<std::string, HttpHandlerFunctionSet>& handlers) : handlers_(handlers) {}
+        HttpExchange(const HttpExchange&) = delete;
+
+        ~HttpExchange() {
+            if (route_ && responded_) {
+                route_->duration.observe(HttpMetrics::Micros() - route_since_);
+            }
+        }
+
+        /* Route the request once method, path and headers are known. Handlers other than coroutines run at end(). */
+        void start(bool remote_done) {
+            remote_done_ = remote_done;
+            auto h = handlers_.find(path);
+            route_ = h != handlers_.end() && h->second.metrics ? h->second.metrics.get() : &HttpMetrics::static_route;
+            route_->requests.inc();
+            route_since_ = HttpMetrics::Micros();
+            if (method == "GET") {
+                if (h != handlers_.end() && h->second.async) {
+                    context_ = std::make_unique<HttpContext>(http_method::GET, path, headers);
+                    start_task(h->second);
+                } else if (remote_done_) {
+                    execute();
+                }
+            } else if (method == "POST") {
+                if (h == handlers_.end()) {
+                    respond("404 Not Found", {{"content-type", "text/plain"}}, post_not_found_resp);
+                    return;
+                }
+                fs_ = &h->second;
+                if (auto cl = headers.find("content-length"); cl != headers.end() && std::strtoull(cl->second.c_str(), nullptr, 10) > fs_->max_body) {
+                    respond("413 Content Too Large", {}, {});
+                    return;
+                }
+                if (fs_->async) {
+                    context_ = std::make_unique<HttpContext>(http_method::POST, path, headers);
+                    context_->body_done_ = remote_done_;
+                    sink_ = [this](const char* d, uint64_t n) {
+                        context_->body_.append(d, n);
+                        return true;
+                    };
+                    start_task(*fs_);
+                    return;
+                }
+                post_.request_handler = headers;
+                if (fs_->body) {
+                    sink_ = [this](const char* d, uint64_t n) { return fs_->body(post_, d, n); };
+                } else {
+                    sink_ = [this](const char* d, uint64_t n) { return post_.request_body.append(d, n); };
+                }
+                if (remote_done_) {
+                    execute();
+                }
+            } else {
+                respond("405 Method Not Allowed", {}, {});
+            }
+        }
+
+        /* Answer without routing the request, its body is dropped. */
+        void refuse(std::string_view status_line, http_header_t fields, bool remote_done) {
+            remote_done_ = remote_done;
+            respond(status_line, std::move(fields), {});
+        }
+
+        /* Request body bytes, false when the handler rejected them or they ran past max_body after the head was sent. Bodies
+         * of requests that were already answered are dropped. */
+        bool body(const char* data, uint64_t len) {
+            if (!sink_) {
+                return true;
+            }
+            received_ += len;
+            if (received_ > fs_->max_body) {
+                if (responded_) {
+                    return false;
+                }
+                // The handler never sees the rest, a suspended coroutine is dropped with it
+                task_ = {};
+                sink_ = nullptr;
+                respond("413 Content Too Large", {}, {});
+                return true;
+            }
+            return sink_(data, len);
+        }
+
+        /* The request is complete. */
+        void end() {
+            remote_done_ = true;
+            if (context_) {
+                context_->body_done_ = true;
+            } else if (!responded_) {
+                execute();
+            }
+        }
+
+        /* Whether the coroutine handler can be resumed. */
+        bool ready() const {
+            return task_.ready();
+        }
+
+        void resume() {
+            task_.resume();
+            settle();
+        }
+
+        bool remote_done() const {
+            return remote_done_;
+        }
+
+        bool responded() const {
+            return responded_;
+        }
+
+        /* The handler failed after the head was sent, the protocol has to reset the stream. */
+        bool aborted() const {
+            return aborted_;
+        }
+
+        /* Whether the coroutine handler holds as much unread body as it may, the protocol should stop granting credit. */
+        bool backlogged() const {
+            return context_ && context_->body_.size() >= HttpContext::body_window;
+        }
+
+        /* Whether the response has no body at all, known as soon as it responded. */
+        bool bodiless() const {
+            return !streaming_ && data_size_ == 0;
+        }
+
+        /* Bytes of body that can be sent now, starting at peek(). */
+        uint64_t available() {
+            if (!streaming_) {
+                return data_size_ - data_pos_;
+            }
+            if (pending_.empty()) {
+                if (context_ && context_->streaming_ && !context_->out_.empty()) {
+                    pending_.swap(context_->out_);
+                } else if (producer_) {
+                    if (!chunk_) chunk_.emplace(4096);
+                    chunk_->clear();
+                    if (!producer_(*chunk_)) {
+                        producer_ = nullptr;
+                    }
+                    if (chunk_->limit() > 0) {
+                        pending_.assign(&(*chunk_)[0], chunk_->limit());
+                    }
+                }
+            }
+            return pending_.size();
+        }
+
+        const char* peek() const {
+            return streaming_ ? pending_.data() : data_ + data_pos_;
+        }
+
+        void consume(uint64_t n) {
+            if (streaming_) {
+                pending_.erase(0, n);
+            } else {
+                data_pos_ += n;
+            }
+        }
+
+        /* Whether nothing follows what available() reported. */
+        bool finishing() const {
+            if (!streaming_) return true;
+            if (producer_) return false;
+            return !context_ || !context_->streaming_ || (task_.done() && context_->out_.empty());
+        }
+    };
+}
\ No newline at end of file
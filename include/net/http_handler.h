@@ -2,36 +2,138 @@
 
 #include <unordered_map>
 #include <string>
+#include <string_view>
+#include <vector>
+#include <any>
+#include <functional>
+#include <memory>
 #include "../mem/memory.h"
+#include "../mem/tracking.h"
+#include "./http_body.h"
+#include "../base/def.h"
 
 
 using http_header_t = std::unordered_map<std::string, std::string>;
 
-using http_response = struct {
+// Pulled by the connection each time the previous piece has been sent. Append the next piece to the pool and return true,
+// or return false after appending the last one. Returning true without appending means nothing is ready yet.
+using HttpProducer = std::function<bool(Nexus::Base::UniquePool<>&)>;
+
+// Memory of response bodies handlers build, accounted as handler_bodies, see tracking.h
+using http_body_allocator_t = Nexus::Base::TrackingAllocator<Nexus::Base::HANDLER_BODIES>;
+using http_response_body_t = Nexus::Base::FixedPool<true, http_body_allocator_t>;
+
+struct http_response {
     std::string response_type;
     http_header_t response_header;
-    Nexus::Base::FixedPool<true, Nexus::Base::HeapAllocator> response_body;
+    http_response_body_t response_body;
+    // When set, the body is streamed with chunked transfer coding and response_body is ignored
+    HttpProducer response_producer {};
 };
 
-using get_request = struct {
+struct get_request {
     http_header_t request_handler;
 };
 
-using post_request = struct {
+struct post_request {
     http_header_t request_handler;
-    Nexus::Base::FixedPool<true, Nexus::Base::HeapAllocator> request_body;
+    Nexus::Net::HttpBody request_body;
+    // Per-request state for streaming handlers, kept from the first body chunk until doPost
+    std::any context;
 };
 
+namespace Nexus::Net {
+    class HttpContext;
+    class HttpTask;
+    class WebSocket;
+    struct RouteMetrics;
+}
+
 using GetFunction = std::function<http_response(get_request&)>;
 using PostFunction = std::function<http_response(post_request&)>;
+// Receives body chunks as they arrive, return false to reject the request
+using BodyFunction = std::function<bool(post_request&, const char*, uint64_t)>;
+// Coroutine handler serving every method of its path, see http_task.h
+using AsyncFunction = std::function<Nexus::Net::HttpTask(Nexus::Net::HttpContext&)>;
+// WebSocket callbacks, see websocket.h. Messages are complete and already inflated, the bool tells binary from text
+using OpenFunction = std::function<void(Nexus::Net::WebSocket&)>;
+using MessageFunction = std::function<void(Nexus::Net::WebSocket&, std::string_view, bool)>;
+using CloseFunction = std::function<void(Nexus::Net::WebSocket&, uint16_t)>;
+// Topics a text/event-stream request subscribes to, see event_stream.h. None answers 204 so the client stops reconnecting
+using SubscribeFunction = std::function<std::vector<std::string>(get_request&)>;
 
 struct HttpHandlerFunctionSet {
     GetFunction get;
     PostFunction post;
+    // Empty unless the handler streams its body, otherwise the body is buffered into post_request::request_body
+    BodyFunction body;
+    // Takes precedence over get, post and body when set
+    AsyncFunction async;
+    // Set for WebSocket endpoints, which answer upgrade requests only
+    OpenFunction open;
+    MessageFunction message;
+    CloseFunction close;
+    // Set for event stream endpoints, which keep GET requests open for published events
+    SubscribeFunction subscribe;
+    // Set by the server the handler was added to, see http_metrics.h
+    std::shared_ptr<Nexus::Net::RouteMetrics> metrics;
+    // Request bodies past this many bytes are refused with 413
+    uint64_t max_body {max_body_size};
 };
 
 template<typename H>
 concept IsHttpHandler = requires {
     { H::doGet(get_request{}) } -> std::same_as<http_response>;
-    { H::doPost(post_request{{}, Nexus::Base::FixedPool<true, Nexus::Base::HeapAllocator>(nullptr, 1024)}) } -> std::same_as<http_response>;
-};
\ No newline at end of file
+    { H::doPost(post_request{}) } -> std::same_as<http_response>;
+};
+
+template<typename H>
+concept IsStreamingHttpHandler = IsHttpHandler<H> && requires(post_request& pr) {
+    { H::doBody(pr, nullptr, 0) } -> std::same_as<bool>;
+};
+
+template<typename H>
+concept IsAsyncHttpHandler = requires(Nexus::Net::HttpContext& ctx) {
+    { H::doAsync(ctx) } -> std::same_as<Nexus::Net::HttpTask>;
+};
+
+template<typename H>
+concept IsWebSocketHandler = requires(Nexus::Net::WebSocket& ws, std::string_view msg) {
+    { H::doMessage(ws, msg, true) } -> std::same_as<void>;
+};
+
+template<typename H>
+concept IsEventStreamHandler = requires(get_request& gr) {
+    { H::doSubscribe(gr) } -> std::same_as<std::vector<std::string>>;
+};
+
+template<typename H> requires IsHttpHandler<H> || IsAsyncHttpHandler<H> || IsWebSocketHandler<H> || IsEventStreamHandler<H>
+inline HttpHandlerFunctionSet make_handler_function_set() {
+    HttpHandlerFunctionSet fs {};
+    if constexpr (IsHttpHandler<H>) {
+        fs.get = H::doGet;
+        fs.post = H::doPost;
+    }
+    if constexpr (IsStreamingHttpHandler<H>) {
+        fs.body = H::doBody;
+    }
+    if constexpr (IsAsyncHttpHandler<H>) {
+        fs.async = H::doAsync;
+    }
+    if constexpr (IsWebSocketHandler<H>) {
+        fs.message = H::doMessage;
+        if constexpr (requires(Nexus::Net::WebSocket& ws) { H::doOpen(ws); }) {
+            fs.open = H::doOpen;
+        }
+        if constexpr (requires(Nexus::Net::WebSocket& ws) { H::doClose(ws, uint16_t{}); }) {
+            fs.close = H::doClose;
+        }
+    }
+    if constexpr (IsEventStreamHandler<H>) {
+        fs.subscribe = H::doSubscribe;
+    }
+    if constexpr (requires { { H::max_body } -> std::convertible_to<uint64_t>; }) {
+        fs.max_body = H::max_body;
+    }
+    return fs;
+}
\ No newline at end of file
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <chrono>
+#include <string>
+#include <vector>
+#include "../metrics/metrics.h"
+
+namespace Nexus::Net {
+    /* Requests and latency of one route, kept with its handler. */
+    struct RouteMetrics {
+        Nexus::Metrics::Counter requests;
+        Nexus::Metrics::Histogram duration;
+
+        explicit RouteMetrics(const std::string& route) :
+            requests("nexus_route_requests_total", "Requests routed, by handler path", {{"route", route}}),
+            duration("nexus_route_duration_seconds", "From a complete request head to the end of its response", {{"route", route}}) {}
+    };
+
+    /*
+     * HttpMetrics are the series the servers record: requests per protocol, open connections, and the time connections
+     * spend in each of their states. Requests no handler takes, static files and not found answers, share the "static"
+     * route.
+     * */
+    struct HttpMetrics {
+        /* Histograms of the time connections of a protocol spend in each state, indexed by the connection's status_t. */
+        template<uint64_t N>
+        static std::vector<Nexus::Metrics::Histogram> States(const std::string& protocol, const char* const (&states)[N]) {
+            std::vector<Nexus::Metrics::Histogram> v;
+            for (auto state : states) {
+                v.emplace_back("nexus_connection_state_seconds", "Time connections spend in a state", Nexus::Metrics::labels_t {{"protocol", protocol}, {"state", state}});
+            }
+            return v;
+        }
+
+        inline static Nexus::Metrics::Counter http1_requests {"nexus_requests_total", "Requests served, by protocol", {{"protocol", "http/1.1"}}};
+        inline static Nexus::Metrics::Counter https_requests {"nexus_requests_total", "Requests served, by protocol", {{"protocol", "https/1.1"}}};
+        inline static Nexus::Metrics::Counter h2_requests {"nexus_requests_total", "Requests served, by protocol", {{"protocol", "h2"}}};
+        inline static Nexus::Metrics::Counter h3_requests {"nexus_requests_total", "Requests served, by protocol", {{"protocol", "h3"}}};
+        inline static Nexus::Metrics::Gauge http1_connections {"nexus_connections", "Open connections, by protocol", {{"protocol", "http/1.1"}}};
+        inline static Nexus::Metrics::Gauge https_connections {"nexus_connections", "Open connections, by protocol", {{"protocol", "https"}}};
+        inline static RouteMetrics static_route {"static"};
+        // Names of the status_t values of HttpConnection and HttpsConnection, in order
+        static constexpr const char* http1_state_names[] = {"read", "executing", "awaiting", "response", "upgraded", "streaming", "finished"};
+        static constexpr const char* https_state_names[] = {"handshake", "read", "executing", "awaiting", "response", "finished", "multiplexing"};
+        inline static std::vector<Nexus::Metrics::Histogram> http1_states = States("http/1.1", http1_state_names);
+        inline static std::vector<Nexus::Metrics::Histogram> https_states = States("https", https_state_names);
+
+        /* Every request the servers answered, what statistics_handler reports. */
+        static uint64_t Requests() {
+            return http1_requests.value() + https_requests.value() + h2_requests.value() + h3_requests.value();
+        }
+
+        static uint64_t Micros() {
+            return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+        }
+    };
+}
\ No newline at end of file
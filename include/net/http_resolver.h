@@ -1,6 +1,8 @@
 #pragma once
 
-#include "../mem/memory.h"
+#include "../mem/iobuf.h"
+#include "../mem/arena.h"
+#include "../mem/tracking.h"
 #include "./http_handler.h"
 #include "../../thirdparty/picohttpparser/picohttpparser.h"
 #include <iostream>
@@ -13,13 +15,18 @@ namespace Nexus::Net {
         UNSUPPORTED
     };
 
+    // Request and response storage of connections, see arena.h for where its memory comes from and tracking.h for how it
+    // is accounted
+    using http_request_buffer_t = Nexus::Base::IOBuf<Nexus::Base::TrackingAllocator<Nexus::Base::REQUEST_BUFFERS, Nexus::Base::ArenaAllocator>>;
+    using http_response_buffer_t = Nexus::Base::IOBuf<Nexus::Base::TrackingAllocator<Nexus::Base::RESPONSE_BUFFERS, Nexus::Base::ArenaAllocator>>;
+
     class HttpResolver {
     private:
         http_header_t headers_;
         std::string method_;
         std::string path_;
         uint64_t request_len_;
-        Nexus::Base::SharedPool<Nexus::Base::AlignedHeapAllocator<4>> buffer_;
+        http_request_buffer_t& buffer_;
         bool cached_ {false};
         bool resolve(const char* str, uint64_t size) {
             const char *method, *path;
@@ -48,10 +55,11 @@ namespace Nexus::Net {
             }
         }
     public:
-        explicit HttpResolver(Nexus::Base::SharedPool<Nexus::Base::AlignedHeapAllocator<4>>& pool) : buffer_(pool) {}
+        explicit HttpResolver(http_request_buffer_t& buffer) : buffer_(buffer) {}
+        /* Parse what the buffer holds, it is made contiguous for the parser. */
         bool header_ended() {
-            using namespace Nexus::Base;
-            return (resolve(&buffer_[0], buffer_.limit()));
+            auto head = buffer_.coalesce();
+            return resolve(head.data(), head.size());
         }
         http_header_t& resolve_headers() {
             return headers_;
@@ -71,5 +79,14 @@ namespace Nexus::Net {
         uint64_t resolve_header_end() {
             return request_len_;
         }
+
+        /* Forget the last request, for a connection that is reused. The header map keeps its buckets. */
+        void reset() {
+            headers_.clear();
+            method_.clear();
+            path_.clear();
+            request_len_ = 0;
+            cached_ = false;
+        }
     };
 }
\ No newline at end of file
@@ -6,25 +6,46 @@
 #include "http_connection.h"
 #include "http_handler.h"
 #include "../parallel/worker.h"
+#include "./admission.h"
+#include "./connection_pool.h"
+#include "./slot_map.h"
+#include "./proxy.h"
 
 namespace Nexus::Net {
     template<typename MUX, int N>
     class HttpServer {
     private:
         Nexus::IO::IOMultiplexer<MUX> iomux_;
-        std::unordered_map<io_handle_t, std::shared_ptr<HttpConnection>> connections_;
+        SlotMap<Nexus::Base::Ref<HttpConnection>> connections_;
+        // Finished connections waiting for the next clients
+        ConnectionPool<HttpConnection> pool_;
         std::unordered_map<std::string, HttpHandlerFunctionSet> handlers_;
         Socket sock_;
+        Admission admission_;
+        socket_profile_t profile_;
         bool flag_ {false};
         Nexus::Parallel::WorkGroup<N>& group_;
     public:
-        // Establish a socket using given addresses
-        explicit HttpServer(Nexus::Utils::NetAddr addr, Nexus::Parallel::WorkGroup<N>& group);
+        // Establish a socket using given addresses, tuned with profile
+        explicit HttpServer(Nexus::Utils::NetAddr addr, Nexus::Parallel::WorkGroup<N>& group, const socket_profile_t& profile = {});
         // Add http handler with given path
-        template<typename H> requires IsHttpHandler<H>
+        template<typename H> requires IsHttpHandler<H> || IsAsyncHttpHandler<H> || IsWebSocketHandler<H> || IsEventStreamHandler<H>
         void add_handler(const std::string& path) {
-            HttpHandlerFunctionSet fs {H::doGet, H::doPost};
-            handlers_[path] = fs;
+            handlers_[path] = make_handler_function_set<H>();
+            handlers_[path].metrics = std::make_shared<RouteMetrics>(path);
+        }
+        // Forward every request of path to the upstreams, see proxy.h
+        void add_proxy(const std::string& path, std::shared_ptr<UpstreamGroup> upstreams) {
+            handlers_[path] = make_proxy_function_set(std::move(upstreams));
+            handlers_[path].metrics = std::make_shared<RouteMetrics>(path);
+        }
+        // Connections this listener may hold at once, 0 leaves only the global limit
+        void limit_connections(uint64_t max) {
+            admission_.set_limit(max);
+        }
+        // Connections open on this listener
+        uint64_t connections() const {
+            return connections_.size();
         }
         // Start the accept loops, subsequent operations are completed by callback
         void loop();
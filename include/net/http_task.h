@@ -0,0 +1,204 @@
+#pragma once
+
+#include <chrono>
+#include <coroutine>
+#include <exception>
+#include <optional>
+#include <string>
+#include "./http_handler.h"
+#include "./http_resolver.h"
+
+#ifdef PLATFORM_WIN32
+#include "../platform/win32/win32_io.h"
+#endif
+
+namespace Nexus::Net {
+#ifdef PLATFORM_WIN32
+    using AsyncFileRead = Nexus::IO::Win32AsyncFileRead;
+#endif
+
+    class HttpAwaitable;
+
+    /*
+     * HttpTask is the return type of coroutine handlers. The handler runs on the connection's driving thread until its first
+     * co_await, the connection then polls the awaited object and resumes the handler from a later drive once it is ready.
+     * */
+    class HttpTask {
+    public:
+        struct promise_type {
+            std::optional<http_response> response;
+            HttpAwaitable* waiting {nullptr};
+            std::exception_ptr exception;
+
+            HttpTask get_return_object() {
+                return HttpTask(std::coroutine_handle<promise_type>::from_promise(*this));
+            }
+            std::suspend_never initial_suspend() noexcept { return {}; }
+            std::suspend_always final_suspend() noexcept { return {}; }
+            void return_value(http_response resp) {
+                response.emplace(std::move(resp));
+            }
+            void unhandled_exception() {
+                exception = std::current_exception();
+            }
+        };
+    private:
+        std::coroutine_handle<promise_type> handle_;
+    public:
+        HttpTask() = default;
+        explicit HttpTask(std::coroutine_handle<promise_type> handle) : handle_(handle) {}
+        HttpTask(const HttpTask&) = delete;
+        HttpTask(HttpTask&& task) noexcept : handle_(task.handle_) {
+            task.handle_ = nullptr;
+        }
+        HttpTask& operator=(HttpTask&& task) noexcept {
+            if (this != &task) {
+                if (handle_) handle_.destroy();
+                handle_ = task.handle_;
+                task.handle_ = nullptr;
+            }
+            return *this;
+        }
+
+        bool valid() const {
+            return static_cast<bool>(handle_);
+        }
+
+        bool done() const {
+            return handle_ && handle_.done();
+        }
+
+        /* The handler finished without a response, either by throwing or by falling off the end. */
+        bool failed() const {
+            return done() && (handle_.promise().exception || !handle_.promise().response.has_value());
+        }
+
+        /* Whether the awaited object is ready and the handler can be resumed. */
+        bool ready() const;
+
+        void resume() {
+            handle_.promise().waiting = nullptr;
+            handle_.resume();
+        }
+
+        http_response& result() {
+            return *handle_.promise().response;
+        }
+
+        ~HttpTask() {
+            if (handle_) handle_.destroy();
+        }
+    };
+
+    /* Base of everything a coroutine handler can co_await. */
+    class HttpAwaitable {
+    public:
+        virtual bool ready() = 0;
+        bool await_ready() {
+            return ready();
+        }
+        void await_suspend(std::coroutine_handle<HttpTask::promise_type> handle) {
+            handle.promise().waiting = this;
+        }
+        virtual ~HttpAwaitable() = default;
+    };
+
+    inline bool HttpTask::ready() const {
+        return handle_ && !handle_.done() && (handle_.promise().waiting == nullptr || handle_.promise().waiting->ready());
+    }
+
+    /*
+     * HttpContext is what a coroutine handler sees of its request. It is owned by the connection and outlives the handler.
+     * */
+    class HttpContext {
+        template<typename C> friend class HttpConnectionBase;
+        friend class HttpConnection;
+        friend class HttpsConnection;
+        friend class HttpExchange;
+    public:
+        // Decoded body bytes the handler may hold before the connection stops reading the socket
+        static constexpr uint64_t body_window = 64 * 1024;
+        http_method method;
+        std::string path;
+        http_header_t headers;
+        // Status and headers used when the handler starts writing before it returns
+        std::string response_type {"200 OK"};
+        http_header_t response_header;
+    private:
+        std::string body_;
+        bool body_done_ {true};
+        std::string out_;
+        bool streaming_ {false};
+    public:
+        HttpContext(http_method method_, std::string path_, http_header_t headers_) : method(method_), path(std::move(path_)), headers(std::move(headers_)) {}
+
+        class BodyAwaitable : public HttpAwaitable {
+            HttpContext& ctx_;
+        public:
+            explicit BodyAwaitable(HttpContext& ctx) : ctx_(ctx) {}
+            bool ready() override {
+                return !ctx_.body_.empty() || ctx_.body_done_;
+            }
+            /* The next piece of body, failed once the whole body was read. */
+            Nexus::Utils::MayFail<std::string> await_resume() {
+                if (ctx_.body_.empty()) return Nexus::Utils::failed;
+                std::string piece = std::move(ctx_.body_);
+                ctx_.body_.clear();
+                return piece;
+            }
+        };
+
+        class WriteAwaitable : public HttpAwaitable {
+            HttpContext& ctx_;
+        public:
+            WriteAwaitable(HttpContext& ctx, const char* data, uint64_t len) : ctx_(ctx) {
+                ctx_.out_.append(data, len);
+                ctx_.streaming_ = true;
+            }
+            bool ready() override {
+                return ctx_.out_.empty();
+            }
+            void await_resume() {}
+        };
+
+        class TimerAwaitable : public HttpAwaitable {
+            std::chrono::steady_clock::time_point deadline_;
+        public:
+            explicit TimerAwaitable(std::chrono::milliseconds duration) : deadline_(std::chrono::steady_clock::now() + duration) {}
+            bool ready() override {
+                return std::chrono::steady_clock::now() >= deadline_;
+            }
+            void await_resume() {}
+        };
+
+        class FileAwaitable : public HttpAwaitable {
+            AsyncFileRead read_;
+        public:
+            explicit FileAwaitable(const std::string& path) {
+                read_.start(path);
+            }
+            bool ready() override {
+                return read_.ready();
+            }
+            Nexus::Utils::MayFail<std::string> await_resume() {
+                return read_.result();
+            }
+        };
+
+        /* Wait for the next piece of request body. */
+        BodyAwaitable read_body() {
+            return BodyAwaitable(*this);
+        }
+        /* Send data as a chunk of the response, resumes once the connection took it. The first write sends the response head. */
+        WriteAwaitable write(const char* data, uint64_t len) {
+            return {*this, data, len};
+        }
+        TimerAwaitable sleep_for(std::chrono::milliseconds duration) {
+            return TimerAwaitable(duration);
+        }
+        /* Read a whole file without blocking the driving thread. */
+        FileAwaitable read_file(const std::string& path) {
+            return FileAwaitable(path);
+        }
+    };
+}
\ No newline at end of file
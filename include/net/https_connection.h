@@ -1,13 +1,15 @@
 #pragma once
-#include <chrono>
-#include <ranges>
 #include <utility>
-#include "./socket.h"
-#include "./http_resolver.h"
+#include "./http_connection_base.h"
 #include "../utils/netaddr.h"
 #include "../io/resource_locator.h"
 #include "http_handler.h"
+#include "http_task.h"
+#include "http2.h"
 #include "include/log/logger.h"
+#include "http_metrics.h"
+#include "../metrics/trace.h"
+#include "rate_limit.h"
 
 #include <openssl/ssl.h>
 #include <openssl/err.h>
@@ -19,39 +21,66 @@
 #endif
 
 namespace Nexus::Net {
-    extern uint64_t executed_tls;
-
-    class HttpsConnection {
+    class HttpsConnection : public HttpConnectionBase<HttpsConnection> {
+        friend class HttpConnectionBase<HttpsConnection>;
     public:
         using status_t = enum {
             HANDSHAKE,
             READ,
             EXECUTING,
+            AWAITING,
             RESPONSE,
-            FINISHED
+            FINISHED,
+            MULTIPLEXING
         };
     private:
-        std::unordered_map<std::string, HttpHandlerFunctionSet>& handlers_;
-        Socket sock_;
-        uint64_t established_time_;
-        Nexus::Base::SharedPool<Nexus::Base::AlignedHeapAllocator<4>> request_;
-        Nexus::Base::Stream<decltype(request_)> req_stream_;
-        Nexus::Base::SharedPool<> response_;
-        Nexus::Base::Stream<decltype(response_)> resp_stream_;
         status_t status_ {HANDSHAKE};
-        HttpResolver resolver_;
-        uint64_t content_length_ {0};
+        // Set when ALPN selected h2, the connection then carries many requests
+        std::unique_ptr<Http2Session> h2_;
         SSL* ssl_;
-        std::mutex mtx_;
+        // The state last recorded in the state histograms and since when the connection is in it
+        status_t tracked_;
+        uint64_t tracked_since_;
+        // Trace id when the connection is sampled, 0 otherwise, see trace.h
+        uint64_t trace_ {Nexus::Metrics::Tracer::Sample()};
+        uint64_t traced_since_ {0};
+
+        /* Start the clocks and counters of a new client. */
+        void open() {
+            HttpConnectionBase::open();
+            tracked_ = status_;
+            tracked_since_ = HttpMetrics::Micros();
+            traced_since_ = trace_ != 0 ? Nexus::Metrics::Tracer::Now() : 0;
+            HttpMetrics::https_connections.inc();
+        }
     public:
-        HttpsConnection(const Socket& sock, std::unordered_map<std::string, HttpHandlerFunctionSet>& handlers, SSL* ssl) : sock_(sock), request_(1024), req_stream_(request_), resolver_(request_),
-                                                                                                                           response_(1024), resp_stream_(response_), handlers_(handlers), ssl_(ssl), mtx_(std::mutex{}) {
-            auto now = std::chrono::system_clock::now().time_since_epoch();
-            established_time_ = std::chrono::duration_cast<std::chrono::milliseconds>(now).count();
+        static constexpr const char* scheme = "Https";
+
+        HttpsConnection(const Socket& sock, std::unordered_map<std::string, HttpHandlerFunctionSet>& handlers, SSL* ssl) : HttpConnectionBase(sock, handlers),
+                                                                                                                           ssl_(ssl) {
+            open();
+        }
+
+        /* Drop what the finished connection still holds and trim its buffers, it waits in a ConnectionPool for reuse(). */
+        void recycle() {
+            HttpConnectionBase::recycle();
+            h2_.reset();
         }
 
-        void drive() {
+        /* Serve a new client with a recycled connection, as if it was constructed for it. */
+        void reuse(const Socket& sock, std::unordered_map<std::string, HttpHandlerFunctionSet>& handlers, SSL* ssl) {
+            sock_ = sock;
+            handlers_ = &handlers;
+            ssl_ = ssl;
+            status_ = HANDSHAKE;
+            trace_ = Nexus::Metrics::Tracer::Sample();
+            open();
+        }
+
+        /* Make progress, queued is when the drive was posted to the work group when the connection is traced. */
+        void drive(uint64_t queued = 0) {
             lock();
+            auto dequeued = trace_ != 0 ? Nexus::Metrics::Tracer::Now() : 0;
             switch (status_) {
                 case HANDSHAKE: {
                     if (ssl_ == nullptr) {
@@ -69,188 +98,214 @@ namespace Nexus::Net {
                         cleanup();
                         break;
                     }
+                    active_time_ = now();
                     BIO_set_nbio(SSL_get_wbio(ssl_), 1);
+                    const unsigned char* alpn = nullptr;
+                    unsigned int alpn_len = 0;
+                    SSL_get0_alpn_selected(ssl_, &alpn, &alpn_len);
+                    if (alpn_len == 2 && memcmp(alpn, "h2", 2) == 0) {
+                        h2_ = std::make_unique<Http2Session>(*handlers_, sock_.addr().url(), client_);
+                        status_ = MULTIPLEXING;
+                        break;
+                    }
                     status_ = READ;
                     break;
                 }
-                case READ: {
-                    int r;
-                    char buf[1024];
-                    while ((r = SSL_read(ssl_, buf, 1024)) > 0) {
-                        req_stream_.write(buf, r);
+                case MULTIPLEXING: {
+                    int r = 1;
+                    char buf[4096];
+                    while (!h2_->failed() && (r = SSL_read(ssl_, buf, sizeof(buf))) > 0) {
+                        active_time_ = now();
+                        h2_->feed(buf, r);
                     }
                     if (r <= 0) {
                         int err = SSL_get_error(ssl_, r);
                         if (err != SSL_ERROR_WANT_READ && err != SSL_ERROR_WANT_WRITE) {
-                            LWARN("SSL read error, closing TLS connection: {}. SSL ErrorCode: {}, Errno: {} | {}", sock_.addr().url(), err, GetLastNetworkError(), GetLastSystemError());
+                            if (err != SSL_ERROR_ZERO_RETURN) {
+                                LWARN("SSL read error, closing TLS connection: {}. SSL ErrorCode: {}, Errno: {} | {}", sock_.addr().url(), err, GetLastNetworkError(), GetLastSystemError());
+                            }
                             cleanup();
                             break;
                         }
                     }
-                    if (resolver_.header_ended()) {
-                        auto method = resolver_.resolve_method();
-                        resolver_.resolve_headers();
-                        if (method == http_method::GET) {
-                            status_ = EXECUTING;
-                            break;
-                        } else if (method == http_method::POST) {
-                            if (!resolver_.resolve_headers().contains("Content-Length")) {
-                                response("400 Bad Request", {});
-                                break;
-                            }
-                            try {
-                                content_length_ = std::stoul(resolver_.resolve_headers()["Content-Length"]);
-                                uint64_t curr = request_.limit() - resolver_.resolve_header_end();
-                                if (curr >= content_length_) {
-                                    status_ = EXECUTING;
-                                }
-                            } catch (std::exception& e) {
-                                response("400 Bad Request", {});
-                                break;
-                            }
-                        } else {
-                            response("405 Method Not Allowed", {});
+                    h2_->resume();
+                    // Send what is pending, then keep pulling frames until the socket would block
+                    while (flush() == flush_t::DONE) {
+                        if (!h2_->pull(response_)) {
                             break;
                         }
                     }
+                    if (status_ == MULTIPLEXING && h2_->closed() && response_.empty()) {
+                        cleanup();
+                    }
+                    break;
+                }
+                case READ: {
+                    int r;
+                    char buf[1024];
+                    while (status_ == READ && (r = SSL_read(ssl_, buf, 1024)) > 0) {
+                        consume(buf, r);
+                    }
+                    if (status_ != READ) {
+                        break;
+                    }
+                    int err = SSL_get_error(ssl_, r);
+                    if (err != SSL_ERROR_WANT_READ && err != SSL_ERROR_WANT_WRITE) {
+                        LWARN("SSL read error, closing TLS connection: {}. SSL ErrorCode: {}, Errno: {} | {}", sock_.addr().url(), err, GetLastNetworkError(), GetLastSystemError());
+                        cleanup();
+                    }
                     break;
                 }
                 case EXECUTING: {
-                    executed_tls++;
-                    if (resolver_.resolve_method() == http_method::GET) {
-                        auto path = resolver_.resolve_path();
-                        LINFO("New Https Request: GET {} from {}", path, sock_.addr().url());
-                        if (handlers_.contains(path)) {
-                            HttpHandlerFunctionSet& fs = handlers_.at(path);
-                            get_request gr { resolver_.resolve_headers() };
-                            http_response resp = fs.get(gr);
-                            if (resp.response_body.limit() == 0) {
-                                response(resp.response_type, resp.response_header);
-                            } else {
-                                response(resp.response_type, resp.response_header, resp.response_body);
-                            }
-                        } else {
-                            if (path == "/") {
-                                path.append("index.html");
-                            }
-                            auto r = Nexus::IO::ResourceLocator::LocateResource(path);
-                            if (r.valid) {
-                                response("200 OK", {
-                                        {"Content-Type", r.mime}
-                                }, r.data);
-                            } else {
-                                response("404 Not Found", {
-                                        {"Content-Type", "text/html"}
-                                }, Nexus::Base::FixedPool(get_not_found_resp.data(), get_not_found_resp.size()));
-                            }
-                        }
-                    } else if (resolver_.resolve_method() == http_method::POST) {
-                        char* body = reinterpret_cast<char*>(malloc(content_length_));
-                        memcpy(body, &request_[resolver_.resolve_header_end() + 1], content_length_);
-                        auto path = resolver_.resolve_path();
-                        LINFO("New Https Request: POST {} from {}", path, sock_.addr().url());
-                        if (handlers_.contains(path)) {
-                            HttpHandlerFunctionSet &fs = handlers_.at(path);
-                            post_request pr{resolver_.resolve_headers(), Nexus::Base::FixedPool<true, Nexus::Base::HeapAllocator>(body, content_length_)};
-                            http_response resp = fs.post(pr);
-                            if (resp.response_body.limit() == 0) {
-                                response(resp.response_type, resp.response_header);
-                            } else {
-                                response<true>(resp.response_type, resp.response_header, resp.response_body);
-                            }
-                        } else {
-                            response("404 Not Found", {
-                                    {"Content-Type", "text/plain"}
-                            }, Nexus::Base::FixedPool(post_not_found_resp.data(), post_not_found_resp.size()));
+                    HttpMetrics::https_requests.inc();
+                    execute();
+                    break;
+                }
+                case AWAITING: {
+                    // Keep reading the body while the handler has room for more
+                    int r = 1;
+                    while (status_ == AWAITING && !context_->body_done_ && context_->body_.size() < HttpContext::body_window) {
+                        char buf[1024];
+                        if ((r = SSL_read(ssl_, buf, 1024)) <= 0) break;
+                        consume(buf, r);
+                    }
+                    if (r <= 0) {
+                        int err = SSL_get_error(ssl_, r);
+                        if (err != SSL_ERROR_WANT_READ && err != SSL_ERROR_WANT_WRITE) {
+                            LWARN("SSL read error, closing TLS connection: {}. SSL ErrorCode: {}, Errno: {} | {}", sock_.addr().url(), err, GetLastNetworkError(), GetLastSystemError());
+                            cleanup();
                         }
                     }
+                    if (status_ == AWAITING && task_.ready()) {
+                        task_.resume();
+                        settle();
+                    }
+                    if (status_ == AWAITING && producer_) {
+                        while (flush() == flush_t::DONE && pull()) {}
+                    }
                     break;
                 }
                 case RESPONSE: {
                     int r;
-                    do {
-                        auto buf = resp_stream_.read(1024);
-                        r = SSL_write(ssl_, buf.reference().ptr(), static_cast<int>(buf.reference().size()));
-                    } while (resp_stream_.flag() != Nexus::Base::SharedPool<>::flag_t::eof && r > 0);
-                    if (r < 0) {
-                        int err = SSL_get_error(ssl_, r);
-                        if (err != SSL_ERROR_WANT_READ && err != SSL_ERROR_WANT_WRITE) {
-                            LWARN("SSL write error, closing TLS connection: {}. SSL ErrorCode: {}, Errno: {} | {}", sock_.addr().url(), err, GetLastNetworkError(), GetLastSystemError());
+                    if (cached_) {
+                        auto& wire = cached_->wire;
+                        r = 0;
+                        while (cached_pos_ < wire.limit()) {
+                            // A retried SSL_write must see the same buffer, which the cached wire image guarantees
+                            r = SSL_write(ssl_, wire.ptr() + cached_pos_, static_cast<int>(std::min<uint64_t>(wire.limit() - cached_pos_, INT32_MAX)));
+                            if (r <= 0) break;
+                            cached_pos_ += r;
+                            active_time_ = now();
+                        }
+                        if (cached_pos_ == wire.limit()) {
                             cleanup();
+                        } else {
+                            int err = SSL_get_error(ssl_, r);
+                            if (err != SSL_ERROR_WANT_READ && err != SSL_ERROR_WANT_WRITE) {
+                                LWARN("SSL write error, closing TLS connection: {}. SSL ErrorCode: {}, Errno: {} | {}", sock_.addr().url(), err, GetLastNetworkError(), GetLastSystemError());
+                                cleanup();
+                            }
+                        }
+                        break;
+                    }
+                    // Send what is pending, then keep pulling from the producer until the socket would block
+                    while (flush() == flush_t::DONE) {
+                        if (!producer_) {
+                            cleanup();
+                            break;
+                        }
+                        if (!pull()) {
+                            break;
                         }
-                    } else {
-                        cleanup();
                     }
                     break;
                 }
                 case FINISHED:
                     break;
             }
+            track(queued, dequeued);
             unlock();
         }
 
+        /* Whether a suspended coroutine handler can make progress, polled by the server loop. */
+        bool resumable() {
+            std::unique_lock lock(mtx_, std::try_to_lock);
+            return lock.owns_lock() && ((status_ == AWAITING && task_.ready()) || (status_ == MULTIPLEXING && h2_->resumable()));
+        }
+
         status_t status() {
             return status_;
         }
 
-        template<bool auto_free = false>
-        void response(const std::string& status, const http_header_t& headers, const Nexus::Base::FixedPool<auto_free>& content) {
-            status_ = RESPONSE;
-            std::stringstream ss;
-            ss << "HTTP/1.1 ";
-            ss << status << "\r\n";
-            const_cast<http_header_t&>(headers).emplace("Content-Length", std::to_string(content.limit()));
-            std::ranges::for_each(headers, [&ss](const auto& pair) {
-                ss << pair.first << ": " << pair.second << "\r\n";
-            });
-            auto prefix = ss.str();
-            response_.write(prefix.data(), prefix.size());
-            response_.write("\r\n", 2);
-            response_.write(content.ptr(), content.limit());
-            resp_stream_.position(0);
+        /* WebSocket and event stream routes are only served over plain HTTP/1.1. */
+        void take_over(HttpHandlerFunctionSet&) {
+            response("501 Not Implemented", {});
+        }
+
+        enum class flush_t {
+            DONE,
+            BLOCKED,
+            FAILED
+        };
+
+        /* Send what response_ holds a slice at a time, SSL_write has no gather. A retry after WANT_WRITE passes the same
+         * front slice again as OpenSSL requires. The connection is cleaned up when it fails. */
+        flush_t flush() {
+            while (!response_.empty()) {
+                auto view = response_.front();
+                int r = SSL_write(ssl_, view.data(), static_cast<int>(std::min<uint64_t>(view.size(), INT32_MAX)));
+                if (r > 0) {
+                    response_.trim_front(r);
+                    active_time_ = now();
+                    continue;
+                }
+                int err = SSL_get_error(ssl_, r);
+                if (err == SSL_ERROR_WANT_READ || err == SSL_ERROR_WANT_WRITE) {
+                    return flush_t::BLOCKED;
+                }
+                LWARN("SSL write error, closing TLS connection: {}. SSL ErrorCode: {}, Errno: {} | {}", sock_.addr().url(), err, GetLastNetworkError(), GetLastSystemError());
+                cleanup();
+                return flush_t::FAILED;
+            }
+            return flush_t::DONE;
+        }
+
+        /* Record how long the connection stayed in the state it just left. Traced connections also record the state as a
+         * span, and how long the drive that left it waited in the work group. */
+        void track(uint64_t queued = 0, uint64_t dequeued = 0) {
+            if (status_ != tracked_) {
+                auto now = HttpMetrics::Micros();
+                HttpMetrics::https_states[tracked_].observe(now - tracked_since_);
+                if (trace_ != 0) {
+                    auto tsc = Nexus::Metrics::Tracer::Now();
+                    Nexus::Metrics::Tracer::Span(trace_, HttpMetrics::https_state_names[tracked_], "https", traced_since_, tsc);
+                    if (queued != 0) {
+                        Nexus::Metrics::Tracer::Span(trace_, "queued", "workgroup", queued, dequeued);
+                    }
+                    traced_since_ = tsc;
+                }
+                tracked_ = status_;
+                tracked_since_ = now;
+            }
         }
-        void response(const std::string& status, const http_header_t& headers) {
-            status_ = RESPONSE;
-            std::stringstream ss;
-            ss << "HTTP/1.1 ";
-            ss << status << "\r\n";
-            std::ranges::for_each(headers, [&ss](const auto& pair) {
-                ss << pair.first << ": " << pair.second << "\r\n";
-            });
-            auto prefix = ss.str();
-            response_.write(prefix.data(), prefix.size());
-            response_.write("\r\n", 2);
-            resp_stream_.position(0);
+
+        uint64_t trace_id() {
+            return trace_;
         }
 
         void cleanup() {
             if (status_ != FINISHED) {
+                if (route_) {
+                    route_->duration.observe(HttpMetrics::Micros() - route_since_);
+                }
                 status_ = FINISHED;
+                track();
+                HttpMetrics::https_connections.dec();
                 SSL_shutdown(ssl_);
                 SSL_free(ssl_);
                 ssl_ = nullptr;
                 sock_.close();
             }
         }
-
-        uint64_t time_established() {
-            return established_time_;
-        }
-
-        Socket& get_socket() {
-            return sock_;
-        }
-        void lock() {
-            mtx_.lock();
-        }
-
-        void unlock() {
-            mtx_.unlock();
-        }
-
     };
-
-
-
-
 }
\ No newline at end of file
@@ -0,0 +1,750 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <format>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "./socket.h"
+#include "./http_handler.h"
+#include "./http_task.h"
+#include "../utils/netaddr.h"
+#include "../log/logger.h"
+#include "../metrics/metrics.h"
+#include "../../thirdparty/picohttpparser/picohttpparser.h"
+
+namespace Nexus::Net {
+    enum class balance_t {
+        ROUND_ROBIN,
+        LEAST_CONNECTIONS
+    };
+
+    /*
+     * UpstreamConnection is one keep-alive HTTP/1.1 connection to an upstream. Exchanges queue their requests on it in
+     * order and get a ticket each, the responses come back in the same order and the exchange whose ticket is served reads
+     * the next one. Whoever polls the connection moves its bytes, requests out of out_ and responses into in_, which reads
+     * no further ahead than read_ahead so a slow client holds back its upstream.
+     * */
+    class UpstreamConnection {
+        friend class Upstream;
+        friend class UpstreamExchange;
+    public:
+        using status_t = enum {
+            RESOLVING,
+            CONNECTING,
+            OPEN,
+            CLOSED
+        };
+        static constexpr uint64_t connect_timeout = 3000;
+        static constexpr uint64_t read_ahead = 64 * 1024;
+    private:
+        Socket sock_ {SockType::INVALID};
+        status_t status_ {RESOLVING};
+        std::shared_ptr<Nexus::Utils::Resolution> resolution_;
+        uint16_t port_;
+        uint64_t opened_;
+        uint64_t idle_since_;
+        std::mutex mtx_;
+        // Bytes queued and not yet sent, queued_ and sent_ count every byte since the connection opened
+        std::string out_;
+        uint64_t queued_ {0};
+        uint64_t sent_ {0};
+        std::string in_;
+        bool eof_ {false};
+        uint64_t next_ticket_ {0};
+        uint64_t serving_ {0};
+        // The last queued request is still sending its body, nothing may be queued behind it
+        bool writing_ {false};
+        // The upstream asked to close after a response, no more requests are queued
+        bool retiring_ {false};
+        // An exchange went away in the middle of its response, the ones behind it cannot be served
+        bool abandoned_ {false};
+
+        void close() {
+            if (status_ == CONNECTING || status_ == OPEN) {
+                sock_.close();
+            }
+            status_ = CLOSED;
+        }
+
+        /* Start connecting to the first address of the resolution. */
+        void open() {
+            if (resolution_->failed()) {
+                LWARN("Resolving upstream {} failed", resolution_->name());
+                close();
+                return;
+            }
+            Nexus::Utils::NetAddr addr(resolution_->addresses()[0], port_);
+            sock_ = Socket(addr.type());
+            if (sock_.invalid() || sock_.fd() == INVALID_SOCKET) {
+                status_ = CLOSED;
+                return;
+            }
+            status_ = CONNECTING;
+            sock_.addr() = addr;
+            int one = 1;
+            setsockopt(sock_.fd(), IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&one), sizeof(one));
+            if (!sock_.setnonblocking() || !sock_.connect(addr)) {
+                LWARN("Connecting to upstream {} failed. Errno: {}", addr.url(), GetLastNetworkError());
+                close();
+            }
+        }
+
+        /* Send and receive what the socket allows, with mtx_ held. */
+        void pump(uint64_t now) {
+            if (status_ == RESOLVING) {
+                if (resolution_->done()) {
+                    open();
+                } else if (now - opened_ > connect_timeout) {
+                    LWARN("Resolving upstream {} timed out", resolution_->name());
+                    close();
+                }
+            }
+            if (status_ == CONNECTING) {
+                WSAPOLLFD pfd {sock_.fd(), POLLOUT, 0};
+                int r = WSAPoll(&pfd, 1, 0);
+                if (r < 0 || (pfd.revents & (POLLERR | POLLHUP)) != 0 || (r == 0 && now - opened_ > connect_timeout)) {
+                    LWARN("Connecting to upstream {} failed. Errno: {}", sock_.addr().url(), GetLastNetworkError());
+                    close();
+                    return;
+                }
+                if (r == 0) {
+                    return;
+                }
+                status_ = OPEN;
+            }
+            if (status_ != OPEN) {
+                return;
+            }
+            while (!out_.empty()) {
+                int r = send(sock_.fd(), out_.data(), static_cast<int>(std::min<uint64_t>(out_.size(), INT32_MAX)), 0);
+                if (r > 0) {
+                    out_.erase(0, r);
+                    sent_ += r;
+                    continue;
+                }
+                if (r < 0 && GetLastNetworkError() == WSAEWOULDBLOCK) {
+                    break;
+                }
+                close();
+                return;
+            }
+            while (!eof_ && in_.size() < read_ahead) {
+                char buf[16384];
+                int r = recv(sock_.fd(), buf, sizeof(buf), 0);
+                if (r > 0) {
+                    in_.append(buf, r);
+                    continue;
+                }
+                if (r == 0) {
+                    eof_ = true;
+                } else if (GetLastNetworkError() != WSAEWOULDBLOCK) {
+                    close();
+                }
+                break;
+            }
+        }
+
+        /* Requests queued and not answered yet. */
+        uint64_t pending() const {
+            return next_ticket_ - serving_;
+        }
+
+        bool reusable() const {
+            return status_ != CLOSED && !eof_ && !retiring_ && !abandoned_;
+        }
+    public:
+        /* A connection to port on whatever the resolution yields, it connects once that is done. */
+        UpstreamConnection(std::shared_ptr<Nexus::Utils::Resolution> resolution, uint16_t port, uint64_t now) :
+            resolution_(std::move(resolution)), port_(port), opened_(now), idle_since_(now) {
+            if (resolution_->done()) {
+                open();
+            }
+        }
+        UpstreamConnection(const UpstreamConnection&) = delete;
+
+        ~UpstreamConnection() {
+            close();
+        }
+    };
+
+    /*
+     * Upstream is one backend server: its pool of connections and its health. Failures are noticed passively, on the
+     * requests that run into them, max_fails in a row take the upstream out of rotation for fail_timeout milliseconds.
+     * */
+    class Upstream {
+    public:
+        static constexpr uint32_t max_fails = 3;
+        static constexpr uint64_t fail_timeout = 10000;
+        // Idle connections kept per upstream, and for how long, in milliseconds
+        static constexpr uint64_t max_idle = 32;
+        static constexpr uint64_t idle_timeout = 30000;
+    private:
+        // A host name is resolved again for every new connection, the Resolver caches it for its TTL
+        std::string host_;
+        uint16_t port_;
+        std::string name_;
+        std::mutex mtx_;
+        std::vector<std::shared_ptr<UpstreamConnection>> connections_;
+        std::atomic<uint64_t> active_ {0};
+        std::atomic<uint32_t> fails_ {0};
+        std::atomic<uint64_t> down_until_ {0};
+        Nexus::Metrics::Counter requests_;
+        Nexus::Metrics::Counter failures_;
+    public:
+        Upstream(const std::string& host, uint16_t port) : host_(host), port_(port), name_(std::format("{}:{}", host, port)),
+            requests_("nexus_upstream_requests_total", "Requests forwarded, by upstream", {{"upstream", name_}}),
+            failures_("nexus_upstream_failures_total", "Requests that failed before the upstream answered, by upstream", {{"upstream", name_}}) {}
+        Upstream(const Upstream&) = delete;
+
+        static uint64_t Now() {
+            return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+        }
+
+        /* Queue a request head on a connection and hand out the connection, with the request's ticket and the count of
+         * queued bytes that ends the head. An idle connection is preferred, a request without body may also queue behind
+         * fewer than depth others. A new connection is opened when neither is there. */
+        std::shared_ptr<UpstreamConnection> acquire(std::string_view head, bool body, uint32_t depth, uint64_t now, uint64_t& ticket, uint64_t& mark) {
+            std::lock_guard lock(mtx_);
+            std::shared_ptr<UpstreamConnection> chosen;
+            uint64_t chosen_pending = 0;
+            uint64_t idle = 0;
+            for (auto it = connections_.begin(); it != connections_.end(); ) {
+                // A copy, erasing may drop the last reference while the lock is held
+                auto conn = *it;
+                std::lock_guard conn_lock(conn->mtx_);
+                auto pending = conn->pending();
+                if (conn->status_ == UpstreamConnection::CLOSED || (pending == 0 && (!conn->reusable() || now - conn->idle_since_ > idle_timeout || idle == max_idle))) {
+                    conn->close();
+                    it = connections_.erase(it);
+                    continue;
+                }
+                if (pending == 0) {
+                    ++idle;
+                    // The upstream may have closed it while it sat idle
+                    conn->pump(now);
+                }
+                if (conn->reusable() && !conn->writing_ && (pending == 0 || (!body && pending < depth)) && (!chosen || pending < chosen_pending)) {
+                    chosen = conn;
+                    chosen_pending = pending;
+                }
+                ++it;
+            }
+            if (!chosen) {
+                chosen = std::make_shared<UpstreamConnection>(Nexus::Utils::Resolver::Global().resolve(host_, now), port_, now);
+                connections_.push_back(chosen);
+            }
+            std::lock_guard conn_lock(chosen->mtx_);
+            ticket = chosen->next_ticket_++;
+            chosen->out_.append(head);
+            chosen->queued_ += head.size();
+            mark = chosen->queued_;
+            chosen->writing_ = body;
+            active_.fetch_add(1, std::memory_order_relaxed);
+            requests_.inc();
+            return chosen;
+        }
+
+        /* A request ended, answered or not. */
+        void release() {
+            active_.fetch_sub(1, std::memory_order_relaxed);
+        }
+
+        bool healthy(uint64_t now) const {
+            return down_until_.load(std::memory_order_relaxed) <= now;
+        }
+
+        void failed(uint64_t now) {
+            failures_.inc();
+            if (fails_.fetch_add(1, std::memory_order_relaxed) + 1 >= max_fails) {
+                fails_.store(0, std::memory_order_relaxed);
+                down_until_.store(now + fail_timeout, std::memory_order_relaxed);
+                LWARN("Upstream {} failed {} times in a row, out of rotation for {}ms", name_, max_fails, fail_timeout);
+            }
+        }
+
+        void succeeded() {
+            fails_.store(0, std::memory_order_relaxed);
+        }
+
+        /* Requests in flight, what least connections balancing compares. */
+        uint64_t active() const {
+            return active_.load(std::memory_order_relaxed);
+        }
+
+        /* Connections in the pool, open or being opened. */
+        uint64_t connections() {
+            std::lock_guard lock(mtx_);
+            return connections_.size();
+        }
+
+        const std::string& name() const {
+            return name_;
+        }
+    };
+
+    /* The upstreams of a proxy route and how requests are spread over them. */
+    class UpstreamGroup {
+    private:
+        std::vector<std::unique_ptr<Upstream>> upstreams_;
+        balance_t balance_;
+        // Requests without body that may be queued on one connection
+        uint32_t depth_;
+        std::atomic<uint64_t> next_ {0};
+    public:
+        /* Upstreams as host and port, hosts may be names or addresses. */
+        explicit UpstreamGroup(const std::vector<std::pair<std::string, uint16_t>>& targets, balance_t balance = balance_t::ROUND_ROBIN, uint32_t depth = 1) :
+            balance_(balance), depth_(std::max<uint32_t>(depth, 1)) {
+            for (auto& [host, port] : targets) {
+                upstreams_.push_back(std::make_unique<Upstream>(host, port));
+            }
+        }
+
+        /* The upstream for the next request, other than exclude when there is a choice. Null when all are out of rotation. */
+        Upstream* pick(uint64_t now, Upstream* exclude = nullptr) {
+            auto n = upstreams_.size();
+            auto start = next_.fetch_add(1, std::memory_order_relaxed);
+            Upstream* best = nullptr;
+            for (uint64_t i = 0; i < n; ++i) {
+                Upstream* u = upstreams_[(start + i) % n].get();
+                if (!u->healthy(now) || u == exclude) {
+                    continue;
+                }
+                if (balance_ == balance_t::ROUND_ROBIN) {
+                    return u;
+                }
+                if (best == nullptr || u->active() < best->active()) {
+                    best = u;
+                }
+            }
+            return best == nullptr && exclude != nullptr && exclude->healthy(now) ? exclude : best;
+        }
+
+        uint32_t depth() const {
+            return depth_;
+        }
+
+        std::vector<std::unique_ptr<Upstream>>& upstreams() {
+            return upstreams_;
+        }
+    };
+
+    /*
+     * UpstreamExchange is one request forwarded to an upstream. Coroutine handlers co_await its sends, the response head
+     * and the pieces of the response body, which come out decoded from whatever framing the upstream used.
+     * */
+    class UpstreamExchange {
+    public:
+        class SendAwaitable : public HttpAwaitable {
+            UpstreamExchange& ex_;
+            uint64_t mark_;
+        public:
+            SendAwaitable(UpstreamExchange& ex, uint64_t mark) : ex_(ex), mark_(mark) {}
+            bool ready() override {
+                return ex_.sent(mark_);
+            }
+            void await_resume() {}
+        };
+
+        class HeadAwaitable : public HttpAwaitable {
+            UpstreamExchange& ex_;
+        public:
+            explicit HeadAwaitable(UpstreamExchange& ex) : ex_(ex) {}
+            bool ready() override {
+                return ex_.poll_head();
+            }
+            /* Whether the head arrived. */
+            bool await_resume() {
+                return !ex_.failed_;
+            }
+        };
+
+        class BodyAwaitable : public HttpAwaitable {
+            UpstreamExchange& ex_;
+        public:
+            explicit BodyAwaitable(UpstreamExchange& ex) : ex_(ex) {}
+            bool ready() override {
+                return ex_.poll_body();
+            }
+            /* The next piece of body, failed once it ended or the upstream failed. */
+            Nexus::Utils::MayFail<std::string> await_resume() {
+                if (ex_.piece_.empty()) return Nexus::Utils::failed;
+                std::string piece = std::move(ex_.piece_);
+                ex_.piece_.clear();
+                return piece;
+            }
+        };
+    private:
+        Upstream& upstream_;
+        std::shared_ptr<UpstreamConnection> conn_;
+        uint64_t ticket_ {0};
+        uint64_t head_mark_ {0};
+        bool failed_ {false};
+        bool head_done_ {false};
+        bool done_ {false};
+        int code_ {0};
+        std::string status_;
+        http_header_t headers_;
+        bool chunked_ {false};
+        bool keep_ {true};
+        // Body bytes still expected, negative when the body runs until the connection closes
+        int64_t left_ {-1};
+        phr_chunked_decoder decoder_ {};
+        std::string piece_;
+
+        /* Give up on the response, counted against the upstream unless another exchange left the connection unusable. The
+         * responses behind this one cannot be read either. */
+        void fail() {
+            if (!failed_) {
+                failed_ = true;
+                conn_->close();
+                if (!head_done_ && !conn_->abandoned_) {
+                    upstream_.failed(Upstream::Now());
+                }
+            }
+        }
+
+        /* The response ended, the connection moves on to the next ticket. */
+        void finish() {
+            done_ = true;
+            ++conn_->serving_;
+            conn_->idle_since_ = Upstream::Now();
+            if (!keep_) {
+                conn_->retiring_ = true;
+                if (conn_->pending() == 0) {
+                    conn_->close();
+                }
+            }
+            upstream_.release();
+        }
+
+        /* Whether the connection can deliver no more of the response, with its lock held. */
+        bool ended() const {
+            return conn_->status_ == UpstreamConnection::CLOSED || conn_->eof_;
+        }
+
+        bool sent(uint64_t mark) {
+            std::lock_guard lock(conn_->mtx_);
+            if (failed_) {
+                return true;
+            }
+            conn_->pump(Upstream::Now());
+            if (conn_->sent_ >= mark) {
+                return true;
+            }
+            if (conn_->status_ == UpstreamConnection::CLOSED) {
+                fail();
+                return true;
+            }
+            return false;
+        }
+
+        bool poll_head() {
+            std::lock_guard lock(conn_->mtx_);
+            if (head_done_ || failed_) {
+                return true;
+            }
+            conn_->pump(Upstream::Now());
+            if (conn_->serving_ != ticket_) {
+                // Responses ahead of ours may still be in in_ when the upstream closed after sending them
+                if (conn_->status_ == UpstreamConnection::CLOSED) {
+                    fail();
+                    return true;
+                }
+                return false;
+            }
+            while (true) {
+                phr_header headers[64];
+                size_t num_headers = 64;
+                int minor = 0;
+                const char* msg = nullptr;
+                size_t msg_len = 0;
+                auto& in = conn_->in_;
+                int r = phr_parse_response(in.data(), in.size(), &minor, &code_, &msg, &msg_len, headers, &num_headers, 0);
+                if (r == -2) {
+                    if (ended()) {
+                        fail();
+                        return true;
+                    }
+                    return false;
+                }
+                if (r == -1 || code_ == 101) {
+                    LWARN("Malformed response from upstream {}", upstream_.name());
+                    fail();
+                    return true;
+                }
+                if (code_ < 200) {
+                    // Interim responses are not forwarded
+                    in.erase(0, r);
+                    continue;
+                }
+                status_ = std::format("{} {}", code_, std::string_view(msg, msg_len));
+                keep_ = minor >= 1;
+                for (size_t i = 0; i < num_headers; ++i) {
+                    std::string name(headers[i].name, headers[i].name_len);
+                    std::string value(headers[i].value, headers[i].value_len);
+                    std::string lower = name;
+                    std::ranges::transform(lower, lower.begin(), [](unsigned char c) { return std::tolower(c); });
+                    if (lower == "content-length") {
+                        left_ = std::strtoll(value.c_str(), nullptr, 10);
+                        continue;
+                    }
+                    if (lower == "transfer-encoding") {
+                        chunked_ = value.find("chunked") != std::string::npos;
+                        continue;
+                    }
+                    if (lower == "connection") {
+                        std::ranges::transform(value, value.begin(), [](unsigned char c) { return std::tolower(c); });
+                        keep_ = value.find("close") == std::string::npos && (minor >= 1 || value.find("keep-alive") != std::string::npos);
+                        continue;
+                    }
+                    if (Hop(lower)) {
+                        continue;
+                    }
+                    // The field table keeps one value per name, repeated fields are joined. Cookies may hold commas
+                    // themselves and cannot be, only the first Set-Cookie is passed on
+                    if (auto h = headers_.find(name); h != headers_.end()) {
+                        if (lower == "set-cookie") {
+                            LWARN("Dropped a repeated Set-Cookie from upstream {}", upstream_.name());
+                        } else {
+                            h->second.append(", ").append(value);
+                        }
+                    } else {
+                        headers_.emplace(std::move(name), std::move(value));
+                    }
+                }
+                in.erase(0, r);
+                head_done_ = true;
+                upstream_.succeeded();
+                if (code_ == 204 || code_ == 304 || (!chunked_ && left_ == 0)) {
+                    finish();
+                } else if (!chunked_ && left_ < 0) {
+                    // The body runs until the upstream closes
+                    keep_ = false;
+                }
+                decoder_.consume_trailer = 1;
+                return true;
+            }
+        }
+
+        bool poll_body() {
+            std::lock_guard lock(conn_->mtx_);
+            if (!piece_.empty() || done_ || failed_) {
+                return true;
+            }
+            conn_->pump(Upstream::Now());
+            auto& in = conn_->in_;
+            if (chunked_) {
+                if (!in.empty()) {
+                    size_t size = in.size();
+                    auto r = phr_decode_chunked(&decoder_, in.data(), &size);
+                    if (r == -1) {
+                        LWARN("Malformed chunked response from upstream {}", upstream_.name());
+                        fail();
+                        return true;
+                    }
+                    piece_.assign(in.data(), size);
+                    if (r >= 0) {
+                        // What follows the last chunk belongs to the next response
+                        in.erase(0, in.size() - r);
+                        finish();
+                    } else {
+                        in.clear();
+                    }
+                }
+            } else if (left_ >= 0) {
+                auto n = std::min<uint64_t>(left_, in.size());
+                piece_.assign(in.data(), n);
+                in.erase(0, n);
+                left_ -= static_cast<int64_t>(n);
+                if (left_ == 0) {
+                    finish();
+                }
+            } else {
+                piece_.swap(in);
+                in.clear();
+                if (conn_->eof_) {
+                    finish();
+                }
+            }
+            if (piece_.empty() && !done_ && ended()) {
+                fail();
+            }
+            return !piece_.empty() || done_ || failed_;
+        }
+    public:
+        UpstreamExchange(Upstream& upstream, std::string_view head, bool body, uint32_t depth) : upstream_(upstream) {
+            conn_ = upstream_.acquire(head, body, depth, Upstream::Now(), ticket_, head_mark_);
+        }
+        UpstreamExchange(const UpstreamExchange&) = delete;
+
+        ~UpstreamExchange() {
+            std::lock_guard lock(conn_->mtx_);
+            if (!done_) {
+                // The response stream is out of step once one is left unread
+                conn_->abandoned_ = true;
+                conn_->close();
+                upstream_.release();
+            }
+        }
+
+        /* Hop-by-hop fields, which a proxy does not forward. Names are lower case. */
+        static bool Hop(std::string_view name) {
+            return name == "connection" || name == "keep-alive" || name == "proxy-connection" || name == "te" || name == "trailer"
+                   || name == "transfer-encoding" || name == "upgrade" || name == "proxy-authenticate" || name == "proxy-authorization";
+        }
+
+        /* Wait until the request head is sent. */
+        SendAwaitable send() {
+            return {*this, head_mark_};
+        }
+
+        /* Queue a piece of request body and wait until it is sent. */
+        SendAwaitable send(std::string_view data) {
+            std::lock_guard lock(conn_->mtx_);
+            conn_->out_.append(data);
+            conn_->queued_ += data.size();
+            return {*this, conn_->queued_};
+        }
+
+        /* The request body is complete, the connection may take further requests. */
+        void sent_body() {
+            std::lock_guard lock(conn_->mtx_);
+            conn_->writing_ = false;
+        }
+
+        HeadAwaitable head() {
+            return HeadAwaitable(*this);
+        }
+
+        BodyAwaitable body() {
+            return BodyAwaitable(*this);
+        }
+
+        bool failed() const {
+            return failed_;
+        }
+
+        /* Status code and reason of the response. */
+        const std::string& status() const {
+            return status_;
+        }
+
+        /* Response fields other than hop-by-hop ones and the body framing. */
+        http_header_t& headers() {
+            return headers_;
+        }
+    };
+
+    /*
+     * Proxy forwards the requests of a route to an UpstreamGroup. Request and response bodies are passed on piece by piece as
+     * they arrive, neither is held whole. A request without body that failed before any response came is tried once more
+     * on another upstream, one with a body cannot be sent again and gets 502.
+     * */
+    class Proxy {
+    private:
+        static http_response Refuse(const std::string& status) {
+            return {status, {}, http_response_body_t(nullptr, 0)};
+        }
+
+        /* The request head sent upstream: the client's fields without hop-by-hop ones, framed for the body as it arrives. */
+        static std::string Head(HttpContext& ctx, bool body, const std::string& upstream) {
+            std::string head = std::format("{} {} HTTP/1.1\r\n", ctx.method == http_method::POST ? "POST" : "GET", ctx.path);
+            bool host = false;
+            bool length = false;
+            for (auto& [name, value] : ctx.headers) {
+                std::string lower = name;
+                std::ranges::transform(lower, lower.begin(), [](unsigned char c) { return std::tolower(c); });
+                if (UpstreamExchange::Hop(lower) || lower == "expect" || (lower == "content-length" && !body)) {
+                    continue;
+                }
+                host = host || lower == "host";
+                length = length || lower == "content-length";
+                head.append(name).append(": ").append(value).append("\r\n");
+            }
+            if (!host) {
+                head.append("Host: ").append(upstream).append("\r\n");
+            }
+            if (body && !length) {
+                head.append("Transfer-Encoding: chunked\r\n");
+            }
+            head.append("\r\n");
+            return head;
+        }
+    public:
+        static HttpTask Forward(std::shared_ptr<UpstreamGroup> group, HttpContext& ctx) {
+            bool body = ctx.method == http_method::POST;
+            Upstream* tried = nullptr;
+            for (int attempt = 0; ; ++attempt) {
+                Upstream* upstream = group->pick(Upstream::Now(), tried);
+                if (upstream == nullptr) {
+                    co_return Refuse("503 Service Unavailable");
+                }
+                auto head = Head(ctx, body, upstream->name());
+                bool chunked = body && head.find("Transfer-Encoding: chunked\r\n") != std::string::npos;
+                UpstreamExchange ex(*upstream, head, body, group->depth());
+                co_await ex.send();
+                if (body && !ex.failed()) {
+                    while (true) {
+                        auto piece = co_await ctx.read_body();
+                        if (!piece.is_valid()) {
+                            break;
+                        }
+                        auto& data = piece.reference();
+                        if (chunked) {
+                            co_await ex.send(std::format("{:x}\r\n{}\r\n", data.size(), data));
+                        } else {
+                            co_await ex.send(data);
+                        }
+                        if (ex.failed()) {
+                            break;
+                        }
+                    }
+                    if (chunked && !ex.failed()) {
+                        co_await ex.send("0\r\n\r\n");
+                    }
+                    ex.sent_body();
+                }
+                if (!ex.failed()) {
+                    co_await ex.head();
+                }
+                if (ex.failed()) {
+                    if (!body && attempt == 0) {
+                        tried = upstream;
+                        continue;
+                    }
+                    co_return Refuse("502 Bad Gateway");
+                }
+                ctx.response_type = ex.status();
+                ctx.response_header = ex.headers();
+                while (true) {
+                    auto piece = co_await ex.body();
+                    if (!piece.is_valid()) {
+                        break;
+                    }
+                    co_await ctx.write(piece.reference().data(), piece.reference().size());
+                }
+                if (ex.failed()) {
+                    // Part of the response is out, the client can only learn of the failure from the connection
+                    throw std::runtime_error("upstream failed in the middle of a response");
+                }
+                co_return http_response {ctx.response_type, ctx.response_header, http_response_body_t(nullptr, 0)};
+            }
+        }
+    };
+
+    /* The handler of a proxy route, which forwards every request of its path to the group. */
+    inline HttpHandlerFunctionSet make_proxy_function_set(std::shared_ptr<UpstreamGroup> group) {
+        HttpHandlerFunctionSet fs {};
+        fs.async = [group](HttpContext& ctx) {
+            return Proxy::Forward(group, ctx);
+        };
+        return fs;
+    }
+}
\ No newline at end of file
@@ -0,0 +1,152 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include "./hpack.h"
+
+namespace Nexus::Net {
+    /*
+     * QpackStatic is the QPACK static table (RFC 9204 appendix A). Unlike HPACK, indices start at 0.
+     * */
+    class QpackStatic {
+    public:
+        static constexpr uint64_t length = 99;
+    private:
+        static const std::array<hpack_field_t, length>& Table() {
+            static const std::array<hpack_field_t, length> table {{
+                {":authority", ""}, {":path", "/"}, {"age", "0"}, {"content-disposition", ""}, {"content-length", "0"},
+                {"cookie", ""}, {"date", ""}, {"etag", ""}, {"if-modified-since", ""}, {"if-none-match", ""},
+                {"last-modified", ""}, {"link", ""}, {"location", ""}, {"referer", ""}, {"set-cookie", ""},
+                {":method", "CONNECT"}, {":method", "DELETE"}, {":method", "GET"}, {":method", "HEAD"},
+                {":method", "OPTIONS"}, {":method", "POST"}, {":method", "PUT"}, {":scheme", "http"}, {":scheme", "https"},
+                {":status", "103"}, {":status", "200"}, {":status", "304"}, {":status", "404"}, {":status", "503"},
+                {"accept", "*/*"}, {"accept", "application/dns-message"}, {"accept-encoding", "gzip, deflate, br"},
+                {"accept-ranges", "bytes"}, {"access-control-allow-headers", "cache-control"},
+                {"access-control-allow-headers", "content-type"}, {"access-control-allow-origin", "*"},
+                {"cache-control", "max-age=0"}, {"cache-control", "max-age=2592000"}, {"cache-control", "max-age=604800"},
+                {"cache-control", "no-cache"}, {"cache-control", "no-store"}, {"cache-control", "public, max-age=31536000"},
+                {"content-encoding", "br"}, {"content-encoding", "gzip"}, {"content-type", "application/dns-message"},
+                {"content-type", "application/javascript"}, {"content-type", "application/json"},
+                {"content-type", "application/x-www-form-urlencoded"}, {"content-type", "image/gif"},
+                {"content-type", "image/jpeg"}, {"content-type", "image/png"}, {"content-type", "text/css"},
+                {"content-type", "text/html; charset=utf-8"}, {"content-type", "text/plain"},
+                {"content-type", "text/plain;charset=utf-8"}, {"range", "bytes=0-"},
+                {"strict-transport-security", "max-age=31536000"},
+                {"strict-transport-security", "max-age=31536000; includesubdomains"},
+                {"strict-transport-security", "max-age=31536000; includesubdomains; preload"},
+                {"vary", "accept-encoding"}, {"vary", "origin"}, {"x-content-type-options", "nosniff"},
+                {"x-xss-protection", "1; mode=block"}, {":status", "100"}, {":status", "204"}, {":status", "206"},
+                {":status", "302"}, {":status", "400"}, {":status", "403"}, {":status", "421"}, {":status", "425"},
+                {":status", "500"}, {"accept-language", ""}, {"access-control-allow-credentials", "FALSE"},
+                {"access-control-allow-credentials", "TRUE"}, {"access-control-allow-headers", "*"},
+                {"access-control-allow-methods", "get"}, {"access-control-allow-methods", "get, post, options"},
+                {"access-control-allow-methods", "options"}, {"access-control-expose-headers", "content-length"},
+                {"access-control-request-headers", "content-type"}, {"access-control-request-method", "get"},
+                {"access-control-request-method", "post"}, {"alt-svc", "clear"}, {"authorization", ""},
+                {"content-security-policy", "script-src 'none'; object-src 'none'; base-uri 'none'"},
+                {"early-data", "1"}, {"expect-ct", ""}, {"forwarded", ""}, {"if-range", ""}, {"origin", ""},
+                {"purpose", "prefetch"}, {"server", ""}, {"timing-allow-origin", "*"}, {"upgrade-insecure-requests", "1"},
+                {"user-agent", ""}, {"x-forwarded-for", ""}, {"x-frame-options", "deny"}, {"x-frame-options", "sameorigin"}
+            }};
+            return table;
+        }
+    public:
+        /* The field at index, nullptr when the index is out of range. */
+        static const hpack_field_t* Get(uint64_t index) {
+            return index < length ? &Table()[index] : nullptr;
+        }
+
+        /* Index of a matching field or of a field with the same name (second is false then), length when there is neither. */
+        static std::pair<uint64_t, bool> Find(std::string_view name, std::string_view value) {
+            uint64_t name_match = length;
+            for (uint64_t i = 0; i < length; ++i) {
+                if (Table()[i].first == name) {
+                    if (Table()[i].second == value) return {i, true};
+                    if (name_match == length) name_match = i;
+                }
+            }
+            return {name_match, false};
+        }
+    };
+
+    /*
+     * QpackDecoder decodes field sections that only refer to the static table. We announce a dynamic table capacity of 0, so a
+     * peer may neither insert entries nor reference them, and every field section can be decoded as soon as it arrives
+     * without waiting on the encoder stream.
+     * */
+    class QpackDecoder {
+    public:
+        /* Decode a complete field section, false is a QPACK_DECOMPRESSION_FAILED error. */
+        static bool Decode(const uint8_t* data, uint64_t len, std::vector<hpack_field_t>& fields) {
+            const uint8_t* p = data;
+            const uint8_t* end = data + len;
+            // Field section prefix, Required Insert Count and Base, the first has to be 0 without a dynamic table
+            uint64_t required, base;
+            if (!HpackDecoder::DecodeInteger(p, end, 8, required) || required != 0) return false;
+            if (!HpackDecoder::DecodeInteger(p, end, 7, base)) return false;
+            while (p != end) {
+                uint8_t b = *p;
+                uint64_t index;
+                if (b & 0x80) {
+                    // Indexed field line, T has to select the static table
+                    if (!(b & 0x40) || !HpackDecoder::DecodeInteger(p, end, 6, index)) return false;
+                    auto f = QpackStatic::Get(index);
+                    if (f == nullptr) return false;
+                    fields.push_back(*f);
+                } else if (b & 0x40) {
+                    // Literal field line with name reference
+                    if (!(b & 0x10) || !HpackDecoder::DecodeInteger(p, end, 4, index)) return false;
+                    auto named = QpackStatic::Get(index);
+                    if (named == nullptr) return false;
+                    hpack_field_t f {named->first, {}};
+                    if (!HpackDecoder::DecodeString(p, end, f.second)) return false;
+                    fields.push_back(std::move(f));
+                } else if (b & 0x20) {
+                    // Literal field line with literal name
+                    hpack_field_t f;
+                    if (!HpackDecoder::DecodeString(p, end, f.first, 3)) return false;
+                    if (!HpackDecoder::DecodeString(p, end, f.second)) return false;
+                    fields.push_back(std::move(f));
+                } else {
+                    // Post-base references point into the dynamic table
+                    return false;
+                }
+            }
+            return true;
+        }
+    };
+
+    /*
+     * QpackEncoder writes field sections against the static table only. Without dynamic table entries nothing ever blocks
+     * the peer, and neither side needs the encoder or decoder stream.
+     * */
+    class QpackEncoder {
+    public:
+        /* Start a field section, Required Insert Count and Base are both 0. */
+        static void Begin(std::string& out) {
+            out.push_back(0);
+            out.push_back(0);
+        }
+
+        /* Append one field line. Names must already be lower case. */
+        static void Encode(std::string_view name, std::string_view value, std::string& out) {
+            auto [index, exact] = QpackStatic::Find(name, value);
+            if (exact) {
+                HpackEncoder::EncodeInteger(out, 0xc0, 6, index);
+                return;
+            }
+            // Sensitive values carry the N bit, so intermediaries never index them either
+            uint8_t never = name == "authorization" || name == "set-cookie" || name == "cookie" ? 0x20 : 0x00;
+            if (index != QpackStatic::length) {
+                HpackEncoder::EncodeInteger(out, 0x50 | never, 4, index);
+            } else {
+                HpackEncoder::EncodeString(out, name, 0x20 | (never >> 1), 3);
+            }
+            HpackEncoder::EncodeString(out, value);
+        }
+    };
+}
\ No newline at end of file
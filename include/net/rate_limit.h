@@ -0,0 +1,178 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include "../utils/netaddr.h"
+#include "../metrics/metrics.h"
+
+namespace Nexus::Net {
+    /*
+     * RateLimiter gives every client address a token bucket, refilled at rate tokens a second up to burst. The buckets live
+     * in a fixed table of slots found by hashing the address, a slot is claimed with a compare and swap on its key and the
+     * bucket is one word updated the same way, so no lock is taken on any path. A client probes a short window of slots,
+     * when all of them belong to others it takes over the one idle the longest. Evictions, and the rare race between two
+     * threads claiming a slot, can hand a client a full bucket early, the limit is approximate by design.
+     * */
+    class RateLimiter {
+    public:
+        static constexpr uint64_t default_slots = 1 << 16;
+        // Slots probed from where a key hashes to
+        static constexpr uint64_t window = 8;
+        // Tokens are counted in 1/256 and a bucket word holds 24 bits of them, which bounds burst
+        static constexpr uint64_t unit = 256;
+        static constexpr uint64_t max_burst = ((uint64_t {1} << 24) - 1) / unit;
+    private:
+        struct slot_t {
+            std::atomic<uint64_t> key {0};
+            // Milliseconds of the last take above, units below, 0 for a bucket nobody took from yet
+            std::atomic<uint64_t> bucket {0};
+        };
+
+        std::unique_ptr<slot_t[]> slots_;
+        uint64_t mask_;
+        // Tokens a second, 0 turns the limiter off
+        std::atomic<uint64_t> rate_ {0};
+        std::atomic<uint64_t> burst_ {0};
+        inline static Nexus::Metrics::Counter limited_accepts_ {"nexus_rate_limited_total", "Connections and requests refused by the per-client rate limit", {{"stage", "accept"}}};
+        inline static Nexus::Metrics::Counter limited_requests_ {"nexus_rate_limited_total", "Connections and requests refused by the per-client rate limit", {{"stage", "request"}}};
+
+        static constexpr uint64_t time_mask = (uint64_t {1} << 40) - 1;
+
+        /* Units in the bucket at now. */
+        uint64_t fill(uint64_t bucket, uint64_t now) const {
+            auto full = burst_.load(std::memory_order_relaxed) * unit;
+            if (bucket == 0) {
+                return full;
+            }
+            // Past 2^22 ms every bucket is full again, the cap keeps the product in range
+            auto elapsed = std::min<uint64_t>(((now & time_mask) - (bucket >> 24)) & time_mask, uint64_t {1} << 22);
+            auto units = (bucket & 0xffffff) + elapsed * rate_.load(std::memory_order_relaxed) * unit / 1000;
+            return std::min<uint64_t>(units, full);
+        }
+
+        /* The slot of a key, claimed or taken over when the key has none. */
+        slot_t* find(uint64_t key, uint64_t now) {
+            slot_t* idlest = nullptr;
+            uint64_t idlest_for = 0;
+            for (uint64_t i = 0; i < window; ++i) {
+                slot_t& slot = slots_[(key + i) & mask_];
+                auto k = slot.key.load(std::memory_order_acquire);
+                if (k == key) {
+                    return &slot;
+                }
+                if (k == 0) {
+                    if (slot.key.compare_exchange_strong(k, key, std::memory_order_acq_rel) || k == key) {
+                        return &slot;
+                    }
+                    continue;
+                }
+                auto bucket = slot.bucket.load(std::memory_order_relaxed);
+                auto idle = bucket == 0 ? time_mask : ((now & time_mask) - (bucket >> 24)) & time_mask;
+                if (idlest == nullptr || idle > idlest_for) {
+                    idlest = &slot;
+                    idlest_for = idle;
+                }
+            }
+            auto evicted = idlest->key.load(std::memory_order_relaxed);
+            if (evicted != key && !idlest->key.compare_exchange_strong(evicted, key, std::memory_order_acq_rel)) {
+                return evicted == key ? idlest : nullptr;
+            }
+            idlest->bucket.store(0, std::memory_order_relaxed);
+            return idlest;
+        }
+    public:
+        explicit RateLimiter(uint64_t slots = default_slots) : slots_(std::make_unique<slot_t[]>(std::bit_ceil(std::max<uint64_t>(slots, window)))),
+                                                               mask_(std::bit_ceil(std::max<uint64_t>(slots, window)) - 1) {}
+        RateLimiter(const RateLimiter&) = delete;
+
+        /* The limiter all listeners share. */
+        static RateLimiter& Global() {
+            static RateLimiter limiter;
+            return limiter;
+        }
+
+        static uint64_t Now() {
+            return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+        }
+
+        /* The bucket key of a client. IPv4-mapped addresses count as the IPv4 one and IPv6 clients are keyed on their /64,
+         * which one subscriber usually gets whole. 0 for addresses that are neither. */
+        static uint64_t Key(const Nexus::Utils::NetAddr& addr) {
+            auto bytes = addr.bytes();
+            uint64_t x;
+            if (bytes.size() == 4) {
+                uint32_t v4;
+                memcpy(&v4, bytes.data(), 4);
+                x = v4 | uint64_t {1} << 32;
+            } else if (bytes.size() == 16) {
+                static constexpr char mapped[12] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, '\xff', '\xff'};
+                if (memcmp(bytes.data(), mapped, 12) == 0) {
+                    uint32_t v4;
+                    memcpy(&v4, bytes.data() + 12, 4);
+                    x = v4 | uint64_t {1} << 32;
+                } else {
+                    memcpy(&x, bytes.data(), 8);
+                    x ^= 0x9e3779b97f4a7c15;
+                }
+            } else {
+                return 0;
+            }
+            // The splitmix64 finalizer, a bijection, so distinct IPv4 addresses never share a key
+            x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9;
+            x = (x ^ (x >> 27)) * 0x94d049bb133111eb;
+            x ^= x >> 31;
+            return x == 0 ? 1 : x;
+        }
+
+        /* Allow rate requests a second with bursts of up to burst, a rate of 0 turns the limiter off. */
+        void configure(uint64_t rate, uint64_t burst) {
+            burst_.store(std::clamp<uint64_t>(burst == 0 ? rate : burst, 1, max_burst), std::memory_order_relaxed);
+            rate_.store(std::min<uint64_t>(rate, uint64_t {1} << 24), std::memory_order_relaxed);
+        }
+
+        bool enabled() const {
+            return rate_.load(std::memory_order_relaxed) != 0;
+        }
+
+        /* Whether the client has a token left, without taking it. Checked at accept, a client out of tokens is dropped
+         * before anything is set up for its connection. */
+        bool allow(uint64_t key, uint64_t now = Now()) {
+            if (!enabled() || key == 0) {
+                return true;
+            }
+            slot_t* slot = find(key, now);
+            if (slot == nullptr || fill(slot->bucket.load(std::memory_order_relaxed), now) >= unit) {
+                return true;
+            }
+            limited_accepts_.inc();
+            return false;
+        }
+
+        /* Take a token for a request, false when the client has none left and should get a 429. */
+        bool take(uint64_t key, uint64_t now = Now()) {
+            if (!enabled() || key == 0) {
+                return true;
+            }
+            slot_t* slot = find(key, now);
+            if (slot == nullptr) {
+                return true;
+            }
+            auto bucket = slot->bucket.load(std::memory_order_relaxed);
+            while (true) {
+                auto units = fill(bucket, now);
+                if (units < unit) {
+                    limited_requests_.inc();
+                    return false;
+                }
+                if (slot->bucket.compare_exchange_weak(bucket, (now & time_mask) << 24 | (units - unit), std::memory_order_relaxed)) {
+                    return true;
+                }
+            }
+        }
+    };
+}
\ No newline at end of file
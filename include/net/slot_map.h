@@ -0,0 +1,111 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#ifdef PLATFORM_WIN32
+#include "../platform/win32/win32_defs.h"
+#endif
+
+namespace Nexus::Net {
+    /*
+     * SlotMap is the connection table of a listener. Entries sit packed in one vector, so sweeping them walks contiguous
+     * memory, and a second vector indexed by handle holds where each one is, so finding the entry of an event is an index
+     * instead of a hash lookup. Erasing moves the last entry into the hole.
+     *
+     * Every entry carries the generation it was inserted in. A handle closed on a worker can come back from accept() before
+     * the sweep erased the entry of its old connection, and events polled before that accept still name the handle. Taking
+     * generation() before the poll tells them apart: an entry inserted since then was not what the event was about.
+     * */
+    template<typename T>
+    class SlotMap {
+    public:
+        struct slot_t {
+            io_handle_t handle;
+            uint64_t generation;
+            T value;
+        };
+        using iterator = typename std::vector<slot_t>::iterator;
+    private:
+        std::vector<slot_t> slots_;
+        // Position in slots_ plus one by Index(handle), 0 for handles that are not in the map
+        std::vector<uint32_t> index_;
+        uint64_t generation_ {0};
+
+        static uint64_t Index(io_handle_t handle) {
+            // Socket handles are handle table entries, multiples of 4 that are handed out again lowest first, so they stay
+            // about as dense as the open connections
+            return static_cast<uint64_t>(handle) >> 2;
+        }
+    public:
+        /* The generation the next insert() gets. */
+        uint64_t generation() const {
+            return generation_;
+        }
+
+        /* Put value under handle, replacing what was there. */
+        slot_t& insert(io_handle_t handle, T value) {
+            auto i = Index(handle);
+            if (i >= index_.size()) {
+                index_.resize(std::max<uint64_t>(i + 1, index_.size() * 2), 0);
+            }
+            if (index_[i] != 0) {
+                auto& slot = slots_[index_[i] - 1];
+                slot.generation = generation_++;
+                slot.value = std::move(value);
+                return slot;
+            }
+            slots_.push_back({handle, generation_++, std::move(value)});
+            index_[i] = static_cast<uint32_t>(slots_.size());
+            return slots_.back();
+        }
+
+        /* The entry of handle, nullptr when there is none. */
+        slot_t* find(io_handle_t handle) {
+            auto i = Index(handle);
+            if (i >= index_.size() || index_[i] == 0) {
+                return nullptr;
+            }
+            return &slots_[index_[i] - 1];
+        }
+
+        /* Erase the entry at it and return the iterator to visit next, which holds what was the last entry. */
+        iterator erase(iterator it) {
+            auto pos = it - slots_.begin();
+            index_[Index(it->handle)] = 0;
+            if (it + 1 != slots_.end()) {
+                *it = std::move(slots_.back());
+                index_[Index(it->handle)] = static_cast<uint32_t>(pos + 1);
+            }
+            slots_.pop_back();
+            return slots_.begin() + pos;
+        }
+
+        bool erase(io_handle_t handle) {
+            auto slot = find(handle);
+            if (slot == nullptr) {
+                return false;
+            }
+            erase(slots_.begin() + (slot - slots_.data()));
+            return true;
+        }
+
+        iterator begin() {
+            return slots_.begin();
+        }
+
+        iterator end() {
+            return slots_.end();
+        }
+
+        uint64_t size() const {
+            return slots_.size();
+        }
+
+        bool empty() const {
+            return slots_.empty();
+        }
+    };
+}
\ No newline at end of file
@@ -10,6 +10,17 @@
 #include "include/utils/netaddr.h"
 
 namespace Nexus::Net {
+    /* Options of a listener and of the connections it accepts. Buffer sizes of 0 keep the system defaults, set on the
+     * listener they are inherited by every accepted socket. */
+    struct socket_profile_t {
+        int backlog {1024};
+        bool nodelay {false};
+        uint32_t recv_buffer {0};
+        uint32_t send_buffer {0};
+        // Clients accepted per readiness of the listener before the loop moves on to its connections
+        uint32_t accept_batch {64};
+    };
+
     class Socket {
     private:
         io_handle_t fd_;
@@ -18,7 +29,8 @@ namespace Nexus::Net {
         Nexus::Utils::NetAddr addr_;
     public:
         Socket(io_handle_t fd, SockType typ, Nexus::Utils::NetAddr addr);
-        explicit Socket(SockType typ);
+        // kind is SOCK_STREAM or SOCK_DGRAM
+        explicit Socket(SockType typ, int kind = SOCK_STREAM);
         Socket(const Socket& sock) : fd_(sock.fd_), invalid_(sock.invalid_), type_(sock.type_), addr_(sock.addr_) {}
         bool bind(const std::string& addr, uint16_t port);
         bool bind(sockaddr_in6 addrv6, uint16_t port);
@@ -27,10 +39,15 @@ namespace Nexus::Net {
         bool connect(const std::string& addr, uint16_t port);
         bool connect(sockaddr_in6 addrv6, uint16_t port);
         bool connect(sockaddr_in addrv4, uint16_t port);
-        void listen();
+        bool connect(Nexus::Utils::NetAddr addr);
+        void listen(int backlog = 1024);
         Socket accept();
         void close();
         bool setnonblocking();
+        // Turn off Nagle's algorithm, responses are written whole
+        bool setnodelay();
+        // SO_RCVBUF and SO_SNDBUF, 0 leaves one as it is
+        bool setbuffers(uint32_t recv, uint32_t send);
         bool invalid();
         io_handle_t fd();
         Nexus::Utils::NetAddr& addr();
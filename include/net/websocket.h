@@ -0,0 +1,736 @@
+#pragma once
+
+#include <algorithm>
+#include <any>
+#include <array>
+#include <cctype>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <zlib.h>
+#include "./http_handler.h"
+#include "include/log/logger.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace Nexus::Net {
+    enum class ws_opcode_t : uint8_t {
+        CONTINUATION = 0x0,
+        TEXT = 0x1,
+        BINARY = 0x2,
+        CLOSE = 0x8,
+        PING = 0x9,
+        PONG = 0xa
+    };
+
+    /*
+     * WebSocketFrame is the frame codec of RFC 6455 section 5.2: FIN, RSV1-3 and the opcode, a 7 bit length extended to 16 or
+     * 64 bits, and a masking key on every frame a client sends.
+     * */
+    struct WebSocketFrame {
+        static constexpr uint8_t FIN = 0x80;
+        static constexpr uint8_t RSV1 = 0x40;
+        static constexpr uint8_t MASK = 0x80;
+        static constexpr uint64_t max_header_size = 14;
+
+        /* Length of the frame header, once its first two bytes are known. */
+        static uint64_t HeaderLength(const uint8_t* p) {
+            uint64_t len = 2 + ((p[1] & MASK) ? 4 : 0);
+            switch (p[1] & 0x7f) {
+                case 126: return len + 2;
+                case 127: return len + 8;
+                default: return len;
+            }
+        }
+
+        /* Append an unmasked frame header, servers never mask. */
+        static void WriteHeader(std::string& out, uint8_t first, uint64_t len) {
+            out.push_back(static_cast<char>(first));
+            if (len < 126) {
+                out.push_back(static_cast<char>(len));
+            } else if (len <= 0xffff) {
+                out.push_back(static_cast<char>(126));
+                out.push_back(static_cast<char>(len >> 8));
+                out.push_back(static_cast<char>(len));
+            } else {
+                out.push_back(static_cast<char>(127));
+                for (int i = 7; i >= 0; --i) {
+                    out.push_back(static_cast<char>(len >> (i * 8)));
+                }
+            }
+        }
+
+        /* XOR len bytes of payload with the masking key in place, offset counts the payload bytes before data. Whole
+         * vectors are done with one XOR each, every block starts at a multiple of 4 so the key pattern never shifts. */
+        static void Unmask(char* data, uint64_t len, const uint8_t* key, uint64_t offset) {
+            uint8_t k[4];
+            for (int i = 0; i < 4; ++i) {
+                k[i] = key[(offset + i) & 3];
+            }
+            uint32_t pattern;
+            memcpy(&pattern, k, 4);
+            uint64_t i = 0;
+#if defined(__AVX2__)
+            const __m256i m256 = _mm256_set1_epi32(static_cast<int>(pattern));
+            for (; i + 32 <= len; i += 32) {
+                auto p = reinterpret_cast<__m256i*>(data + i);
+                _mm256_storeu_si256(p, _mm256_xor_si256(_mm256_loadu_si256(p), m256));
+            }
+#endif
+#if defined(__SSE2__)
+            const __m128i m128 = _mm_set1_epi32(static_cast<int>(pattern));
+            for (; i + 16 <= len; i += 16) {
+                auto p = reinterpret_cast<__m128i*>(data + i);
+                _mm_storeu_si128(p, _mm_xor_si128(_mm_loadu_si128(p), m128));
+            }
+#endif
+            const uint64_t wide = (static_cast<uint64_t>(pattern) << 32) | pattern;
+            for (; i + 8 <= len; i += 8) {
+                uint64_t v;
+                memcpy(&v, data + i, 8);
+                v ^= wide;
+                memcpy(data + i, &v, 8);
+            }
+            for (; i < len; ++i) {
+                data[i] = static_cast<char>(data[i] ^ k[i & 3]);
+            }
+        }
+
+        /* Whether text is well-formed UTF-8, without overlong forms, surrogates or code points past U+10FFFF. */
+        static bool Utf8(std::string_view s) {
+            uint64_t i = 0;
+            const uint64_t n = s.size();
+            while (i < n) {
+                // Skip ASCII 8 bytes at a time
+                if (i + 8 <= n) {
+                    uint64_t v;
+                    memcpy(&v, s.data() + i, 8);
+                    if (!(v & 0x8080808080808080ULL)) {
+                        i += 8;
+                        continue;
+                    }
+                }
+                auto c = static_cast<uint8_t>(s[i]);
+                if (c < 0x80) {
+                    ++i;
+                    continue;
+                }
+                uint64_t len;
+                uint32_t cp;
+                if ((c & 0xe0) == 0xc0) {
+                    len = 2;
+                    cp = c & 0x1f;
+                } else if ((c & 0xf0) == 0xe0) {
+                    len = 3;
+                    cp = c & 0x0f;
+                } else if ((c & 0xf8) == 0xf0) {
+                    len = 4;
+                    cp = c & 0x07;
+                } else {
+                    return false;
+                }
+                if (i + len > n) return false;
+                for (uint64_t j = 1; j < len; ++j) {
+                    auto cc = static_cast<uint8_t>(s[i + j]);
+                    if ((cc & 0xc0) != 0x80) return false;
+                    cp = (cp << 6) | (cc & 0x3f);
+                }
+                if ((len == 2 && cp < 0x80) || (len == 3 && cp < 0x800) || (len == 4 && (cp < 0x10000 || cp > 0x10ffff)) || (cp >= 0xd800 && cp <= 0xdfff)) {
+                    return false;
+                }
+                i += len;
+            }
+            return true;
+        }
+    };
+
+    /*
+     * WebSocketDeflate is the permessage-deflate extension (RFC 7692). We always ask for server_no_context_takeover and
+     * compress with a 1 KiB window, so the sending side costs a few KiB per connection. The inflater needs the window the
+     * client compresses with, it is allocated on the first compressed message and capped at 1 KiB as well when the client
+     * lets us pick client_max_window_bits.
+     * */
+    class WebSocketDeflate {
+    public:
+        static constexpr int window_bits = 10;
+        // Smaller messages go out uncompressed
+        static constexpr uint64_t threshold = 128;
+    private:
+        z_stream deflate_ {};
+        z_stream inflate_ {};
+        bool deflating_ {false};
+        bool inflating_ {false};
+        int server_bits_ {window_bits};
+        int client_bits_ {15};
+        bool client_no_context_ {false};
+
+        static std::string_view Trim(std::string_view s) {
+            while (!s.empty() && (s.front() == ' ' || s.front() == '\t')) s.remove_prefix(1);
+            while (!s.empty() && (s.back() == ' ' || s.back() == '\t')) s.remove_suffix(1);
+            return s;
+        }
+
+        /* Parse a window bits value, 0 when it is not a number from 8 to 15. Quoted values are allowed. */
+        static int WindowBits(std::string_view v) {
+            if (v.size() >= 2 && v.front() == '"' && v.back() == '"') {
+                v = v.substr(1, v.size() - 2);
+            }
+            if (v.size() == 1 && v[0] >= '8' && v[0] <= '9') return v[0] - '0';
+            if (v.size() == 2 && v[0] == '1' && v[1] >= '0' && v[1] <= '5') return 10 + v[1] - '0';
+            return 0;
+        }
+    public:
+        WebSocketDeflate() = default;
+        WebSocketDeflate(const WebSocketDeflate&) = delete;
+        WebSocketDeflate& operator=(const WebSocketDeflate&) = delete;
+
+        ~WebSocketDeflate() {
+            if (deflating_) deflateEnd(&deflate_);
+            if (inflating_) inflateEnd(&inflate_);
+        }
+
+        /* Accept the first permessage-deflate offer in a Sec-WebSocket-Extensions value we can serve. Fills the response
+         * value and returns nullptr when there is none. */
+        static std::unique_ptr<WebSocketDeflate> Negotiate(std::string_view offers, std::string& accepted) {
+            while (!offers.empty()) {
+                auto comma = offers.find(',');
+                auto offer = offers.substr(0, comma);
+                offers = comma == std::string_view::npos ? std::string_view{} : offers.substr(comma + 1);
+                auto semi = offer.find(';');
+                if (Trim(offer.substr(0, semi)) != "permessage-deflate") continue;
+                offer = semi == std::string_view::npos ? std::string_view{} : offer.substr(semi + 1);
+                int server_bits = 0, client_bits = 0;
+                bool server_no_context = false, client_no_context = false, client_window = false, valid = true;
+                while (valid && !offer.empty()) {
+                    semi = offer.find(';');
+                    auto param = offer.substr(0, semi);
+                    offer = semi == std::string_view::npos ? std::string_view{} : offer.substr(semi + 1);
+                    auto eq = param.find('=');
+                    auto name = Trim(param.substr(0, eq));
+                    auto value = eq == std::string_view::npos ? std::string_view{} : Trim(param.substr(eq + 1));
+                    if (name == "server_no_context_takeover" && !server_no_context && value.empty()) {
+                        server_no_context = true;
+                    } else if (name == "client_no_context_takeover" && !client_no_context && value.empty()) {
+                        client_no_context = true;
+                    } else if (name == "server_max_window_bits" && server_bits == 0) {
+                        // zlib cannot write raw deflate with a 256 byte window
+                        server_bits = WindowBits(value);
+                        valid = server_bits >= 9;
+                    } else if (name == "client_max_window_bits" && !client_window) {
+                        client_window = true;
+                        client_bits = value.empty() ? 15 : WindowBits(value);
+                        valid = client_bits != 0;
+                    } else {
+                        valid = false;
+                    }
+                }
+                if (!valid) continue;
+                auto deflate = std::make_unique<WebSocketDeflate>();
+                accepted = "permessage-deflate; server_no_context_takeover";
+                if (client_no_context) {
+                    deflate->client_no_context_ = true;
+                    accepted += "; client_no_context_takeover";
+                }
+                if (server_bits != 0) {
+                    deflate->server_bits_ = std::min<int>(server_bits, window_bits);
+                    accepted += "; server_max_window_bits=" + std::to_string(deflate->server_bits_);
+                }
+                if (client_window) {
+                    deflate->client_bits_ = std::min<int>(client_bits, window_bits);
+                    accepted += "; client_max_window_bits=" + std::to_string(deflate->client_bits_);
+                }
+                return deflate;
+            }
+            return nullptr;
+        }
+
+        /* Compress one message, out receives the payload without the trailing empty stored block. */
+        bool compress(std::string_view in, std::string& out) {
+            if (!deflating_) {
+                if (deflateInit2(&deflate_, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -server_bits_, 4, Z_DEFAULT_STRATEGY) != Z_OK) return false;
+                deflating_ = true;
+            }
+            deflate_.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(in.data()));
+            deflate_.avail_in = static_cast<uInt>(in.size());
+            auto start = out.size();
+            do {
+                auto at = out.size();
+                out.resize(at + in.size() / 2 + 64);
+                deflate_.next_out = reinterpret_cast<Bytef*>(out.data() + at);
+                deflate_.avail_out = static_cast<uInt>(out.size() - at);
+                if (deflate(&deflate_, Z_SYNC_FLUSH) == Z_STREAM_ERROR) return false;
+                out.resize(out.size() - deflate_.avail_out);
+            } while (deflate_.avail_out == 0);
+            // Every sync flush ends with 00 00 ff ff, the receiver puts it back
+            if (out.size() - start < 4) return false;
+            out.resize(out.size() - 4);
+            return deflateReset(&deflate_) == Z_OK;
+        }
+
+        /* Decompress one message into out, false when it is corrupt or inflates past limit. */
+        bool decompress(std::string_view in, std::string& out, uint64_t limit) {
+            if (!inflating_) {
+                if (inflateInit2(&inflate_, -client_bits_) != Z_OK) return false;
+                inflating_ = true;
+            }
+            static const char tail[] = {0x00, 0x00, static_cast<char>(0xff), static_cast<char>(0xff)};
+            bool ended = false;
+            for (auto part : {in, std::string_view(tail, 4)}) {
+                inflate_.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(part.data()));
+                inflate_.avail_in = static_cast<uInt>(part.size());
+                while (!ended && inflate_.avail_in > 0) {
+                    auto at = out.size();
+                    out.resize(at + std::max<uint64_t>(part.size() * 2, 1024));
+                    inflate_.next_out = reinterpret_cast<Bytef*>(out.data() + at);
+                    inflate_.avail_out = static_cast<uInt>(out.size() - at);
+                    int r = inflate(&inflate_, Z_SYNC_FLUSH);
+                    out.resize(out.size() - inflate_.avail_out);
+                    if (r == Z_STREAM_END) {
+                        // A final block ends the stream, the next message starts a new one
+                        ended = true;
+                    } else if (r != Z_OK && r != Z_BUF_ERROR) {
+                        return false;
+                    }
+                    if (out.size() > limit) return false;
+                }
+            }
+            if (ended || client_no_context_) {
+                return inflateReset(&inflate_) == Z_OK;
+            }
+            return true;
+        }
+    };
+
+    /*
+     * WebSocketHandshake answers the opening handshake of RFC 6455 section 4.2. The accept key is the base64 encoded SHA-1
+     * of the client key and a fixed GUID, both are small enough to live here instead of pulling in a crypto library.
+     * */
+    class WebSocketHandshake {
+    private:
+        static uint32_t Rotl(uint32_t x, int n) {
+            return (x << n) | (x >> (32 - n));
+        }
+
+        static const std::string* FindHeader(const http_header_t& headers, std::string_view name) {
+            for (auto& [k, v] : headers) {
+                if (k.size() == name.size() && std::equal(k.begin(), k.end(), name.begin(), [](char a, char b) {
+                    return std::tolower(static_cast<unsigned char>(a)) == std::tolower(static_cast<unsigned char>(b));
+                })) {
+                    return &v;
+                }
+            }
+            return nullptr;
+        }
+
+        /* Whether a comma separated header value lists token, ignoring case. */
+        static bool HasToken(std::string_view value, std::string_view token) {
+            while (!value.empty()) {
+                auto comma = value.find(',');
+                auto item = value.substr(0, comma);
+                value = comma == std::string_view::npos ? std::string_view{} : value.substr(comma + 1);
+                while (!item.empty() && item.front() == ' ') item.remove_prefix(1);
+                while (!item.empty() && item.back() == ' ') item.remove_suffix(1);
+                if (item.size() == token.size() && std::equal(item.begin(), item.end(), token.begin(), [](char a, char b) {
+                    return std::tolower(static_cast<unsigned char>(a)) == std::tolower(static_cast<unsigned char>(b));
+                })) {
+                    return true;
+                }
+            }
+            return false;
+        }
+    public:
+        static std::array<uint8_t, 20> Sha1(std::string_view data) {
+            uint32_t h[5] = {0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0};
+            std::string msg(data);
+            msg.push_back(static_cast<char>(0x80));
+            while (msg.size() % 64 != 56) {
+                msg.push_back(0);
+            }
+            const uint64_t bits = static_cast<uint64_t>(data.size()) * 8;
+            for (int i = 7; i >= 0; --i) {
+                msg.push_back(static_cast<char>(bits >> (i * 8)));
+            }
+            for (uint64_t off = 0; off < msg.size(); off += 64) {
+                uint32_t w[80];
+                for (int i = 0; i < 16; ++i) {
+                    auto p = reinterpret_cast<const uint8_t*>(msg.data() + off + i * 4);
+                    w[i] = (static_cast<uint32_t>(p[0]) << 24) | (static_cast<uint32_t>(p[1]) << 16) | (static_cast<uint32_t>(p[2]) << 8) | p[3];
+                }
+                for (int i = 16; i < 80; ++i) {
+                    w[i] = Rotl(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+                }
+                uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+                for (int i = 0; i < 80; ++i) {
+                    uint32_t f, k;
+                    if (i < 20) {
+                        f = (b & c) | (~b & d);
+                        k = 0x5a827999;
+                    } else if (i < 40) {
+                        f = b ^ c ^ d;
+                        k = 0x6ed9eba1;
+                    } else if (i < 60) {
+                        f = (b & c) | (b & d) | (c & d);
+                        k = 0x8f1bbcdc;
+                    } else {
+                        f = b ^ c ^ d;
+                        k = 0xca62c1d6;
+                    }
+                    uint32_t t = Rotl(a, 5) + f + e + k + w[i];
+                    e = d;
+                    d = c;
+                    c = Rotl(b, 30);
+                    b = a;
+                    a = t;
+                }
+                h[0] += a;
+                h[1] += b;
+                h[2] += c;
+                h[3] += d;
+                h[4] += e;
+            }
+            std::array<uint8_t, 20> digest {};
+            for (int i = 0; i < 20; ++i) {
+                digest[i] = static_cast<uint8_t>(h[i / 4] >> (24 - (i % 4) * 8));
+            }
+            return digest;
+        }
+
+        static std::string Base64(const uint8_t* data, uint64_t len) {
+            static constexpr char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+            std::string out;
+            out.reserve((len + 2) / 3 * 4);
+            for (uint64_t i = 0; i < len; i += 3) {
+                uint32_t v = static_cast<uint32_t>(data[i]) << 16;
+                if (i + 1 < len) v |= static_cast<uint32_t>(data[i + 1]) << 8;
+                if (i + 2 < len) v |= data[i + 2];
+                out.push_back(alphabet[(v >> 18) & 0x3f]);
+                out.push_back(alphabet[(v >> 12) & 0x3f]);
+                out.push_back(i + 1 < len ? alphabet[(v >> 6) & 0x3f] : '=');
+                out.push_back(i + 2 < len ? alphabet[v & 0x3f] : '=');
+            }
+            return out;
+        }
+
+        /* Sec-WebSocket-Accept for a client's Sec-WebSocket-Key. */
+        static std::string Accept(std::string_view key) {
+            std::string s(key);
+            s.append("258EAFA5-E914-47DA-95CA-C5AB0DC85B11");
+            auto digest = Sha1(s);
+            return Base64(digest.data(), digest.size());
+        }
+
+        /* Check an upgrade request and fill the response headers. Returns the status line to refuse with, empty when the
+         * connection may switch to 101 Switching Protocols. */
+        static std::string Handshake(const http_header_t& request, http_header_t& response, std::unique_ptr<WebSocketDeflate>& deflate) {
+            auto upgrade = FindHeader(request, "Upgrade");
+            auto connection = FindHeader(request, "Connection");
+            if (upgrade == nullptr || !HasToken(*upgrade, "websocket") || connection == nullptr || !HasToken(*connection, "upgrade")) {
+                response.emplace("Upgrade", "websocket");
+                response.emplace("Connection", "Upgrade");
+                return "426 Upgrade Required";
+            }
+            auto version = FindHeader(request, "Sec-WebSocket-Version");
+            if (version == nullptr || *version != "13") {
+                response.emplace("Sec-WebSocket-Version", "13");
+                return "426 Upgrade Required";
+            }
+            auto key = FindHeader(request, "Sec-WebSocket-Key");
+            if (key == nullptr || key->size() != 24) {
+                return "400 Bad Request";
+            }
+            response.emplace("Upgrade", "websocket");
+            response.emplace("Connection", "Upgrade");
+            response.emplace("Sec-WebSocket-Accept", Accept(*key));
+            if (auto extensions = FindHeader(request, "Sec-WebSocket-Extensions"); extensions != nullptr) {
+                std::string accepted;
+                deflate = WebSocketDeflate::Negotiate(*extensions, accepted);
+                if (deflate) {
+                    response.emplace("Sec-WebSocket-Extensions", accepted);
+                }
+            }
+            return {};
+        }
+    };
+
+    /*
+     * WebSocket is one upgraded connection. The transport feeds it whatever it reads and sends whatever is pending, the
+     * WebSocket reassembles fragmented messages, answers pings and the closing handshake, and hands complete messages to
+     * the handler. It only keeps the frame header, the message being reassembled and the frames not sent yet, so an idle
+     * connection costs little more than the object itself.
+     * */
+    class WebSocket {
+    public:
+        enum class status_t {
+            OPEN,
+            // We sent a close frame and wait for the answer
+            CLOSING,
+            CLOSED
+        };
+        // Larger messages are refused with 1009, before and after inflating
+        static constexpr uint64_t max_message = 1 << 20;
+        // Connections without traffic are pinged after half of this and dropped after all of it, in milliseconds
+        static constexpr uint64_t idle_timeout = 60000;
+        // Per-connection state for handlers, kept until the connection closes
+        std::any context;
+    private:
+        HttpHandlerFunctionSet& fs_;
+        std::string peer_;
+        std::unique_ptr<WebSocketDeflate> deflate_;
+        status_t status_ {status_t::OPEN};
+        bool notified_ {false};
+        bool pinging_ {false};
+        // Header of the frame being read
+        uint8_t head_[WebSocketFrame::max_header_size] {};
+        uint64_t head_len_ {0};
+        bool in_payload_ {false};
+        bool fin_ {false};
+        ws_opcode_t opcode_ {ws_opcode_t::CONTINUATION};
+        uint64_t length_ {0};
+        uint64_t read_ {0};
+        uint8_t mask_[4] {};
+        // Data message being reassembled, control frames may arrive between its fragments
+        std::string message_;
+        bool fragmented_ {false};
+        bool binary_ {false};
+        bool compressed_ {false};
+        std::string control_;
+        // Frames not sent yet
+        std::string out_;
+        uint64_t out_pos_ {0};
+
+        /* Queue a close frame with code and give up on the connection. */
+        bool fail(uint16_t code, std::string_view reason) {
+            LWARN("WebSocket error with {}: {}", peer_, reason);
+            if (status_ == status_t::OPEN) {
+                queue_close(code);
+            }
+            status_ = status_t::CLOSED;
+            notify(code);
+            return false;
+        }
+
+        void notify(uint16_t code) {
+            if (!notified_) {
+                notified_ = true;
+                if (fs_.close) fs_.close(*this, code);
+            }
+        }
+
+        void queue(ws_opcode_t op, std::string_view payload, uint8_t flags = 0) {
+            WebSocketFrame::WriteHeader(out_, WebSocketFrame::FIN | flags | static_cast<uint8_t>(op), payload.size());
+            out_.append(payload);
+        }
+
+        void queue_close(uint16_t code) {
+            char payload[2] = {static_cast<char>(code >> 8), static_cast<char>(code)};
+            queue(ws_opcode_t::CLOSE, std::string_view(payload, code == 1005 ? 0 : 2));
+        }
+
+        /* Validate the header in head_ and start reading its payload. */
+        bool begin_frame() {
+            fin_ = head_[0] & WebSocketFrame::FIN;
+            const uint8_t rsv = head_[0] & 0x70;
+            opcode_ = static_cast<ws_opcode_t>(head_[0] & 0x0f);
+            if (!(head_[1] & WebSocketFrame::MASK)) return fail(1002, "unmasked client frame");
+            const uint8_t* p = head_ + 2;
+            length_ = head_[1] & 0x7f;
+            if (length_ == 126) {
+                length_ = (static_cast<uint64_t>(p[0]) << 8) | p[1];
+                p += 2;
+            } else if (length_ == 127) {
+                length_ = 0;
+                for (int i = 0; i < 8; ++i) {
+                    length_ = (length_ << 8) | p[i];
+                }
+                p += 8;
+                if (length_ >> 63) return fail(1002, "frame length out of range");
+            }
+            memcpy(mask_, p, 4);
+            switch (opcode_) {
+                case ws_opcode_t::CLOSE:
+                case ws_opcode_t::PING:
+                case ws_opcode_t::PONG:
+                    if (!fin_ || length_ > 125 || rsv) return fail(1002, "malformed control frame");
+                    control_.clear();
+                    break;
+                case ws_opcode_t::CONTINUATION:
+                    if (!fragmented_ || rsv) return fail(1002, "unexpected continuation frame");
+                    break;
+                case ws_opcode_t::TEXT:
+                case ws_opcode_t::BINARY:
+                    if (fragmented_) return fail(1002, "data frame inside a fragmented message");
+                    if ((rsv & ~WebSocketFrame::RSV1) || ((rsv & WebSocketFrame::RSV1) && !deflate_)) return fail(1002, "reserved bits set");
+                    binary_ = opcode_ == ws_opcode_t::BINARY;
+                    compressed_ = rsv & WebSocketFrame::RSV1;
+                    message_.clear();
+                    break;
+                default:
+                    return fail(1002, "reserved opcode");
+            }
+            if (opcode_ <= ws_opcode_t::BINARY) {
+                if (message_.size() + length_ > max_message) return fail(1009, "message too big");
+                fragmented_ = !fin_;
+            }
+            head_len_ = 0;
+            read_ = 0;
+            in_payload_ = true;
+            return length_ > 0 || end_frame();
+        }
+
+        /* Act on a frame whose payload is complete. */
+        bool end_frame() {
+            in_payload_ = false;
+            switch (opcode_) {
+                case ws_opcode_t::PING:
+                    if (status_ == status_t::OPEN) queue(ws_opcode_t::PONG, control_);
+                    return true;
+                case ws_opcode_t::PONG:
+                    pinging_ = false;
+                    return true;
+                case ws_opcode_t::CLOSE: {
+                    uint16_t code = 1005;
+                    if (control_.size() == 1) return fail(1002, "truncated close code");
+                    if (control_.size() >= 2) {
+                        code = static_cast<uint16_t>((static_cast<uint8_t>(control_[0]) << 8) | static_cast<uint8_t>(control_[1]));
+                        if (!((code >= 1000 && code <= 1014 && code != 1004 && code != 1005 && code != 1006) || (code >= 3000 && code <= 4999))) {
+                            return fail(1002, "invalid close code");
+                        }
+                        if (!WebSocketFrame::Utf8(std::string_view(control_).substr(2))) return fail(1007, "close reason is not UTF-8");
+                    }
+                    // Echo the code, the transport closes once it is sent
+                    if (status_ == status_t::OPEN) queue_close(code);
+                    status_ = status_t::CLOSED;
+                    notify(code);
+                    return false;
+                }
+                default:
+                    break;
+            }
+            if (!fin_) return true;
+            std::string inflated;
+            std::string_view message = message_;
+            if (compressed_) {
+                if (!deflate_->decompress(message_, inflated, max_message)) return fail(1009, "message cannot be inflated");
+                message = inflated;
+            }
+            if (!binary_ && !WebSocketFrame::Utf8(message)) return fail(1007, "text message is not UTF-8");
+            if (status_ == status_t::OPEN && fs_.message) {
+                fs_.message(*this, message, binary_);
+            }
+            // Large messages do not pin their buffer for the rest of the connection
+            if (message_.capacity() > 4096) {
+                std::string().swap(message_);
+            } else {
+                message_.clear();
+            }
+            return true;
+        }
+    public:
+        WebSocket(HttpHandlerFunctionSet& fs, std::string peer, std::unique_ptr<WebSocketDeflate> deflate) : fs_(fs), peer_(std::move(peer)), deflate_(std::move(deflate)) {}
+
+        /* Tell the handler the connection is open, frames sent from here follow the handshake response. */
+        void open() {
+            if (fs_.open) fs_.open(*this);
+        }
+
+        /* Feed bytes read from the connection. False once the connection is closed and only pending() is left to send. */
+        bool feed(const char* data, uint64_t len) {
+            while (len > 0 && status_ != status_t::CLOSED) {
+                if (!in_payload_) {
+                    uint64_t need = head_len_ < 2 ? 2 : WebSocketFrame::HeaderLength(head_);
+                    uint64_t take = std::min<uint64_t>(need - head_len_, len);
+                    memcpy(head_ + head_len_, data, take);
+                    head_len_ += take;
+                    data += take;
+                    len -= take;
+                    if (head_len_ < need || (head_len_ == 2 && WebSocketFrame::HeaderLength(head_) > 2)) continue;
+                    if (!begin_frame()) return false;
+                    continue;
+                }
+                auto& target = opcode_ >= ws_opcode_t::CLOSE ? control_ : message_;
+                uint64_t take = std::min<uint64_t>(length_ - read_, len);
+                auto at = target.size();
+                target.append(data, take);
+                WebSocketFrame::Unmask(target.data() + at, take, mask_, read_);
+                read_ += take;
+                data += take;
+                len -= take;
+                if (read_ == length_ && !end_frame()) return false;
+            }
+            return status_ != status_t::CLOSED;
+        }
+
+        /* Send a message, large ones compressed when the client agreed to permessage-deflate. */
+        bool send(std::string_view data, bool binary = false) {
+            if (status_ != status_t::OPEN) return false;
+            auto op = binary ? ws_opcode_t::BINARY : ws_opcode_t::TEXT;
+            if (deflate_ && data.size() >= WebSocketDeflate::threshold) {
+                std::string compressed;
+                if (deflate_->compress(data, compressed) && compressed.size() < data.size()) {
+                    queue(op, compressed, WebSocketFrame::RSV1);
+                    return true;
+                }
+            }
+            queue(op, data);
+            return true;
+        }
+
+        bool ping(std::string_view payload = {}) {
+            if (status_ != status_t::OPEN || payload.size() > 125) return false;
+            pinging_ = true;
+            queue(ws_opcode_t::PING, payload);
+            return true;
+        }
+
+        /* Ping an idle peer, unless a ping is already waiting for its pong. */
+        void keepalive() {
+            if (!pinging_) ping();
+        }
+
+        /* Start the closing handshake, the peer answers with its own close frame. */
+        void close(uint16_t code = 1000) {
+            if (status_ == status_t::OPEN) {
+                queue_close(code);
+                status_ = status_t::CLOSING;
+            }
+        }
+
+        /* The transport went away without a closing handshake. */
+        void drop() {
+            status_ = status_t::CLOSED;
+            notify(1006);
+        }
+
+        /* Frames waiting to be sent. */
+        std::string_view pending() {
+            return std::string_view(out_).substr(out_pos_);
+        }
+
+        /* Mark n bytes of pending() as sent. */
+        void sent(uint64_t n) {
+            out_pos_ += n;
+            if (out_pos_ == out_.size()) {
+                out_pos_ = 0;
+                if (out_.capacity() > 4096) {
+                    std::string().swap(out_);
+                } else {
+                    out_.clear();
+                }
+            }
+        }
+
+        status_t status() {
+            return status_;
+        }
+
+        const std::string& peer() {
+            return peer_;
+        }
+    };
+}
\ No newline at end of file
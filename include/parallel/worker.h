@@ -76,8 +76,12 @@ namespace Nexus::Parallel {
         }
         void cleanup() {
             for (auto& w : workers_) {
+                // Set the flag under the lock, a worker between its predicate check and its wait would miss the notify
+                {
+                    std::lock_guard lock(w.mtx_);
+                    w.stop();
+                }
                 w.cv_.notify_one();
-                w.stop();
                 w.worker_thread_.join();
             }
         }
@@ -1,6 +1,10 @@
 #pragma once
 
+#include <algorithm>
 #include <vector>
+#include <string>
+#include <thread>
+#include <functional>
 #include "../../io/mux.h"
 #include "./win32_defs.h"
 
@@ -27,12 +31,14 @@ namespace Nexus::IO {
                 pfd_[i].fd = fds_[i].handle;
                 pfd_[i].events = fds_[i].evtyp;
             }
-            int r = WSAPoll(pfd_, fds_.size(), 0);
-            auto ret = fds_;
+            int r = WSAPoll(pfd_, fds_.size(), waitms);
+            std::vector<io_ev> ret;
             if (r != SOCKET_ERROR) {
+                // Report only the handles that are ready, together with what they are ready for
                 for (int i = 0; i < fds_.size(); ++i) {
-                    ret[i].handle = pfd_[i].fd;
-                    ret[i].evtyp = pfd_[i].events;
+                    if (pfd_[i].revents != 0) {
+                        ret.push_back({pfd_[i].fd, static_cast<io_evtyp_t>(pfd_[i].revents)});
+                    }
                 }
                 return ret;
             } else {
@@ -86,7 +92,7 @@ namespace Nexus::IO {
                     if (FD_ISSET(fd.handle, &rset)) MSK_SET(ie.evtyp, EVREAD);
                     if (FD_ISSET(fd.handle, &wset)) MSK_SET(ie.evtyp, EVWRITE);
                     if (FD_ISSET(fd.handle, &eset)) MSK_SET(ie.evtyp, EVEXCEPTION);
-                    if (fd.evtyp != 0) {
+                    if (ie.evtyp != 0) {
                         r.push_back(ie);
                     }
                 }
@@ -101,6 +107,151 @@ namespace Nexus::IO {
 
     };
 
+    /*
+     * Win32DirectoryWatcher reports changed files under a directory tree through ReadDirectoryChangesW.
+     * The callback receives the path relative to the watched root with '/' as separator, or an empty string
+     * when the change buffer overflowed and the caller has to rescan everything.
+     * */
+    class Win32DirectoryWatcher {
+    public:
+        using callback_t = std::function<void(const std::string&)>;
+    private:
+        HANDLE dir_ {INVALID_HANDLE_VALUE};
+        HANDLE stop_ {nullptr};
+        std::thread thread_;
+
+        static std::string narrow(const WCHAR* str, int len) {
+            int sz = WideCharToMultiByte(CP_UTF8, 0, str, len, nullptr, 0, nullptr, nullptr);
+            std::string r(sz, '\0');
+            WideCharToMultiByte(CP_UTF8, 0, str, len, r.data(), sz, nullptr, nullptr);
+            std::replace(r.begin(), r.end(), '\\', '/');
+            return r;
+        }
+    public:
+        Win32DirectoryWatcher() = default;
+        Win32DirectoryWatcher(const Win32DirectoryWatcher&) = delete;
+
+        bool start(const std::string& root, callback_t cb) {
+            dir_ = CreateFileA(root.c_str(), FILE_LIST_DIRECTORY, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                               nullptr, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, nullptr);
+            if (dir_ == INVALID_HANDLE_VALUE) {
+                return false;
+            }
+            stop_ = CreateEvent(nullptr, TRUE, FALSE, nullptr);
+            thread_ = std::thread([this, cb = std::move(cb)]() {
+                alignas(DWORD) char buf[16384];
+                OVERLAPPED ov {};
+                ov.hEvent = CreateEvent(nullptr, TRUE, FALSE, nullptr);
+                HANDLE handles[2] = {ov.hEvent, stop_};
+                while (true) {
+                    if (!ReadDirectoryChangesW(dir_, buf, sizeof(buf), TRUE, FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_DIR_NAME | FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_SIZE,
+                                               nullptr, &ov, nullptr)) {
+                        break;
+                    }
+                    if (WaitForMultipleObjects(2, handles, FALSE, INFINITE) != WAIT_OBJECT_0) {
+                        CancelIo(dir_);
+                        break;
+                    }
+                    DWORD bytes = 0;
+                    if (!GetOverlappedResult(dir_, &ov, &bytes, FALSE)) {
+                        break;
+                    }
+                    ResetEvent(ov.hEvent);
+                    if (bytes == 0) {
+                        // The notification buffer overflowed, individual changes were lost
+                        cb({});
+                        continue;
+                    }
+                    auto* info = reinterpret_cast<FILE_NOTIFY_INFORMATION*>(buf);
+                    while (true) {
+                        cb(narrow(info->FileName, static_cast<int>(info->FileNameLength / sizeof(WCHAR))));
+                        if (info->NextEntryOffset == 0) break;
+                        info = reinterpret_cast<FILE_NOTIFY_INFORMATION*>(reinterpret_cast<char*>(info) + info->NextEntryOffset);
+                    }
+                }
+                CloseHandle(ov.hEvent);
+            });
+            return true;
+        }
+
+        void stop() {
+            if (dir_ == INVALID_HANDLE_VALUE) return;
+            SetEvent(stop_);
+            if (thread_.joinable()) thread_.join();
+            CloseHandle(stop_);
+            CloseHandle(dir_);
+            stop_ = nullptr;
+            dir_ = INVALID_HANDLE_VALUE;
+        }
+
+        ~Win32DirectoryWatcher() {
+            stop();
+        }
+    };
+
+    /*
+     * Win32AsyncFileRead reads a whole file with overlapped I/O. start() only issues the read, ready() can be polled
+     * without blocking and result() hands out the content once the read completed.
+     * */
+    class Win32AsyncFileRead {
+    private:
+        HANDLE file_ {INVALID_HANDLE_VALUE};
+        OVERLAPPED ov_ {};
+        std::string buffer_;
+        bool failed_ {false};
+    public:
+        Win32AsyncFileRead() = default;
+        Win32AsyncFileRead(const Win32AsyncFileRead&) = delete;
+
+        bool start(const std::string& path) {
+            file_ = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_OVERLAPPED, nullptr);
+            LARGE_INTEGER size {};
+            if (file_ == INVALID_HANDLE_VALUE || !GetFileSizeEx(file_, &size) || size.QuadPart > UINT32_MAX) {
+                failed_ = true;
+                return false;
+            }
+            buffer_.resize(size.QuadPart);
+            if (buffer_.empty()) {
+                return true;
+            }
+            if (!ReadFile(file_, buffer_.data(), static_cast<DWORD>(buffer_.size()), nullptr, &ov_) && GetLastError() != ERROR_IO_PENDING) {
+                failed_ = true;
+                return false;
+            }
+            return true;
+        }
+
+        bool ready() {
+            return failed_ || buffer_.empty() || HasOverlappedIoCompleted(&ov_);
+        }
+
+        Nexus::Utils::MayFail<std::string> result() {
+            if (failed_) {
+                return Nexus::Utils::failed;
+            }
+            if (!buffer_.empty()) {
+                DWORD readn = 0;
+                if (!GetOverlappedResult(file_, &ov_, &readn, TRUE)) {
+                    return Nexus::Utils::failed;
+                }
+                buffer_.resize(readn);
+            }
+            return std::move(buffer_);
+        }
+
+        ~Win32AsyncFileRead() {
+            if (file_ != INVALID_HANDLE_VALUE) {
+                if (!failed_ && !buffer_.empty() && !HasOverlappedIoCompleted(&ov_)) {
+                    // The kernel still writes into buffer_, wait for it before the memory goes away
+                    CancelIo(file_);
+                    DWORD readn = 0;
+                    GetOverlappedResult(file_, &ov_, &readn, TRUE);
+                }
+                CloseHandle(file_);
+            }
+        }
+    };
+
     inline static void EnableWindowsVirtualANSI() {
 #ifdef LOG_ANSI_SUPPORT
         HANDLE hOut = GetStdHandle(STD_OUTPUT_HANDLE);
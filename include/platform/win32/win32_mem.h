@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstdint>
+#include "./win32_defs.h"
+
+namespace Nexus::Base {
+    /* Enable SeLockMemoryPrivilege for the process, large pages cannot be mapped without it. The account has to hold the
+     * privilege already, "Lock pages in memory" in the local security policy. */
+    static bool EnableLargePages() {
+        HANDLE token;
+        if (!OpenProcessToken(GetCurrentProcess(), TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, &token)) {
+            return false;
+        }
+        TOKEN_PRIVILEGES tp {};
+        tp.PrivilegeCount = 1;
+        tp.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+        bool ok = LookupPrivilegeValue(nullptr, SE_LOCK_MEMORY_NAME, &tp.Privileges[0].Luid) &&
+                  AdjustTokenPrivileges(token, FALSE, &tp, 0, nullptr, nullptr) && GetLastError() == ERROR_SUCCESS;
+        CloseHandle(token);
+        return ok && GetLargePageMinimum() > 0;
+    }
+
+    /* Size of a large page, 0 when the system has none. */
+    static uint64_t LargePageSize() {
+        return GetLargePageMinimum();
+    }
+
+    static uint32_t NumaNodes() {
+        ULONG highest = 0;
+        if (!GetNumaHighestNodeNumber(&highest)) {
+            return 1;
+        }
+        return highest + 1;
+    }
+
+    /* The NUMA node of the processor the calling thread runs on. */
+    static uint32_t CurrentNumaNode() {
+        PROCESSOR_NUMBER pn;
+        GetCurrentProcessorNumberEx(&pn);
+        USHORT node = 0;
+        if (!GetNumaProcessorNodeEx(&pn, &node)) {
+            return 0;
+        }
+        return node;
+    }
+
+    /* Commit size bytes of zeroed memory on node, in large pages when large is set and then size has to be a multiple of
+     * LargePageSize(). nullptr when it cannot be had. */
+    static char* MapPages(uint64_t size, uint32_t node, bool large) {
+        DWORD type = MEM_RESERVE | MEM_COMMIT | (large ? MEM_LARGE_PAGES : 0);
+        return reinterpret_cast<char*>(VirtualAllocExNuma(GetCurrentProcess(), nullptr, size, type, PAGE_READWRITE, node));
+    }
+
+    static void UnmapPages(void* ptr, [[maybe_unused]] uint64_t size) {
+        VirtualFree(ptr, 0, MEM_RELEASE);
+    }
+}
\ No newline at end of file
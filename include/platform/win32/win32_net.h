@@ -5,7 +5,9 @@
 #include "./include/utils/unexpected.h"
 
 namespace Nexus::Utils {
-    static MayFail<in_addr> DNSLookUpV4(const std::string& str) {
+    /* The first A record of a name, ttl gets its time to live in seconds. Failing is an answer like any other, the name may
+     * simply not exist. */
+    static MayFail<in_addr> DNSLookUpV4(const std::string& str, uint32_t* ttl = nullptr) {
         PDNS_RECORD dnsrec {};
         DNS_STATUS status = DnsQuery(str.c_str(), DNS_TYPE_A, DNS_QUERY_STANDARD, nullptr, &dnsrec, nullptr);
         if (status == DNS_ERROR_RCODE_NO_ERROR) {
@@ -13,32 +15,31 @@ namespace Nexus::Utils {
                 if (r->wType == DNS_TYPE_A) {
                     in_addr adr{};
                     adr.S_un.S_addr = r->Data.A.IpAddress;
-                    char straddr[16] = {};
-                    inet_ntop(AF_INET, reinterpret_cast<void*>(&adr), straddr, 16);
+                    if (ttl != nullptr) *ttl = r->dwTtl;
                     DnsRecordListFree(dnsrec, DnsFreeRecordList);
                     return adr;
                 }
             }
+            DnsRecordListFree(dnsrec, DnsFreeRecordList);
         }
-        BREAKPOINT;
         return failed;
     }
-    static MayFail<in6_addr> DNSLookUpV6(const std::string& str) {
+    /* The first AAAA record of a name, like DNSLookUpV4. */
+    static MayFail<in6_addr> DNSLookUpV6(const std::string& str, uint32_t* ttl = nullptr) {
         PDNS_RECORD dnsrec {};
-            DNS_STATUS status = DnsQuery(str.c_str(), DNS_TYPE_AAAA, DNS_QUERY_STANDARD, nullptr, &dnsrec, nullptr);
+        DNS_STATUS status = DnsQuery(str.c_str(), DNS_TYPE_AAAA, DNS_QUERY_STANDARD, nullptr, &dnsrec, nullptr);
         if (status == DNS_ERROR_RCODE_NO_ERROR) {
             for (PDNS_RECORD r = dnsrec; r != nullptr; r = r->pNext) {
                 if (r->wType == DNS_TYPE_AAAA) {
                     in6_addr adr{};
                     memcpy(adr.u.Byte, r->Data.AAAA.Ip6Address.IP6Byte, sizeof(in6_addr));
-                    char straddr[46] = {};
-                    inet_ntop(AF_INET6, reinterpret_cast<void*>(&adr), straddr, 46);
+                    if (ttl != nullptr) *ttl = r->dwTtl;
                     DnsRecordListFree(dnsrec, DnsFreeRecordList);
                     return adr;
                 }
             }
+            DnsRecordListFree(dnsrec, DnsFreeRecordList);
         }
-        BREAKPOINT;
         return failed;
     }
 }
\ No newline at end of file
@@ -0,0 +1,145 @@
+#pragma once
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include "./win32_defs.h"
+#include <MSWSock.h>
+
+// Older MinGW headers lack the UDP offload options of Windows 10 2004 and later
+#ifndef UDP_SEND_MSG_SIZE
+#define UDP_SEND_MSG_SIZE 2
+#endif
+#ifndef UDP_RECV_MAX_COALESCED_SIZE
+#define UDP_RECV_MAX_COALESCED_SIZE 3
+#endif
+#ifndef UDP_COALESCED_INFO
+#define UDP_COALESCED_INFO 3
+#endif
+#ifndef SIO_UDP_CONNRESET
+#define SIO_UDP_CONNRESET _WSAIOW(IOC_VENDOR, 12)
+#endif
+
+namespace Nexus::IO {
+    /*
+     * Win32UdpBatch moves datagrams of one UDP socket in batches with UDP segmentation offload (USO) and receive offload
+     * (URO), the Windows counterparts of GSO and GRO. Equally sized datagrams to one peer leave with a single WSASendMsg that
+     * the stack or the NIC splits, and one WSARecvMsg may return several coalesced datagrams that recv() hands out one by one.
+     * Without the offloads every datagram takes its own call.
+     * */
+    class Win32UdpBatch {
+    public:
+        // Largest coalesced payload, a datagram of 64 KiB minus the IPv6 and UDP headers
+        static constexpr DWORD max_coalesced = 65535 - 40 - 8;
+    private:
+        SOCKET fd_ {INVALID_SOCKET};
+        LPFN_WSARECVMSG recvmsg_ {nullptr};
+        bool uso_ {false};
+        bool uro_ {false};
+        std::unique_ptr<char[]> rbuf_;
+        // The coalesced receive being split, datagrams are rseg_ bytes except the last one
+        DWORD rlen_ {0};
+        DWORD rpos_ {0};
+        DWORD rseg_ {0};
+        sockaddr_storage rfrom_ {};
+        int rfromlen_ {0};
+
+        bool receive() {
+            WSABUF buf {max_coalesced, rbuf_.get()};
+            alignas(WSACMSGHDR) char control[WSA_CMSG_SPACE(sizeof(DWORD))] {};
+            WSAMSG msg {};
+            msg.name = reinterpret_cast<LPSOCKADDR>(&rfrom_);
+            msg.namelen = sizeof(rfrom_);
+            msg.lpBuffers = &buf;
+            msg.dwBufferCount = 1;
+            msg.Control = {sizeof(control), control};
+            DWORD n = 0;
+            if (recvmsg_(fd_, &msg, &n, nullptr, nullptr) == SOCKET_ERROR) {
+                return false;
+            }
+            rfromlen_ = msg.namelen;
+            rlen_ = n;
+            rpos_ = 0;
+            rseg_ = n;
+            for (WSACMSGHDR* c = WSA_CMSG_FIRSTHDR(&msg); c != nullptr; c = WSA_CMSG_NXTHDR(&msg, c)) {
+                if (c->cmsg_level == IPPROTO_UDP && c->cmsg_type == UDP_COALESCED_INFO) {
+                    rseg_ = *reinterpret_cast<DWORD*>(WSA_CMSG_DATA(c));
+                }
+            }
+            return true;
+        }
+    public:
+        Win32UdpBatch() = default;
+        Win32UdpBatch(const Win32UdpBatch&) = delete;
+
+        /* Attach to a bound datagram socket and turn on what the system supports. */
+        bool open(SOCKET fd) {
+            fd_ = fd;
+            GUID guid = WSAID_WSARECVMSG;
+            DWORD n = 0;
+            if (WSAIoctl(fd_, SIO_GET_EXTENSION_FUNCTION_POINTER, &guid, sizeof(guid), &recvmsg_, sizeof(recvmsg_), &n, nullptr, nullptr) == SOCKET_ERROR) {
+                return false;
+            }
+            // ICMP port unreachable would otherwise fail the next receive with WSAECONNRESET
+            BOOL report = FALSE;
+            WSAIoctl(fd_, SIO_UDP_CONNRESET, &report, sizeof(report), nullptr, 0, &n, nullptr, nullptr);
+            DWORD coalesced = max_coalesced;
+            uro_ = setsockopt(fd_, IPPROTO_UDP, UDP_RECV_MAX_COALESCED_SIZE, reinterpret_cast<const char*>(&coalesced), sizeof(coalesced)) != SOCKET_ERROR;
+            DWORD segment = 0;
+            int len = sizeof(segment);
+            uso_ = getsockopt(fd_, IPPROTO_UDP, UDP_SEND_MSG_SIZE, reinterpret_cast<char*>(&segment), &len) != SOCKET_ERROR;
+            rbuf_ = std::make_unique<char[]>(max_coalesced);
+            return true;
+        }
+
+        /* Next datagram, SOCKET_ERROR when there is none or the receive failed, see WSAGetLastError. */
+        int recv(char* buf, int len, sockaddr_storage& from, int& fromlen) {
+            if (rpos_ == rlen_ && !receive()) {
+                return SOCKET_ERROR;
+            }
+            DWORD n = std::min<DWORD>(rseg_, rlen_ - rpos_);
+            // A datagram longer than the buffer is truncated, like recvfrom does
+            memcpy(buf, rbuf_.get() + rpos_, std::min<DWORD>(n, static_cast<DWORD>(len)));
+            rpos_ += n;
+            from = rfrom_;
+            fromlen = rfromlen_;
+            return static_cast<int>(std::min<DWORD>(n, static_cast<DWORD>(len)));
+        }
+
+        /* Send the datagrams stored back to back in data to one peer, each segment bytes long except the last one. */
+        bool send(const char* data, DWORD len, DWORD segment, const sockaddr* to, int tolen) {
+            if (uso_ && len > segment) {
+                WSABUF buf {len, const_cast<char*>(data)};
+                alignas(WSACMSGHDR) char control[WSA_CMSG_SPACE(sizeof(DWORD))] {};
+                WSAMSG msg {};
+                msg.name = const_cast<LPSOCKADDR>(to);
+                msg.namelen = tolen;
+                msg.lpBuffers = &buf;
+                msg.dwBufferCount = 1;
+                msg.Control = {sizeof(control), control};
+                WSACMSGHDR* c = WSA_CMSG_FIRSTHDR(&msg);
+                c->cmsg_level = IPPROTO_UDP;
+                c->cmsg_type = UDP_SEND_MSG_SIZE;
+                c->cmsg_len = WSA_CMSG_LEN(sizeof(DWORD));
+                *reinterpret_cast<DWORD*>(WSA_CMSG_DATA(c)) = segment;
+                DWORD sent = 0;
+                return WSASendMsg(fd_, &msg, 0, &sent, nullptr, nullptr) != SOCKET_ERROR;
+            }
+            for (DWORD off = 0; off < len; off += segment) {
+                int n = static_cast<int>(std::min<DWORD>(segment, len - off));
+                if (sendto(fd_, data + off, n, 0, to, tolen) == SOCKET_ERROR) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        bool uso() const {
+            return uso_;
+        }
+
+        bool uro() const {
+            return uro_;
+        }
+    };
+}
\ No newline at end of file
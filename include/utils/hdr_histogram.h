@@ -0,0 +1,154 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <vector>
+
+namespace Nexus::Utils {
+    /*
+     * HdrHistogram records integer values, usually latencies in nanoseconds, into log-linear buckets that keep three
+     * significant decimal digits over the whole trackable range. Recording is an index computation and an increment, so
+     * it can sit on the hot path of a load generator, and two histograms of the same range merge by adding counts.
+     * The layout follows the reference HdrHistogram with a lowest discernible value of 1.
+     * */
+    class HdrHistogram {
+    private:
+        // 2 * 10^3 rounded up to a power of two, the resolution of three significant digits
+        static constexpr int64_t sub_bucket_count_ = 2048;
+        static constexpr int64_t sub_bucket_half_count_ = sub_bucket_count_ / 2;
+        static constexpr int sub_bucket_half_count_magnitude_ = 10;
+        static constexpr int64_t sub_bucket_mask_ = sub_bucket_count_ - 1;
+        int64_t highest_;
+        std::vector<uint64_t> counts_;
+        uint64_t total_ {0};
+        int64_t min_ {INT64_MAX};
+        int64_t max_ {0};
+
+        static int BucketIndex(int64_t value) {
+            return 64 - std::countl_zero(static_cast<uint64_t>(value | sub_bucket_mask_)) - (sub_bucket_half_count_magnitude_ + 1);
+        }
+
+        static uint64_t CountsIndex(int64_t value) {
+            int bucket = BucketIndex(value);
+            int64_t sub_bucket = value >> bucket;
+            return (static_cast<uint64_t>(bucket + 1) << sub_bucket_half_count_magnitude_) + (sub_bucket - sub_bucket_half_count_);
+        }
+
+        /* The lowest value that lands in counts index i. */
+        static int64_t ValueAt(uint64_t i) {
+            int bucket = static_cast<int>(i >> sub_bucket_half_count_magnitude_) - 1;
+            int64_t sub_bucket = static_cast<int64_t>(i & (sub_bucket_half_count_ - 1)) + sub_bucket_half_count_;
+            if (bucket < 0) {
+                sub_bucket -= sub_bucket_half_count_;
+                bucket = 0;
+            }
+            return sub_bucket << bucket;
+        }
+
+        /* The highest value that is recorded as the same as value. */
+        static int64_t HighestEquivalent(int64_t value) {
+            int bucket = BucketIndex(value);
+            int64_t sub_bucket = value >> bucket;
+            int64_t lowest = sub_bucket << bucket;
+            int64_t range = int64_t {1} << (bucket + (sub_bucket >= sub_bucket_count_ ? 1 : 0));
+            return lowest + range - 1;
+        }
+    public:
+        /* Track values from 1 up to highest, larger values are clamped to it. */
+        explicit HdrHistogram(int64_t highest) : highest_(std::max<int64_t>(highest, sub_bucket_count_)) {
+            counts_.resize(CountsIndex(highest_) + 1);
+        }
+
+        void record(int64_t value, uint64_t count = 1) {
+            value = std::clamp<int64_t>(value, 0, highest_);
+            counts_[CountsIndex(value)] += count;
+            total_ += count;
+            min_ = std::min<int64_t>(min_, value);
+            max_ = std::max<int64_t>(max_, value);
+        }
+
+        /* Record a value taken once per expected_interval. A value longer than the interval means the measuring loop
+         * stalled and skipped the samples it would have taken meanwhile, those are filled in with linearly decreasing
+         * values, as copyCorrectedForCoordinatedOmission does in the reference implementation. */
+        void record_corrected(int64_t value, int64_t expected_interval, uint64_t count = 1) {
+            record(value, count);
+            if (expected_interval <= 0) {
+                return;
+            }
+            for (int64_t missing = value - expected_interval; missing >= expected_interval; missing -= expected_interval) {
+                record(missing, count);
+            }
+        }
+
+        /* A copy with coordinated omission corrected after the fact, for closed-loop runs where the interval is only
+         * known once they are over. Each bucket is replayed at its highest value, as the reference does. */
+        [[nodiscard]] HdrHistogram corrected(int64_t expected_interval) const {
+            HdrHistogram out(highest_);
+            for (uint64_t i = 0; i < counts_.size(); ++i) {
+                if (counts_[i] != 0) {
+                    out.record_corrected(HighestEquivalent(ValueAt(i)), expected_interval, counts_[i]);
+                }
+            }
+            return out;
+        }
+
+        /* Add the counts of a histogram with the same range. */
+        void merge(const HdrHistogram& other) {
+            for (uint64_t i = 0; i < std::min<uint64_t>(counts_.size(), other.counts_.size()); ++i) {
+                counts_[i] += other.counts_[i];
+            }
+            total_ += other.total_;
+            min_ = std::min<int64_t>(min_, other.min_);
+            max_ = std::max<int64_t>(max_, other.max_);
+        }
+
+        /* The value below which percentile percent of the recorded values fall, reported as the top of its bucket. */
+        [[nodiscard]] int64_t percentile(double percentile) const {
+            if (total_ == 0) {
+                return 0;
+            }
+            auto wanted = static_cast<uint64_t>(std::clamp(percentile, 0.0, 100.0) / 100.0 * static_cast<double>(total_) + 0.5);
+            wanted = std::max<uint64_t>(wanted, 1);
+            uint64_t seen = 0;
+            for (uint64_t i = 0; i < counts_.size(); ++i) {
+                seen += counts_[i];
+                if (seen >= wanted) {
+                    return std::min<int64_t>(HighestEquivalent(ValueAt(i)), max_);
+                }
+            }
+            return max_;
+        }
+
+        [[nodiscard]] double mean() const {
+            if (total_ == 0) {
+                return 0;
+            }
+            double sum = 0;
+            for (uint64_t i = 0; i < counts_.size(); ++i) {
+                if (counts_[i] != 0) {
+                    // The middle of the bucket, as the reference implementation does
+                    auto low = ValueAt(i);
+                    sum += static_cast<double>(counts_[i]) * (static_cast<double>(low) + static_cast<double>(HighestEquivalent(low) - low) / 2);
+                }
+            }
+            return sum / static_cast<double>(total_);
+        }
+
+        [[nodiscard]] uint64_t count() const {
+            return total_;
+        }
+
+        [[nodiscard]] int64_t min_value() const {
+            return total_ == 0 ? 0 : min_;
+        }
+
+        [[nodiscard]] int64_t max_value() const {
+            return max_;
+        }
+
+        [[nodiscard]] int64_t trackable() const {
+            return highest_;
+        }
+    };
+}
\ No newline at end of file
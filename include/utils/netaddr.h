@@ -2,8 +2,10 @@
 
 #include <cstdint>
 #include <string>
+#include <string_view>
 #include "../mem/memory.h"
 #include "../base/def.h"
+#include "./resolver.h"
 
 #ifdef PLATFORM_WIN32
 #include "../platform/win32/win32_net.h"
@@ -33,26 +35,26 @@ namespace Nexus::Utils {
                 type_ = SockType::SOCK_IPV6;
                 memcpy(inaddr_, &v6adr, sizeof(in6_addr));
             } else {
-                //may be domain or unexpected input, try to query IPv4 address first
-                type_ = SockType::SOCK_IPV4;
-                auto v4 = DNSLookUpV4(addr);
-                if (v4.is_valid()) {
-                    memcpy(inaddr_, reinterpret_cast<char*>(&v4.reference()), sizeof(v4.reference()));
+                // A host name. This waits for the Resolver, code on the event loop should resolve() it and construct
+                // from the answer instead
+                auto r = Resolver::Global().lookup(addr);
+                if (r->failed()) {
+                    type_ = SockType::INVALID;
                 } else {
-                    //try IPV6 then
-                    type_ = SockType::SOCK_IPV6;
-                    auto v6 = DNSLookUpV6(addr);
-                    if (v6.is_valid()) {
-                        memcpy(inaddr_, reinterpret_cast<char*>(&v6.reference()), sizeof(v6.reference()));
-                    } else {
-                        //invalid_ address
-                        type_ = SockType::INVALID;
-                        BREAKPOINT;
-                    }
+                    type_ = r->addresses()[0].type;
+                    memcpy(inaddr_, r->addresses()[0].bytes, sizeof(in6_addr));
                 }
             }
         }
 
+        NetAddr(const ip_addr_t& ip, uint16_t port) : port_(htons(port)), type_(ip.type) {
+            char str[INET6_ADDRSTRLEN] {};
+            memcpy(inaddr_, ip.bytes, sizeof(in6_addr));
+            if (type_ != SockType::INVALID && inet_ntop(type_ == SockType::SOCK_IPV4 ? AF_INET : AF_INET6, inaddr_, str, sizeof(str)) != nullptr) {
+                raw_addr_ = str;
+            }
+        }
+
         explicit NetAddr(sockaddr* addr) {
             char ip[INET6_ADDRSTRLEN];
             if (addr->sa_family == AF_INET) {
@@ -66,6 +68,7 @@ namespace Nexus::Utils {
                     port_ = sin->sin_port;
                     type_ = SockType::SOCK_IPV4;
                 }
+                memcpy(inaddr_, &sin->sin_addr, sizeof(in_addr));
 
             } else if (addr->sa_family == AF_INET6) {
                 auto* sin = reinterpret_cast<sockaddr_in6*>(addr);
@@ -78,6 +81,7 @@ namespace Nexus::Utils {
                     port_ = sin->sin6_port;
                     type_ = SockType::SOCK_IPV6;
                 }
+                memcpy(inaddr_, &sin->sin6_addr, sizeof(in6_addr));
 
             } else {
                 raw_addr_ = "invalid address";
@@ -140,6 +144,18 @@ namespace Nexus::Utils {
             return port_;
         }
 
+        /* The address or host name it was made from. */
+        const std::string& host() const {
+            return raw_addr_;
+        }
+
+        /* The address in network byte order, 4 bytes for IPv4, 16 for IPv6 and none otherwise. */
+        std::string_view bytes() const {
+            if (type_ == SockType::SOCK_IPV4) return {inaddr_, sizeof(in_addr)};
+            if (type_ == SockType::SOCK_IPV6) return {inaddr_, sizeof(in6_addr)};
+            return {};
+        }
+
         std::string url() {
             return std::format("{}:{}", raw_addr_, ntohs(port_));
         }
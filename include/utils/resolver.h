@@ -0,0 +1,302 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "../base/def.h"
+#include "../metrics/metrics.h"
+
+#ifdef PLATFORM_WIN32
+#include "../platform/win32/win32_net.h"
+#endif
+
+namespace Nexus::Utils {
+    // One address of a resolved name, in network byte order
+    struct ip_addr_t {
+        SockType type {SockType::INVALID};
+        char bytes[16] {};
+
+        /* The address of a literal like 10.0.0.1 or ::1, invalid when str is not one. */
+        static ip_addr_t Parse(const std::string& str) {
+            ip_addr_t ip;
+            if (inet_pton(AF_INET, str.c_str(), ip.bytes) == 1) {
+                ip.type = SockType::SOCK_IPV4;
+            } else if (inet_pton(AF_INET6, str.c_str(), ip.bytes) == 1) {
+                ip.type = SockType::SOCK_IPV6;
+            }
+            return ip;
+        }
+    };
+
+    /* The answer to one query. The resolver fills it in and sets done, readers poll done() and read nothing before it. */
+    class Resolution {
+        friend class Resolver;
+    private:
+        std::string name_;
+        std::vector<ip_addr_t> addrs_;
+        std::atomic<bool> done_ {false};
+    public:
+        explicit Resolution(std::string name) : name_(std::move(name)) {}
+
+        bool done() const {
+            return done_.load(std::memory_order_acquire);
+        }
+
+        bool failed() const {
+            return done() && addrs_.empty();
+        }
+
+        const std::string& name() const {
+            return name_;
+        }
+
+        /* IPv4 addresses first, then IPv6 ones. */
+        const std::vector<ip_addr_t>& addresses() const {
+            return addrs_;
+        }
+    };
+
+    /*
+     * Resolver turns host names into addresses off the event loop. Queries go to a few resolver threads, which make the
+     * blocking system call, and the caller gets a Resolution to poll from its loop the way awaitables are polled. Answers
+     * are cached for their TTL, clamped to [min_ttl, max_ttl], and names that do not resolve are remembered for
+     * negative_ttl, so a dead name does not cost a query per connection. Queries for a name already being resolved share
+     * its Resolution. Entries added with add_host() or load_hosts() answer before any query and never expire, tests use
+     * them, or set_backend(), to resolve without a DNS server.
+     * */
+    class Resolver {
+    public:
+        // Whatever answers queries on the resolver threads: fills addrs and ttl in seconds, false when the name has none
+        using backend_t = std::function<bool(const std::string& name, std::vector<ip_addr_t>& addrs, uint32_t& ttl)>;
+        static constexpr uint64_t threads = 2;
+        static constexpr uint64_t max_entries = 4096;
+    private:
+        struct entry_t {
+            std::shared_ptr<Resolution> resolution;
+            // Milliseconds, 0 for host entries which never expire
+            uint64_t expires;
+        };
+
+        std::mutex mtx_;
+        std::condition_variable cv_;
+        std::unordered_map<std::string, entry_t> cache_;
+        std::unordered_map<std::string, std::shared_ptr<Resolution>> inflight_;
+        std::deque<std::shared_ptr<Resolution>> queue_;
+        std::vector<std::thread> workers_;
+        bool stop_ {false};
+        backend_t backend_;
+        uint64_t min_ttl_ {1000};
+        uint64_t max_ttl_ {300000};
+        uint64_t negative_ttl_ {5000};
+        inline static Nexus::Metrics::Counter cached_ {"nexus_dns_lookups_total", "Host name lookups, by how they were answered", {{"result", "cached"}}};
+        inline static Nexus::Metrics::Counter coalesced_ {"nexus_dns_lookups_total", "Host name lookups, by how they were answered", {{"result", "coalesced"}}};
+        inline static Nexus::Metrics::Counter queried_ {"nexus_dns_lookups_total", "Host name lookups, by how they were answered", {{"result", "queried"}}};
+        inline static Nexus::Metrics::Counter failures_ {"nexus_dns_failures_total", "Queries that found no address"};
+
+        static std::shared_ptr<Resolution> Done(const std::string& name, std::vector<ip_addr_t> addrs) {
+            auto r = std::make_shared<Resolution>(name);
+            r->addrs_ = std::move(addrs);
+            r->done_.store(true, std::memory_order_release);
+            return r;
+        }
+
+        /* The system resolver, which also reads the hosts file of the machine. */
+        static bool SystemLookUp(const std::string& name, std::vector<ip_addr_t>& addrs, uint32_t& ttl) {
+            uint32_t ttl4 = UINT32_MAX;
+            uint32_t ttl6 = UINT32_MAX;
+            if (auto v4 = DNSLookUpV4(name, &ttl4); v4.is_valid()) {
+                ip_addr_t ip {SockType::SOCK_IPV4};
+                memcpy(ip.bytes, &v4.reference(), sizeof(in_addr));
+                addrs.push_back(ip);
+            }
+            if (auto v6 = DNSLookUpV6(name, &ttl6); v6.is_valid()) {
+                ip_addr_t ip {SockType::SOCK_IPV6};
+                memcpy(ip.bytes, &v6.reference(), sizeof(in6_addr));
+                addrs.push_back(ip);
+            }
+            ttl = std::min<uint32_t>(ttl4, ttl6);
+            return !addrs.empty();
+        }
+
+        void work() {
+            std::unique_lock lock(mtx_);
+            while (true) {
+                cv_.wait(lock, [this] { return stop_ || !queue_.empty(); });
+                if (stop_) {
+                    return;
+                }
+                auto r = std::move(queue_.front());
+                queue_.pop_front();
+                auto backend = backend_;
+                lock.unlock();
+                std::vector<ip_addr_t> addrs;
+                uint32_t ttl = 0;
+                if (!backend(r->name_, addrs, ttl)) {
+                    addrs.clear();
+                }
+                lock.lock();
+                r->addrs_ = std::move(addrs);
+                r->done_.store(true, std::memory_order_release);
+                uint64_t lifetime = negative_ttl_;
+                if (r->addrs_.empty()) {
+                    failures_.inc();
+                } else {
+                    lifetime = std::clamp<uint64_t>(uint64_t {ttl} * 1000, min_ttl_, max_ttl_);
+                }
+                inflight_.erase(r->name_);
+                // A host entry added while the query ran wins
+                if (auto it = cache_.find(r->name_); it == cache_.end() || it->second.expires != 0) {
+                    if (cache_.size() >= max_entries) {
+                        trim(Now());
+                    }
+                    cache_[r->name_] = {r, Now() + lifetime};
+                }
+                cv_.notify_all();
+            }
+        }
+
+        /* Drop expired entries, and any one entry when none had, with mtx_ held. */
+        void trim(uint64_t now) {
+            std::erase_if(cache_, [now](auto& kv) { return kv.second.expires != 0 && kv.second.expires <= now; });
+            if (cache_.size() >= max_entries) {
+                for (auto it = cache_.begin(); it != cache_.end(); ++it) {
+                    if (it->second.expires != 0) {
+                        cache_.erase(it);
+                        break;
+                    }
+                }
+            }
+        }
+    public:
+        Resolver() : backend_(SystemLookUp) {}
+        Resolver(const Resolver&) = delete;
+
+        ~Resolver() {
+            {
+                std::lock_guard lock(mtx_);
+                stop_ = true;
+            }
+            cv_.notify_all();
+            for (auto& w : workers_) {
+                w.join();
+            }
+        }
+
+        static Resolver& Global() {
+            static Resolver resolver;
+            return resolver;
+        }
+
+        static uint64_t Now() {
+            return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+        }
+
+        /* Answer queries with backend instead of the system resolver. */
+        void set_backend(backend_t backend) {
+            std::lock_guard lock(mtx_);
+            backend_ = std::move(backend);
+        }
+
+        /* Cache answers for at least min_ttl and at most max_ttl, failures for negative_ttl, all in milliseconds. */
+        void configure(uint64_t min_ttl, uint64_t max_ttl, uint64_t negative_ttl) {
+            std::lock_guard lock(mtx_);
+            min_ttl_ = min_ttl;
+            max_ttl_ = std::max<uint64_t>(max_ttl, min_ttl);
+            negative_ttl_ = negative_ttl;
+        }
+
+        /* Resolve name to addrs without asking anyone, until clear(). */
+        void add_host(const std::string& name, std::vector<ip_addr_t> addrs) {
+            std::lock_guard lock(mtx_);
+            cache_[name] = {Done(name, std::move(addrs)), 0};
+        }
+
+        /* Add the entries of a hosts file, "address name [aliases...]" a line with # comments. False when it cannot be read. */
+        bool load_hosts(const std::string& path) {
+            std::ifstream in(path);
+            if (!in) {
+                return false;
+            }
+            std::unordered_map<std::string, std::vector<ip_addr_t>> hosts;
+            std::string line;
+            while (std::getline(in, line)) {
+                line = line.substr(0, line.find('#'));
+                std::istringstream fields(line);
+                std::string address, name;
+                if (!(fields >> address)) {
+                    continue;
+                }
+                auto ip = ip_addr_t::Parse(address);
+                if (ip.type == SockType::INVALID) {
+                    continue;
+                }
+                while (fields >> name) {
+                    hosts[name].push_back(ip);
+                }
+            }
+            for (auto& [name, addrs] : hosts) {
+                std::stable_partition(addrs.begin(), addrs.end(), [](const ip_addr_t& ip) { return ip.type == SockType::SOCK_IPV4; });
+                add_host(name, std::move(addrs));
+            }
+            return true;
+        }
+
+        /* Forget every cached answer and host entry. */
+        void clear() {
+            std::lock_guard lock(mtx_);
+            cache_.clear();
+        }
+
+        /* Start resolving name, or find it resolved. Never blocks, the Resolution is done at once for literal addresses and
+         * cached names. */
+        std::shared_ptr<Resolution> resolve(const std::string& name, uint64_t now = Now()) {
+            if (auto ip = ip_addr_t::Parse(name); ip.type != SockType::INVALID) {
+                return Done(name, {ip});
+            }
+            std::lock_guard lock(mtx_);
+            if (auto it = cache_.find(name); it != cache_.end()) {
+                if (it->second.expires == 0 || it->second.expires > now) {
+                    cached_.inc();
+                    return it->second.resolution;
+                }
+                cache_.erase(it);
+            }
+            if (auto it = inflight_.find(name); it != inflight_.end()) {
+                coalesced_.inc();
+                return it->second;
+            }
+            queried_.inc();
+            auto r = std::make_shared<Resolution>(name);
+            inflight_.emplace(name, r);
+            queue_.push_back(r);
+            if (workers_.empty()) {
+                for (uint64_t i = 0; i < threads; ++i) {
+                    workers_.emplace_back([this] { work(); });
+                }
+            }
+            cv_.notify_all();
+            return r;
+        }
+
+        /* Resolve name and wait for the answer. Only for code off the event loop, like reading configuration at start. */
+        std::shared_ptr<Resolution> lookup(const std::string& name) {
+            auto r = resolve(name);
+            std::unique_lock lock(mtx_);
+            cv_.wait(lock, [&] { return r->done() || stop_; });
+            return r;
+        }
+    };
+}
\ No newline at end of file
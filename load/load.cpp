@@ -0,0 +1,217 @@
+#include "load_client.h"
+#include "include/log/logger.h"
+#include "include/net/http_server.h"
+#include "include/net/https_server.h"
+#include "include/parallel/worker.h"
+
+#include <atomic>
+#include <iostream>
+#include <thread>
+
+using namespace Nexus::Load;
+using namespace Nexus::Utils;
+
+// What the in-process server answers on the load path
+class load_handler {
+public:
+    static http_response doGet(const get_request& gr) {
+        static constexpr char body[] = "nexus-load\n";
+        Nexus::Base::UniquePool<http_body_allocator_t> resp(sizeof(body));
+        resp.write(body, sizeof(body) - 1);
+        return {"200 OK", {
+                {"Content-Type", "text/plain"}
+        }, Nexus::Base::unique_to_readonly<http_body_allocator_t>(std::move(resp))};
+    }
+    static http_response doPost(const post_request& pr) {
+        return {"405 Method Not Allowed", {}, http_response_body_t(nullptr, 0)};
+    }
+};
+
+/* Split http[s]://host[:port][/path] into options, false when it is not such a URL. */
+static bool ParseUrl(const std::string& url, load_options_t& options) {
+    std::string rest;
+    if (url.starts_with("https://")) {
+        options.tls = true;
+        rest = url.substr(8);
+    } else if (url.starts_with("http://")) {
+        options.tls = false;
+        rest = url.substr(7);
+    } else {
+        return false;
+    }
+    auto slash = rest.find('/');
+    options.path = slash == std::string::npos ? "/" : rest.substr(slash);
+    auto authority = rest.substr(0, slash);
+    auto colon = authority.rfind(':');
+    if (colon != std::string::npos && authority.find(']', colon) == std::string::npos) {
+        options.port = static_cast<uint16_t>(std::stoi(authority.substr(colon + 1)));
+        authority.resize(colon);
+    } else {
+        options.port = options.tls ? 443 : 80;
+    }
+    if (authority.size() > 2 && authority.front() == '[' && authority.back() == ']') {
+        authority = authority.substr(1, authority.size() - 2);
+    }
+    options.host = authority;
+    return !authority.empty();
+}
+
+static void PrintHistogram(const char* title, const HdrHistogram& h) {
+    std::cout << std::format("{}\n  {:>8} {:>12.3f} ms\n", title, "mean", h.mean() / 1e6);
+    for (double p : {50.0, 75.0, 90.0, 99.0, 99.9, 99.99}) {
+        std::cout << std::format("  {:>8} {:>12.3f} ms\n", std::format("p{}", p), static_cast<double>(h.percentile(p)) / 1e6);
+    }
+    std::cout << std::format("  {:>8} {:>12.3f} ms\n", "max", static_cast<double>(h.max_value()) / 1e6);
+}
+
+static void Usage() {
+    std::cout << "nexus-load [--url http[s]://host:port/path] [--connections N] [--threads N] [--duration SECONDS]\n"
+                 "           [--rate REQUESTS_PER_SECOND] [--keepalive on|off] [--local]\n"
+                 "Without --rate every connection sends its next request as soon as the previous one completes.\n"
+                 "--local serves the url from an in-process HttpServer or HttpsServer, HTTPS reads server.crt and server.key.\n";
+}
+
+int main(int argc, char** argv) {
+    load_options_t options;
+    bool local = false;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--local") {
+            local = true;
+        } else if (arg == "--url" && has_value) {
+            if (!ParseUrl(argv[++i], options)) {
+                Usage();
+                return 1;
+            }
+        } else if (arg == "--connections" && has_value) {
+            options.connections = std::stoull(argv[++i]);
+        } else if (arg == "--threads" && has_value) {
+            options.threads = std::stoull(argv[++i]);
+        } else if (arg == "--duration" && has_value) {
+            options.duration_ms = static_cast<uint64_t>(std::stod(argv[++i]) * 1000);
+        } else if (arg == "--rate" && has_value) {
+            options.rate = std::stod(argv[++i]);
+        } else if (arg == "--keepalive" && has_value) {
+            options.keepalive = std::string(argv[++i]) != "off";
+        } else {
+            Usage();
+            return 1;
+        }
+    }
+    options.threads = std::clamp<uint64_t>(options.threads, 1, std::max<uint64_t>(options.connections, 1));
+    // One poll set per thread holds at most EVMAX sockets
+    if (options.connections == 0 || options.connections > options.threads * EVMAX) {
+        std::cout << std::format("Connections must be between 1 and {} with {} threads\n", options.threads * EVMAX, options.threads);
+        return 1;
+    }
+
+    WSADATA wsaData;
+    int err = WSAStartup(MAKEWORD(2, 2), &wsaData);
+    if (err != 0) {
+        std::cout << std::format("WSAStartup Failed. Error Code: {}\n", err);
+        return 1;
+    }
+    NetAddr addr(options.host, options.port);
+    if (addr.type() == SockType::INVALID) {
+        std::cout << std::format("Cannot resolve {}\n", options.host);
+        return 1;
+    }
+
+    SSL_CTX* ssl_ctx = nullptr;
+    if (options.tls) {
+        ssl_ctx = SSL_CTX_new(TLS_client_method());
+        // The loopback certificate is usually self-signed, and verifying it is not what is being measured
+        SSL_CTX_set_verify(ssl_ctx, SSL_VERIFY_NONE, nullptr);
+        SSL_CTX_set_mode(ssl_ctx, SSL_MODE_ENABLE_PARTIAL_WRITE | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+        // Offer HTTP/1.1 only, the server would pick h2 otherwise
+        static constexpr unsigned char alpn[] = "\x08http/1.1";
+        SSL_CTX_set_alpn_protos(ssl_ctx, alpn, sizeof(alpn) - 1);
+    }
+
+    // The in-process server shares the machine with the load, its log is kept to warnings
+    std::atomic<bool> stop {false};
+    std::thread server;
+    std::unique_ptr<Nexus::Parallel::WorkGroup<CPU_CORES - 1>> group;
+    if (local) {
+        Nexus::Log::log_threshold = Nexus::Log::log_level::WARNING;
+        group = std::make_unique<Nexus::Parallel::WorkGroup<CPU_CORES - 1>>();
+        if (options.tls) {
+            auto https = std::make_shared<HttpsServer<Nexus::IO::Win32PollMUX, CPU_CORES - 1>>(addr, *group);
+            https->add_handler<load_handler>(options.path);
+            server = std::thread([https, &stop]() {
+                while (!stop.load(std::memory_order_relaxed)) {
+                    https->loop();
+                }
+                https->close();
+            });
+        } else {
+            auto http = std::make_shared<HttpServer<Nexus::IO::Win32PollMUX, CPU_CORES - 1>>(addr, *group);
+            http->add_handler<load_handler>(options.path);
+            server = std::thread([http, &stop]() {
+                while (!stop.load(std::memory_order_relaxed)) {
+                    http->loop();
+                }
+                http->close();
+            });
+        }
+    }
+
+    std::cout << std::format("{} {}://{}:{}{} with {} connections on {} threads for {:.1f}s, keep-alive {}\n",
+                             options.rate > 0 ? std::format("Open loop at {:.0f} req/s,", options.rate) : std::string("Closed loop,"),
+                             options.tls ? "https" : "http", options.host, options.port, options.path, options.connections,
+                             options.threads, static_cast<double>(options.duration_ms) / 1000, options.keepalive ? "on" : "off");
+    std::vector<std::unique_ptr<LoadWorker>> workers;
+    for (uint64_t i = 0; i < options.threads; ++i) {
+        // Connections and rate are shared out evenly, the first threads take the remainder
+        uint64_t connections = options.connections / options.threads + (i < options.connections % options.threads ? 1 : 0);
+        double rate = options.rate * static_cast<double>(connections) / static_cast<double>(options.connections);
+        workers.push_back(std::make_unique<LoadWorker>(options, addr, ssl_ctx, connections, rate));
+    }
+    std::vector<load_result_t> results(options.threads);
+    std::vector<std::thread> threads;
+    auto begin = Now();
+    auto end = begin + static_cast<int64_t>(options.duration_ms) * 1'000'000;
+    for (uint64_t i = 0; i < options.threads; ++i) {
+        threads.emplace_back([&, i]() {
+            results[i] = workers[i]->run(begin, end);
+        });
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+    auto elapsed = static_cast<double>(Now() - begin) / 1e9;
+    load_result_t total;
+    for (auto& r : results) {
+        total.merge(r);
+    }
+
+    std::cout << std::format("{} requests in {:.2f}s, {:.1f} req/s, {:.2f} MB read\n", total.completed, elapsed,
+                             static_cast<double>(total.completed) / elapsed, static_cast<double>(total.bytes) / 1e6);
+    std::cout << std::format("{} errors, {} reconnects, {} unfinished\n", total.errors, total.reconnects, total.unfinished);
+    for (auto& [status, count] : total.statuses) {
+        std::cout << std::format("  status {}: {}\n", status, count);
+    }
+    if (total.completed != 0) {
+        PrintHistogram("Service time, request written to response read (uncorrected)", total.service);
+        if (options.rate > 0) {
+            PrintHistogram("Latency from the scheduled send time (corrected for coordinated omission)", total.latency);
+        } else {
+            // A closed-loop connection sends once per service time, that mean is the interval stalls hide samples from
+            auto interval = static_cast<int64_t>(total.service.mean());
+            PrintHistogram(std::format("Latency corrected for coordinated omission, expected interval {:.3f} ms",
+                                       static_cast<double>(interval) / 1e6).c_str(), total.service.corrected(interval));
+        }
+    }
+
+    if (local) {
+        stop = true;
+        server.join();
+        group->cleanup();
+    }
+    if (ssl_ctx != nullptr) {
+        SSL_CTX_free(ssl_ctx);
+    }
+    WSACleanup();
+    return total.completed != 0 ? 0 : 1;
+}
\ No newline at end of file
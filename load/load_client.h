@@ -0,0 +1,520 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <format>
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "include/net/socket.h"
+#include "include/io/mux.h"
+#include "include/utils/netaddr.h"
+#include "include/utils/hdr_histogram.h"
+#include "thirdparty/picohttpparser/picohttpparser.h"
+
+#include <openssl/ssl.h>
+#include <openssl/err.h>
+
+#ifdef PLATFORM_WIN32
+#include "include/platform/win32/win32_io.h"
+#endif
+
+namespace Nexus::Load {
+    using namespace Nexus::Net;
+    using load_mux_t = Nexus::IO::Win32PollMUX;
+
+    struct load_options_t {
+        std::string host {"127.0.0.1"};
+        uint16_t port {8080};
+        std::string path {"/load"};
+        bool tls {false};
+        bool keepalive {true};
+        uint64_t connections {16};
+        uint64_t threads {1};
+        uint64_t duration_ms {10000};
+        // Requests per second over all connections, zero runs closed loop
+        double rate {0};
+    };
+
+    // Latencies are recorded in nanoseconds, anything slower than a minute is clamped
+    inline constexpr int64_t latency_trackable = 60'000'000'000;
+
+    struct load_result_t {
+        // From the moment a request was written to its last response byte
+        Nexus::Utils::HdrHistogram service {latency_trackable};
+        // From the moment a request was due, only filled in open loop where the schedule is known up front
+        Nexus::Utils::HdrHistogram latency {latency_trackable};
+        std::map<int, uint64_t> statuses;
+        uint64_t completed {0};
+        uint64_t errors {0};
+        uint64_t reconnects {0};
+        uint64_t bytes {0};
+        // Requests that were due before the run ended but did not complete
+        uint64_t unfinished {0};
+
+        void merge(const load_result_t& other) {
+            service.merge(other.service);
+            latency.merge(other.latency);
+            for (auto& [status, count] : other.statuses) {
+                statuses[status] += count;
+            }
+            completed += other.completed;
+            errors += other.errors;
+            reconnects += other.reconnects;
+            bytes += other.bytes;
+            unfinished += other.unfinished;
+        }
+    };
+
+    inline int64_t Now() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    /*
+     * LoadConnection is one client connection of the load generator. It writes a prepared request, reads the response
+     * framed by Content-Length, chunked coding or the end of the connection, and reopens itself on the next request when
+     * the server or keep-alive being off closed it.
+     * */
+    class LoadConnection {
+    public:
+        enum status_t {
+            CLOSED,
+            HANDSHAKING,
+            WRITING,
+            READING,
+            IDLE
+        };
+        enum outcome_t {
+            PENDING,
+            DONE,
+            FAILED
+        };
+        // When the current request was due and when it was written
+        int64_t due {0};
+        int64_t started {0};
+    private:
+        // Results of a single read or write besides the byte count
+        static constexpr int64_t io_again = 0;
+        static constexpr int64_t io_closed = -1;
+        static constexpr int64_t io_failed = -2;
+        Nexus::IO::IOMultiplexer<load_mux_t>& mux_;
+        Nexus::Utils::NetAddr addr_;
+        const std::string& request_;
+        SSL_CTX* ssl_ctx_;
+        Socket sock_ {SockType::INVALID};
+        SSL* ssl_ {nullptr};
+        status_t status_ {CLOSED};
+        Nexus::IO::io_evtyp_t interest_ {0};
+        uint64_t written_ {0};
+        uint64_t connects_ {0};
+        uint64_t bytes_ {0};
+        // The response head until it parses, then nothing
+        std::string head_;
+        bool head_done_ {false};
+        int status_code_ {0};
+        bool chunked_ {false};
+        bool close_after_ {false};
+        bool malformed_ {false};
+        // The request went out on a connection kept from an earlier one
+        bool reused_ {false};
+        // Body bytes still expected, negative when the body runs until the connection closes
+        int64_t body_left_ {-1};
+        phr_chunked_decoder decoder_ {};
+
+        void want(Nexus::IO::io_evtyp_t ev) {
+            if (ev != interest_) {
+                if (interest_ != 0) {
+                    mux_.remove(sock_.fd());
+                }
+                mux_.add(sock_.fd(), ev);
+                interest_ = ev;
+            }
+        }
+
+        bool open() {
+            sock_ = Socket(addr_.type());
+            if (sock_.invalid() || !sock_.connect(addr_)) {
+                sock_.close();
+                return false;
+            }
+            ++connects_;
+            sock_.setnonblocking();
+            int one = 1;
+            setsockopt(sock_.fd(), IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&one), sizeof(one));
+            if (ssl_ctx_ != nullptr) {
+                ssl_ = SSL_new(ssl_ctx_);
+                SSL_set_fd(ssl_, static_cast<int>(sock_.fd()));
+                SSL_set_connect_state(ssl_);
+                status_ = HANDSHAKING;
+            } else {
+                status_ = WRITING;
+            }
+            want(load_mux_t::EVREAD | load_mux_t::EVWRITE);
+            return true;
+        }
+
+        /* A kept connection the server closed before our request reached it fails without a byte of response. That
+         * is the usual keep-alive race rather than an error, so the request is sent again on a new connection. */
+        bool retry() {
+            if (!reused_ || !head_.empty()) {
+                return false;
+            }
+            close();
+            reused_ = false;
+            written_ = 0;
+            return open();
+        }
+
+        /* Map the result of SSL_read or SSL_write onto io_again, io_closed or io_failed. */
+        int64_t tls_result(int r) {
+            switch (SSL_get_error(ssl_, r)) {
+                case SSL_ERROR_WANT_READ:
+                    want(load_mux_t::EVREAD);
+                    return io_again;
+                case SSL_ERROR_WANT_WRITE:
+                    want(load_mux_t::EVREAD | load_mux_t::EVWRITE);
+                    return io_again;
+                case SSL_ERROR_ZERO_RETURN:
+                    return io_closed;
+                case SSL_ERROR_SYSCALL:
+                    // Peers that close without close_notify
+                    return r == 0 ? io_closed : io_failed;
+                default:
+                    return io_failed;
+            }
+        }
+
+        int64_t read(char* buf, uint64_t len) {
+            if (ssl_ != nullptr) {
+                int r = SSL_read(ssl_, buf, static_cast<int>(len));
+                return r > 0 ? r : tls_result(r);
+            }
+            int r = ::recv(sock_.fd(), buf, static_cast<int>(len), 0);
+            if (r > 0) {
+                return r;
+            }
+            if (r == 0) {
+                return io_closed;
+            }
+            return GetLastNetworkError() == WSAEWOULDBLOCK ? io_again : io_failed;
+        }
+
+        int64_t write(const char* buf, uint64_t len) {
+            if (ssl_ != nullptr) {
+                int r = SSL_write(ssl_, buf, static_cast<int>(len));
+                return r > 0 ? r : tls_result(r);
+            }
+            int r = ::send(sock_.fd(), buf, static_cast<int>(len), 0);
+            if (r >= 0) {
+                return r;
+            }
+            return GetLastNetworkError() == WSAEWOULDBLOCK ? io_again : io_failed;
+        }
+
+        /* Account body bytes, true once the response is complete. */
+        bool body(char* data, uint64_t len) {
+            if (chunked_) {
+                size_t size = len;
+                auto r = phr_decode_chunked(&decoder_, data, &size);
+                if (r == -1) {
+                    malformed_ = true;
+                    return false;
+                }
+                return r >= 0;
+            }
+            if (body_left_ >= 0) {
+                body_left_ -= static_cast<int64_t>(len);
+                return body_left_ <= 0;
+            }
+            return false;
+        }
+
+        /* Parse the head once it is all there, then hand what follows it to body(). */
+        bool consume(char* data, uint64_t len) {
+            if (head_done_) {
+                return body(data, len);
+            }
+            head_.append(data, len);
+            phr_header headers[64];
+            size_t num_headers = 64;
+            int minor = 0;
+            const char* msg = nullptr;
+            size_t msg_len = 0;
+            int r = phr_parse_response(head_.data(), head_.size(), &minor, &status_code_, &msg, &msg_len, headers, &num_headers, 0);
+            if (r == -2) {
+                return false;
+            }
+            if (r == -1) {
+                malformed_ = true;
+                return false;
+            }
+            head_done_ = true;
+            close_after_ = minor == 0;
+            for (size_t i = 0; i < num_headers; ++i) {
+                std::string name(headers[i].name, headers[i].name_len);
+                std::string value(headers[i].value, headers[i].value_len);
+                for (auto& c : name) c = static_cast<char>(tolower(c));
+                for (auto& c : value) c = static_cast<char>(tolower(c));
+                if (name == "content-length") {
+                    body_left_ = std::strtoll(value.c_str(), nullptr, 10);
+                } else if (name == "transfer-encoding" && value.find("chunked") != std::string::npos) {
+                    chunked_ = true;
+                } else if (name == "connection") {
+                    close_after_ = value.find("close") != std::string::npos || (minor == 0 && value.find("keep-alive") == std::string::npos);
+                }
+            }
+            if (status_code_ < 200 || status_code_ == 204 || status_code_ == 304) {
+                body_left_ = 0;
+                chunked_ = false;
+            }
+            return body(head_.data() + r, head_.size() - r);
+        }
+    public:
+        LoadConnection(Nexus::IO::IOMultiplexer<load_mux_t>& mux, Nexus::Utils::NetAddr addr, const std::string& request, SSL_CTX* ssl_ctx) :
+            mux_(mux), addr_(std::move(addr)), request_(request), ssl_ctx_(ssl_ctx) {}
+
+        ~LoadConnection() {
+            close();
+        }
+
+        /* Begin a request, reopening the connection when it is closed. False when the server cannot be reached. */
+        bool start(int64_t due_at) {
+            due = due_at;
+            started = Now();
+            written_ = 0;
+            head_.clear();
+            head_done_ = chunked_ = close_after_ = malformed_ = false;
+            status_code_ = 0;
+            body_left_ = -1;
+            decoder_ = {};
+            decoder_.consume_trailer = 1;
+            reused_ = status_ != CLOSED;
+            if (status_ == CLOSED) {
+                return open();
+            }
+            status_ = WRITING;
+            want(load_mux_t::EVREAD | load_mux_t::EVWRITE);
+            return true;
+        }
+
+        /* Make whatever progress the socket allows. */
+        outcome_t drive() {
+            while (true) {
+                switch (status_) {
+                    case HANDSHAKING: {
+                        int r = SSL_connect(ssl_);
+                        if (r == 1) {
+                            status_ = WRITING;
+                            continue;
+                        }
+                        return tls_result(r) == io_again ? PENDING : FAILED;
+                    }
+                    case WRITING: {
+                        auto n = write(request_.data() + written_, request_.size() - written_);
+                        if (n < 0) {
+                            if (retry()) {
+                                continue;
+                            }
+                            return FAILED;
+                        }
+                        if (n == io_again) {
+                            return PENDING;
+                        }
+                        written_ += n;
+                        if (written_ == request_.size()) {
+                            status_ = READING;
+                            want(load_mux_t::EVREAD);
+                        }
+                        continue;
+                    }
+                    case READING: {
+                        char buf[16384];
+                        auto n = read(buf, sizeof(buf));
+                        if (n == io_again) {
+                            return PENDING;
+                        }
+                        if (n == io_closed && head_done_ && !chunked_ && body_left_ < 0) {
+                            // The body ran until the end of the connection
+                            close();
+                            return DONE;
+                        }
+                        if (n < 0) {
+                            if (retry()) {
+                                continue;
+                            }
+                            return FAILED;
+                        }
+                        bytes_ += n;
+                        if (consume(buf, n)) {
+                            if (close_after_) {
+                                close();
+                            } else {
+                                status_ = IDLE;
+                            }
+                            return DONE;
+                        }
+                        if (malformed_) {
+                            return FAILED;
+                        }
+                        continue;
+                    }
+                    case IDLE: {
+                        // Nothing is expected on an idle keep-alive connection, readiness means the server closed it
+                        char buf[512];
+                        if (read(buf, sizeof(buf)) != io_again) {
+                            close();
+                        }
+                        return PENDING;
+                    }
+                    case CLOSED:
+                        return PENDING;
+                }
+            }
+        }
+
+        void close() {
+            if (status_ == CLOSED) {
+                return;
+            }
+            if (interest_ != 0) {
+                mux_.remove(sock_.fd());
+                interest_ = 0;
+            }
+            if (ssl_ != nullptr) {
+                SSL_free(ssl_);
+                ssl_ = nullptr;
+            }
+            sock_.close();
+            status_ = CLOSED;
+        }
+
+        /* A request is outstanding. */
+        bool busy() {
+            return status_ == HANDSHAKING || status_ == WRITING || status_ == READING;
+        }
+
+        io_handle_t fd() {
+            return sock_.fd();
+        }
+
+        int status_code() {
+            return status_code_;
+        }
+
+        uint64_t connects() {
+            return connects_;
+        }
+
+        uint64_t bytes() {
+            return bytes_;
+        }
+    };
+
+    /*
+     * LoadWorker drives a share of the connections from one thread. In open loop every connection follows a fixed
+     * schedule and latency is measured from when a request was due, so a stalled server is charged for the requests it
+     * kept waiting as well, which is how wrk2 avoids coordinated omission. In closed loop a connection sends the next
+     * request as soon as the previous one completes and the correction is applied to the histogram afterwards.
+     * */
+    class LoadWorker {
+    private:
+        Nexus::IO::IOMultiplexer<load_mux_t> mux_;
+        std::string request_;
+        std::vector<std::unique_ptr<LoadConnection>> connections_;
+        std::unordered_map<io_handle_t, LoadConnection*> handles_;
+        // Time between requests on one connection, zero in closed loop
+        int64_t interval_;
+        load_result_t result_;
+
+        /* Start conn at due, the next due time is pushed back when the server cannot be reached. */
+        void issue(LoadConnection* conn, int64_t due) {
+            if (!conn->start(due)) {
+                ++result_.errors;
+                conn->due = interval_ != 0 ? due + interval_ : Now() + 1'000'000;
+                return;
+            }
+            handles_[conn->fd()] = conn;
+            complete(conn, conn->drive());
+        }
+
+        void complete(LoadConnection* conn, LoadConnection::outcome_t outcome) {
+            if (outcome == LoadConnection::PENDING) {
+                return;
+            }
+            auto now = Now();
+            if (outcome == LoadConnection::DONE) {
+                ++result_.completed;
+                ++result_.statuses[conn->status_code()];
+                result_.service.record(now - conn->started);
+                if (interval_ != 0) {
+                    result_.latency.record(now - conn->due);
+                }
+            } else {
+                ++result_.errors;
+                conn->close();
+            }
+            conn->due = interval_ != 0 ? conn->due + interval_ : now;
+        }
+    public:
+        LoadWorker(const load_options_t& options, const Nexus::Utils::NetAddr& addr, SSL_CTX* ssl_ctx, uint64_t connections, double rate) :
+            interval_(rate > 0 ? static_cast<int64_t>(1e9 * static_cast<double>(connections) / rate) : 0) {
+            request_ = std::format("GET {} HTTP/1.1\r\nHost: {}\r\nUser-Agent: nexus-load\r\nConnection: {}\r\n\r\n",
+                                   options.path, options.host, options.keepalive ? "keep-alive" : "close");
+            for (uint64_t i = 0; i < connections; ++i) {
+                connections_.push_back(std::make_unique<LoadConnection>(mux_, addr, request_, ssl_ctx));
+            }
+        }
+
+        load_result_t run(int64_t begin, int64_t end) {
+            auto n = static_cast<int64_t>(connections_.size());
+            for (int64_t i = 0; i < n; ++i) {
+                // Spread the schedules so the connections do not fire together
+                connections_[i]->due = begin + (interval_ != 0 ? interval_ * i / n : 0);
+            }
+            while (true) {
+                auto now = Now();
+                if (now >= end) {
+                    break;
+                }
+                auto next = end;
+                for (auto& conn : connections_) {
+                    if (!conn->busy() && conn->due <= now) {
+                        issue(conn.get(), interval_ != 0 ? conn->due : now);
+                    }
+                    if (!conn->busy()) {
+                        next = std::min<int64_t>(next, conn->due);
+                    }
+                }
+                // Sleep in poll until the next request is due, at most 10ms so the end of the run is noticed
+                int wait = static_cast<int>(std::clamp<int64_t>((next - Now()) / 1'000'000, 0, 10));
+                auto evs = mux_.poll(wait);
+                if (!evs.is_valid()) {
+                    continue;
+                }
+                for (auto& ev : evs.reference()) {
+                    if (auto it = handles_.find(ev.handle); it != handles_.end()) {
+                        complete(it->second, it->second->drive());
+                    }
+                }
+            }
+            for (auto& conn : connections_) {
+                if (conn->busy()) {
+                    ++result_.unfinished;
+                }
+                if (interval_ != 0 && conn->due < end) {
+                    // Requests the schedule had due that never got their turn
+                    result_.unfinished += (end - conn->due + interval_ - 1) / interval_ - (conn->busy() ? 1 : 0);
+                }
+                result_.bytes += conn->bytes();
+                if (conn->connects() > 1) {
+                    result_.reconnects += conn->connects() - 1;
+                }
+                conn->close();
+            }
+            return std::move(result_);
+        }
+    };
+}
\ No newline at end of file
@@ -4,9 +4,11 @@
 #include "include/net/http_server.h"
 #include "include/net/basic_handlers.h"
 #include "include/net/https_server.h"
+#include "include/net/http3_server.h"
 #include "include/io/terminal.h"
 #include "include/platform/win32/win32_io.h"
 #include <thread>
+#include <fstream>
 #include <dbghelp.h>
 
 using namespace Nexus::Base;
@@ -55,22 +57,147 @@ int main() {
         LFATAL("WSAStartup Failed. Error Code: {}", err);
         return 0;
     }
+    // NEXUS_ARENAS puts connection buffers and cached files in node-local arenas, "numa" in normal pages and "hugepages"
+    // in large pages, which need the Lock pages in memory right. Unset leaves them on the heap.
+    if (const char* arenas = std::getenv("NEXUS_ARENAS"); arenas != nullptr) {
+        std::string_view mode(arenas);
+        if (mode == "hugepages") {
+            if (!Arena::Configure(Arena::HUGEPAGES)) {
+                LWARN("Large pages are not available, arenas use normal pages");
+            }
+        } else if (mode == "numa") {
+            Arena::Configure(Arena::NUMA);
+        } else {
+            LWARN("Ignoring NEXUS_ARENAS={}, expected numa or hugepages", mode);
+        }
+    }
+    if (!Nexus::IO::ResourceLocator::StartWatching()) {
+        LWARN("Cannot watch static resources, changed files will not be refreshed until restart");
+    }
+    // Where Prometheus scrapes the metrics, NEXUS_METRICS_PATH moves it
+    const char* metrics_env = std::getenv("NEXUS_METRICS_PATH");
+    std::string metrics_path = metrics_env != nullptr && metrics_env[0] == '/' ? metrics_env : "/metrics";
+    // One connection in NEXUS_TRACE_SAMPLE is traced, 0 turns tracing off
+    if (const char* sample = std::getenv("NEXUS_TRACE_SAMPLE"); sample != nullptr) {
+        Nexus::Metrics::Tracer::SetSampling(std::strtoull(sample, nullptr, 10));
+    }
+    // NEXUS_MAX_CONNECTIONS caps the connections all listeners hold together, 0 lifts the cap
+    if (const char* max = std::getenv("NEXUS_MAX_CONNECTIONS"); max != nullptr) {
+        Nexus::Net::Admission::SetGlobalLimit(std::strtoull(max, nullptr, 10));
+    }
+    // NEXUS_RATE_LIMIT requests a second per client address with bursts of NEXUS_RATE_BURST, unset leaves clients unlimited
+    if (const char* rate = std::getenv("NEXUS_RATE_LIMIT"); rate != nullptr) {
+        const char* burst = std::getenv("NEXUS_RATE_BURST");
+        Nexus::Net::RateLimiter::Global().configure(std::strtoull(rate, nullptr, 10), burst != nullptr ? std::strtoull(burst, nullptr, 10) : 0);
+    }
+    // NEXUS_HOSTS names a hosts file that answers for host names before DNS is asked
+    if (const char* hosts = std::getenv("NEXUS_HOSTS"); hosts != nullptr && !Resolver::Global().load_hosts(hosts)) {
+        LWARN("Cannot read hosts file {}", hosts);
+    }
+    // NEXUS_PROXY forwards routes to upstreams, "/api=10.0.0.2:8080,10.0.0.3:8080;/app=[::1]:3000". NEXUS_PROXY_BALANCE
+    // picks least_conn over round robin and NEXUS_PROXY_PIPELINE queues that many bodiless requests on one connection
+    std::vector<std::pair<std::string, std::shared_ptr<UpstreamGroup>>> proxies;
+    if (const char* proxy = std::getenv("NEXUS_PROXY"); proxy != nullptr) {
+        const char* balance_env = std::getenv("NEXUS_PROXY_BALANCE");
+        auto balance = balance_env != nullptr && std::string_view(balance_env) == "least_conn" ? balance_t::LEAST_CONNECTIONS : balance_t::ROUND_ROBIN;
+        const char* pipeline = std::getenv("NEXUS_PROXY_PIPELINE");
+        auto depth = pipeline != nullptr ? static_cast<uint32_t>(std::strtoul(pipeline, nullptr, 10)) : 1;
+        std::string_view routes(proxy);
+        while (!routes.empty()) {
+            auto route = routes.substr(0, routes.find(';'));
+            routes.remove_prefix(std::min<uint64_t>(route.size() + 1, routes.size()));
+            auto eq = route.find('=');
+            if (eq == std::string_view::npos || route[0] != '/') {
+                LWARN("Ignoring proxy route {}, expected path=host:port[,host:port...]", route);
+                continue;
+            }
+            std::vector<std::pair<std::string, uint16_t>> addrs;
+            auto targets = route.substr(eq + 1);
+            while (!targets.empty()) {
+                auto target = targets.substr(0, targets.find(','));
+                targets.remove_prefix(std::min<uint64_t>(target.size() + 1, targets.size()));
+                auto colon = target.rfind(':');
+                if (colon == std::string_view::npos) {
+                    LWARN("Ignoring upstream {} without a port", target);
+                    continue;
+                }
+                auto host = target.substr(0, colon);
+                if (host.size() > 1 && host.front() == '[' && host.back() == ']') {
+                    host = host.substr(1, host.size() - 2);
+                }
+                addrs.emplace_back(std::string(host), static_cast<uint16_t>(std::strtoul(std::string(target.substr(colon + 1)).c_str(), nullptr, 10)));
+            }
+            if (!addrs.empty()) {
+                proxies.emplace_back(std::string(route.substr(0, eq)), std::make_shared<UpstreamGroup>(addrs, balance, depth));
+            }
+        }
+    }
+    // Socket options of the TCP listeners: NEXUS_BACKLOG, NEXUS_TCP_NODELAY=1, NEXUS_SO_RCVBUF and NEXUS_SO_SNDBUF in bytes,
+    // and NEXUS_ACCEPT_BATCH clients accepted per poll
+    socket_profile_t profile {};
+    if (const char* backlog = std::getenv("NEXUS_BACKLOG"); backlog != nullptr) {
+        profile.backlog = static_cast<int>(std::strtol(backlog, nullptr, 10));
+    }
+    if (const char* nodelay = std::getenv("NEXUS_TCP_NODELAY"); nodelay != nullptr) {
+        profile.nodelay = std::string_view(nodelay) == "1";
+    }
+    if (const char* rcvbuf = std::getenv("NEXUS_SO_RCVBUF"); rcvbuf != nullptr) {
+        profile.recv_buffer = static_cast<uint32_t>(std::strtoul(rcvbuf, nullptr, 10));
+    }
+    if (const char* sndbuf = std::getenv("NEXUS_SO_SNDBUF"); sndbuf != nullptr) {
+        profile.send_buffer = static_cast<uint32_t>(std::strtoul(sndbuf, nullptr, 10));
+    }
+    if (const char* batch = std::getenv("NEXUS_ACCEPT_BATCH"); batch != nullptr) {
+        profile.accept_batch = std::max<uint32_t>(static_cast<uint32_t>(std::strtoul(batch, nullptr, 10)), 1);
+    }
     WorkGroup<CPU_CORES - 1> group;
-    HttpsServer<Nexus::IO::Win32PollMUX, CPU_CORES - 1> https(NetAddr("0.0.0.0", 443), group);
-    HttpServer <Nexus::IO::Win32PollMUX, CPU_CORES - 1> http(NetAddr("0.0.0.0", 80), group);
+    HttpsServer<Nexus::IO::Win32PollMUX, CPU_CORES - 1> https(NetAddr("0.0.0.0", 443), group, profile);
+    HttpServer <Nexus::IO::Win32PollMUX, CPU_CORES - 1> http(NetAddr("0.0.0.0", 80), group, profile);
+#if OPENSSL_VERSION_NUMBER >= 0x30500000L
+    // QUIC needs the server API of OpenSSL 3.5, older builds serve HTTP/1.1 and HTTP/2 only
+    Http3Server<Nexus::IO::Win32PollMUX, CPU_CORES - 1> http3(NetAddr("0.0.0.0", 443), group);
+    http3.add_handler<statistics_handler>("/statistics");
+    http3.add_handler<metrics_handler>(metrics_path);
+    http3.add_handler<memory_handler>("/debug/memory");
+#endif
     https.add_handler<statistics_handler>("/statistics");
     http.add_handler<statistics_handler>("/statistics");
+    https.add_handler<metrics_handler>(metrics_path);
+    http.add_handler<metrics_handler>(metrics_path);
+    https.add_handler<trace_handler>("/debug/trace");
+    http.add_handler<trace_handler>("/debug/trace");
+    https.add_handler<memory_handler>("/debug/memory");
+    http.add_handler<memory_handler>("/debug/memory");
+    for (auto& [path, upstreams] : proxies) {
+        https.add_proxy(path, upstreams);
+        http.add_proxy(path, upstreams);
+#if OPENSSL_VERSION_NUMBER >= 0x30500000L
+        http3.add_proxy(path, upstreams);
+#endif
+        LINFO("Proxying {} to {} upstreams", path, upstreams->upstreams().size());
+    }
     while (true) {
         https.loop();
         http.loop();
+#if OPENSSL_VERSION_NUMBER >= 0x30500000L
+        http3.loop();
+#endif
         if (Nexus::IO::getch() == 0) {
             LINFO("Quit key pressed. Now Exiting...");
             break;
         }
     }
     group.cleanup();
+    // Keep what the trace rings hold next to the log
+    if (Nexus::Metrics::Tracer::Sampling() != 0) {
+        std::ofstream(std::format("./log/{}.trace.json", Nexus::Log::format_time("%Y-%m-%d_%H_%M_%S"))) << Nexus::Metrics::Tracer::Export();
+    }
+    Nexus::IO::ResourceLocator::StopWatching();
     https.close();
     http.close();
+#if OPENSSL_VERSION_NUMBER >= 0x30500000L
+    http3.close();
+#endif
     Nexus::Log::log_stop();
     return 0;
 }
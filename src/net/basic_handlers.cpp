@@ -3,14 +3,56 @@
 #include <include/net/http_server.h>
 
 http_response statistics_handler::doGet(const get_request &gr) {
-    Nexus::Base::UniquePool<> resp(1024);
-    auto data = std::to_string(Nexus::Net::executed_sock + Nexus::Net::executed_tls);
+    Nexus::Base::UniquePool<http_body_allocator_t> resp(1024);
+    auto data = std::to_string(Nexus::Net::HttpMetrics::Requests());
     resp.write(data.c_str(), data.size());
     return {"200 OK",{
             {"Content-Type", "text/plain"}
-    }, Nexus::Base::unique_to_readonly<Nexus::Base::HeapAllocator>(std::move(resp))};
+    }, Nexus::Base::unique_to_readonly<http_body_allocator_t>(std::move(resp))};
 }
 
 http_response statistics_handler::doPost(const post_request &pr) {
-    return {"405 Method Not Allowed",{}, Nexus::Base::FixedPool<true>(nullptr, 0)};
+    return {"405 Method Not Allowed",{}, http_response_body_t(nullptr, 0)};
 }
+
+
+http_response metrics_handler::doGet(const get_request &gr) {
+    auto text = Nexus::Metrics::Registry::Expose();
+    Nexus::Base::UniquePool<http_body_allocator_t> resp(text.size() + 1);
+    resp.write(text.data(), text.size());
+    return {"200 OK",{
+            {"Content-Type", "text/plain; version=0.0.4; charset=utf-8"}
+    }, Nexus::Base::unique_to_readonly<http_body_allocator_t>(std::move(resp))};
+}
+
+http_response metrics_handler::doPost(const post_request &pr) {
+    return {"405 Method Not Allowed",{}, http_response_body_t(nullptr, 0)};
+}
+
+http_response trace_handler::doGet(const get_request &gr) {
+    auto json = Nexus::Metrics::Tracer::Export();
+    Nexus::Base::UniquePool<http_body_allocator_t> resp(json.size() + 1);
+    resp.write(json.data(), json.size());
+    return {"200 OK",{
+            {"Content-Type", "application/json"}
+    }, Nexus::Base::unique_to_readonly<http_body_allocator_t>(std::move(resp))};
+}
+
+http_response trace_handler::doPost(const post_request &pr) {
+    return {"405 Method Not Allowed",{}, http_response_body_t(nullptr, 0)};
+}
+
+http_response memory_handler::doGet(const get_request &gr) {
+    static constexpr const char* modes[] = {"heap", "numa", "hugepages"};
+    auto json = std::format("{{\"accounts\":{},\"arena\":{{\"mode\":\"{}\",\"chunks\":{},\"large_chunks\":{}}}}}", Nexus::Base::MemoryAccounts::Export(),
+                            modes[Nexus::Base::Arena::Mode()], Nexus::Base::Arena::Chunks(), Nexus::Base::Arena::LargeChunks());
+    Nexus::Base::UniquePool<http_body_allocator_t> resp(json.size() + 1);
+    resp.write(json.data(), json.size());
+    return {"200 OK",{
+            {"Content-Type", "application/json"}
+    }, Nexus::Base::unique_to_readonly<http_body_allocator_t>(std::move(resp))};
+}
+
+http_response memory_handler::doPost(const post_request &pr) {
+    return {"405 Method Not Allowed",{}, http_response_body_t(nullptr, 0)};
+}
\ No newline at end of file
@@ -0,0 +1,255 @@
+#include <include/net/http3_server.h>
+#include <unordered_map>
+
+#if OPENSSL_VERSION_NUMBER >= 0x30500000L
+using namespace Nexus::IO;
+using namespace Nexus::Base;
+using namespace Nexus::Parallel;
+
+static BIO_MSG* MessageAt(BIO_MSG* msg, size_t stride, size_t i) {
+    return reinterpret_cast<BIO_MSG*>(reinterpret_cast<char*>(msg) + i * stride);
+}
+
+static bool ToSockaddr(const BIO_ADDR* addr, sockaddr_storage& ss, int& len) {
+    ss = {};
+    size_t rawlen = 0;
+    if (BIO_ADDR_family(addr) == AF_INET) {
+        auto sin = reinterpret_cast<sockaddr_in*>(&ss);
+        sin->sin_family = AF_INET;
+        sin->sin_port = BIO_ADDR_rawport(addr);
+        len = sizeof(sockaddr_in);
+        return BIO_ADDR_rawaddress(addr, &sin->sin_addr, &rawlen) && rawlen == sizeof(in_addr);
+    }
+    if (BIO_ADDR_family(addr) == AF_INET6) {
+        auto sin6 = reinterpret_cast<sockaddr_in6*>(&ss);
+        sin6->sin6_family = AF_INET6;
+        sin6->sin6_port = BIO_ADDR_rawport(addr);
+        len = sizeof(sockaddr_in6);
+        return BIO_ADDR_rawaddress(addr, &sin6->sin6_addr, &rawlen) && rawlen == sizeof(in6_addr);
+    }
+    return false;
+}
+
+static void FromSockaddr(const sockaddr_storage& ss, BIO_ADDR* addr) {
+    if (ss.ss_family == AF_INET) {
+        auto sin = reinterpret_cast<const sockaddr_in*>(&ss);
+        BIO_ADDR_rawmake(addr, AF_INET, &sin->sin_addr, sizeof(in_addr), sin->sin_port);
+    } else if (ss.ss_family == AF_INET6) {
+        auto sin6 = reinterpret_cast<const sockaddr_in6*>(&ss);
+        BIO_ADDR_rawmake(addr, AF_INET6, &sin6->sin6_addr, sizeof(in6_addr), sin6->sin6_port);
+    } else {
+        BIO_ADDR_clear(addr);
+    }
+}
+
+/*
+ * Send a batch of datagrams. Runs of equally sized datagrams to the same peer, of which only the last may be shorter, are
+ * what QUIC produces when it flushes a congestion window, and each run leaves with one segmentation offload send.
+ * */
+static int DatagramSend(BIO* bio, BIO_MSG* msg, size_t stride, size_t num_msg, uint64_t, size_t* msgs_processed) {
+    auto dgram = static_cast<Nexus::Net::Http3Datagram*>(BIO_get_data(bio));
+    size_t i = 0;
+    while (i < num_msg) {
+        BIO_MSG* first = MessageAt(msg, stride, i);
+        sockaddr_storage to;
+        int tolen = 0;
+        if (first->peer == nullptr || !ToSockaddr(first->peer, to, tolen)) break;
+        auto segment = static_cast<DWORD>(first->data_len);
+        dgram->staging.assign(static_cast<const char*>(first->data), first->data_len);
+        size_t j = i + 1;
+        for (; j < num_msg; ++j) {
+            BIO_MSG* m = MessageAt(msg, stride, j);
+            sockaddr_storage next;
+            int nextlen = 0;
+            if (m->data_len > segment || dgram->staging.size() + m->data_len > Win32UdpBatch::max_coalesced) break;
+            if (m->peer == nullptr || !ToSockaddr(m->peer, next, nextlen) || nextlen != tolen || memcmp(&next, &to, tolen) != 0) break;
+            dgram->staging.append(static_cast<const char*>(m->data), m->data_len);
+            if (m->data_len < segment) {
+                ++j;
+                break;
+            }
+        }
+        if (!dgram->batch.send(dgram->staging.data(), static_cast<DWORD>(dgram->staging.size()), segment, reinterpret_cast<sockaddr*>(&to), tolen)) break;
+        i = j;
+    }
+    *msgs_processed = i;
+    if (i == 0) {
+        // QUIC recovers lost datagrams, a failed send is never fatal for the connection
+        ERR_raise(ERR_LIB_BIO, BIO_R_NON_FATAL);
+        return 0;
+    }
+    return 1;
+}
+
+/* Receive a batch of datagrams, coalesced receives are split by Win32UdpBatch. */
+static int DatagramRecv(BIO* bio, BIO_MSG* msg, size_t stride, size_t num_msg, uint64_t, size_t* msgs_processed) {
+    auto dgram = static_cast<Nexus::Net::Http3Datagram*>(BIO_get_data(bio));
+    size_t i = 0;
+    for (; i < num_msg; ++i) {
+        BIO_MSG* m = MessageAt(msg, stride, i);
+        sockaddr_storage from;
+        int fromlen = 0;
+        int n = dgram->batch.recv(static_cast<char*>(m->data), static_cast<int>(m->data_len), from, fromlen);
+        if (n == SOCKET_ERROR) break;
+        m->data_len = n;
+        m->flags = 0;
+        if (m->peer != nullptr) FromSockaddr(from, m->peer);
+        if (m->local != nullptr) BIO_ADDR_clear(m->local);
+    }
+    *msgs_processed = i;
+    if (i == 0) {
+        ERR_raise(ERR_LIB_BIO, BIO_R_NON_FATAL);
+        return 0;
+    }
+    return 1;
+}
+
+static long DatagramCtrl(BIO* bio, int cmd, long, void* parg) {
+    auto dgram = static_cast<Nexus::Net::Http3Datagram*>(BIO_get_data(bio));
+    switch (cmd) {
+        case BIO_CTRL_DGRAM_GET_CAPS:
+        case BIO_CTRL_DGRAM_GET_EFFECTIVE_CAPS:
+            // Every datagram goes to its own peer and reports where it came from, one socket serves all connections
+            return BIO_DGRAM_CAP_HANDLES_DST_ADDR | BIO_DGRAM_CAP_PROVIDES_SRC_ADDR;
+        case BIO_CTRL_DGRAM_SET_CAPS:
+        case BIO_CTRL_FLUSH:
+            return 1;
+        case BIO_CTRL_DGRAM_GET_MTU:
+            return 1472;
+        case BIO_CTRL_GET_RPOLL_DESCRIPTOR:
+        case BIO_CTRL_GET_WPOLL_DESCRIPTOR: {
+            auto desc = static_cast<BIO_POLL_DESCRIPTOR*>(parg);
+            desc->type = BIO_POLL_DESCRIPTOR_TYPE_SOCK_FD;
+            desc->value.fd = static_cast<int>(dgram->fd);
+            return 1;
+        }
+        case BIO_C_GET_FD:
+            if (parg != nullptr) *static_cast<int*>(parg) = static_cast<int>(dgram->fd);
+            return static_cast<long>(dgram->fd);
+        default:
+            return 0;
+    }
+}
+
+static BIO* NewDatagramBio(Nexus::Net::Http3Datagram& dgram) {
+    static BIO_METHOD* method = []() {
+        BIO_METHOD* m = BIO_meth_new(BIO_get_new_index() | BIO_TYPE_SOURCE_SINK, "nexus datagram");
+        BIO_meth_set_sendmmsg(m, DatagramSend);
+        BIO_meth_set_recvmmsg(m, DatagramRecv);
+        BIO_meth_set_ctrl(m, DatagramCtrl);
+        return m;
+    }();
+    BIO* bio = BIO_new(method);
+    if (bio != nullptr) {
+        BIO_set_data(bio, &dgram);
+        BIO_set_init(bio, 1);
+    }
+    return bio;
+}
+
+template<typename MUX, int N>
+Nexus::Net::Http3Server<MUX, N>::Http3Server(Nexus::Utils::NetAddr addr, WorkGroup<N>& group, const std::string& cert, const std::string& key) : iomux_(IOMultiplexer<MUX>()),
+                                                                                                                                                  sock_(addr.type(), SOCK_DGRAM), group_(group) {
+    SSL_CTX* ctx = SSL_CTX_new(OSSL_QUIC_server_method());
+    if (!ctx) {
+        ERR_print_errors_fp(stderr);
+        LFATAL("Error occurred when creating QUIC SSL context");
+        exit(EXIT_FAILURE);
+    }
+    if (SSL_CTX_use_certificate_file(ctx, cert.c_str(), SSL_FILETYPE_PEM) <= 0 || SSL_CTX_use_PrivateKey_file(ctx, key.c_str(), SSL_FILETYPE_PEM) <= 0) {
+        ERR_print_errors_fp(stderr);
+        LFATAL("Error occurred when reading SSL Certificate or Private Key");
+        exit(EXIT_FAILURE);
+    }
+    SSL_CTX_set_mode(ctx, SSL_MODE_ENABLE_PARTIAL_WRITE | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+    // QUIC carries nothing but h3 here
+    SSL_CTX_set_alpn_select_cb(ctx, [](SSL*, const unsigned char** out, unsigned char* outlen, const unsigned char* in, unsigned int inlen, void*) -> int {
+        static constexpr unsigned char protos[] = "\x02h3";
+        if (SSL_select_next_proto(const_cast<unsigned char**>(out), outlen, protos, sizeof(protos) - 1, in, inlen) != OPENSSL_NPN_NEGOTIATED) {
+            return SSL_TLSEXT_ERR_ALERT_FATAL;
+        }
+        return SSL_TLSEXT_ERR_OK;
+    }, nullptr);
+    ssl_ctx_ = ctx;
+    if (!sock_.bind(addr)) {
+        LFATAL("Error occured when bind http3 server to {}. Error Code: {}", addr.url(), GetLastNetworkError());
+        exit(EXIT_FAILURE);
+    }
+    sock_.setnonblocking();
+    dgram_ = std::make_unique<Http3Datagram>();
+    dgram_->fd = sock_.fd();
+    if (!dgram_->batch.open(sock_.fd())) {
+        LFATAL("Error occurred when preparing the UDP socket of http3 server. Error Code: {}", GetLastNetworkError());
+        exit(EXIT_FAILURE);
+    }
+    BIO* bio = NewDatagramBio(*dgram_);
+    listener_ = SSL_new_listener(ctx, 0);
+    if (bio == nullptr || listener_ == nullptr) {
+        ERR_print_errors_fp(stderr);
+        LFATAL("Error occurred when creating QUIC listener");
+        exit(EXIT_FAILURE);
+    }
+    SSL_set_bio(listener_, bio, bio);
+    SSL_set_blocking_mode(listener_, 0);
+    if (!SSL_listen(listener_)) {
+        ERR_print_errors_fp(stderr);
+        LFATAL("Error occurred when starting QUIC listener");
+        exit(EXIT_FAILURE);
+    }
+    iomux_.add(sock_.fd(), MUX::EVREAD);
+    LINFO("Http3 Server started on {}, segmentation offload: {}, receive offload: {}", addr.url(), dgram_->batch.uso(), dgram_->batch.uro());
+}
+
+template<typename MUX, int N>
+void Nexus::Net::Http3Server<MUX, N>::loop() {
+    auto evs = iomux_.poll(0);
+    bool ticked = evs.is_valid() && !evs.reference().empty();
+    // Datagrams arrived or a QUIC timer (retransmission, ACK delay, idle timeout) expired
+    timeval tv {};
+    int infinite = 0;
+    if (!ticked && SSL_get_event_timeout(listener_, &tv, &infinite) && !infinite && tv.tv_sec == 0 && tv.tv_usec == 0) {
+        ticked = true;
+    }
+    if (ticked) {
+        SSL_handle_events(listener_);
+    }
+    while (SSL* c = SSL_accept_connection(listener_, SSL_ACCEPT_CONNECTION_NO_BLOCK)) {
+        uint64_t id = ++accepted_;
+        auto conn = std::make_shared<Http3Connection>(c, handlers_, "quic#" + std::to_string(id));
+        connections_.emplace(id, conn);
+        LINFO("New QUIC Connection created: {}", conn->peer());
+        ticked = true;
+    }
+    for (auto it = connections_.begin(); it != connections_.end(); ) {
+        std::shared_ptr<Http3Connection> conn = it->second;
+        if (conn->status() == Http3Connection::FINISHED) {
+            it = connections_.erase(it);
+            continue;
+        }
+        // The socket is shared, so every connection may have received something when the engine ticked
+        if (ticked || conn->resumable()) {
+            group_.post([conn](){
+                conn->drive();
+            });
+        }
+        ++it;
+    }
+}
+
+template<typename MUX, int N>
+void Nexus::Net::Http3Server<MUX, N>::close() {
+    for (auto it = connections_.begin(); it != connections_.end(); ) {
+        std::shared_ptr<Http3Connection> conn = it->second;
+        conn->cleanup();
+        it = connections_.erase(it);
+    }
+    SSL_free(listener_);
+    SSL_CTX_free(ssl_ctx_);
+    sock_.close();
+}
+
+#ifdef PLATFORM_WIN32
+    template class Nexus::Net::Http3Server<Win32SelectMUX, CPU_CORES - 1>;
+    template class Nexus::Net::Http3Server<Win32PollMUX, CPU_CORES - 1>;
+#endif
+#endif
\ No newline at end of file
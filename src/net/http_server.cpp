@@ -10,15 +10,18 @@ using namespace Nexus::IO;
 using namespace Nexus::Base;
 using namespace Nexus::Parallel;
 
-uint64_t Nexus::Net::executed_sock = 0;
-
 template<typename MUX, int N>
-Nexus::Net::HttpServer<MUX, N>::HttpServer::HttpServer(Nexus::Utils::NetAddr addr , WorkGroup<N>& group) : sock_(addr.type()), iomux_(IOMultiplexer<MUX>()), group_(group) {
+Nexus::Net::HttpServer<MUX, N>::HttpServer::HttpServer(Nexus::Utils::NetAddr addr , WorkGroup<N>& group, const socket_profile_t& profile) : sock_(addr.type()),
+                                                          iomux_(IOMultiplexer<MUX>()), profile_(profile), group_(group) {
+    // Before listen(), the window scale is settled on the handshake
+    if (!sock_.setbuffers(profile_.recv_buffer, profile_.send_buffer)) {
+        LWARN("Cannot set socket buffers of {}. Error Code: {}", addr.url(), GetLastNetworkError());
+    }
     if (!sock_.bind(addr)) {
         LFATAL("Error occured when bind http server to {}. Error Code: {}", addr.url(), GetLastNetworkError());
         exit(EXIT_FAILURE);
     }
-    sock_.listen();
+    sock_.listen(profile_.backlog);
     LINFO("Http Server started on {}", addr.url());
     auto b = sock_.setnonblocking();
     iomux_.add(sock_.fd(), MUX::EVREAD);
@@ -26,61 +29,101 @@ Nexus::Net::HttpServer<MUX, N>::HttpServer::HttpServer(Nexus::Utils::NetAddr add
 
 template<typename MUX, int N>
 void Nexus::Net::HttpServer<MUX, N>::HttpServer::loop() {
+    auto now = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    // Connections inserted from here on were accepted after the poll, see slot_map.h
+    auto polled = connections_.generation();
     auto evs = iomux_.poll(0);
     if (evs.is_valid()) {
         for (auto& ev : evs.reference()) {
             if (ev.handle == sock_.fd()) {
-                // Server socket
-                Socket client = sock_.accept();
-                if (client.invalid()) {
-                    client.close();
-                    continue;
+                // Server socket, take what the backlog holds up to accept_batch instead of a client per poll
+                for (uint32_t n = 0; n < profile_.accept_batch; ++n) {
+                    auto accepted = Nexus::Metrics::Tracer::Now();
+                    Socket client = admission_.accept(sock_, now);
+                    if (client.invalid()) {
+                        break;
+                    }
+                    // Clients out of tokens are dropped before anything is set up for them
+                    if (!RateLimiter::Global().allow(RateLimiter::Key(client.addr()))) {
+                        client.close();
+                        admission_.release();
+                        continue;
+                    }
+                    client.setnonblocking();
+                    if (profile_.nodelay) {
+                        client.setnodelay();
+                    }
+                    // The handle came back before the sweep erased the connection that had it last, which closed it already
+                    if (auto stale = connections_.find(client.fd()); stale != nullptr) {
+                        iomux_.remove(client.fd());
+                        admission_.release();
+                        pool_.release(std::move(stale->value));
+                        connections_.erase(client.fd());
+                    }
+                    iomux_.add(client.fd(), MUX::EVREAD | MUX::EVWRITE);
+                    auto conn = pool_.acquire(client, handlers_);
+                    Nexus::Metrics::Tracer::Span(conn->trace_id(), "accept", "http1", accepted, Nexus::Metrics::Tracer::Now());
+                    connections_.insert(client.fd(), std::move(conn));
+                    LINFO("New Socket Connection created: {}", client.addr().url());
                 }
-                client.setnonblocking();
-                iomux_.add(client.fd(), MUX::EVREAD | MUX::EVWRITE);
-                std::shared_ptr<HttpConnection> conn = std::make_shared<HttpConnection>(client, handlers_);
-                connections_.insert(std::make_pair(client.fd(), conn));
-                LINFO("New Socket Connection created: {}", client.addr().url());
             } else {
-                std::shared_ptr<HttpConnection> conn = connections_.at(ev.handle);
-                group_.post([conn](){
-                    conn->drive();
+                auto slot = connections_.find(ev.handle);
+                if (slot == nullptr || slot->generation >= polled) {
+                    continue;
+                }
+                auto conn = slot->value;
+                auto queued = conn->trace_id() != 0 ? Nexus::Metrics::Tracer::Now() : 0;
+                group_.post([conn, queued](){
+                    conn->drive(queued);
                 });
             }
         }
     }
+    // Leave new connections in the backlog while at the limit
+    if (admission_.pause(now)) {
+        LWARN("Listener paused with {} connections open", admission_.open());
+        iomux_.remove(sock_.fd());
+    }
     // drive connections
-    auto now = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
     for (auto it = connections_.begin(); it != connections_.end(); ) {
-        std::shared_ptr<HttpConnection> conn = it->second;
-        auto time_elapsed = now - conn->time_established();
+        auto& conn = it->value;
         if (conn->status() == HttpConnection::FINISHED) {
             conn->cleanup();
-            iomux_.remove(it->first);
+            iomux_.remove(it->handle);
+            admission_.release();
+            pool_.release(std::move(conn));
             it = connections_.erase(it);
-        } else if(time_elapsed > 10000) {
+        } else if (conn->expired(now)) {
             LINFO("Socket Connection {} time out. Remain connections: {}", conn->get_socket().addr().url(), connections_.size());
             conn->cleanup();
-            iomux_.remove(it->first);
+            iomux_.remove(it->handle);
+            admission_.release();
+            pool_.release(std::move(conn));
             it = connections_.erase(it);
         } else {
-            if (conn->status() == HttpConnection::EXECUTING) {
-                group_.post([conn](){
-                    conn->drive();
+            if (conn->status() == HttpConnection::EXECUTING || conn->resumable()) {
+                auto queued = conn->trace_id() != 0 ? Nexus::Metrics::Tracer::Now() : 0;
+                group_.post([conn, queued](){
+                    conn->drive(queued);
                 });
             }
             ++it;
         }
     }
-
+    pool_.collect();
+    if (admission_.resume(now)) {
+        iomux_.add(sock_.fd(), MUX::EVREAD);
+    }
 }
 template<typename MUX, int N>
 void Nexus::Net::HttpServer<MUX, N>::HttpServer::close() {
     for (auto it = connections_.begin(); it != connections_.end(); ) {
-        std::shared_ptr<HttpConnection> conn = it->second;
+        auto& conn = it->value;
         conn->cleanup();
+        admission_.release();
         it = connections_.erase(it);
     }
+    pool_.clear();
 }
 
 #ifdef PLATFORM_WIN32
@@ -5,10 +5,9 @@ using namespace Nexus::IO;
 using namespace Nexus::Base;
 using namespace Nexus::Parallel;
 
-uint64_t Nexus::Net::executed_tls = 0;
-
 template<typename MUX, int N>
-Nexus::Net::HttpsServer<MUX, N>::HttpsServer(Nexus::Utils::NetAddr addr, WorkGroup<N>& group) : sock_(addr.type()), iomux_(IOMultiplexer<MUX>()), group_(group) {
+Nexus::Net::HttpsServer<MUX, N>::HttpsServer(Nexus::Utils::NetAddr addr, WorkGroup<N>& group, const socket_profile_t& profile) : sock_(addr.type()),
+                                                         iomux_(IOMultiplexer<MUX>()), profile_(profile), group_(group) {
     SSL_load_error_strings();
     OpenSSL_add_ssl_algorithms();
     SSL_CTX *ctx = SSL_CTX_new(TLS_server_method());
@@ -26,6 +25,18 @@ Nexus::Net::HttpsServer<MUX, N>::HttpsServer(Nexus::Utils::NetAddr addr, WorkGro
     }
     SSL_CTX_set_min_proto_version(ctx, TLS1_1_VERSION);
     SSL_CTX_set_max_proto_version(ctx, TLS1_3_VERSION);
+    // Responses are written from offsets into buffers that may grow between retries
+    SSL_CTX_set_mode(ctx, SSL_MODE_ENABLE_PARTIAL_WRITE | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+    // Prefer h2 when the client offers it, HTTP/2 requires at least TLS 1.2
+    SSL_CTX_set_alpn_select_cb(ctx, [](SSL* ssl, const unsigned char** out, unsigned char* outlen, const unsigned char* in, unsigned int inlen, void*) -> int {
+        static constexpr unsigned char protos[] = "\x02h2\x08http/1.1";
+        const unsigned char* server = SSL_version(ssl) >= TLS1_2_VERSION ? protos : protos + 3;
+        unsigned int server_len = static_cast<unsigned int>(sizeof(protos) - 1 - (server - protos));
+        if (SSL_select_next_proto(const_cast<unsigned char**>(out), outlen, server, server_len, in, inlen) != OPENSSL_NPN_NEGOTIATED) {
+            return SSL_TLSEXT_ERR_NOACK;
+        }
+        return SSL_TLSEXT_ERR_OK;
+    }, nullptr);
     if (SSL_CTX_use_PrivateKey_file(ctx, "server.key", SSL_FILETYPE_PEM) <= 0)
     {
         ERR_print_errors_fp(stderr);
@@ -33,74 +44,119 @@ Nexus::Net::HttpsServer<MUX, N>::HttpsServer(Nexus::Utils::NetAddr addr, WorkGro
         exit(EXIT_FAILURE);
     }
     ssl_ctx_ = ctx;
+    // Before listen(), the window scale is settled on the handshake
+    if (!sock_.setbuffers(profile_.recv_buffer, profile_.send_buffer)) {
+        LWARN("Cannot set socket buffers of {}. Error Code: {}", addr.url(), GetLastNetworkError());
+    }
     if (!sock_.bind(addr)) {
         LFATAL("Error occured when bind http server to {}. Error Code: {}", addr.url(), GetLastNetworkError());
         exit(EXIT_FAILURE);
     }
-    sock_.listen();
+    sock_.listen(profile_.backlog);
     sock_.setnonblocking();
     iomux_.add(sock_.fd(), MUX::EVREAD);
     LINFO("Https Server started on {}", addr.url());
 }
 template<typename MUX, int N>
 void Nexus::Net::HttpsServer<MUX, N>::HttpsServer::loop() {
+    auto now = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    // Connections inserted from here on were accepted after the poll, see slot_map.h
+    auto polled = connections_.generation();
     auto evs = iomux_.poll(0);
     if (evs.is_valid()) {
         for (auto& ev : evs.reference()) {
             if (ev.handle == sock_.fd()) {
-                // Server socket
-                Socket client = sock_.accept();
-                if (client.invalid()) {
-                    client.close();
-                    continue;
+                // Server socket, take what the backlog holds up to accept_batch instead of a client per poll
+                for (uint32_t n = 0; n < profile_.accept_batch; ++n) {
+                    auto accepted = Nexus::Metrics::Tracer::Now();
+                    Socket client = admission_.accept(sock_, now);
+                    if (client.invalid()) {
+                        break;
+                    }
+                    // Clients out of tokens are dropped before anything is set up for them
+                    if (!RateLimiter::Global().allow(RateLimiter::Key(client.addr()))) {
+                        client.close();
+                        admission_.release();
+                        continue;
+                    }
+                    SSL* ssl = SSL_new(ssl_ctx_);
+                    SSL_set_fd(ssl, client.fd());
+                    client.setnonblocking();
+                    if (profile_.nodelay) {
+                        client.setnodelay();
+                    }
+                    // The handle came back before the sweep erased the connection that had it last, which closed it already
+                    if (auto stale = connections_.find(client.fd()); stale != nullptr) {
+                        iomux_.remove(client.fd());
+                        admission_.release();
+                        pool_.release(std::move(stale->value));
+                        connections_.erase(client.fd());
+                    }
+                    iomux_.add(client.fd(), MUX::EVREAD | MUX::EVWRITE);
+                    auto conn = pool_.acquire(client, handlers_, ssl);
+                    Nexus::Metrics::Tracer::Span(conn->trace_id(), "accept", "https", accepted, Nexus::Metrics::Tracer::Now());
+                    connections_.insert(client.fd(), std::move(conn));
+                    LINFO("New TLS Connection created: {}", client.addr().url());
                 }
-                SSL* ssl = SSL_new(ssl_ctx_);
-                SSL_set_fd(ssl, client.fd());
-                client.setnonblocking();
-                iomux_.add(client.fd(), MUX::EVREAD | MUX::EVWRITE);
-                std::shared_ptr conn = std::make_shared<HttpsConnection>(client, handlers_, ssl);
-                connections_.insert(std::make_pair(client.fd(), conn));
-                LINFO("New TLS Connection created: {}", client.addr().url());
             } else {
-                std::shared_ptr<HttpsConnection> conn = connections_.at(ev.handle);
-                group_.post([conn](){
-                    conn->drive();
+                auto slot = connections_.find(ev.handle);
+                if (slot == nullptr || slot->generation >= polled) {
+                    continue;
+                }
+                auto conn = slot->value;
+                auto queued = conn->trace_id() != 0 ? Nexus::Metrics::Tracer::Now() : 0;
+                group_.post([conn, queued](){
+                    conn->drive(queued);
                 });
             }
         }
     }
+    // Leave new connections in the backlog while at the limit
+    if (admission_.pause(now)) {
+        LWARN("Listener paused with {} connections open", admission_.open());
+        iomux_.remove(sock_.fd());
+    }
     // drive connections
-    auto now = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
     for (auto it = connections_.begin(); it != connections_.end(); ) {
-        std::shared_ptr<HttpsConnection> conn = it->second;
-        auto time_elapsed = now - conn->time_established();
+        auto& conn = it->value;
         if (conn->status() == HttpsConnection::FINISHED) {
             conn->cleanup();
-            iomux_.remove(it->first);
+            iomux_.remove(it->handle);
+            admission_.release();
+            pool_.release(std::move(conn));
             it = connections_.erase(it);
-        } else if(time_elapsed > 10000) {
+        } else if (conn->expired(now)) {
             LINFO("TLS Connection {} time out. Remain connections: {}", conn->get_socket().addr().url(), connections_.size());
             conn->cleanup();
-            iomux_.remove(it->first);
+            iomux_.remove(it->handle);
+            admission_.release();
+            pool_.release(std::move(conn));
             it = connections_.erase(it);
         } else {
-            if (conn->status() == HttpsConnection::EXECUTING) {
-                group_.post([conn](){
-                    conn->drive();
+            if (conn->status() == HttpsConnection::EXECUTING || conn->resumable()) {
+                auto queued = conn->trace_id() != 0 ? Nexus::Metrics::Tracer::Now() : 0;
+                group_.post([conn, queued](){
+                    conn->drive(queued);
                 });
             }
             ++it;
         }
     }
+    pool_.collect();
+    if (admission_.resume(now)) {
+        iomux_.add(sock_.fd(), MUX::EVREAD);
+    }
 }
 
 template<typename MUX, int N>
 void Nexus::Net::HttpsServer<MUX, N>::HttpsServer::close() {
     for (auto it = connections_.begin(); it != connections_.end(); ) {
-        std::shared_ptr<HttpsConnection> conn = it->second;
+        auto& conn = it->value;
         conn->cleanup();
+        admission_.release();
         it = connections_.erase(it);
     }
+    pool_.clear();
     EVP_cleanup();
 }
 
@@ -5,9 +5,9 @@
 using namespace Nexus::Net;
 using namespace Nexus::Utils;
 
-Socket::Socket(SockType typ) : type_(typ) {
-    if (typ == SockType::SOCK_IPV4) fd_ = socket(AF_INET, SOCK_STREAM, 0);
-    else if (typ == SockType::SOCK_IPV6) fd_ = socket(AF_INET6, SOCK_STREAM, 0);
+Socket::Socket(SockType typ, int kind) : type_(typ) {
+    if (typ == SockType::SOCK_IPV4) fd_ = socket(AF_INET, kind, 0);
+    else if (typ == SockType::SOCK_IPV6) fd_ = socket(AF_INET6, kind, 0);
     else {
         invalid_ = true;
         fd_ = 0;
@@ -81,7 +81,7 @@ bool Socket::connect(const std::string &addr, uint16_t port) {
     NetAddr na(addr, port);
     int r = ::connect(fd_, na.addr().ptr(), na.size());
     if (r == -1) {
-        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        if (GetLastNetworkError() == WSAEWOULDBLOCK) {
             return true;
         } else {
             return false;
@@ -93,7 +93,7 @@ bool Socket::connect(const std::string &addr, uint16_t port) {
 bool Socket::connect(sockaddr_in6 addrv6, uint16_t port) {
     int r = ::connect(fd_, reinterpret_cast<sockaddr*>(&addrv6), sizeof(sockaddr_in6));
     if (r == -1) {
-        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        if (GetLastNetworkError() == WSAEWOULDBLOCK) {
             return true;
         } else {
             return false;
@@ -105,7 +105,7 @@ bool Socket::connect(sockaddr_in6 addrv6, uint16_t port) {
 bool Socket::connect(sockaddr_in addrv4, uint16_t port) {
     int r = ::connect(fd_, reinterpret_cast<sockaddr*>(&addrv4), sizeof(sockaddr_in));
     if (r == -1) {
-        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        if (GetLastNetworkError() == WSAEWOULDBLOCK) {
             return true;
         } else {
             return false;
@@ -114,8 +114,8 @@ bool Socket::connect(sockaddr_in addrv4, uint16_t port) {
     return true;
 }
 
-void Socket::listen() {
-    ::listen(fd_, 1024);
+void Socket::listen(int backlog) {
+    ::listen(fd_, backlog);
 }
 
 Socket Socket::accept() {
@@ -149,6 +149,24 @@ bool Socket::setnonblocking() {
     return SetNonblockingSocket(fd_);
 }
 
+bool Socket::setnodelay() {
+    int one = 1;
+    return setsockopt(fd_, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&one), sizeof(one)) != SOCKET_ERROR;
+}
+
+bool Socket::setbuffers(uint32_t recv, uint32_t send) {
+    bool ok = true;
+    if (recv != 0) {
+        int size = static_cast<int>(recv);
+        ok = setsockopt(fd_, SOL_SOCKET, SO_RCVBUF, reinterpret_cast<const char*>(&size), sizeof(size)) != SOCKET_ERROR;
+    }
+    if (send != 0) {
+        int size = static_cast<int>(send);
+        ok = setsockopt(fd_, SOL_SOCKET, SO_SNDBUF, reinterpret_cast<const char*>(&size), sizeof(size)) != SOCKET_ERROR && ok;
+    }
+    return ok;
+}
+
 bool Socket::bind(Nexus::Utils::NetAddr addr) {
     if (addr.type() == SockType::SOCK_IPV4) {
         return bind(addr.addrv4().get(), addr.port());
@@ -156,6 +174,13 @@ bool Socket::bind(Nexus::Utils::NetAddr addr) {
         return bind(addr.addrv6().get(), addr.port());
     }
 }
+bool Socket::connect(Nexus::Utils::NetAddr addr) {
+    if (addr.type() == SockType::SOCK_IPV4) {
+        return connect(addr.addrv4().get(), addr.port());
+    } else {
+        return connect(addr.addrv6().get(), addr.port());
+    }
+}
 io_handle_t Socket::fd() {
     return fd_;
 }
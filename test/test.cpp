@@ -1,5 +1,13 @@
 #include "test_framework.h"
 #include "unit_memory.hpp"
+#include "unit_http.hpp"
+#include "unit_http2.hpp"
+#include "unit_http3.hpp"
+#include "unit_websocket.hpp"
+#include "unit_event_stream.hpp"
+#include "unit_utils.hpp"
+#include "unit_metrics.hpp"
+#include "unit_proxy.hpp"
 #include "include/net/http_server.h"
 #include <include/mem/memory.h>
 #include <include/utils/netaddr.h>
@@ -11,5 +19,36 @@ int main() {
     RegisterTask(SharedPoolTest);
     RegisterTask(UniquePoolTest);
     RegisterTask(UniqueFlexHolderTest);
+    RegisterTask(PoolViewTest);
+    RegisterTask(IOBufTest);
+    RegisterTask(ArenaTest);
+    RegisterTask(TrackingTest);
+    RegisterTask(Nexus::Test::Net::HttpBodyReaderChunkedTest);
+    RegisterTask(Nexus::Test::Net::HttpBodySpillTest);
+    RegisterTask(Nexus::Test::Net::HttpTaskTest);
+    RegisterTask(Nexus::Test::Net::HttpParserKernelTest);
+    RegisterTask(Nexus::Test::Net::AdmissionTest);
+    RegisterTask(Nexus::Test::Net::RateLimiterTest);
+    RegisterTask(Nexus::Test::Net::SocketProfileTest);
+    RegisterTask(Nexus::Test::Net::HttpProducerWireTest);
+    RegisterTask(Nexus::Test::Net::ConnectionPoolTest);
+    RegisterTask(Nexus::Test::Net::SlotMapTest);
+    RegisterTask(Nexus::Test::Net::ResourceLocatorTest);
+    RegisterTask(Nexus::Test::Net::ProxyTest);
+    RegisterTask(Nexus::Test::Net::HpackDecodeTest);
+    RegisterTask(Nexus::Test::Net::Http2SessionTest);
+    RegisterTask(Nexus::Test::Net::QpackTest);
+    RegisterTask(Nexus::Test::Net::Http3StreamTest);
+    RegisterTask(Nexus::Test::Net::Http3ControlStreamTest);
+    RegisterTask(Nexus::Test::Net::WebSocketHandshakeTest);
+    RegisterTask(Nexus::Test::Net::WebSocketFrameTest);
+    RegisterTask(Nexus::Test::Net::WebSocketDeflateTest);
+    RegisterTask(Nexus::Test::Net::EventStreamEncodeTest);
+    RegisterTask(Nexus::Test::Net::EventBrokerTest);
+    RegisterTask(Nexus::Test::Utils::HdrHistogramTest);
+    RegisterTask(Nexus::Test::Utils::ResolverTest);
+    RegisterTask(Nexus::Test::Metrics::MetricsRegistryTest);
+    RegisterTask(Nexus::Test::Metrics::MetricsHistogramTest);
+    RegisterTask(Nexus::Test::Metrics::TraceExportTest);
     ExecuteAll();
 }
\ No newline at end of file
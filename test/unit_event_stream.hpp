@@ -0,0 +1,50 @@
+#include "test_framework.h"
+#include <include/net/event_stream.h>
+
+namespace Nexus::Test::Net {
+    using namespace Nexus::Net;
+
+    inline static bool EventStreamEncodeTest() {
+        auto event = EventBroker::Encode("tick", "first\r\nsecond", 7);
+        test_assert(*event == "event: tick\nid: 7\ndata: first\ndata: second\n\n");
+        test_assert(*EventBroker::Encode({}, {}, 0) == "data: \n\n");
+        // A line break cannot smuggle another field into the event name
+        test_assert(*EventBroker::Encode("a\nid: 1", "x", 0) == "event: a\ndata: x\n\n");
+        return true;
+    }
+
+    inline static bool EventBrokerTest() {
+        auto a = std::make_shared<EventSubscriber>();
+        auto b = std::make_shared<EventSubscriber>();
+        EventBroker::Subscribe("unit-test", a);
+        EventBroker::Subscribe("unit-test", b);
+        test_assert(EventBroker::Publish("unit-test", "hello") == 2);
+        test_assert(EventBroker::Publish("nobody-listens", "hello") == 0);
+        // Both queues hold the same buffer
+        std::string_view va[4], vb[4];
+        test_assert(a->gather(va, 4) == 1 && b->gather(vb, 4) == 1);
+        test_assert(va[0].data() == vb[0].data() && va[0] == "id: 1\ndata: hello\n\n");
+        // A partial send resumes inside the event
+        a->sent(4);
+        test_assert(a->gather(va, 4) == 1 && va[0] == "1\ndata: hello\n\n");
+        a->sent(va[0].size());
+        test_assert(a->gather(va, 4) == 0);
+        // Gone subscribers are pruned, slow ones overflow and are pruned as well
+        b.reset();
+        test_assert(EventBroker::Publish("unit-test", "again") == 1);
+        test_assert(EventBroker::Subscribers("unit-test") == 1);
+        std::string big(EventSubscriber::max_queued / 2, 'x');
+        test_assert(EventBroker::Publish("unit-test", big) == 1);
+        test_assert(EventBroker::Publish("unit-test", big) == 0 && a->overflowed());
+        test_assert(EventBroker::Subscribers("unit-test") == 0);
+        // Connections coming and going on a topic nobody publishes to do not pile up
+        auto stays = std::make_shared<EventSubscriber>();
+        EventBroker::Subscribe("unit-test-quiet", stays);
+        for (int i = 0; i < 1000; ++i) {
+            EventBroker::Subscribe("unit-test-quiet", std::make_shared<EventSubscriber>());
+        }
+        test_assert(EventBroker::Subscribers("unit-test-quiet") <= 32);
+        test_assert(EventBroker::Publish("unit-test-quiet", "still here") == 1);
+        return true;
+    }
+}
\ No newline at end of file
@@ -0,0 +1,459 @@
+#include "test_framework.h"
+#include <include/net/http_body.h>
+#include <include/net/http_task.h>
+#include <include/net/admission.h>
+#include <include/net/rate_limit.h>
+#include <include/net/connection_pool.h>
+#include <include/net/http_connection.h>
+#include <include/net/http_server.h>
+#include <include/net/slot_map.h>
+#include <include/net/socket.h>
+#include <include/io/resource_locator.h>
+#include <thirdparty/picohttpparser/picohttpparser.h>
+#include <filesystem>
+#include <fstream>
+#include <random>
+
+namespace Nexus::Test::Net {
+    using namespace Nexus::Net;
+
+    inline static bool HttpBodyReaderChunkedTest() {
+        std::string received;
+        HttpBodyReader reader([&received](const char* d, uint64_t n) {
+            received.append(d, n);
+            return true;
+        });
+        // Split in the middle of a chunk size line and a chunk payload
+        char part1[] = "4\r\nWiki\r\n5\r";
+        char part2[] = "\npedia\r\nE\r\n in\r\n\r\nchunks.\r\n0\r\nX-Trailer: 1\r\n\r\n";
+        test_assert(reader.feed(part1, sizeof(part1) - 1) == HttpBodyReader::status_t::PARTIAL);
+        test_assert(reader.feed(part2, sizeof(part2) - 1) == HttpBodyReader::status_t::COMPLETE);
+        test_assert(received == "Wikipedia in\r\n\r\nchunks.");
+        char bad[] = "zz\r\n";
+        HttpBodyReader broken([](const char*, uint64_t) { return true; });
+        test_assert(broken.feed(bad, sizeof(bad) - 1) == HttpBodyReader::status_t::MALFORMED);
+        // The limit counts decoded bytes, the chunk framing is free
+        char large[] = "8\r\n01234567\r\n8\r\n89abcdef\r\n0\r\n\r\n";
+        HttpBodyReader bounded([](const char*, uint64_t) { return true; });
+        bounded.set_limit(16);
+        test_assert(bounded.feed(large, sizeof(large) - 1) == HttpBodyReader::status_t::COMPLETE);
+        HttpBodyReader tight([](const char*, uint64_t) { return true; });
+        tight.set_limit(15);
+        char copy[] = "8\r\n01234567\r\n8\r\n89abcdef\r\n0\r\n\r\n";
+        test_assert(tight.feed(copy, sizeof(copy) - 1) == HttpBodyReader::status_t::TOO_LARGE);
+        return true;
+    }
+
+    inline static bool HttpBodySpillTest() {
+        HttpBody body;
+        HttpBodyReader reader([&body](const char* d, uint64_t n) {
+            return body.append(d, n);
+        }, HttpBody::spill_threshold + 4096);
+        std::string block(4096, 'n');
+        HttpBodyReader::status_t st = HttpBodyReader::status_t::PARTIAL;
+        for (uint64_t i = 0; i <= HttpBody::spill_threshold / block.size(); ++i) {
+            block[0] = static_cast<char>('a' + i % 26);
+            st = reader.feed(block.data(), block.size());
+        }
+        test_assert(st == HttpBodyReader::status_t::COMPLETE);
+        test_assert(body.spilled());
+        test_assert(body.size() == HttpBody::spill_threshold + 4096);
+        test_assert(body.view().limit() == 0);
+        char c;
+        test_assert(body.read(&c, 4096 * 3, 1) == 1 && c == 'd');
+        test_assert(body.read(&c, body.size(), 1) == 0);
+        // Offsets of spilled bodies go past what a 32 bit long holds, seeking there must not wrap. Seeking past the end
+        // writes nothing, so this needs no 3 GiB file
+        FILE* file = tmpfile();
+        test_assert(file != nullptr);
+        uint64_t far = (uint64_t(1) << 31) + (uint64_t(1) << 30) + 7;
+        test_assert(HttpBody::Seek(file, far) && _ftelli64(file) == static_cast<int64_t>(far));
+        test_assert(HttpBody::Seek(file, 12) && _ftelli64(file) == 12);
+        fclose(file);
+        return true;
+    }
+
+    inline static HttpTask SleepyHandler(HttpContext& ctx) {
+        co_await ctx.sleep_for(std::chrono::milliseconds(20));
+        ctx.response_header.emplace("X-Slept", "1");
+        co_return http_response{"200 OK", {}, http_response_body_t(nullptr, 0)};
+    }
+
+    inline static HttpTask ThrowingHandler(HttpContext& ctx) {
+        co_await ctx.sleep_for(std::chrono::milliseconds(1));
+        throw std::runtime_error("handler failed");
+    }
+
+    inline static bool HttpTaskTest() {
+        HttpContext ctx(http_method::GET, "/sleep", {});
+        HttpTask task = SleepyHandler(ctx);
+        test_assert(task.valid() && !task.done());
+        test_assert(!task.ready());
+        std::this_thread::sleep_for(std::chrono::milliseconds(30));
+        test_assert(task.ready());
+        task.resume();
+        test_assert(task.done() && !task.failed());
+        test_assert(task.result().response_type == "200 OK");
+        test_assert(ctx.response_header.contains("X-Slept"));
+        HttpTask failing = ThrowingHandler(ctx);
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        test_assert(failing.ready());
+        failing.resume();
+        test_assert(failing.done() && failing.failed());
+        return true;
+    }
+
+    inline static bool HttpParserKernelTest() {
+        // Long enough to cross several 64 byte blocks, with the byte that ends each token at every offset somewhere
+        std::string request = "GET /" + std::string(150, 'p') + " HTTP/1.1\r\nHost: localhost\r\n";
+        for (int i = 0; i < 70; ++i) {
+            request += "X-" + std::string(i, 'h') + ": " + std::string(70 - i, 'v') + "\xc3\xa9\r\n";
+        }
+        request += "\r\n";
+        std::vector<std::string> inputs {request};
+        // Invalid bytes at every position of the request line and the first header
+        for (uint64_t i = 0; i < 230; ++i) {
+            for (char c : {'\x01', '\x7f', '\t', '\n', ' '}) {
+                std::string broken = request;
+                broken[i] = c;
+                inputs.push_back(broken);
+            }
+        }
+        std::mt19937 rng(42);
+        for (int i = 0; i < 200; ++i) {
+            std::string fuzzed = request;
+            fuzzed[rng() % fuzzed.size()] = static_cast<char>(rng());
+            inputs.push_back(fuzzed);
+        }
+        auto parse = [](const std::string& in) {
+            const char *method, *path;
+            size_t method_len, path_len, num_headers = 100;
+            int minor;
+            phr_header headers[100];
+            int r = phr_parse_request(in.data(), in.size(), &method, &method_len, &path, &path_len, &minor, headers, &num_headers, 0);
+            std::string out = std::to_string(r);
+            if (r > 0) {
+                out += std::string(method, method_len) + std::string(path, path_len);
+                for (size_t i = 0; i < num_headers; ++i) {
+                    out += '|' + std::string(headers[i].name ? headers[i].name : "", headers[i].name_len) + ':' + std::string(headers[i].value, headers[i].value_len);
+                }
+            }
+            return out;
+        };
+        // Every kernel the host has must agree with the scalar one
+        int widest = phr_set_kernel(-1);
+        std::vector<std::string> expected;
+        phr_set_kernel(PHR_KERNEL_SCALAR);
+        for (auto& in : inputs) {
+            expected.push_back(parse(in));
+        }
+        test_assert(std::stoi(expected[0]) == static_cast<int>(request.size()));
+        for (int level = PHR_KERNEL_SSE42; level <= widest; ++level) {
+            test_assert(phr_set_kernel(level) == level);
+            for (uint64_t i = 0; i < inputs.size(); ++i) {
+                test_assert(parse(inputs[i]) == expected[i]);
+            }
+        }
+        test_assert(phr_set_kernel(-1) == widest && phr_kernel() == widest);
+        return true;
+    }
+
+    inline static bool AdmissionTest() {
+        Admission::SetGlobalLimit(3);
+        Admission a, b;
+        a.set_limit(2);
+        // The listener's own limit
+        test_assert(a.admit() && a.admit() && !a.admit() && a.saturated() && a.open() == 2);
+        // The global one, which the other listener runs into first
+        test_assert(b.admit() && !b.admit() && b.saturated() && Admission::GlobalOpen() == 3);
+        // Saturated listeners pause once and resume when a slot frees
+        test_assert(a.pause(0) && !a.pause(0) && a.paused() && !a.resume(0));
+        a.release();
+        test_assert(a.resume(0) && !a.paused() && !b.saturated());
+        test_assert(b.admit() && b.open() == 2);
+        a.release();
+        b.release();
+        b.release();
+        test_assert(Admission::GlobalOpen() == 0);
+        // 0 lifts the global limit
+        Admission::SetGlobalLimit(0);
+        for (int i = 0; i < 100; ++i) {
+            test_assert(b.admit());
+        }
+        for (int i = 0; i < 100; ++i) {
+            b.release();
+        }
+        Admission::SetGlobalLimit(16384);
+        return true;
+    }
+
+    inline static bool RateLimiterTest() {
+        RateLimiter limiter;
+        auto a = RateLimiter::Key(Nexus::Utils::NetAddr("192.0.2.1", 80));
+        auto b = RateLimiter::Key(Nexus::Utils::NetAddr("192.0.2.2", 80));
+        // Ports and IPv4-mapped forms are the same client, so is a whole IPv6 /64
+        test_assert(a != b && a == RateLimiter::Key(Nexus::Utils::NetAddr("192.0.2.1", 443)));
+        test_assert(a == RateLimiter::Key(Nexus::Utils::NetAddr("::ffff:192.0.2.1", 80)));
+        test_assert(RateLimiter::Key(Nexus::Utils::NetAddr("2001:db8::1", 80)) == RateLimiter::Key(Nexus::Utils::NetAddr("2001:db8::ffff:2", 80)));
+        test_assert(RateLimiter::Key(Nexus::Utils::NetAddr("2001:db8::1", 80)) != RateLimiter::Key(Nexus::Utils::NetAddr("2001:db8:0:1::1", 80)));
+        // Off until configured
+        for (int i = 0; i < 100; ++i) {
+            test_assert(limiter.take(a, 1000));
+        }
+        // 10 a second in bursts of 5, a burst empties the bucket and a token comes back every 100ms
+        limiter.configure(10, 5);
+        for (int i = 0; i < 5; ++i) {
+            test_assert(limiter.take(a, 1000));
+        }
+        test_assert(!limiter.take(a, 1000) && !limiter.allow(a, 1050) && limiter.allow(b, 1050));
+        test_assert(limiter.take(a, 1100) && !limiter.take(a, 1150));
+        // Idle clients get back up to burst and no more
+        for (int i = 0; i < 5; ++i) {
+            test_assert(limiter.take(a, 60000));
+        }
+        test_assert(!limiter.take(a, 60000));
+        // A full window takes over the slot idle the longest, whose client starts over with a full bucket
+        RateLimiter small(RateLimiter::window);
+        small.configure(1, 1);
+        for (uint64_t key = 1; key <= RateLimiter::window; ++key) {
+            test_assert(small.take(key, key) && !small.take(key, key));
+        }
+        test_assert(small.take(100, 10));
+        test_assert(small.take(1, 11));
+        test_assert(!small.take(3, 12));
+        return true;
+    }
+
+    inline static bool SocketProfileTest() {
+        socket_profile_t profile {};
+        profile.backlog = 16;
+        profile.recv_buffer = 65536;
+        profile.send_buffer = 65536;
+        profile.accept_batch = 16;
+        Nexus::Parallel::WorkGroup<CPU_CORES - 1> group;
+        HttpServer<Nexus::IO::Win32PollMUX, CPU_CORES - 1> server(Nexus::Utils::NetAddr("127.0.0.1", 18081), group, profile);
+        sockaddr_in addr {};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(18081);
+        inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+        SOCKET clients[12];
+        for (auto& c : clients) {
+            c = socket(AF_INET, SOCK_STREAM, 0);
+            test_assert(connect(c, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0);
+        }
+        // The whole burst is admitted by the pass that sees the listener readable
+        server.loop();
+        test_assert(server.connections() == 12);
+        for (auto c : clients) {
+            closesocket(c);
+        }
+        server.close();
+        group.cleanup();
+        return true;
+    }
+
+    inline static bool HttpProducerWireTest() {
+        // The producer hands out a chunk, nothing yet, a chunk of 16 bytes and then the end
+        int calls = 0;
+        std::unordered_map<std::string, HttpHandlerFunctionSet> handlers;
+        handlers["/stream"].get = [&calls](const get_request&) {
+            http_response resp {"200 OK", {}, Nexus::Base::unique_to_readonly<http_body_allocator_t>(Nexus::Base::UniquePool<http_body_allocator_t>(1))};
+            resp.response_producer = [&calls](Nexus::Base::UniquePool<>& chunk) {
+                switch (calls++) {
+                    case 0:
+                        chunk.write("hello", 5);
+                        return true;
+                    case 1:
+                        return true;
+                    case 2:
+                        chunk.write("0123456789abcdef", 16);
+                        return true;
+                    default:
+                        return false;
+                }
+            };
+            return resp;
+        };
+        Socket listener(SockType::SOCK_IPV4);
+        test_assert(listener.bind(Nexus::Utils::NetAddr("127.0.0.1", 18082)));
+        listener.listen(1);
+        sockaddr_in addr {};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(18082);
+        inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+        SOCKET c = socket(AF_INET, SOCK_STREAM, 0);
+        test_assert(connect(c, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0);
+        u_long nonblocking = 1;
+        ioctlsocket(c, FIONBIO, &nonblocking);
+        Socket server = listener.accept();
+        test_assert(!server.invalid() && server.setnonblocking());
+        auto receive = [c]() {
+            std::string out;
+            char buf[1024];
+            int r;
+            while ((r = recv(c, buf, sizeof(buf), 0)) > 0) {
+                out.append(buf, r);
+            }
+            return out;
+        };
+        HttpConnection conn(server, handlers);
+        const char request[] = "GET /stream HTTP/1.1\r\nHost: test\r\n\r\n";
+        send(c, request, sizeof(request) - 1, 0);
+        conn.drive();
+        test_assert(conn.status() == HttpConnection::EXECUTING);
+        conn.drive();
+        test_assert(conn.status() == HttpConnection::RESPONSE && calls == 0);
+        // The head and the first chunk go out, the empty pull leaves the connection waiting for more
+        conn.drive();
+        test_assert(calls == 2 && conn.status() == HttpConnection::RESPONSE);
+        test_assert(receive() == "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n5\r\nhello\r\n");
+        // The size line is hex, the last pull only adds the terminator
+        conn.drive();
+        test_assert(calls == 4 && conn.status() == HttpConnection::FINISHED);
+        test_assert(receive() == "10\r\n0123456789abcdef\r\n0\r\n\r\n");
+        closesocket(c);
+        listener.close();
+        return true;
+    }
+
+    struct pooled_connection : public Nexus::Base::RefCounted {
+        int client;
+        int reused {0};
+        bool recycled {false};
+
+        explicit pooled_connection(int c) : client(c) {}
+
+        void recycle() {
+            recycled = true;
+        }
+
+        void reuse(int c) {
+            client = c;
+            recycled = false;
+            ++reused;
+        }
+    };
+
+    inline static bool ConnectionPoolTest() {
+        ConnectionPool<pooled_connection> pool;
+        auto a = pool.acquire(1);
+        auto* first = a.get();
+        // A drive still holds the connection, it is retired until that one is gone
+        auto drive = a;
+        pool.release(std::move(a));
+        pool.collect();
+        test_assert(pool.idle() == 0);
+        test_assert(!first->recycled);
+        drive.reset();
+        pool.collect();
+        test_assert(pool.idle() == 1);
+        test_assert(first->recycled);
+        // The next client gets the same object
+        auto b = pool.acquire(2);
+        test_assert(b.get() == first);
+        test_assert(b->client == 2 && b->reused == 1 && !b->recycled);
+        test_assert(pool.idle() == 0);
+        auto c = pool.acquire(3);
+        test_assert(c.get() != first && c->reused == 0);
+        // No more than max_idle are kept
+        std::vector<Nexus::Base::Ref<pooled_connection>> many;
+        for (uint64_t i = 0; i < ConnectionPool<pooled_connection>::max_idle + 10; ++i) {
+            many.push_back(pool.acquire(static_cast<int>(i)));
+        }
+        for (auto& conn : many) {
+            pool.release(std::move(conn));
+        }
+        pool.collect();
+        test_assert(pool.idle() == ConnectionPool<pooled_connection>::max_idle);
+        pool.clear();
+        test_assert(pool.idle() == 0);
+        return true;
+    }
+
+    inline static bool SlotMapTest() {
+        SlotMap<int> map;
+        // Handles are multiples of 4 like socket handles
+        for (int i = 1; i <= 8; ++i) {
+            map.insert(static_cast<io_handle_t>(i * 4), i);
+        }
+        test_assert(map.size() == 8 && map.find(12)->value == 3 && map.find(36) == nullptr);
+        // Erasing moves the last entry into the hole and the sweep visits it next
+        uint64_t visited = 0;
+        int sum = 0;
+        for (auto it = map.begin(); it != map.end(); ) {
+            ++visited;
+            sum += it->value;
+            if (it->value % 2 == 0) {
+                it = map.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        test_assert(visited == 8 && sum == 36 && map.size() == 4);
+        for (int i = 1; i <= 8; ++i) {
+            auto slot = map.find(static_cast<io_handle_t>(i * 4));
+            test_assert(i % 2 == 0 ? slot == nullptr : slot != nullptr && slot->value == i);
+        }
+        // An entry inserted after generation() was taken is newer than what was polled then
+        auto polled = map.generation();
+        test_assert(map.find(4)->generation < polled);
+        map.insert(4, 100);
+        test_assert(map.find(4)->value == 100 && map.find(4)->generation >= polled && map.size() == 4);
+        test_assert(map.erase(static_cast<io_handle_t>(4)) && !map.erase(static_cast<io_handle_t>(4)) && map.size() == 3);
+        // Refs free what they point to with the last of them
+        struct counted : public Nexus::Base::RefCounted {
+            bool* freed;
+            explicit counted(bool* f) : freed(f) {}
+            ~counted() { *freed = true; }
+        };
+        bool freed = false;
+        {
+            auto a = Nexus::Base::Ref<counted>::Make(&freed);
+            auto b = a;
+            test_assert(a->refs() == 2 && a == b);
+            a.reset();
+            test_assert(!a && b->refs() == 1 && !freed);
+        }
+        test_assert(freed);
+        return true;
+    }
+
+    inline static bool ResourceLocatorTest() {
+        using Nexus::IO::ResourceLocator;
+        std::filesystem::create_directories("static/locator_test/sub");
+        auto write = [](const char* path, const std::string& content) {
+            std::ofstream(path, std::ios::binary | std::ios::trunc) << content;
+        };
+        write("static/locator_test/a.txt", "first");
+        write("static/locator_test/sub/b.txt", "inner");
+        // The wire image is the whole response and data the body in it
+        auto a = ResourceLocator::LocateResource("/locator_test/a.txt");
+        test_assert(a.is_valid());
+        std::string wire(a.reference()->wire.ptr(), a.reference()->wire.limit());
+        test_assert(wire == "HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\nContent-Length: 5\r\n\r\nfirst");
+        test_assert(std::string(a.reference()->data.ptr(), a.reference()->data.limit()) == "first");
+        // Hits share the cached entry whatever case the path is asked in
+        auto again = ResourceLocator::LocateResource("/LOCATOR_TEST/A.txt");
+        test_assert(again.is_valid() && again.reference() == a.reference());
+        // A change reloads the entry while responses in flight keep the old one
+        write("static/locator_test/a.txt", "second!");
+        ResourceLocator::RefreshResource("/locator_test/a.txt");
+        auto changed = ResourceLocator::LocateResource("/locator_test/a.txt");
+        test_assert(changed.is_valid() && changed.reference() != a.reference());
+        test_assert(std::string(changed.reference()->data.ptr(), changed.reference()->data.limit()) == "second!");
+        test_assert(std::string(a.reference()->data.ptr(), a.reference()->data.limit()) == "first");
+        // A change to a directory drops what is under it
+        auto b = ResourceLocator::LocateResource("/locator_test/sub/b.txt");
+        test_assert(b.is_valid());
+        std::filesystem::rename("static/locator_test/sub", "static/locator_test/moved");
+        ResourceLocator::RefreshResource("/locator_test/sub");
+        test_assert(!ResourceLocator::LocateResource("/locator_test/sub/b.txt").is_valid());
+        test_assert(ResourceLocator::LocateResource("/locator_test/moved/b.txt").is_valid());
+        std::filesystem::remove_all("static/locator_test");
+        ResourceLocator::RefreshAll();
+        test_assert(!ResourceLocator::LocateResource("/locator_test/a.txt").is_valid());
+        std::error_code ec;
+        std::filesystem::remove("static", ec);
+        return true;
+    }
+}
\ No newline at end of file
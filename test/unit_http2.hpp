@@ -0,0 +1,137 @@
+#include "test_framework.h"
+#include <include/net/hpack.h>
+#include <include/net/http2.h>
+
+namespace Nexus::Test::Net {
+    using namespace Nexus::Net;
+
+    class Http2EchoHandler {
+    public:
+        static constexpr uint64_t max_body = 16;
+        static http_response doGet(const get_request& gr) {
+            Nexus::Base::UniquePool<http_body_allocator_t> resp(128);
+            std::string body(100, 'g');
+            resp.write(body.data(), body.size());
+            return {"200 OK", {{"Content-Type", "text/plain"}}, Nexus::Base::unique_to_readonly<http_body_allocator_t>(std::move(resp))};
+        }
+        static http_response doPost(const post_request& pr) {
+            Nexus::Base::UniquePool<http_body_allocator_t> resp(128);
+            auto view = pr.request_body.view();
+            resp.write(view.ptr(), view.limit());
+            return {"201 Created", {}, Nexus::Base::unique_to_readonly<http_body_allocator_t>(std::move(resp))};
+        }
+    };
+
+    inline static bool HpackDecodeTest() {
+        // RFC 7541 C.4.1 and C.4.2, requests with Huffman coding sharing one dynamic table
+        const uint8_t first[] = {0x82, 0x86, 0x84, 0x41, 0x8c, 0xf1, 0xe3, 0xc2, 0xe5, 0xf2, 0x3a, 0x6b, 0xa0, 0xab, 0x90, 0xf4, 0xff};
+        const uint8_t second[] = {0x82, 0x86, 0x84, 0xbe, 0x58, 0x86, 0xa8, 0xeb, 0x10, 0x64, 0x9c, 0xbf};
+        HpackDecoder decoder;
+        std::vector<hpack_field_t> fields;
+        test_assert(decoder.decode(first, sizeof(first), fields));
+        test_assert(fields.size() == 4 && fields[3].first == ":authority" && fields[3].second == "www.example.com");
+        test_assert(decoder.table().size() == 57);
+        fields.clear();
+        test_assert(decoder.decode(second, sizeof(second), fields));
+        test_assert(fields.size() == 5 && fields[3].second == "www.example.com" && fields[4].first == "cache-control" && fields[4].second == "no-cache");
+        test_assert(decoder.table().size() == 110);
+        // Padding longer than 7 bits is a decoding error
+        const uint8_t bad[] = {0x40, 0x81, 0xff, 0x81, 0x1f};
+        test_assert(!decoder.decode(bad, sizeof(bad), fields));
+        // What the encoder writes decodes to the same fields, the second time from the dynamic table
+        HpackEncoder encoder;
+        std::string block;
+        encoder.encode("content-type", "text/html; charset=utf-8", block);
+        auto once = block.size();
+        encoder.encode("content-type", "text/html; charset=utf-8", block);
+        test_assert(block.size() == once + 1);
+        HpackDecoder peer;
+        fields.clear();
+        test_assert(peer.decode(reinterpret_cast<const uint8_t*>(block.data()), block.size(), fields));
+        test_assert(fields.size() == 2 && fields[1].second == "text/html; charset=utf-8");
+        return true;
+    }
+
+    inline static bool Http2SessionTest() {
+        std::unordered_map<std::string, HttpHandlerFunctionSet> handlers;
+        handlers["/echo"] = make_handler_function_set<Http2EchoHandler>();
+        Http2Session session(handlers, "loopback");
+        // The client limits stream windows to 40 bytes, so the 100 byte GET response needs two WINDOW_UPDATEs
+        Nexus::Base::UniquePool<> client(1024);
+        client.write(Http2Session::preface.data(), Http2Session::preface.size());
+        const char settings[] = {0x00, 0x04, 0x00, 0x00, 0x00, 0x28};
+        Http2Frame::Write(client, h2_frame_t::SETTINGS, 0, 0, settings, sizeof(settings));
+        HpackEncoder encoder;
+        std::string get, post;
+        encoder.encode(":method", "GET", get);
+        encoder.encode(":path", "/echo", get);
+        encoder.encode(":method", "POST", post);
+        encoder.encode(":path", "/echo", post);
+        Http2Frame::Write(client, h2_frame_t::HEADERS, Http2Frame::END_HEADERS | Http2Frame::END_STREAM, 1, get.data(), get.size());
+        Http2Frame::Write(client, h2_frame_t::HEADERS, Http2Frame::END_HEADERS, 3, post.data(), post.size());
+        Http2Frame::Write(client, h2_frame_t::DATA, Http2Frame::END_STREAM, 3, "hello", 5);
+        // Bodies past max_body are refused, by their content-length or once the DATA frames run over it
+        std::string declared, undeclared;
+        encoder.encode(":method", "POST", declared);
+        encoder.encode(":path", "/echo", declared);
+        encoder.encode("content-length", "64", declared);
+        encoder.encode(":method", "POST", undeclared);
+        encoder.encode(":path", "/echo", undeclared);
+        Http2Frame::Write(client, h2_frame_t::HEADERS, Http2Frame::END_HEADERS, 5, declared.data(), declared.size());
+        Http2Frame::Write(client, h2_frame_t::DATA, Http2Frame::END_STREAM, 5, "hello", 5);
+        Http2Frame::Write(client, h2_frame_t::HEADERS, Http2Frame::END_HEADERS, 7, undeclared.data(), undeclared.size());
+        Http2Frame::Write(client, h2_frame_t::DATA, 0, 7, "0123456789", 10);
+        Http2Frame::Write(client, h2_frame_t::DATA, Http2Frame::END_STREAM, 7, "0123456789", 10);
+        test_assert(session.feed(&client[0], client.limit()));
+
+        std::map<uint32_t, std::string> status;
+        std::map<uint32_t, std::string> body;
+        std::map<uint32_t, bool> ended;
+        bool settings_ack = false;
+        HpackDecoder decoder;
+        auto drain = [&]() {
+            Nexus::Base::SharedPool<> out(1024);
+            while (session.pull(out)) {
+                uint64_t pos = 0;
+                while (pos < out.limit()) {
+                    auto f = Http2Frame::Parse(reinterpret_cast<const uint8_t*>(&out[pos]));
+                    auto payload = reinterpret_cast<const uint8_t*>(&out[pos + Http2Frame::header_size]);
+                    if (f.type == h2_frame_t::SETTINGS && (f.flags & Http2Frame::ACK)) {
+                        settings_ack = true;
+                    } else if (f.type == h2_frame_t::HEADERS) {
+                        std::vector<hpack_field_t> fields;
+                        decoder.decode(payload, f.length, fields);
+                        status[f.stream] = fields[0].second;
+                    } else if (f.type == h2_frame_t::DATA) {
+                        body[f.stream].append(reinterpret_cast<const char*>(payload), f.length);
+                    }
+                    if ((f.type == h2_frame_t::HEADERS || f.type == h2_frame_t::DATA) && (f.flags & Http2Frame::END_STREAM)) {
+                        ended[f.stream] = true;
+                    }
+                    pos += Http2Frame::header_size + f.length;
+                }
+                out.clear();
+            }
+        };
+        drain();
+        test_assert(settings_ack);
+        test_assert(status[1] == "200" && status[3] == "201");
+        test_assert(body[3] == "hello" && ended[3]);
+        test_assert(status[5] == "413" && ended[5] && status[7] == "413" && ended[7]);
+        test_assert(body[1].size() == 40 && !ended[1]);
+        char increment[4];
+        Http2Frame::Write32(increment, 60);
+        client.clear();
+        Http2Frame::Write(client, h2_frame_t::WINDOW_UPDATE, 0, 1, increment, 4);
+        test_assert(session.feed(&client[0], client.limit()));
+        drain();
+        test_assert(body[1] == std::string(100, 'g') && ended[1]);
+        // A frame on stream 0 that must not be there is a connection error
+        client.clear();
+        Http2Frame::Write(client, h2_frame_t::DATA, 0, 0, "x", 1);
+        test_assert(!session.feed(&client[0], client.limit()));
+        drain();
+        test_assert(session.closed());
+        return true;
+    }
+}
\ No newline at end of file
@@ -0,0 +1,129 @@
+#include "test_framework.h"
+#include <include/net/qpack.h>
+#include <include/net/http3.h>
+
+namespace Nexus::Test::Net {
+    using namespace Nexus::Net;
+
+    inline static bool QpackTest() {
+        // RFC 9204 B.1, a literal with a static name reference
+        const uint8_t literal[] = {0x00, 0x00, 0x51, 0x0b, '/', 'i', 'n', 'd', 'e', 'x', '.', 'h', 't', 'm', 'l'};
+        std::vector<hpack_field_t> fields;
+        test_assert(QpackDecoder::Decode(literal, sizeof(literal), fields));
+        test_assert(fields.size() == 1 && fields[0].first == ":path" && fields[0].second == "/index.html");
+        // Anything that needs a dynamic table is a decompression error
+        const uint8_t required[] = {0x02, 0x00, 0xd1};
+        const uint8_t dynamic[] = {0x00, 0x00, 0x80};
+        test_assert(!QpackDecoder::Decode(required, sizeof(required), fields));
+        test_assert(!QpackDecoder::Decode(dynamic, sizeof(dynamic), fields));
+        // Exact static matches take one byte, the rest decodes back to what was encoded
+        std::string block;
+        QpackEncoder::Begin(block);
+        QpackEncoder::Encode(":status", "200", block);
+        test_assert(block.size() == 3);
+        QpackEncoder::Encode("content-type", "text/x-custom", block);
+        QpackEncoder::Encode("x-request-id", "42", block);
+        QpackEncoder::Encode("set-cookie", "a=b", block);
+        fields.clear();
+        test_assert(QpackDecoder::Decode(reinterpret_cast<const uint8_t*>(block.data()), block.size(), fields));
+        test_assert(fields.size() == 4 && fields[0].second == "200" && fields[1].second == "text/x-custom");
+        test_assert(fields[2].first == "x-request-id" && fields[2].second == "42" && fields[3].second == "a=b");
+        return true;
+    }
+
+    inline static bool Http3StreamTest() {
+        std::unordered_map<std::string, HttpHandlerFunctionSet> handlers;
+        handlers["/echo"] = make_handler_function_set<Http2EchoHandler>();
+        auto request = [](std::string_view method) {
+            std::string block, out;
+            QpackEncoder::Begin(block);
+            QpackEncoder::Encode(":method", method, block);
+            QpackEncoder::Encode(":scheme", "https", block);
+            QpackEncoder::Encode(":path", "/echo", block);
+            Http3Frame::Write(out, h3_frame_t::HEADERS, block.data(), block.size());
+            return out;
+        };
+        auto response = [](Http3Stream& stream, std::string& status, std::string& body) {
+            std::string out;
+            while (stream.pull(out)) {}
+            auto p = reinterpret_cast<const uint8_t*>(out.data());
+            auto end = p + out.size();
+            while (p != end) {
+                uint64_t type, length;
+                if (!Http3Frame::ReadVarint(p, end, type) || !Http3Frame::ReadVarint(p, end, length)) return false;
+                if (type == static_cast<uint64_t>(h3_frame_t::HEADERS)) {
+                    std::vector<hpack_field_t> fields;
+                    if (!QpackDecoder::Decode(p, length, fields)) return false;
+                    status = fields[0].second;
+                } else if (type == static_cast<uint64_t>(h3_frame_t::DATA)) {
+                    body.append(reinterpret_cast<const char*>(p), length);
+                }
+                p += length;
+            }
+            return stream.finished();
+        };
+
+        // GET answered once the stream ends
+        Http3Stream get(handlers, 0, "loopback");
+        auto bytes = request("GET");
+        test_assert(get.feed(bytes.data(), bytes.size(), false));
+        std::string status, body;
+        test_assert(!get.pull(body));
+        test_assert(get.feed(nullptr, 0, true));
+        test_assert(response(get, status, body));
+        test_assert(status == "200" && body == std::string(100, 'g'));
+
+        // POST body in a DATA frame split across reads, with a grease frame in between
+        Http3Stream post(handlers, 4, "loopback");
+        bytes = request("POST");
+        Http3Frame::Write(bytes, h3_frame_t::DATA, "hel", 3);
+        Http3Frame::Write(bytes, static_cast<h3_frame_t>(0x21), "ignored", 7);
+        Http3Frame::Write(bytes, h3_frame_t::DATA, "lo", 2);
+        for (uint64_t i = 0; i < bytes.size(); i += 5) {
+            test_assert(post.feed(bytes.data() + i, std::min<uint64_t>(5, bytes.size() - i), false));
+        }
+        test_assert(post.feed(nullptr, 0, true));
+        status.clear();
+        body.clear();
+        test_assert(response(post, status, body));
+        test_assert(status == "201" && body == "hello");
+
+        // DATA before HEADERS and SETTINGS on a request stream are connection errors
+        Http3Stream early(handlers, 8, "loopback");
+        bytes.clear();
+        Http3Frame::Write(bytes, h3_frame_t::DATA, "x", 1);
+        test_assert(!early.feed(bytes.data(), bytes.size(), false));
+        test_assert(early.error() == h3_error_t::FRAME_UNEXPECTED && early.fatal());
+        // A stream that ends inside a frame is truncated
+        Http3Stream truncated(handlers, 12, "loopback");
+        bytes = request("GET");
+        test_assert(!truncated.feed(bytes.data(), bytes.size() - 1, true));
+        test_assert(truncated.error() == h3_error_t::FRAME);
+        return true;
+    }
+
+    inline static bool Http3ControlStreamTest() {
+        // Our own control stream is valid input, even byte by byte
+        auto preamble = Http3UniStream::Preamble();
+        Http3UniStream control;
+        for (char c : preamble) {
+            test_assert(control.feed(&c, 1, false));
+        }
+        test_assert(control.typed() && control.critical());
+        std::string goaway;
+        Http3Frame::Write(goaway, h3_frame_t::GOAWAY, "\x04", 1);
+        test_assert(control.feed(goaway.data(), goaway.size(), false) && control.goaway());
+        test_assert(!control.feed(nullptr, 0, true));
+        test_assert(control.error() == h3_error_t::CLOSED_CRITICAL_STREAM);
+        // The first frame has to be SETTINGS
+        Http3UniStream missing;
+        std::string bytes(1, '\0');
+        bytes += goaway;
+        test_assert(!missing.feed(bytes.data(), bytes.size(), false));
+        test_assert(missing.error() == h3_error_t::MISSING_SETTINGS);
+        // Unknown stream types are read and discarded
+        Http3UniStream unknown;
+        test_assert(unknown.feed("\x21junk", 5, true) && !unknown.critical());
+        return true;
+    }
+}
\ No newline at end of file
@@ -1,5 +1,9 @@
 #include "test_framework.h"
+#include <optional>
 #include <include/mem/memory.h>
+#include <include/mem/iobuf.h>
+#include <include/mem/arena.h>
+#include <include/mem/tracking.h>
 
 namespace Nexus::Test::Base {
     using namespace Nexus::Base;
@@ -79,6 +83,163 @@ namespace Nexus::Test::Base {
         return true;
     }
 
+    inline static bool PoolViewTest() {
+        // Views borrow what is at the position, consume moves past it
+        UniquePool<> up(4);
+        up.write("hello world", 11);
+        up.rewind();
+        test_assert(up.peek(5) == "hello" && up.position() == 0);
+        test_assert(up.peek(5).data() == &up[0]);
+        up.consume(6);
+        test_assert(up.read_view(100) == "world" && up.flag() == UniquePool<>::flag_t::normal);
+        test_assert(up.read_view(1).empty() && up.flag() == UniquePool<>::flag_t::eof);
+        up.consume(10);
+        test_assert(up.position() == up.limit());
+        const char text[] = "fixed pool";
+        FixedPool<> fp(text, 10);
+        auto stream = fp.read_view(5);
+        test_assert(stream.data() == text && stream == "fixed");
+        fp.consume(1);
+        test_assert(fp.peek(100) == "pool" && fp.read_view(100) == "pool" && fp.peek(1).empty());
+        // A view of a SharedPool keeps the memory after every copy of the pool is gone
+        std::optional<SharedPool<>::View> view;
+        {
+            SharedPool<> sp(4);
+            sp.write("abcdefgh", 8);
+            auto copy = sp;
+            copy.rewind();
+            test_assert(copy.peek(3).str() == "abc" && copy.position() == 0);
+            copy.consume(5);
+            test_assert(copy.read_view(10).str() == "fgh" && copy.read_view(10).empty());
+            view.emplace(sp.read_view(2, 3));
+        }
+        test_assert(view->str() == "cde");
+        Stream<SharedPool<>> sp_stream(SharedPool<>(16));
+        sp_stream.write(const_cast<char*>("stream"), 6);
+        sp_stream.rewind();
+        test_assert(sp_stream.read_view(3).str() == "str" && sp_stream.peek(10).str() == "eam");
+        return true;
+    }
+
+    inline static bool IOBufTest() {
+        using Buf = IOBuf<>;
+        Buf buf;
+        std::string big(Buf::segment_room * 2 + 100, 'x');
+        for (uint64_t i = 0; i < big.size(); ++i) big[i] = static_cast<char>('a' + i % 26);
+        buf.append(big.data(), big.size());
+        std::string_view views[8];
+        test_assert(buf.size() == big.size() && buf.to_string() == big && buf.gather(views, 8) == 3);
+        test_assert(views[0].size() == Buf::segment_room && views[2].size() == 100);
+        // Heads go in front without moving the body
+        auto body = views[0].data();
+        buf.prepend("HEAD ", 5);
+        buf.prepend("GET ", 4);
+        test_assert(buf.to_string() == "GET HEAD " + big && buf.gather(views, 8) == 4 && views[1].data() == body);
+        buf.trim_front(9);
+        buf.trim_back(50);
+        test_assert(buf.to_string() == big.substr(0, big.size() - 50));
+        // Both halves keep the boundary segment
+        auto front = buf.split(Buf::segment_room + 10);
+        test_assert(front.to_string() == big.substr(0, Buf::segment_room + 10));
+        test_assert(buf.to_string() == big.substr(Buf::segment_room + 10, Buf::segment_room + 40));
+        front.append("!", 1);
+        test_assert(front.size() == Buf::segment_room + 11 && buf.front()[0] == big[Buf::segment_room + 10]);
+        front.clear();
+        auto rest = buf.coalesce();
+        test_assert(rest == big.substr(Buf::segment_room + 10, Buf::segment_room + 40) && buf.gather(views, 8) == 1);
+        // Borrowed memory is linked, not copied
+        static const char external[] = "borrowed";
+        buf.clear();
+        buf.append("head:", 5);
+        buf.append_external(external, 8);
+        buf.append(";", 1);
+        test_assert(buf.gather(views, 8) == 3 && views[1].data() == external && buf.to_string() == "head:borrowed;");
+        buf.trim_front(7);
+        test_assert(buf.front() == "rrowed" && buf.coalesce() == "rrowed;");
+        // Reading into the free tail
+        Buf in;
+        auto [ptr, room] = in.prepare();
+        test_assert(room == Buf::segment_room);
+        memcpy(ptr, "read", 4);
+        in.commit(4);
+        test_assert(in.to_string() == "read" && in.prepare().first == ptr + 4);
+        // Dropped segments are reused
+        in.clear();
+        Buf again;
+        again.append("x", 1);
+        test_assert(again.front().data() == ptr);
+        Buf moved(std::move(again));
+        test_assert(moved.to_string() == "x" && again.empty());
+        moved.append(std::move(buf));
+        test_assert(moved.to_string() == "xrrowed;" && buf.empty());
+        return true;
+    }
+
+    inline static bool ArenaTest() {
+        // Blocks from the heap are still freed right after the arena is switched on
+        auto heap = Arena::Allocate(100);
+        test_assert(Arena::Mode() == Arena::HEAP && heap[99] == 0);
+        // Without the privilege for large pages the arena settles for normal ones
+        bool large = Arena::Configure(Arena::HUGEPAGES);
+        test_assert(Arena::Mode() == (large ? Arena::HUGEPAGES : Arena::NUMA));
+        Arena::Recycle(heap);
+        auto a = Arena::Allocate(4096);
+        auto b = Arena::Allocate(4096);
+        test_assert(Arena::Chunks() >= 1 && b - a == 4096 + 16);
+        memset(a, 0x5a, 4096);
+        Arena::Recycle(a);
+        // Same class, same block, zeroed again
+        auto c = Arena::Allocate(4000);
+        test_assert(c == a && c[0] == 0 && c[3999] == 0);
+        memcpy(c, "arena", 5);
+        auto d = Arena::Reallocate(c, 4096);
+        test_assert(d == c);
+        d = Arena::Reallocate(d, 10000);
+        test_assert(d != c && memcmp(d, "arena", 5) == 0);
+        // Past the largest class blocks are mapped on their own
+        auto big = Arena::Allocate(Arena::max_class_size + 1);
+        big[Arena::max_class_size] = 1;
+        Arena::Recycle(big);
+        Arena::Recycle(b);
+        Arena::Recycle(d);
+        {
+            SharedPool<ArenaAllocator> sp(16);
+            for (int i = 0; i < 100; ++i) sp.write("0123456789", 10);
+            test_assert(sp.limit() == 1000 && memcmp(&sp[990], "0123456789", 10) == 0);
+            IOBuf<ArenaAllocator> buf;
+            buf.append("segment", 7);
+            test_assert(buf.to_string() == "segment");
+        }
+        Arena::Configure(Arena::HEAP);
+        return true;
+    }
+
+    inline static bool TrackingTest() {
+        using tracked_t = TrackingAllocator<HANDLER_BODIES>;
+        auto live = MemoryAccounts::Live(HANDLER_BODIES);
+        auto allocations = MemoryAccounts::Allocations(HANDLER_BODIES);
+        auto frees = MemoryAccounts::Frees(HANDLER_BODIES);
+        {
+            UniquePool<tracked_t> up(16);
+            for (int i = 0; i < 30; ++i) up.write("0123456789", 10);
+            uint64_t capacity = up.capacity();
+            test_assert(MemoryAccounts::Live(HANDLER_BODIES) == live + static_cast<int64_t>(capacity));
+            // A read-only pool reads up to what was written but frees all that was allocated
+            auto ro = unique_to_readonly<tracked_t>(std::move(up));
+            test_assert(ro.limit() == 300 && ro.read(300).is_valid() && !ro.read(1).is_valid());
+            test_assert(MemoryAccounts::Live(HANDLER_BODIES) == live + static_cast<int64_t>(capacity));
+        }
+        test_assert(MemoryAccounts::Live(HANDLER_BODIES) == live);
+        test_assert(MemoryAccounts::Allocations(HANDLER_BODIES) == allocations + 1 && MemoryAccounts::Frees(HANDLER_BODIES) == frees + 1);
+        // The high-water mark stays after the memory is gone
+        auto big = tracked_t().allocate(MemoryAccounts::flush_bytes * 2);
+        tracked_t().recycle(big, MemoryAccounts::flush_bytes * 2);
+        test_assert(MemoryAccounts::Live(HANDLER_BODIES) == live);
+        test_assert(MemoryAccounts::Peak(HANDLER_BODIES) >= live + MemoryAccounts::flush_bytes * 2);
+        test_assert(MemoryAccounts::Export().find("\"handler_bodies\":{\"live_bytes\":") != std::string::npos);
+        return true;
+    }
+
     auto getholder() {
         char data[32] = {1, 1, 4, 5, 1, 4, 1, 9, 1, 9, 8, 1, 0};
         return UniqueFlexHolder(data);
@@ -0,0 +1,92 @@
+#include "test_framework.h"
+#include <include/metrics/metrics.h>
+#include <include/metrics/trace.h>
+#include <thread>
+
+namespace Nexus::Test::Metrics {
+    using namespace Nexus::Metrics;
+
+    inline static bool MetricsRegistryTest() {
+        Counter requests("unit_requests_total", "Requests", {{"route", "/a\"b"}});
+        Gauge open("unit_open", "Open things");
+        // Every thread counts into its own shard, the totals add them up
+        std::vector<std::thread> threads;
+        for (int t = 0; t < 4; ++t) {
+            threads.emplace_back([&requests, &open]() {
+                for (int i = 0; i < 10000; ++i) {
+                    requests.inc();
+                }
+                open.inc();
+            });
+        }
+        for (auto& t : threads) {
+            t.join();
+        }
+        test_assert(requests.value() == 40000);
+        // Lowered on another thread than the one that raised it
+        open.dec();
+        test_assert(open.value() == 3);
+        // The same series registered again shares the cells
+        Counter again("unit_requests_total", "Requests", {{"route", "/a\"b"}});
+        again.inc(2);
+        test_assert(requests.value() == 40002);
+        auto text = Registry::Expose();
+        test_assert(text.find("# TYPE unit_requests_total counter\n") != std::string::npos);
+        test_assert(text.find("unit_requests_total{route=\"/a\\\"b\"} 40002\n") != std::string::npos);
+        test_assert(text.find("unit_open 3\n") != std::string::npos);
+        return true;
+    }
+
+    inline static bool MetricsHistogramTest() {
+        // Bounds go 1, 2, 3, 4, 6, 8, 12, ... and every value lands in the first bucket that holds it
+        test_assert(Histogram::Bound(0) == 1 && Histogram::Bound(2) == 3 && Histogram::Bound(4) == 6 && Histogram::Bound(7) == 16);
+        for (uint64_t v = 0; v < 100000; ++v) {
+            auto b = Histogram::Bucket(v);
+            test_assert(v <= Histogram::Bound(b) && (b == 0 || v > Histogram::Bound(b - 1)));
+        }
+        test_assert(Histogram::Bucket(Histogram::Bound(Histogram::buckets - 1) + 1) == Histogram::buckets);
+        Histogram latency("unit_latency_seconds", "Latency", {{"route", "/h"}});
+        latency.observe(5);
+        latency.observe(5);
+        latency.observe(1000);
+        latency.observe(uint64_t {1} << 40);
+        test_assert(latency.count() == 4);
+        auto text = Registry::Expose();
+        test_assert(text.find("unit_latency_seconds_bucket{route=\"/h\",le=\"6e-06\"} 2\n") != std::string::npos);
+        test_assert(text.find("unit_latency_seconds_bucket{route=\"/h\",le=\"0.001024\"} 3\n") != std::string::npos);
+        test_assert(text.find("unit_latency_seconds_bucket{route=\"/h\",le=\"+Inf\"} 4\n") != std::string::npos);
+        test_assert(text.find("unit_latency_seconds_count{route=\"/h\"} 4\n") != std::string::npos);
+        return true;
+    }
+
+    inline static bool TraceExportTest() {
+        Tracer::SetSampling(0);
+        test_assert(Tracer::Sample() == 0);
+        // With every connection sampled each one gets an id of its own
+        Tracer::SetSampling(1);
+        auto a = Tracer::Sample();
+        auto b = Tracer::Sample();
+        test_assert(a != 0 && b != 0 && a != b);
+        auto begin = Tracer::Now();
+        auto end = Tracer::Now() + 1000;
+        Tracer::Span(a, "unit-read", "unit", begin, end);
+        Tracer::Span(0, "unit-untraced", "unit", begin, end);
+        // A ring keeps the latest spans once it wrapped
+        std::thread([b, begin, end]() {
+            for (uint64_t i = 0; i < TraceRing::capacity + 10; ++i) {
+                Tracer::Span(b, "unit-wrap", "unit", begin, end);
+            }
+        }).join();
+        auto json = Tracer::Export();
+        test_assert(json.starts_with("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[") && json.ends_with("]}"));
+        test_assert(json.find(std::format("\"name\":\"unit-read\",\"cat\":\"unit\",\"ph\":\"X\",\"pid\":1,\"tid\":{}", a)) != std::string::npos);
+        test_assert(json.find("unit-untraced") == std::string::npos);
+        uint64_t wrapped = 0;
+        for (auto at = json.find("unit-wrap"); at != std::string::npos; at = json.find("unit-wrap", at + 1)) {
+            ++wrapped;
+        }
+        test_assert(wrapped == TraceRing::capacity);
+        Tracer::SetSampling(64);
+        return true;
+    }
+}
\ No newline at end of file
@@ -0,0 +1,191 @@
+#include "test_framework.h"
+#include <atomic>
+#include <thread>
+#include <include/net/proxy.h>
+
+namespace Nexus::Test::Net {
+    using namespace Nexus::Net;
+
+    /* A backend on loopback that answers pipelined requests in order, one thread per connection. */
+    class ProxyTestBackend {
+        SOCKET listener_;
+        std::atomic<bool> stop_ {false};
+        std::atomic<uint64_t> accepted_ {0};
+        std::thread thread_;
+        std::vector<std::thread> workers_;
+
+        static void Serve(SOCKET s) {
+            u_long blocking = 0;
+            ioctlsocket(s, FIONBIO, &blocking);
+            std::string in;
+            char buf[4096];
+            while (true) {
+                const char* method;
+                const char* path;
+                size_t method_len, path_len, num_headers = 16;
+                int minor;
+                phr_header headers[16];
+                int parsed = phr_parse_request(in.data(), in.size(), &method, &method_len, &path, &path_len, &minor, headers, &num_headers, 0);
+                if (parsed == -2) {
+                    int r = recv(s, buf, sizeof(buf), 0);
+                    if (r <= 0) break;
+                    in.append(buf, r);
+                    continue;
+                }
+                if (parsed < 0) break;
+                std::string target(path, path_len);
+                uint64_t length = 0;
+                for (size_t i = 0; i < num_headers; ++i) {
+                    if (std::string_view(headers[i].name, headers[i].name_len) == "content-length") {
+                        length = std::strtoull(std::string(headers[i].value, headers[i].value_len).c_str(), nullptr, 10);
+                    }
+                }
+                while (in.size() < parsed + length) {
+                    int r = recv(s, buf, sizeof(buf), 0);
+                    if (r <= 0) return;
+                    in.append(buf, r);
+                }
+                std::string body = in.substr(parsed, length);
+                in.erase(0, parsed + length);
+                std::string out;
+                if (target == "/chunked") {
+                    out = "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\nConnection: keep-alive\r\n\r\n5\r\nhello\r\n6\r\n world\r\n0\r\n\r\n";
+                } else if (target == "/echo") {
+                    out = std::format("HTTP/1.1 200 OK\r\nContent-Length: {}\r\n\r\n{}", body.size(), body);
+                } else {
+                    out = "HTTP/1.1 200 OK\r\nContent-Length: 5\r\nX-Backend: 1\r\nSet-Cookie: a=1; Expires=Wed, 21 Oct 2026 07:28:00 GMT\r\nSet-Cookie: b=2\r\n\r\nhello";
+                }
+                send(s, out.data(), static_cast<int>(out.size()), 0);
+            }
+            closesocket(s);
+        }
+    public:
+        explicit ProxyTestBackend(uint16_t port) {
+            listener_ = socket(AF_INET, SOCK_STREAM, 0);
+            sockaddr_in addr {};
+            addr.sin_family = AF_INET;
+            addr.sin_port = htons(port);
+            inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+            bind(listener_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+            listen(listener_, 16);
+            u_long nonblocking = 1;
+            ioctlsocket(listener_, FIONBIO, &nonblocking);
+            thread_ = std::thread([this] {
+                while (!stop_.load()) {
+                    SOCKET s = accept(listener_, nullptr, nullptr);
+                    if (s == INVALID_SOCKET) {
+                        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                        continue;
+                    }
+                    accepted_.fetch_add(1);
+                    workers_.emplace_back(Serve, s);
+                }
+            });
+        }
+
+        ~ProxyTestBackend() {
+            stop_.store(true);
+            thread_.join();
+            closesocket(listener_);
+            for (auto& w : workers_) {
+                w.detach();
+            }
+        }
+
+        uint64_t accepted() const {
+            return accepted_.load();
+        }
+    };
+
+    /* Run an exchange to the end of its response, the body it sent comes back. */
+    inline static bool ProxyDrive(std::vector<HttpExchange*> exchanges, std::vector<std::string>& bodies) {
+        bodies.assign(exchanges.size(), {});
+        std::vector<bool> done(exchanges.size(), false);
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+        while (std::chrono::steady_clock::now() < deadline) {
+            bool all = true;
+            for (uint64_t i = 0; i < exchanges.size(); ++i) {
+                auto& ex = *exchanges[i];
+                if (done[i]) continue;
+                if (ex.ready()) ex.resume();
+                if (ex.responded()) {
+                    while (auto n = ex.available()) {
+                        bodies[i].append(ex.peek(), n);
+                        ex.consume(n);
+                    }
+                    done[i] = ex.finishing() && ex.available() == 0;
+                }
+                all = all && done[i];
+            }
+            if (all) return true;
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        return false;
+    }
+
+    inline static bool ProxyTest() {
+        WSADATA wsa;
+        WSAStartup(MAKEWORD(2, 2), &wsa);
+        bool ok = [] {
+            ProxyTestBackend backend(18080);
+            std::unordered_map<std::string, HttpHandlerFunctionSet> handlers;
+            Nexus::Utils::Resolver::Global().add_host("backend.test", {Nexus::Utils::ip_addr_t::Parse("127.0.0.1")});
+            auto group = std::make_shared<UpstreamGroup>(std::vector<std::pair<std::string, uint16_t>> {{"backend.test", 18080}}, balance_t::ROUND_ROBIN, 2);
+            for (auto path : {"/hello", "/chunked", "/echo"}) {
+                handlers[path] = make_proxy_function_set(group);
+            }
+            auto get = [&](const char* path) {
+                auto ex = std::make_unique<HttpExchange>(handlers);
+                ex->method = "GET";
+                ex->path = path;
+                ex->start(true);
+                return ex;
+            };
+            std::vector<std::string> bodies;
+            // Sequential requests reuse the kept-alive connection
+            auto a = get("/hello");
+            test_assert(ProxyDrive({a.get()}, bodies));
+            test_assert(a->status == "200" && bodies[0] == "hello" && a->response_header["x-backend"] == "1");
+            // Repeated Set-Cookie fields are not joined, the first one wins
+            test_assert(a->response_header["set-cookie"] == "a=1; Expires=Wed, 21 Oct 2026 07:28:00 GMT");
+            auto b = get("/hello");
+            test_assert(ProxyDrive({b.get()}, bodies) && bodies[0] == "hello");
+            test_assert(backend.accepted() == 1);
+            // Two requests in flight are pipelined on that one connection
+            auto c = get("/hello");
+            auto d = get("/chunked");
+            test_assert(ProxyDrive({c.get(), d.get()}, bodies));
+            test_assert(bodies[0] == "hello" && bodies[1] == "hello world");
+            test_assert(backend.accepted() == 1 && group->upstreams()[0]->connections() == 1);
+            // Request bodies are streamed through
+            HttpExchange post(handlers);
+            post.method = "POST";
+            post.path = "/echo";
+            post.headers["content-length"] = "11";
+            post.start(false);
+            test_assert(post.body("hello ", 6));
+            test_assert(post.body("proxy", 5));
+            post.end();
+            test_assert(ProxyDrive({&post}, bodies) && post.status == "200" && bodies[0] == "hello proxy");
+            // A dead upstream costs a retry, after max_fails it is out of rotation
+            auto mixed = std::make_shared<UpstreamGroup>(std::vector<std::pair<std::string, uint16_t>> {{"127.0.0.1", 1}, {"127.0.0.1", 18080}});
+            handlers["/hello"] = make_proxy_function_set(mixed);
+            for (int i = 0; i < 8; ++i) {
+                auto e = get("/hello");
+                test_assert(ProxyDrive({e.get()}, bodies) && e->status == "200" && bodies[0] == "hello");
+            }
+            test_assert(!mixed->upstreams()[0]->healthy(Upstream::Now()) && mixed->upstreams()[1]->healthy(Upstream::Now()));
+            // With nothing healthy left the proxy answers 503
+            auto dead = std::make_shared<UpstreamGroup>(std::vector<std::pair<std::string, uint16_t>> {{"127.0.0.1", 1}});
+            handlers["/hello"] = make_proxy_function_set(dead);
+            auto first = get("/hello");
+            test_assert(ProxyDrive({first.get()}, bodies) && first->status == "502");
+            auto second = get("/hello");
+            test_assert(ProxyDrive({second.get()}, bodies) && second->status == "503");
+            Nexus::Utils::Resolver::Global().clear();
+            return true;
+        }();
+        WSACleanup();
+        return ok;
+    }
+}
\ No newline at end of file
@@ -0,0 +1,112 @@
+#include "test_framework.h"
+#include <atomic>
+#include <filesystem>
+#include <fstream>
+#include <thread>
+#include <include/utils/hdr_histogram.h>
+#include <include/utils/netaddr.h>
+#include <include/utils/resolver.h>
+
+namespace Nexus::Test::Utils {
+    using namespace Nexus::Utils;
+
+    inline static bool Near(int64_t value, int64_t expected) {
+        // Three significant digits
+        return value >= expected - expected / 1000 && value <= expected + expected / 1000;
+    }
+
+    inline static bool HdrHistogramTest() {
+        // The reference coordinated omission case: 10000 samples of 1ms taken every 10ms, then one 100s stall
+        HdrHistogram raw(3'600'000'000);
+        for (int i = 0; i < 10000; ++i) {
+            raw.record(1000);
+        }
+        raw.record(100'000'000);
+        test_assert(raw.count() == 10001 && raw.min_value() == 1000 && raw.max_value() == 100'000'000);
+        test_assert(raw.percentile(50) == 1000 && raw.percentile(99.99) == 1000);
+        test_assert(raw.percentile(100) == 100'000'000);
+        // The stall hid the 9999 samples it would have taken, which are filled in from 99.99s down to 10ms
+        auto corrected = raw.corrected(10000);
+        test_assert(corrected.count() == 20000);
+        test_assert(corrected.percentile(50) == 1000);
+        test_assert(Near(corrected.percentile(75), 49'990'000));
+        test_assert(Near(corrected.percentile(90), 79'990'000));
+        test_assert(Near(static_cast<int64_t>(corrected.mean()), 25'000'500));
+        // Recording corrected as it goes agrees with correcting afterwards
+        HdrHistogram online(3'600'000'000);
+        for (int i = 0; i < 10000; ++i) {
+            online.record_corrected(1000, 10000);
+        }
+        online.record_corrected(100'000'000, 10000);
+        test_assert(online.count() == corrected.count() && online.percentile(99) == corrected.percentile(99));
+        // Values keep three significant digits across the range and merge by adding counts
+        HdrHistogram a(3'600'000'000), b(3'600'000'000);
+        for (int64_t v = 1; v < 3'000'000'000; v = v * 3 + 7) {
+            a.record(v);
+            test_assert(Near(a.percentile(100), v));
+            b.record(v);
+        }
+        a.merge(b);
+        test_assert(a.count() == 2 * b.count() && a.percentile(50) == b.percentile(50));
+        // Values past the trackable range are clamped
+        HdrHistogram small(10'000);
+        small.record(1'000'000);
+        test_assert(small.max_value() == small.trackable());
+        return true;
+    }
+
+    inline static bool ResolverTest() {
+        Resolver resolver;
+        std::atomic<int> queries {0};
+        resolver.set_backend([&](const std::string& name, std::vector<ip_addr_t>& addrs, uint32_t& ttl) {
+            queries.fetch_add(1);
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+            if (name != "svc.test") {
+                return false;
+            }
+            addrs.push_back(ip_addr_t::Parse("10.0.0.7"));
+            ttl = 60;
+            return true;
+        });
+        auto wait = [](const std::shared_ptr<Resolution>& r) {
+            for (int i = 0; i < 5000 && !r->done(); ++i) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+            return r->done();
+        };
+        // Literals need no query
+        auto literal = resolver.resolve("::1");
+        test_assert(literal->done() && literal->addresses()[0].type == SockType::SOCK_IPV6 && queries == 0);
+        // Queries for a name in flight share one answer, which is cached after
+        auto a = resolver.resolve("svc.test");
+        auto b = resolver.resolve("svc.test");
+        test_assert(a == b && !a->done());
+        test_assert(wait(a) && !a->failed() && queries == 1);
+        test_assert(NetAddr(a->addresses()[0], 80).url() == "10.0.0.7:80");
+        test_assert(resolver.resolve("svc.test") == a && queries == 1);
+        // Failures are cached for the negative TTL, then asked again
+        resolver.configure(1000, 300000, 30);
+        auto missing = resolver.resolve("missing.test");
+        test_assert(wait(missing) && missing->failed() && queries == 2);
+        test_assert(resolver.resolve("missing.test") == missing && queries == 2);
+        std::this_thread::sleep_for(std::chrono::milliseconds(40));
+        auto again = resolver.resolve("missing.test");
+        test_assert(again != missing && wait(again) && queries == 3);
+        // Hosts file entries answer at once, IPv4 first
+        auto path = std::filesystem::temp_directory_path() / "nexus_test_hosts";
+        std::ofstream(path) << "# test hosts\n::2 db.test\n10.0.0.9 db.test db # primary\nnot-an-address x.test\n";
+        test_assert(resolver.load_hosts(path.string()));
+        std::filesystem::remove(path);
+        auto db = resolver.resolve("db");
+        test_assert(db->done() && db->addresses().size() == 1);
+        db = resolver.resolve("db.test");
+        test_assert(db->done() && db->addresses().size() == 2 && db->addresses()[0].type == SockType::SOCK_IPV4);
+        test_assert(!resolver.resolve("x.test")->done() && queries >= 3);
+        // NetAddr resolves names through the global resolver and is invalid for ones that do not resolve
+        Resolver::Global().add_host("local.test", {ip_addr_t::Parse("127.0.0.1")});
+        NetAddr named("local.test", 8080);
+        test_assert(named.type() == SockType::SOCK_IPV4 && named.bytes() == std::string_view("\x7f\0\0\x01", 4));
+        Resolver::Global().clear();
+        return true;
+    }
+}
\ No newline at end of file
@@ -0,0 +1,152 @@
+#include "test_framework.h"
+#include <include/net/websocket.h>
+
+namespace Nexus::Test::Net {
+    using namespace Nexus::Net;
+
+    class WebSocketEchoHandler {
+    public:
+        static void doMessage(WebSocket& ws, std::string_view msg, bool binary) {
+            ws.send(msg, binary);
+        }
+        static void doClose(WebSocket& ws, uint16_t code) {
+            ws.context = code;
+        }
+    };
+
+    // A client frame, masked with a fixed key
+    inline static std::string ClientFrame(ws_opcode_t op, std::string_view payload, bool fin = true, uint8_t rsv = 0) {
+        static const uint8_t key[4] = {0x37, 0xfa, 0x21, 0x3d};
+        std::string out;
+        WebSocketFrame::WriteHeader(out, (fin ? WebSocketFrame::FIN : 0) | rsv | static_cast<uint8_t>(op), payload.size());
+        out[1] = static_cast<char>(out[1] | WebSocketFrame::MASK);
+        out.append(reinterpret_cast<const char*>(key), 4);
+        auto at = out.size();
+        out.append(payload);
+        WebSocketFrame::Unmask(out.data() + at, payload.size(), key, 0);
+        return out;
+    }
+
+    // Split what the server queued into (first byte, payload) pairs
+    inline static std::vector<std::pair<uint8_t, std::string>> ServerFrames(WebSocket& ws) {
+        std::vector<std::pair<uint8_t, std::string>> frames;
+        std::string out(ws.pending());
+        ws.sent(out.size());
+        auto p = reinterpret_cast<const uint8_t*>(out.data());
+        auto end = p + out.size();
+        while (p < end) {
+            auto header = WebSocketFrame::HeaderLength(p);
+            uint64_t len = p[1] & 0x7f;
+            if (len == 126) {
+                len = (static_cast<uint64_t>(p[2]) << 8) | p[3];
+            } else if (len == 127) {
+                len = 0;
+                for (int i = 0; i < 8; ++i) len = (len << 8) | p[2 + i];
+            }
+            frames.emplace_back(p[0], std::string(reinterpret_cast<const char*>(p + header), len));
+            p += header + len;
+        }
+        return frames;
+    }
+
+    inline static bool WebSocketHandshakeTest() {
+        // RFC 6455 section 1.3
+        test_assert(WebSocketHandshake::Accept("dGhlIHNhbXBsZSBub25jZQ==") == "s3pPLMBiTxaQ9kYGzzhZRbK+xOo=");
+        http_header_t request {
+            {"host", "localhost"}, {"upgrade", "WebSocket"}, {"connection", "keep-alive, Upgrade"},
+            {"sec-websocket-key", "dGhlIHNhbXBsZSBub25jZQ=="}, {"sec-websocket-version", "13"},
+            {"sec-websocket-extensions", "x-webkit-deflate-frame, permessage-deflate; client_max_window_bits"}
+        };
+        http_header_t response;
+        std::unique_ptr<WebSocketDeflate> deflate;
+        test_assert(WebSocketHandshake::Handshake(request, response, deflate).empty());
+        test_assert(response["Sec-WebSocket-Accept"] == "s3pPLMBiTxaQ9kYGzzhZRbK+xOo=" && deflate);
+        test_assert(response["Sec-WebSocket-Extensions"] == "permessage-deflate; server_no_context_takeover; client_max_window_bits=10");
+        // Offers with parameters we cannot honour are declined
+        std::string accepted;
+        test_assert(!WebSocketDeflate::Negotiate("permessage-deflate; server_max_window_bits=8", accepted));
+        test_assert(!WebSocketDeflate::Negotiate("permessage-deflate; client_max_window_bits=16", accepted));
+        // Other versions are told which one we speak
+        request["sec-websocket-version"] = "8";
+        response.clear();
+        test_assert(WebSocketHandshake::Handshake(request, response, deflate) == "426 Upgrade Required");
+        test_assert(response["Sec-WebSocket-Version"] == "13");
+        return true;
+    }
+
+    inline static bool WebSocketFrameTest() {
+        // Unmasking whole vectors agrees with the plain loop at every alignment and key offset
+        const uint8_t key[4] = {0xa1, 0x02, 0xf3, 0x44};
+        std::string plain(301, '\0');
+        for (uint64_t i = 0; i < plain.size(); ++i) plain[i] = static_cast<char>(i * 7);
+        for (uint64_t offset = 0; offset < 4; ++offset) {
+            for (uint64_t start = 0; start < 40; ++start) {
+                std::string s = plain;
+                WebSocketFrame::Unmask(s.data() + start, s.size() - start, key, offset);
+                for (uint64_t i = start; i < s.size(); ++i) {
+                    test_assert(static_cast<uint8_t>(s[i]) == (static_cast<uint8_t>(plain[i]) ^ key[(offset + i - start) & 3]));
+                }
+            }
+        }
+        test_assert(WebSocketFrame::Utf8("\xce\xba\xe1\xbd\xb9\xcf\x83\xce\xbc\xce\xb5 plain ascii tail"));
+        test_assert(!WebSocketFrame::Utf8("\xc0\xaf") && !WebSocketFrame::Utf8("\xed\xa0\x80") && !WebSocketFrame::Utf8("\xf4\x90\x80\x80"));
+
+        auto fs = make_handler_function_set<WebSocketEchoHandler>();
+        WebSocket ws(fs, "loopback", nullptr);
+        // A fragmented text message with a ping between its fragments, fed one byte at a time
+        auto bytes = ClientFrame(ws_opcode_t::TEXT, "Hel", false);
+        bytes += ClientFrame(ws_opcode_t::PING, "p");
+        bytes += ClientFrame(ws_opcode_t::CONTINUATION, "lo");
+        std::string large(70000, 'x');
+        bytes += ClientFrame(ws_opcode_t::BINARY, large);
+        for (char c : bytes) {
+            test_assert(ws.feed(&c, 1));
+        }
+        auto frames = ServerFrames(ws);
+        test_assert(frames.size() == 3);
+        test_assert(frames[0].first == (WebSocketFrame::FIN | 0xa) && frames[0].second == "p");
+        test_assert(frames[1].first == (WebSocketFrame::FIN | 0x1) && frames[1].second == "Hello");
+        test_assert(frames[2].first == (WebSocketFrame::FIN | 0x2) && frames[2].second == large);
+        // The closing handshake echoes the code
+        bytes = ClientFrame(ws_opcode_t::CLOSE, std::string_view("\x03\xe8", 2));
+        test_assert(!ws.feed(bytes.data(), bytes.size()));
+        frames = ServerFrames(ws);
+        test_assert(frames.size() == 1 && frames[0].second == std::string_view("\x03\xe8", 2));
+        test_assert(ws.status() == WebSocket::status_t::CLOSED && std::any_cast<uint16_t>(ws.context) == 1000);
+
+        // Unmasked frames and continuations without a start are protocol errors
+        WebSocket unmasked(fs, "loopback", nullptr);
+        test_assert(!unmasked.feed("\x81\x00", 2));
+        test_assert(std::any_cast<uint16_t>(unmasked.context) == 1002);
+        WebSocket orphan(fs, "loopback", nullptr);
+        bytes = ClientFrame(ws_opcode_t::CONTINUATION, "x");
+        test_assert(!orphan.feed(bytes.data(), bytes.size()));
+        test_assert(std::any_cast<uint16_t>(orphan.context) == 1002);
+        return true;
+    }
+
+    inline static bool WebSocketDeflateTest() {
+        std::string accepted;
+        auto fs = make_handler_function_set<WebSocketEchoHandler>();
+        WebSocket ws(fs, "loopback", WebSocketDeflate::Negotiate("permessage-deflate", accepted));
+        auto client = WebSocketDeflate::Negotiate("permessage-deflate", accepted);
+        std::string text;
+        for (int i = 0; i < 200; ++i) text += "compressible text " + std::to_string(i % 10) + " ";
+        // Two compressed messages, the second may refer back to the first
+        for (int round = 0; round < 2; ++round) {
+            std::string compressed;
+            test_assert(client->compress(text, compressed) && compressed.size() < text.size());
+            auto bytes = ClientFrame(ws_opcode_t::TEXT, compressed, true, WebSocketFrame::RSV1);
+            test_assert(ws.feed(bytes.data(), bytes.size()));
+            auto frames = ServerFrames(ws);
+            test_assert(frames.size() == 1 && (frames[0].first & WebSocketFrame::RSV1));
+            std::string echoed;
+            test_assert(client->decompress(frames[0].second, echoed, WebSocket::max_message) && echoed == text);
+        }
+        // RSV1 without the extension is a protocol error
+        WebSocket plain(fs, "loopback", nullptr);
+        auto bytes = ClientFrame(ws_opcode_t::TEXT, "x", true, WebSocketFrame::RSV1);
+        test_assert(!plain.feed(bytes.data(), bytes.size()));
+        return true;
+    }
+}
\ No newline at end of file
@@ -25,11 +25,14 @@
  */
 
 #include <assert.h>
+#include <stdatomic.h>
 #include <stddef.h>
 #include <string.h>
-#ifdef __SSE4_2__
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define PHR_X86 1
 #ifdef _MSC_VER
-#include <nmmintrin.h>
+#include <intrin.h>
+#include <immintrin.h>
 #else
 #include <x86intrin.h>
 #endif
@@ -50,6 +53,13 @@
 #define ALIGNED(n) __attribute__((aligned(n)))
 #endif
 
+/* kernels are compiled for their instruction set regardless of the build flags and picked at run time */
+#ifdef _MSC_VER
+#define TARGET(isa)
+#else
+#define TARGET(isa) __attribute__((target(isa)))
+#endif
+
 #define IS_PRINTABLE_ASCII(c) ((unsigned char)(c)-040u < 0137u)
 
 #define CHECK_EOF()                                                                                                                \
@@ -102,10 +112,36 @@ static const char *token_char_map = "\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\
                                     "\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0"
                                     "\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0";
 
-static const char *findchar_fast(const char *buf, const char *buf_end, const char *ranges, size_t ranges_size, int *found)
+typedef const char *(*findchar_t)(const char *buf, const char *buf_end, const char *ranges, size_t ranges_size, int *found);
+
+/* Every kernel scans whole blocks only and returns where it stopped, the callers finish the tail byte by byte. ranges holds up
+ * to eight inclusive [lo, hi] byte pairs and *found tells whether the returned position is a byte in one of them. */
+static const char *findchar_scalar(const char *buf, const char *buf_end, const char *ranges, size_t ranges_size, int *found)
+{
+    *found = 0;
+    /* suppress unused parameter warning */
+    (void)buf_end;
+    (void)ranges;
+    (void)ranges_size;
+    return buf;
+}
+
+#ifdef PHR_X86
+static unsigned ctz64(uint64_t v)
+{
+#ifdef _MSC_VER
+    unsigned long i;
+    _BitScanForward64(&i, v);
+    return i;
+#else
+    return __builtin_ctzll(v);
+#endif
+}
+
+TARGET("sse4.2")
+static const char *findchar_sse42(const char *buf, const char *buf_end, const char *ranges, size_t ranges_size, int *found)
 {
     *found = 0;
-#if __SSE4_2__
     if (likely(buf_end - buf >= 16)) {
         __m128i ranges16 = _mm_loadu_si128((const __m128i *)ranges);
 
@@ -122,20 +158,164 @@ static const char *findchar_fast(const char *buf, const char *buf_end, const cha
             left -= 16;
         } while (likely(left != 0));
     }
+    return buf;
+}
+
+/* There is no 256 bit pcmpestri, a byte c is in [lo, hi] when the wrapping c - lo is at most hi - lo as unsigned */
+TARGET("avx2,sse4.2")
+static const char *findchar_avx2(const char *buf, const char *buf_end, const char *ranges, size_t ranges_size, int *found)
+{
+    *found = 0;
+    if (likely(buf_end - buf >= 32)) {
+        __m256i lo[8], span[8];
+        size_t n = ranges_size / 2, i;
+        for (i = 0; i != n; ++i) {
+            lo[i] = _mm256_set1_epi8(ranges[i * 2]);
+            span[i] = _mm256_set1_epi8((char)((unsigned char)ranges[i * 2 + 1] - (unsigned char)ranges[i * 2]));
+        }
+        size_t left = (buf_end - buf) & ~31;
+        do {
+            __m256i b32 = _mm256_loadu_si256((const __m256i *)buf);
+            __m256i hit = _mm256_setzero_si256();
+            for (i = 0; i != n; ++i) {
+                __m256i d = _mm256_sub_epi8(b32, lo[i]);
+                hit = _mm256_or_si256(hit, _mm256_cmpeq_epi8(_mm256_min_epu8(d, span[i]), d));
+            }
+            unsigned mask = (unsigned)_mm256_movemask_epi8(hit);
+            if (unlikely(mask != 0)) {
+                *found = 1;
+                return buf + ctz64(mask);
+            }
+            buf += 32;
+            left -= 32;
+        } while (likely(left != 0));
+    }
+    return findchar_sse42(buf, buf_end, ranges, ranges_size, found);
+}
+
+TARGET("avx512f,avx512bw,avx2,sse4.2")
+static const char *findchar_avx512(const char *buf, const char *buf_end, const char *ranges, size_t ranges_size, int *found)
+{
+    *found = 0;
+    if (likely(buf_end - buf >= 64)) {
+        __m512i lo[8], span[8];
+        size_t n = ranges_size / 2, i;
+        for (i = 0; i != n; ++i) {
+            lo[i] = _mm512_set1_epi8(ranges[i * 2]);
+            span[i] = _mm512_set1_epi8((char)((unsigned char)ranges[i * 2 + 1] - (unsigned char)ranges[i * 2]));
+        }
+        size_t left = (buf_end - buf) & ~63;
+        do {
+            __m512i b64 = _mm512_loadu_si512((const void *)buf);
+            __mmask64 hit = 0;
+            for (i = 0; i != n; ++i) {
+                hit |= _mm512_cmple_epu8_mask(_mm512_sub_epi8(b64, lo[i]), span[i]);
+            }
+            if (unlikely(hit != 0)) {
+                *found = 1;
+                return buf + ctz64(hit);
+            }
+            buf += 64;
+            left -= 64;
+        } while (likely(left != 0));
+    }
+    return findchar_avx2(buf, buf_end, ranges, ranges_size, found);
+}
+
+static int detect_kernel(void)
+{
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 1);
+    int sse42 = (info[2] >> 20) & 1, avx = 0, avx512 = 0;
+    /* the OS has to save the wider registers as well, XCR0 tells */
+    if (((info[2] >> 27) & 1) && ((info[2] >> 28) & 1)) {
+        unsigned long long xcr0 = _xgetbv(0);
+        __cpuidex(info, 7, 0);
+        avx = (xcr0 & 0x6) == 0x6 && ((info[1] >> 5) & 1);
+        avx512 = avx && (xcr0 & 0xe0) == 0xe0 && ((info[1] >> 16) & 1) && ((info[1] >> 30) & 1);
+    }
+    if (avx512)
+        return PHR_KERNEL_AVX512;
+    if (avx)
+        return PHR_KERNEL_AVX2;
+    if (sse42)
+        return PHR_KERNEL_SSE42;
 #else
-    /* suppress unused parameter warning */
-    (void)buf_end;
-    (void)ranges;
-    (void)ranges_size;
+    /* libgcc checks XCR0 before reporting AVX features */
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw"))
+        return PHR_KERNEL_AVX512;
+    if (__builtin_cpu_supports("avx2"))
+        return PHR_KERNEL_AVX2;
+    if (__builtin_cpu_supports("sse4.2"))
+        return PHR_KERNEL_SSE42;
 #endif
-    return buf;
+    return PHR_KERNEL_SCALAR;
+}
+#else
+static int detect_kernel(void)
+{
+    return PHR_KERNEL_SCALAR;
+}
+#endif
+
+static const char *findchar_detect(const char *buf, const char *buf_end, const char *ranges, size_t ranges_size, int *found);
+
+/* Every thread that races on the first call stores the same values, relaxed atomics make the race well defined without
+ * ordering the scanning itself */
+static _Atomic(findchar_t) findchar_impl = findchar_detect;
+static atomic_int findchar_kernel = -1;
+
+int phr_set_kernel(int level)
+{
+    findchar_t impl;
+    int supported = detect_kernel();
+    if (level < 0 || level > supported)
+        level = supported;
+    switch (level) {
+#ifdef PHR_X86
+    case PHR_KERNEL_AVX512:
+        impl = findchar_avx512;
+        break;
+    case PHR_KERNEL_AVX2:
+        impl = findchar_avx2;
+        break;
+    case PHR_KERNEL_SSE42:
+        impl = findchar_sse42;
+        break;
+#endif
+    default:
+        level = PHR_KERNEL_SCALAR;
+        impl = findchar_scalar;
+        break;
+    }
+    atomic_store_explicit(&findchar_impl, impl, memory_order_relaxed);
+    atomic_store_explicit(&findchar_kernel, level, memory_order_relaxed);
+    return level;
+}
+
+int phr_kernel(void)
+{
+    int level = atomic_load_explicit(&findchar_kernel, memory_order_relaxed);
+    return level < 0 ? phr_set_kernel(-1) : level;
+}
+
+static const char *findchar_detect(const char *buf, const char *buf_end, const char *ranges, size_t ranges_size, int *found)
+{
+    phr_set_kernel(-1);
+    return atomic_load_explicit(&findchar_impl, memory_order_relaxed)(buf, buf_end, ranges, ranges_size, found);
+}
+
+static const char *findchar_fast(const char *buf, const char *buf_end, const char *ranges, size_t ranges_size, int *found)
+{
+    return atomic_load_explicit(&findchar_impl, memory_order_relaxed)(buf, buf_end, ranges, ranges_size, found);
 }
 
 static const char *get_token_to_eol(const char *buf, const char *buf_end, const char **token, size_t *token_len, int *ret)
 {
     const char *token_start = buf;
 
-#ifdef __SSE4_2__
     static const char ALIGNED(16) ranges1[16] = "\0\010"    /* allow HT */
                                                 "\012\037"  /* allow SP and up to but not including DEL */
                                                 "\177\177"; /* allow chars w. MSB set */
@@ -143,8 +323,8 @@ static const char *get_token_to_eol(const char *buf, const char *buf_end, const
     buf = findchar_fast(buf, buf_end, ranges1, 6, &found);
     if (found)
         goto FOUND_CTL;
-#else
-    /* find non-printable char within the next 8 bytes, this is the hottest code; manually inlined */
+    /* find non-printable char within the next 8 bytes, this is the hottest code; manually inlined. Handles what the vector
+     * kernel left over, or everything with the scalar one */
     while (likely(buf_end - buf >= 8)) {
 #define DOIT()                                                                                                                     \
     do {                                                                                                                           \
@@ -168,7 +348,6 @@ static const char *get_token_to_eol(const char *buf, const char *buf_end, const
         }
         ++buf;
     }
-#endif
     for (;; ++buf) {
         CHECK_EOF();
         if (unlikely(!IS_PRINTABLE_ASCII(*buf))) {
@@ -59,6 +59,16 @@ int phr_parse_response(const char *_buf, size_t len, int *minor_version, int *st
 /* ditto */
 int phr_parse_headers(const char *buf, size_t len, struct phr_header *headers, size_t *num_headers, size_t last_len);
 
+/* header scanning kernels, the widest one the CPU supports is picked on first use */
+enum { PHR_KERNEL_SCALAR, PHR_KERNEL_SSE42, PHR_KERNEL_AVX2, PHR_KERNEL_AVX512 };
+
+/* returns the kernel in use */
+int phr_kernel(void);
+
+/* use the widest kernel up to level that the CPU supports, a negative level picks the widest. Returns the kernel chosen.
+ * Not meant to be called while other threads are parsing */
+int phr_set_kernel(int level);
+
 /* should be zero-filled before start */
 struct phr_chunked_decoder {
     size_t bytes_left_in_chunk; /* number of bytes left in current chunk */